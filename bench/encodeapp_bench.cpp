@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cxxopts.hpp"
+#include "nlohmann/json.hpp"
+#include "vpl/preview/vpl.hpp"
+
+#include "cpu_usage/cpu_usage.hpp"
+#include "mapping/mapping.hpp"
+#include "memory_frame_reader/memory_frame_reader.hpp"
+#include "statistics/statistics.hpp"
+#include "synthetic_frame_reader/synthetic_frame_reader.hpp"
+#include "utils.hpp"
+#include "video_encoder/video_encoder.hpp"
+
+namespace vpl = oneapi::vpl;
+
+constexpr const int kTimeout100Ms = 100;
+// Distinct frames held in memory, the reader cycles through them.
+constexpr const size_t kDistinctFrames = 8;
+
+struct Scenario {
+  std::string codec;
+  uint16_t width;
+  uint16_t height;
+  std::string bitrate_mode;
+  int bitrate;
+  uint16_t async_depth;
+};
+
+struct RunResult {
+  double fps;
+  double p50_latency_us;
+  double p99_latency_us;
+  double mean_frame_size;
+  long cpu_time_us;
+  long peak_rss_kb;
+};
+
+static std::string scenario_name(const Scenario& scenario) {
+  return scenario.codec + "_" + std::to_string(scenario.width) + "x" +
+         std::to_string(scenario.height) + "_" + scenario.bitrate_mode + "_async" +
+         std::to_string(scenario.async_depth);
+}
+
+static std::vector<Scenario> make_scenarios(const std::string& set) {
+  std::vector<std::pair<uint16_t, uint16_t>> sizes{{320, 240}, {1280, 720}};
+  std::vector<std::string> codecs{"avc", "hevc"};
+  if (set == "full") {
+    sizes.insert(sizes.end(), {{1920, 1080}, {3840, 2160}});
+    codecs.push_back("av1");
+  } else if (set != "quick") {
+    throw std::invalid_argument("Unknown scenario set " + set);
+  }
+  std::vector<Scenario> scenarios;
+  for (const auto& codec : codecs) {
+    for (const auto& [width, height] : sizes) {
+      for (const std::string bitrate_mode : {"cqp", "vbr"}) {
+        // About 0.1 bits per pixel at 30 fps.
+        const int bitrate = bitrate_mode == "cqp" ? 0 : width * height * 3 / 1000;
+        for (const uint16_t async_depth : {1, 4}) {
+          scenarios.push_back({codec, width, height, bitrate_mode, bitrate, async_depth});
+        }
+      }
+    }
+  }
+  return scenarios;
+}
+
+// Generated once per size, the same on every run.
+static std::vector<uint8_t> make_frames(uint16_t width, uint16_t height, size_t count) {
+  const SyntheticFrameGenerator generator{
+      width, height, vpl::color_format_fourcc::i420, SyntheticPattern{}};
+  std::vector<uint8_t> frames(generator.frame_size() * count);
+  for (size_t i = 0; i < count; i++) {
+    generator.render(i, frames.data() + i * generator.frame_size());
+  }
+  return frames;
+}
+
+static RunResult run_scenario(const Scenario& scenario,
+                              const std::vector<uint8_t>& frames,
+                              size_t frame_count,
+                              size_t warmup_frames,
+                              bool use_hw) {
+  vpl::default_selector impl_sel{std::vector<vpl::property>{
+      vpl::dprops::impl(use_hw ? vpl::implementation_type::hw : vpl::implementation_type::sw),
+      vpl::dprops::api_version(2, 5),
+      vpl::dprops::encoder({vpl::dprops::codec_id(codec_formats.at(scenario.codec))})}};
+  MemoryFrameReader reader{scenario.width,
+                           scenario.height,
+                           vpl::color_format_fourcc::i420,
+                           &frames,
+                           warmup_frames + frame_count};
+  VideoEncoder encoder{impl_sel, &reader};
+
+  vpl::frame_info info{};
+  info.set_frame_rate({30, 1});
+  info.set_frame_size({ALIGN16(scenario.width), ALIGN16(scenario.height)});
+  info.set_FourCC(vpl::color_format_fourcc::i420);
+  info.set_ChromaFormat(vpl::chroma_format_idc::yuv420);
+  info.set_ROI({{0, 0}, {scenario.width, scenario.height}});
+  info.set_PicStruct(vpl::pic_struct::progressive);
+  EncoderParams encoder_params{};
+  encoder_params.target_kbps = scenario.bitrate;
+  encoder_params.async_depth = scenario.async_depth;
+  encoder.init(info,
+               codec_formats.at(scenario.codec),
+               bitrate_control_method.at(scenario.bitrate_mode),
+               {},
+               encoder_params);
+
+  reset_peak_rss();
+  std::vector<double> latencies;
+  double bytes = 0;
+  size_t output_frames = 0;
+  auto steady_start = std::chrono::steady_clock::now();
+  auto cpu_start = cpu_times();
+  // Up to async depth frames are submitted before the oldest one is synced,
+  // so the session works on as many frames as it is configured for.
+  std::deque<std::shared_ptr<vpl::bitstream_as_dst>> in_flight;
+  auto sync_oldest = [&] {
+    auto bitstream = std::move(in_flight.front());
+    in_flight.pop_front();
+    bitstream->wait_for(std::chrono::milliseconds{kTimeout100Ms});
+    const auto input = encoder.match_input_frame(bitstream->get_TimeStamp());
+    const auto ready = std::chrono::steady_clock::now();
+    // Warmup frames pay for page faults and encoder start up.
+    if (++output_frames <= warmup_frames) {
+      steady_start = ready;
+      cpu_start = cpu_times();
+      return;
+    }
+    bytes += bitstream->get_DataLength();
+    if (input) {
+      latencies.push_back(
+          std::chrono::duration<double, std::micro>(ready - input->arrival).count());
+    }
+  };
+  bool drained = false;
+  while (!drained) {
+    auto bitstream = std::make_shared<vpl::bitstream_as_dst>();
+    const auto status = encoder.encode(bitstream);
+    if (status == vpl::status::EndOfStreamReached) {
+      drained = true;
+    } else if (status == vpl::status::DeviceBusy) {
+      if (!in_flight.empty()) {
+        sync_oldest();
+      }
+    } else if (status == vpl::status::Ok) {
+      in_flight.push_back(std::move(bitstream));
+      if (in_flight.size() >= std::max<size_t>(scenario.async_depth, 1)) {
+        sync_oldest();
+      }
+    } else {
+      throw std::runtime_error("Encode failed with status " +
+                               std::to_string(static_cast<int>(status)));
+    }
+  }
+  while (!in_flight.empty()) {
+    sync_oldest();
+  }
+  const auto cpu_stop = cpu_times();
+  const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - steady_start).count();
+  const size_t measured = output_frames > warmup_frames ? output_frames - warmup_frames : 0;
+  return {seconds > 0 ? measured / seconds : 0,
+          percentile(latencies, 0.5),
+          percentile(latencies, 0.99),
+          measured ? bytes / measured : 0,
+          cpu_stop.user - cpu_start.user + cpu_stop.system - cpu_start.system,
+          peak_rss_kb()};
+}
+
+int main(int argc, char** argv) {
+  cxxopts::Options options{"encodeapp_bench", "Encoder throughput and latency benchmark."};
+  options.add_options(
+      "bench",
+      {{"set",
+        "Scenario set, quick or full",
+        cxxopts::value<std::string>()->default_value("quick")},
+       {"filter", "Run scenarios whose name contains the text", cxxopts::value<std::string>()},
+       {"frames", "Measured frames per run", cxxopts::value<size_t>()->default_value("60")},
+       {"warmup",
+        "Frames encoded before measuring",
+        cxxopts::value<size_t>()->default_value("10")},
+       {"repeat", "Runs per scenario", cxxopts::value<int>()->default_value("3")},
+       {"use-hw", "Use hardware implementation", cxxopts::value<bool>()->default_value("false")},
+       {"o,output",
+        "Report file",
+        cxxopts::value<std::string>()->default_value("encodeapp_bench.json")},
+       {"help", "Print usage"}});
+  auto result = options.parse(argc, argv);
+  if (result.count("help")) {
+    std::cout << options.help() << std::endl;
+    return 0;
+  }
+  const auto frame_count = result["frames"].as<size_t>();
+  const auto warmup_frames = result["warmup"].as<size_t>();
+  const int repeat = result["repeat"].as<int>();
+  const bool use_hw = result["use-hw"].as<bool>();
+  if (frame_count == 0 || repeat < 1) {
+    std::cout << "Invalid frame or repeat count" << std::endl;
+    return EINVAL;
+  }
+
+  std::vector<Scenario> scenarios;
+  try {
+    scenarios = make_scenarios(result["set"].as<std::string>());
+  } catch (std::invalid_argument& e) {
+    std::cout << e.what() << std::endl;
+    return EINVAL;
+  }
+
+  // Only measured values go to the report so reports of two builds diff cleanly.
+  nlohmann::json report{{"frames", frame_count},
+                        {"warmup", warmup_frames},
+                        {"repeat", repeat},
+                        {"hw", use_hw},
+                        {"scenarios", nlohmann::json::object()}};
+  std::vector<uint8_t> frames;
+  std::pair<uint16_t, uint16_t> frames_size{};
+  for (const auto& scenario : scenarios) {
+    const auto name = scenario_name(scenario);
+    if (result.count("filter") &&
+        name.find(result["filter"].as<std::string>()) == std::string::npos) {
+      continue;
+    }
+    if (frames_size != std::make_pair(scenario.width, scenario.height)) {
+      frames = make_frames(scenario.width, scenario.height, kDistinctFrames);
+      frames_size = {scenario.width, scenario.height};
+    }
+    std::cout << "Running " << name << std::endl;
+    nlohmann::json runs = nlohmann::json::array();
+    std::vector<double> fps, p50_latency, p99_latency, cpu_time;
+    try {
+      for (int i = 0; i < repeat; i++) {
+        const auto run = run_scenario(scenario, frames, frame_count, warmup_frames, use_hw);
+        runs.push_back({{"fps", run.fps},
+                        {"p50latency", run.p50_latency_us},
+                        {"p99latency", run.p99_latency_us},
+                        {"framesize", run.mean_frame_size},
+                        {"cputime", run.cpu_time_us},
+                        {"peakrss", run.peak_rss_kb}});
+        fps.push_back(run.fps);
+        p50_latency.push_back(run.p50_latency_us);
+        p99_latency.push_back(run.p99_latency_us);
+        cpu_time.push_back(run.cpu_time_us);
+      }
+    } catch (std::exception& e) {
+      std::cout << name << " failed: " << e.what() << std::endl;
+      report["scenarios"][name] = {{"error", e.what()}};
+      continue;
+    }
+    // Medians of the runs, the encoded size is the same for every run.
+    report["scenarios"][name] = {{"codec", scenario.codec},
+                                 {"width", scenario.width},
+                                 {"height", scenario.height},
+                                 {"bitratemode", scenario.bitrate_mode},
+                                 {"bitrate", scenario.bitrate},
+                                 {"asyncdepth", scenario.async_depth},
+                                 {"fps", percentile(fps, 0.5)},
+                                 {"p50latency", percentile(p50_latency, 0.5)},
+                                 {"p99latency", percentile(p99_latency, 0.5)},
+                                 {"cputime", percentile(cpu_time, 0.5)},
+                                 {"framesize", runs.back()["framesize"]},
+                                 {"runs", runs}};
+    std::cout << name << ": " << percentile(fps, 0.5) << " fps" << std::endl;
+  }
+
+  const auto output_filename = result["output"].as<std::string>();
+  std::ofstream output{output_filename};
+  output << std::setw(4) << report << std::endl;
+  if (!output) {
+    std::cout << "Couldn't write " << output_filename << std::endl;
+    return EIO;
+  }
+  std::cout << "Report " << output_filename << std::endl;
+  return 0;
+}
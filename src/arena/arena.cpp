@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: MIT
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+#include "arena.hpp"
+
+#include "numa/numa.hpp"
+
+constexpr const size_t kHugePageSize = 2 * 1024 * 1024;
+constexpr const size_t kArenaAlignment = 64;
+
+static size_t round_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+ArenaType arena_type_from_string(const std::string& name) {
+  if (name == "default") {
+    return ArenaType::standard;
+  }
+  if (name == "hugepage") {
+    return ArenaType::hugepage;
+  }
+  throw std::invalid_argument("Unknown arena " + name);
+}
+
+Arena::Arena(ArenaType type, size_t capacity, bool prefault, int numa_node) :
+  type_{type},
+  mapped_size_{round_up(capacity, kHugePageSize)},
+  base_{nullptr},
+  used_{0},
+  explicit_hugepages_{false},
+  prefaulted_{prefault},
+  numa_bound_{false} {
+  void* mapping = MAP_FAILED;
+  if (type_ == ArenaType::hugepage) {
+    mapping = mmap(nullptr,
+                   mapped_size_,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                   -1,
+                   0);
+    explicit_hugepages_ = mapping != MAP_FAILED;
+  }
+  if (mapping == MAP_FAILED) {
+    // Over-map so the arena can start on a hugepage boundary.
+    const size_t size = mapped_size_ + kHugePageSize;
+    mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    auto* start = static_cast<uint8_t*>(mapping);
+    auto* aligned = reinterpret_cast<uint8_t*>(
+        round_up(reinterpret_cast<uintptr_t>(start), kHugePageSize));
+    if (aligned != start) {
+      munmap(start, aligned - start);
+    }
+    munmap(aligned + mapped_size_, start + size - (aligned + mapped_size_));
+    mapping = aligned;
+    if (type_ == ArenaType::hugepage) {
+      madvise(mapping, mapped_size_, MADV_HUGEPAGE);
+    }
+  }
+  base_ = static_cast<uint8_t*>(mapping);
+  if (numa_node >= 0) {
+    numa_bound_ = bind_memory(base_, mapped_size_, numa_node);
+  }
+  if (prefaulted_) {
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < mapped_size_; offset += page_size) {
+      base_[offset] = 0;
+    }
+  }
+}
+
+Arena::~Arena() {
+  munmap(base_, mapped_size_);
+}
+
+uint8_t* Arena::allocate(size_t size) {
+  const size_t offset = round_up(used_, kArenaAlignment);
+  if (offset + size > mapped_size_) {
+    return nullptr;
+  }
+  used_ = offset + size;
+  return base_ + offset;
+}
+
+// Transparent hugepages backing the mapping, from its smaps entry.
+size_t Arena::hugepage_bytes() const {
+  if (explicit_hugepages_) {
+    return mapped_size_;
+  }
+  std::ifstream smaps{"/proc/self/smaps"};
+  std::string line;
+  bool in_arena = false;
+  while (std::getline(smaps, line)) {
+    uintptr_t start = 0;
+    uintptr_t end = 0;
+    char dash = 0;
+    std::istringstream range{line};
+    if (range >> std::hex >> start >> dash >> end && dash == '-') {
+      in_arena = start <= reinterpret_cast<uintptr_t>(base_) &&
+                 reinterpret_cast<uintptr_t>(base_) < end;
+      continue;
+    }
+    size_t kb = 0;
+    if (in_arena && line.rfind("AnonHugePages:", 0) == 0 &&
+        std::istringstream{line.substr(14)} >> kb) {
+      return kb * 1024;
+    }
+  }
+  return 0;
+}
+
+ArenaInfo Arena::info() const {
+  ArenaInfo info{};
+  info.type = type_ == ArenaType::hugepage ? "hugepage" : "default";
+  info.reserved = mapped_size_;
+  info.used = used_;
+  info.hugepage_bytes = hugepage_bytes();
+  info.hugepage_hit_rate = static_cast<double>(info.hugepage_bytes) / mapped_size_;
+  info.explicit_hugepages = explicit_hugepages_;
+  info.prefaulted = prefaulted_;
+  info.numa_bound = numa_bound_;
+  return info;
+}
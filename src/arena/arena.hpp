@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "statistics/statistics.hpp"
+
+enum class ArenaType {
+  standard,
+  // Explicit 2MB hugepages (MAP_HUGETLB), transparent hugepages when none
+  // are reserved, standard pages as the last resort.
+  hugepage,
+};
+
+// Throws std::invalid_argument for names other than "default" and "hugepage".
+ArenaType arena_type_from_string(const std::string& name);
+
+// Bump allocator over a single mapping, memory is returned all at once when
+// the arena is destroyed. Throws std::bad_alloc when the mapping fails.
+class Arena {
+ public:
+  // Pages are allocated on numa_node unless it's negative.
+  Arena(ArenaType type, size_t capacity, bool prefault, int numa_node = -1);
+  ~Arena();
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Block aligned to 64 bytes, null when the arena is full.
+  uint8_t* allocate(size_t size);
+
+  ArenaInfo info() const;
+
+ private:
+  size_t hugepage_bytes() const;
+
+  const ArenaType type_;
+  size_t mapped_size_;
+  uint8_t* base_;
+  size_t used_;
+  bool explicit_hugepages_;
+  bool prefaulted_;
+  bool numa_bound_;
+};
@@ -0,0 +1,1026 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "bitstream_parser.hpp"
+
+NalCodec nal_codec_from_string(const std::string& codec) {
+  if (codec == "avc") {
+    return NalCodec::h264;
+  }
+  if (codec == "hevc") {
+    return NalCodec::h265;
+  }
+  if (codec == "av1") {
+    return NalCodec::av1;
+  }
+  throw std::invalid_argument("No NAL unit parser for " + codec);
+}
+
+static int nal_type(const uint8_t* data, size_t size, NalCodec codec) {
+  if (size == 0) {
+    return -1;
+  }
+  return codec == NalCodec::h265 ? (data[0] >> 1) & 0x3f : data[0] & 0x1f;
+}
+
+std::vector<NalUnit> split_annexb(const uint8_t* data, size_t size, NalCodec codec) {
+  std::vector<NalUnit> nal_units;
+  const uint8_t* nal_start = nullptr;
+  size_t i = 0;
+  while (i + 3 <= size) {
+    if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) {
+      i++;
+      continue;
+    }
+    if (nal_start) {
+      // Zero bytes before the start code are trailing_zero_8bits or the
+      // leading byte of a four byte start code.
+      size_t end = i;
+      while (end > static_cast<size_t>(nal_start - data) && data[end - 1] == 0) {
+        end--;
+      }
+      const size_t nal_size = end - (nal_start - data);
+      nal_units.push_back({nal_start, nal_size, nal_type(nal_start, nal_size, codec)});
+    }
+    i += 3;
+    nal_start = data + i;
+  }
+  if (nal_start) {
+    size_t end = size;
+    while (end > static_cast<size_t>(nal_start - data) && data[end - 1] == 0) {
+      end--;
+    }
+    const size_t nal_size = end - (nal_start - data);
+    nal_units.push_back({nal_start, nal_size, nal_type(nal_start, nal_size, codec)});
+  }
+  return nal_units;
+}
+
+// Reads a leb128 value, returns the number of bytes read or 0 when the value
+// runs past the end.
+static size_t read_leb128(const uint8_t* data, size_t size, uint64_t* value) {
+  *value = 0;
+  for (size_t i = 0; i < 8 && i < size; i++) {
+    *value |= static_cast<uint64_t>(data[i] & 0x7f) << (i * 7);
+    if (!(data[i] & 0x80)) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+// Size of the OBU header and size field, the payload follows.
+static size_t obu_header_size(const uint8_t* data, size_t size, uint64_t* payload_size) {
+  const bool has_extension = data[0] & 0x04;
+  const bool has_size_field = data[0] & 0x02;
+  const size_t header_size = has_extension ? 2 : 1;
+  if (header_size > size) {
+    throw std::runtime_error("Truncated OBU header");
+  }
+  if (!has_size_field) {
+    *payload_size = size - header_size;
+    return header_size;
+  }
+  const size_t leb128_size = read_leb128(data + header_size, size - header_size, payload_size);
+  if (leb128_size == 0) {
+    throw std::runtime_error("Truncated OBU size");
+  }
+  return header_size + leb128_size;
+}
+
+std::vector<NalUnit> split_obus(const uint8_t* data, size_t size) {
+  std::vector<NalUnit> obus;
+  size_t position = 0;
+  while (position < size) {
+    uint64_t payload_size = 0;
+    const size_t header_size = obu_header_size(data + position, size - position, &payload_size);
+    if (payload_size > size - position - header_size) {
+      throw std::runtime_error("OBU runs past the end of the bitstream");
+    }
+    const size_t obu_size = header_size + payload_size;
+    obus.push_back({data + position, obu_size, (data[position] >> 3) & 0x0f});
+    position += obu_size;
+  }
+  return obus;
+}
+
+std::vector<NalUnit> split_nal_units(const uint8_t* data, size_t size, NalCodec codec) {
+  return codec == NalCodec::av1 ? split_obus(data, size) : split_annexb(data, size, codec);
+}
+
+std::vector<uint8_t> unescape_rbsp(const uint8_t* data, size_t size) {
+  std::vector<uint8_t> rbsp;
+  rbsp.reserve(size);
+  int zeros = 0;
+  for (size_t i = 0; i < size; i++) {
+    if (zeros >= 2 && data[i] == 3) {
+      zeros = 0;
+      continue;
+    }
+    zeros = data[i] == 0 ? zeros + 1 : 0;
+    rbsp.push_back(data[i]);
+  }
+  return rbsp;
+}
+
+BitReader::BitReader(const uint8_t* data, size_t size) : data_{data}, size_{size}, position_{0} {}
+
+bool BitReader::bit() {
+  if (position_ >= size_ * 8) {
+    position_++;
+    return false;
+  }
+  const bool value = (data_[position_ / 8] >> (7 - position_ % 8)) & 1;
+  position_++;
+  return value;
+}
+
+uint32_t BitReader::bits(int count) {
+  uint32_t value = 0;
+  for (int i = 0; i < count; i++) {
+    value = (value << 1) | bit();
+  }
+  return value;
+}
+
+uint32_t BitReader::ue() {
+  int leading_zeros = 0;
+  while (!bit() && leading_zeros < 32) {
+    leading_zeros++;
+  }
+  if (leading_zeros >= 32) {
+    return 0;
+  }
+  return ((1u << leading_zeros) - 1) + bits(leading_zeros);
+}
+
+int32_t BitReader::se() {
+  const uint32_t code = ue();
+  return (code & 1) ? static_cast<int32_t>((code + 1) / 2) : -static_cast<int32_t>(code / 2);
+}
+
+void BitReader::skip(size_t count) {
+  position_ += count;
+}
+
+bool BitReader::overrun() const {
+  return position_ > size_ * 8;
+}
+
+static void skip_h264_scaling_list(BitReader* reader, int size) {
+  int last_scale = 8;
+  int next_scale = 8;
+  for (int i = 0; i < size && next_scale != 0; i++) {
+    next_scale = (last_scale + reader->se() + 256) % 256;
+    last_scale = next_scale == 0 ? last_scale : next_scale;
+  }
+}
+
+H264Sps parse_h264_sps(const NalUnit& nal) {
+  const auto rbsp = unescape_rbsp(nal.data, nal.size);
+  BitReader reader{rbsp.data(), rbsp.size()};
+  reader.skip(8);
+  H264Sps sps{};
+  sps.profile_idc = reader.bits(8);
+  sps.constraint_flags = reader.bits(8);
+  sps.level_idc = reader.bits(8);
+  sps.sps_id = reader.ue();
+  sps.chroma_format_idc = 1;
+  sps.bit_depth_luma = 8;
+  sps.bit_depth_chroma = 8;
+  switch (sps.profile_idc) {
+  case 100:
+  case 110:
+  case 122:
+  case 244:
+  case 44:
+  case 83:
+  case 86:
+  case 118:
+  case 128:
+  case 138:
+  case 139:
+  case 134:
+  case 135:
+    sps.chroma_format_idc = reader.ue();
+    if (sps.chroma_format_idc == 3) {
+      sps.separate_colour_plane = reader.bit();
+    }
+    sps.bit_depth_luma = reader.ue() + 8;
+    sps.bit_depth_chroma = reader.ue() + 8;
+    reader.skip(1);  // qpprime_y_zero_transform_bypass_flag
+    if (reader.bit()) {
+      const int lists = sps.chroma_format_idc != 3 ? 8 : 12;
+      for (int i = 0; i < lists; i++) {
+        if (reader.bit()) {
+          skip_h264_scaling_list(&reader, i < 6 ? 16 : 64);
+        }
+      }
+    }
+    break;
+  default:
+    break;
+  }
+  sps.log2_max_frame_num = reader.ue() + 4;
+  sps.pic_order_cnt_type = reader.ue();
+  if (sps.pic_order_cnt_type == 0) {
+    sps.log2_max_pic_order_cnt_lsb = reader.ue() + 4;
+  } else if (sps.pic_order_cnt_type == 1) {
+    sps.delta_pic_order_always_zero = reader.bit();
+    reader.se();  // offset_for_non_ref_pic
+    reader.se();  // offset_for_top_to_bottom_field
+    const uint32_t cycle = reader.ue();
+    for (uint32_t i = 0; i < cycle && !reader.overrun(); i++) {
+      reader.se();
+    }
+  }
+  reader.ue();    // max_num_ref_frames
+  reader.skip(1);  // gaps_in_frame_num_value_allowed_flag
+  reader.ue();    // pic_width_in_mbs_minus1
+  reader.ue();    // pic_height_in_map_units_minus1
+  sps.frame_mbs_only = reader.bit();
+  if (reader.overrun()) {
+    throw std::runtime_error("Truncated H.264 SPS");
+  }
+  return sps;
+}
+
+H264Pps parse_h264_pps(const NalUnit& nal) {
+  const auto rbsp = unescape_rbsp(nal.data, nal.size);
+  BitReader reader{rbsp.data(), rbsp.size()};
+  reader.skip(8);
+  H264Pps pps{};
+  pps.pps_id = reader.ue();
+  pps.sps_id = reader.ue();
+  pps.entropy_coding_mode = reader.bit();
+  pps.bottom_field_pic_order_in_frame_present = reader.bit();
+  if (reader.ue() > 0) {
+    throw std::runtime_error("H.264 slice groups are not supported");
+  }
+  pps.num_ref_idx_l0_default = reader.ue() + 1;
+  pps.num_ref_idx_l1_default = reader.ue() + 1;
+  pps.weighted_pred = reader.bit();
+  pps.weighted_bipred_idc = reader.bits(2);
+  pps.pic_init_qp = 26 + reader.se();
+  reader.se();     // pic_init_qs_minus26
+  reader.se();     // chroma_qp_index_offset
+  reader.skip(2);  // deblocking_filter_control_present_flag, constrained_intra_pred_flag
+  pps.redundant_pic_cnt_present = reader.bit();
+  if (reader.overrun()) {
+    throw std::runtime_error("Truncated H.264 PPS");
+  }
+  return pps;
+}
+
+static void skip_h265_scaling_list_data(BitReader* reader) {
+  for (int size_id = 0; size_id < 4; size_id++) {
+    for (int matrix_id = 0; matrix_id < 6; matrix_id += size_id == 3 ? 3 : 1) {
+      if (!reader->bit()) {
+        reader->ue();  // scaling_list_pred_matrix_id_delta
+        continue;
+      }
+      const int coefficients = std::min(64, 1 << (4 + (size_id << 1)));
+      if (size_id > 1) {
+        reader->se();  // scaling_list_dc_coef_minus8
+      }
+      for (int i = 0; i < coefficients; i++) {
+        reader->se();
+      }
+    }
+  }
+}
+
+// Parses st_ref_pic_set(index) and returns it with the sets parsed before.
+static H265ShortTermRps parse_h265_st_rps(BitReader* reader,
+                                          size_t index,
+                                          const std::vector<H265ShortTermRps>& sets) {
+  H265ShortTermRps rps{};
+  if (index != 0 && reader->bit()) {
+    size_t delta_index = 1;
+    if (index == sets.size()) {
+      delta_index = reader->ue() + 1;
+    }
+    if (delta_index > index) {
+      throw std::runtime_error("Invalid HEVC reference picture set");
+    }
+    reader->skip(1);  // delta_rps_sign
+    reader->ue();     // abs_delta_rps_minus1
+    const auto& reference = sets[index - delta_index];
+    for (int j = 0; j <= reference.num_delta_pocs; j++) {
+      const bool used_by_curr_pic = reader->bit();
+      const bool use_delta = used_by_curr_pic || reader->bit();
+      rps.num_delta_pocs += use_delta;
+      rps.num_used_by_curr += used_by_curr_pic;
+    }
+    return rps;
+  }
+  const uint32_t negative = reader->ue();
+  const uint32_t positive = reader->ue();
+  if (negative > 16 || positive > 16) {
+    throw std::runtime_error("Invalid HEVC reference picture set");
+  }
+  for (uint32_t i = 0; i < negative + positive; i++) {
+    reader->ue();  // delta_poc_minus1
+    rps.num_used_by_curr += reader->bit();
+  }
+  rps.num_delta_pocs = negative + positive;
+  return rps;
+}
+
+H265Sps parse_h265_sps(const NalUnit& nal) {
+  const auto rbsp = unescape_rbsp(nal.data, nal.size);
+  BitReader reader{rbsp.data(), rbsp.size()};
+  reader.skip(16);
+  H265Sps sps{};
+  reader.skip(4);  // sps_video_parameter_set_id
+  sps.max_sub_layers = reader.bits(3) + 1;
+  sps.temporal_id_nesting = reader.bit();
+  // profile_tier_level()
+  sps.profile_space = reader.bits(2);
+  sps.tier_flag = reader.bit();
+  sps.profile_idc = reader.bits(5);
+  sps.profile_compatibility_flags = reader.bits(32);
+  sps.constraint_indicator_flags = static_cast<uint64_t>(reader.bits(16)) << 32;
+  sps.constraint_indicator_flags |= reader.bits(32);
+  sps.level_idc = reader.bits(8);
+  std::vector<std::pair<bool, bool>> sub_layers;
+  for (int i = 0; i < sps.max_sub_layers - 1; i++) {
+    const bool profile_present = reader.bit();
+    const bool level_present = reader.bit();
+    sub_layers.emplace_back(profile_present, level_present);
+  }
+  if (sps.max_sub_layers > 1) {
+    reader.skip(2 * (9 - sps.max_sub_layers));
+  }
+  for (const auto& [profile_present, level_present] : sub_layers) {
+    reader.skip(profile_present ? 88 : 0);
+    reader.skip(level_present ? 8 : 0);
+  }
+  sps.sps_id = reader.ue();
+  sps.chroma_format_idc = reader.ue();
+  if (sps.chroma_format_idc == 3) {
+    sps.separate_colour_plane = reader.bit();
+  }
+  sps.width = reader.ue();
+  sps.height = reader.ue();
+  if (reader.bit()) {
+    // conformance_window offsets
+    for (int i = 0; i < 4; i++) {
+      reader.ue();
+    }
+  }
+  sps.bit_depth_luma = reader.ue() + 8;
+  sps.bit_depth_chroma = reader.ue() + 8;
+  sps.log2_max_pic_order_cnt_lsb = reader.ue() + 4;
+  const bool sub_layer_ordering_info_present = reader.bit();
+  for (int i = sub_layer_ordering_info_present ? 0 : sps.max_sub_layers - 1;
+       i < sps.max_sub_layers;
+       i++) {
+    reader.ue();  // sps_max_dec_pic_buffering_minus1
+    reader.ue();  // sps_max_num_reorder_pics
+    reader.ue();  // sps_max_latency_increase_plus1
+  }
+  const int log2_min_coding_block_size = reader.ue() + 3;
+  sps.log2_ctb_size = log2_min_coding_block_size + reader.ue();
+  reader.ue();  // log2_min_luma_transform_block_size_minus2
+  reader.ue();  // log2_diff_max_min_luma_transform_block_size
+  reader.ue();  // max_transform_hierarchy_depth_inter
+  reader.ue();  // max_transform_hierarchy_depth_intra
+  if (reader.bit() && reader.bit()) {
+    skip_h265_scaling_list_data(&reader);
+  }
+  reader.skip(1);  // amp_enabled_flag
+  sps.sample_adaptive_offset = reader.bit();
+  if (reader.bit()) {
+    reader.skip(8);  // pcm sample bit depths
+    reader.ue();     // log2_min_pcm_luma_coding_block_size_minus3
+    reader.ue();     // log2_diff_max_min_pcm_luma_coding_block_size
+    reader.skip(1);  // pcm_loop_filter_disabled_flag
+  }
+  const uint32_t num_short_term_ref_pic_sets = reader.ue();
+  if (num_short_term_ref_pic_sets > 64) {
+    throw std::runtime_error("Invalid HEVC SPS");
+  }
+  for (uint32_t i = 0; i < num_short_term_ref_pic_sets && !reader.overrun(); i++) {
+    sps.short_term_ref_pic_sets.push_back(
+        parse_h265_st_rps(&reader, i, sps.short_term_ref_pic_sets));
+  }
+  sps.long_term_ref_pics_present = reader.bit();
+  if (sps.long_term_ref_pics_present) {
+    const uint32_t num_long_term_ref_pics = reader.ue();
+    for (uint32_t i = 0; i < num_long_term_ref_pics && i < 33 && !reader.overrun(); i++) {
+      reader.skip(sps.log2_max_pic_order_cnt_lsb);
+      sps.long_term_used_by_curr.push_back(reader.bit());
+    }
+  }
+  sps.temporal_mvp = reader.bit();
+  if (reader.overrun()) {
+    throw std::runtime_error("Truncated HEVC SPS");
+  }
+  return sps;
+}
+
+H265Pps parse_h265_pps(const NalUnit& nal) {
+  const auto rbsp = unescape_rbsp(nal.data, nal.size);
+  BitReader reader{rbsp.data(), rbsp.size()};
+  reader.skip(16);
+  H265Pps pps{};
+  pps.pps_id = reader.ue();
+  pps.sps_id = reader.ue();
+  pps.dependent_slice_segments_enabled = reader.bit();
+  pps.output_flag_present = reader.bit();
+  pps.num_extra_slice_header_bits = reader.bits(3);
+  reader.skip(1);  // sign_data_hiding_enabled_flag
+  pps.cabac_init_present = reader.bit();
+  pps.num_ref_idx_l0_default = reader.ue() + 1;
+  pps.num_ref_idx_l1_default = reader.ue() + 1;
+  pps.init_qp = 26 + reader.se();
+  reader.skip(2);  // constrained_intra_pred_flag, transform_skip_enabled_flag
+  if (reader.bit()) {
+    reader.ue();  // diff_cu_qp_delta_depth
+  }
+  reader.se();     // pps_cb_qp_offset
+  reader.se();     // pps_cr_qp_offset
+  reader.skip(1);  // pps_slice_chroma_qp_offsets_present_flag
+  pps.weighted_pred = reader.bit();
+  pps.weighted_bipred = reader.bit();
+  reader.skip(1);  // transquant_bypass_enabled_flag
+  const bool tiles_enabled = reader.bit();
+  reader.skip(1);  // entropy_coding_sync_enabled_flag
+  if (tiles_enabled) {
+    const uint32_t columns = reader.ue() + 1;
+    const uint32_t rows = reader.ue() + 1;
+    if (!reader.bit()) {
+      for (uint32_t i = 0; i + 1 < columns && !reader.overrun(); i++) {
+        reader.ue();
+      }
+      for (uint32_t i = 0; i + 1 < rows && !reader.overrun(); i++) {
+        reader.ue();
+      }
+    }
+    reader.skip(1);  // loop_filter_across_tiles_enabled_flag
+  }
+  reader.skip(1);  // pps_loop_filter_across_slices_enabled_flag
+  if (reader.bit()) {
+    reader.skip(1);  // deblocking_filter_override_enabled_flag
+    if (!reader.bit()) {
+      reader.se();  // pps_beta_offset_div2
+      reader.se();  // pps_tc_offset_div2
+    }
+  }
+  if (reader.bit()) {
+    skip_h265_scaling_list_data(&reader);
+  }
+  pps.lists_modification_present = reader.bit();
+  if (reader.overrun()) {
+    throw std::runtime_error("Truncated HEVC PPS");
+  }
+  return pps;
+}
+
+static uint32_t read_uvlc(BitReader* reader) {
+  int leading_zeros = 0;
+  while (!reader->bit() && leading_zeros < 32) {
+    leading_zeros++;
+  }
+  if (leading_zeros >= 32) {
+    return UINT32_MAX;
+  }
+  return reader->bits(leading_zeros) + ((1u << leading_zeros) - 1);
+}
+
+Av1SequenceHeader parse_av1_sequence_header(const NalUnit& obu) {
+  uint64_t payload_size = 0;
+  const size_t header_size = obu_header_size(obu.data, obu.size, &payload_size);
+  BitReader reader{obu.data + header_size, static_cast<size_t>(payload_size)};
+  Av1SequenceHeader header{};
+  header.profile = reader.bits(3);
+  reader.skip(1);  // still_picture
+  const bool reduced_still_picture_header = reader.bit();
+  if (reduced_still_picture_header) {
+    header.level_idx = reader.bits(5);
+  } else {
+    bool decoder_model_info_present = false;
+    int buffer_delay_length = 0;
+    if (reader.bit()) {
+      // timing_info()
+      reader.skip(64);
+      if (reader.bit()) {
+        read_uvlc(&reader);
+      }
+      decoder_model_info_present = reader.bit();
+      if (decoder_model_info_present) {
+        buffer_delay_length = reader.bits(5) + 1;
+        reader.skip(32 + 5 + 5);
+      }
+    }
+    const bool initial_display_delay_present = reader.bit();
+    const int operating_points = reader.bits(5) + 1;
+    for (int i = 0; i < operating_points; i++) {
+      reader.skip(12);  // operating_point_idc
+      const int level_idx = reader.bits(5);
+      const int tier = level_idx > 7 ? reader.bit() : 0;
+      if (i == 0) {
+        header.level_idx = level_idx;
+        header.tier = tier;
+      }
+      if (decoder_model_info_present && reader.bit()) {
+        reader.skip(2 * buffer_delay_length + 1);
+      }
+      if (initial_display_delay_present && reader.bit()) {
+        reader.skip(4);
+      }
+    }
+  }
+  const int frame_width_bits = reader.bits(4) + 1;
+  const int frame_height_bits = reader.bits(4) + 1;
+  reader.skip(frame_width_bits + frame_height_bits);
+  if (!reduced_still_picture_header && reader.bit()) {
+    reader.skip(4 + 3);  // frame id lengths
+  }
+  reader.skip(3);  // use_128x128_superblock, enable_filter_intra, enable_intra_edge_filter
+  if (!reduced_still_picture_header) {
+    reader.skip(4);  // interintra, masked compound, warped motion, dual filter
+    const bool enable_order_hint = reader.bit();
+    if (enable_order_hint) {
+      reader.skip(2);  // enable_jnt_comp, enable_ref_frame_mvs
+    }
+    int force_screen_content_tools = 2;
+    if (!reader.bit()) {
+      force_screen_content_tools = reader.bit();
+    }
+    if (force_screen_content_tools > 0 && !reader.bit()) {
+      reader.skip(1);  // seq_force_integer_mv
+    }
+    if (enable_order_hint) {
+      reader.skip(3);  // order_hint_bits_minus_1
+    }
+  }
+  reader.skip(3);  // enable_superres, enable_cdef, enable_restoration
+  // color_config()
+  header.high_bitdepth = reader.bit();
+  if (header.profile == 2 && header.high_bitdepth) {
+    header.twelve_bit = reader.bit();
+  }
+  header.monochrome = header.profile == 1 ? false : reader.bit();
+  int color_primaries = 2;
+  int transfer_characteristics = 2;
+  int matrix_coefficients = 2;
+  if (reader.bit()) {
+    color_primaries = reader.bits(8);
+    transfer_characteristics = reader.bits(8);
+    matrix_coefficients = reader.bits(8);
+  }
+  if (header.monochrome) {
+    header.subsampling_x = true;
+    header.subsampling_y = true;
+  } else if (color_primaries == 1 && transfer_characteristics == 13 && matrix_coefficients == 0) {
+    header.subsampling_x = false;
+    header.subsampling_y = false;
+  } else {
+    reader.skip(1);  // color_range
+    if (header.profile == 0) {
+      header.subsampling_x = true;
+      header.subsampling_y = true;
+    } else if (header.profile == 1) {
+      header.subsampling_x = false;
+      header.subsampling_y = false;
+    } else if (header.twelve_bit) {
+      header.subsampling_x = reader.bit();
+      header.subsampling_y = header.subsampling_x ? reader.bit() : false;
+    } else {
+      header.subsampling_x = true;
+      header.subsampling_y = false;
+    }
+    if (header.subsampling_x && header.subsampling_y) {
+      header.chroma_sample_position = reader.bits(2);
+    }
+  }
+  if (reader.overrun()) {
+    throw std::runtime_error("Truncated AV1 sequence header");
+  }
+  return header;
+}
+
+size_t unescape_rbsp(const uint8_t* data, size_t size, uint8_t* rbsp, size_t rbsp_size) {
+  size_t length = 0;
+  int zeros = 0;
+  for (size_t i = 0; i < size && length < rbsp_size; i++) {
+    if (zeros >= 2 && data[i] == 3) {
+      zeros = 0;
+      continue;
+    }
+    zeros = data[i] == 0 ? zeros + 1 : 0;
+    rbsp[length++] = data[i];
+  }
+  return length;
+}
+
+static int ceil_log2(uint32_t value) {
+  int bits = 0;
+  while ((1u << bits) < value) {
+    bits++;
+  }
+  return bits;
+}
+
+static void skip_h264_pred_weight_table(BitReader* reader,
+                                        int chroma_array_type,
+                                        uint32_t num_ref_idx_l0,
+                                        uint32_t num_ref_idx_l1) {
+  reader->ue();  // luma_log2_weight_denom
+  if (chroma_array_type != 0) {
+    reader->ue();  // chroma_log2_weight_denom
+  }
+  for (const uint32_t num_ref_idx : {num_ref_idx_l0, num_ref_idx_l1}) {
+    for (uint32_t i = 0; i < num_ref_idx && !reader->overrun(); i++) {
+      if (reader->bit()) {
+        reader->se();
+        reader->se();
+      }
+      if (chroma_array_type != 0 && reader->bit()) {
+        for (int j = 0; j < 4; j++) {
+          reader->se();
+        }
+      }
+    }
+  }
+}
+
+int parse_h264_slice_qp(const NalUnit& nal, const H264Sps& sps, const H264Pps& pps) {
+  uint8_t rbsp[kSliceHeaderBytes];
+  BitReader reader{rbsp, unescape_rbsp(nal.data, nal.size, rbsp, sizeof(rbsp))};
+  const int nal_ref_idc = (reader.bits(8) >> 5) & 3;
+  const bool idr = nal.type == 5;
+  reader.ue();  // first_mb_in_slice
+  const uint32_t slice_type = reader.ue() % 5;
+  const bool p_slice = slice_type == 0 || slice_type == 3;
+  const bool b_slice = slice_type == 1;
+  reader.ue();  // pic_parameter_set_id
+  if (sps.separate_colour_plane) {
+    reader.skip(2);  // colour_plane_id
+  }
+  reader.skip(sps.log2_max_frame_num);
+  bool field_pic = false;
+  if (!sps.frame_mbs_only) {
+    field_pic = reader.bit();
+    if (field_pic) {
+      reader.skip(1);  // bottom_field_flag
+    }
+  }
+  if (idr) {
+    reader.ue();  // idr_pic_id
+  }
+  if (sps.pic_order_cnt_type == 0) {
+    reader.skip(sps.log2_max_pic_order_cnt_lsb);
+    if (pps.bottom_field_pic_order_in_frame_present && !field_pic) {
+      reader.se();  // delta_pic_order_cnt_bottom
+    }
+  }
+  if (sps.pic_order_cnt_type == 1 && !sps.delta_pic_order_always_zero) {
+    reader.se();
+    if (pps.bottom_field_pic_order_in_frame_present && !field_pic) {
+      reader.se();
+    }
+  }
+  if (pps.redundant_pic_cnt_present) {
+    reader.ue();
+  }
+  if (b_slice) {
+    reader.skip(1);  // direct_spatial_mv_pred_flag
+  }
+  uint32_t num_ref_idx_l0 = pps.num_ref_idx_l0_default;
+  uint32_t num_ref_idx_l1 = pps.num_ref_idx_l1_default;
+  if ((p_slice || b_slice) && reader.bit()) {
+    num_ref_idx_l0 = reader.ue() + 1;
+    if (b_slice) {
+      num_ref_idx_l1 = reader.ue() + 1;
+    }
+  }
+  // ref_pic_list_modification()
+  for (int list = 0; list < (b_slice ? 2 : (p_slice ? 1 : 0)); list++) {
+    if (!reader.bit()) {
+      continue;
+    }
+    uint32_t modification = 0;
+    do {
+      modification = reader.ue();
+      if (modification != 3) {
+        reader.ue();
+      }
+    } while (modification != 3 && !reader.overrun());
+  }
+  if ((pps.weighted_pred && p_slice) || (pps.weighted_bipred_idc == 1 && b_slice)) {
+    skip_h264_pred_weight_table(&reader,
+                                sps.separate_colour_plane ? 0 : sps.chroma_format_idc,
+                                num_ref_idx_l0,
+                                b_slice ? num_ref_idx_l1 : 0);
+  }
+  if (nal_ref_idc != 0) {
+    // dec_ref_pic_marking()
+    if (idr) {
+      reader.skip(2);
+    } else if (reader.bit()) {
+      uint32_t operation = 0;
+      do {
+        operation = reader.ue();
+        if (operation == 1 || operation == 3) {
+          reader.ue();  // difference_of_pic_nums_minus1
+        }
+        if (operation == 2) {
+          reader.ue();  // long_term_pic_num
+        }
+        if (operation == 3 || operation == 6) {
+          reader.ue();  // long_term_frame_idx
+        }
+        if (operation == 4) {
+          reader.ue();  // max_long_term_frame_idx_plus1
+        }
+      } while (operation != 0 && !reader.overrun());
+    }
+  }
+  if (pps.entropy_coding_mode && slice_type != 2 && slice_type != 4) {
+    reader.ue();  // cabac_init_idc
+  }
+  const int qp = pps.pic_init_qp + reader.se();
+  return reader.overrun() ? -1 : qp;
+}
+
+static void skip_h265_pred_weight_table(BitReader* reader,
+                                        int chroma_array_type,
+                                        uint32_t num_ref_idx_l0,
+                                        uint32_t num_ref_idx_l1) {
+  reader->ue();  // luma_log2_weight_denom
+  if (chroma_array_type != 0) {
+    reader->se();  // delta_chroma_log2_weight_denom
+  }
+  for (const uint32_t num_ref_idx : {num_ref_idx_l0, num_ref_idx_l1}) {
+    if (num_ref_idx > 16) {
+      reader->skip(kSliceHeaderBytes * 8);
+      return;
+    }
+    bool luma_weight[16] = {};
+    bool chroma_weight[16] = {};
+    for (uint32_t i = 0; i < num_ref_idx; i++) {
+      luma_weight[i] = reader->bit();
+    }
+    for (uint32_t i = 0; chroma_array_type != 0 && i < num_ref_idx; i++) {
+      chroma_weight[i] = reader->bit();
+    }
+    for (uint32_t i = 0; i < num_ref_idx; i++) {
+      if (luma_weight[i]) {
+        reader->se();
+        reader->se();
+      }
+      if (chroma_weight[i]) {
+        for (int j = 0; j < 4; j++) {
+          reader->se();
+        }
+      }
+    }
+  }
+}
+
+int parse_h265_slice_qp(const NalUnit& nal, const H265Sps& sps, const H265Pps& pps) {
+  uint8_t rbsp[kSliceHeaderBytes];
+  BitReader reader{rbsp, unescape_rbsp(nal.data, nal.size, rbsp, sizeof(rbsp))};
+  reader.skip(16);
+  const bool first_slice_segment = reader.bit();
+  if (nal.type >= 16 && nal.type <= 23) {
+    reader.skip(1);  // no_output_of_prior_pics_flag
+  }
+  reader.ue();  // slice_pic_parameter_set_id
+  if (!first_slice_segment) {
+    if (pps.dependent_slice_segments_enabled && reader.bit()) {
+      // Dependent slice segments carry the QP of their slice.
+      return -1;
+    }
+    const uint32_t ctb_size = 1u << sps.log2_ctb_size;
+    const uint32_t ctbs = ((sps.width + ctb_size - 1) / ctb_size) *
+                          ((sps.height + ctb_size - 1) / ctb_size);
+    reader.skip(ceil_log2(ctbs));  // slice_segment_address
+  }
+  reader.skip(pps.num_extra_slice_header_bits);
+  const uint32_t slice_type = reader.ue();
+  const bool b_slice = slice_type == 0;
+  const bool p_slice = slice_type == 1;
+  if (pps.output_flag_present) {
+    reader.skip(1);
+  }
+  if (sps.separate_colour_plane) {
+    reader.skip(2);
+  }
+  int num_pic_total_curr = 0;
+  bool slice_temporal_mvp = false;
+  const bool idr = nal.type == 19 || nal.type == 20;
+  if (!idr) {
+    reader.skip(sps.log2_max_pic_order_cnt_lsb);
+    const auto& sets = sps.short_term_ref_pic_sets;
+    if (!reader.bit()) {
+      num_pic_total_curr += parse_h265_st_rps(&reader, sets.size(), sets).num_used_by_curr;
+    } else if (!sets.empty()) {
+      const uint32_t index = sets.size() > 1 ? reader.bits(ceil_log2(sets.size())) : 0;
+      if (index >= sets.size()) {
+        return -1;
+      }
+      num_pic_total_curr += sets[index].num_used_by_curr;
+    }
+    if (sps.long_term_ref_pics_present) {
+      const auto& sps_long_term = sps.long_term_used_by_curr;
+      const uint32_t num_long_term_sps = sps_long_term.empty() ? 0 : reader.ue();
+      const uint32_t num_long_term_pics = reader.ue();
+      if (num_long_term_sps + num_long_term_pics > 32) {
+        return -1;
+      }
+      for (uint32_t i = 0; i < num_long_term_sps + num_long_term_pics; i++) {
+        if (i < num_long_term_sps) {
+          const uint32_t index =
+              sps_long_term.size() > 1 ? reader.bits(ceil_log2(sps_long_term.size())) : 0;
+          num_pic_total_curr += index < sps_long_term.size() && sps_long_term[index];
+        } else {
+          reader.skip(sps.log2_max_pic_order_cnt_lsb);
+          num_pic_total_curr += reader.bit();
+        }
+        if (reader.bit()) {
+          reader.ue();  // delta_poc_msb_cycle_lt
+        }
+      }
+    }
+    if (sps.temporal_mvp) {
+      slice_temporal_mvp = reader.bit();
+    }
+  }
+  const int chroma_array_type = sps.separate_colour_plane ? 0 : sps.chroma_format_idc;
+  if (sps.sample_adaptive_offset) {
+    reader.skip(chroma_array_type != 0 ? 2 : 1);
+  }
+  if (p_slice || b_slice) {
+    uint32_t num_ref_idx_l0 = pps.num_ref_idx_l0_default;
+    uint32_t num_ref_idx_l1 = b_slice ? pps.num_ref_idx_l1_default : 0;
+    if (reader.bit()) {
+      num_ref_idx_l0 = reader.ue() + 1;
+      if (b_slice) {
+        num_ref_idx_l1 = reader.ue() + 1;
+      }
+    }
+    if (pps.lists_modification_present && num_pic_total_curr > 1) {
+      const int entry_bits = ceil_log2(num_pic_total_curr);
+      for (const uint32_t num_ref_idx : {num_ref_idx_l0, num_ref_idx_l1}) {
+        if (num_ref_idx > 0 && reader.bit()) {
+          reader.skip(num_ref_idx * entry_bits);
+        }
+      }
+    }
+    if (b_slice) {
+      reader.skip(1);  // mvd_l1_zero_flag
+    }
+    if (pps.cabac_init_present) {
+      reader.skip(1);
+    }
+    if (slice_temporal_mvp) {
+      const bool collocated_from_l0 = b_slice ? reader.bit() : true;
+      if ((collocated_from_l0 && num_ref_idx_l0 > 1) ||
+          (!collocated_from_l0 && num_ref_idx_l1 > 1)) {
+        reader.ue();  // collocated_ref_idx
+      }
+    }
+    if ((pps.weighted_pred && p_slice) || (pps.weighted_bipred && b_slice)) {
+      skip_h265_pred_weight_table(&reader, chroma_array_type, num_ref_idx_l0, num_ref_idx_l1);
+    }
+    reader.ue();  // five_minus_max_num_merge_cand
+  }
+  const int qp = pps.init_qp + reader.se();
+  return reader.overrun() ? -1 : qp;
+}
+
+BitstreamAnalyzer::BitstreamAnalyzer(NalCodec codec) : codec_{codec} {}
+
+FrameSyntax BitstreamAnalyzer::analyze(const uint8_t* data, size_t size) {
+  FrameSyntax syntax{};
+  syntax.qp = -1;
+  int qp_sum = 0;
+  int qp_count = 0;
+  for (const auto& nal : split_nal_units(data, size, codec_)) {
+    syntax.nal_types.push_back(nal.type);
+    switch (codec_) {
+    case NalCodec::h264:
+      analyze_h264(nal, &syntax, &qp_sum, &qp_count);
+      break;
+    case NalCodec::h265:
+      analyze_h265(nal, &syntax, &qp_sum, &qp_count);
+      break;
+    case NalCodec::av1:
+      if (nal.size > 1 && (nal.data[0] & 0x04)) {
+        syntax.temporal_id = std::max(syntax.temporal_id, nal.data[1] >> 5);
+      }
+      if (nal.type == kAv1ObuSequenceHeader) {
+        syntax.parameter_set_bytes += nal.size;
+      } else if (nal.type == 3 || nal.type == 4 || nal.type == 6) {
+        // Frame header, tile group and frame OBUs.
+        syntax.slice_bytes += nal.size;
+      } else if (nal.type == 5) {
+        syntax.sei_bytes += nal.size;  // metadata
+      }
+      break;
+    }
+  }
+  if (qp_count > 0) {
+    syntax.qp = (qp_sum + qp_count / 2) / qp_count;
+  }
+  return syntax;
+}
+
+void BitstreamAnalyzer::analyze_h264(const NalUnit& nal,
+                                     FrameSyntax* syntax,
+                                     int* qp_sum,
+                                     int* qp_count) {
+  switch (nal.type) {
+  case kH264NalSps:
+  case kH264NalPps:
+    syntax->parameter_set_bytes += nal.size;
+    try {
+      if (nal.type == kH264NalSps) {
+        const auto sps = parse_h264_sps(nal);
+        h264_sps_[sps.sps_id] = sps;
+      } else {
+        const auto pps = parse_h264_pps(nal);
+        h264_pps_[pps.pps_id] = pps;
+      }
+    } catch (std::runtime_error&) {
+      // Slices referring to it get no QP.
+    }
+    break;
+  case 6:
+    syntax->sei_bytes += nal.size;
+    break;
+  case 1:
+  case 5: {
+    syntax->slice_bytes += nal.size;
+    uint8_t rbsp[8];
+    BitReader reader{rbsp, unescape_rbsp(nal.data, nal.size, rbsp, sizeof(rbsp))};
+    reader.skip(8);
+    reader.ue();
+    reader.ue();
+    const auto pps = h264_pps_.find(reader.ue());
+    if (pps == h264_pps_.end()) {
+      break;
+    }
+    const auto sps = h264_sps_.find(pps->second.sps_id);
+    if (sps == h264_sps_.end()) {
+      break;
+    }
+    const int qp = parse_h264_slice_qp(nal, sps->second, pps->second);
+    if (qp >= 0) {
+      *qp_sum += qp;
+      (*qp_count)++;
+    }
+  } break;
+  default:
+    break;
+  }
+}
+
+void BitstreamAnalyzer::analyze_h265(const NalUnit& nal,
+                                     FrameSyntax* syntax,
+                                     int* qp_sum,
+                                     int* qp_count) {
+  if (nal.size >= 2) {
+    syntax->temporal_id = std::max(syntax->temporal_id, (nal.data[1] & 0x07) - 1);
+  }
+  if (nal.type >= kH265NalVps && nal.type <= kH265NalPps) {
+    syntax->parameter_set_bytes += nal.size;
+    try {
+      if (nal.type == kH265NalSps) {
+        const auto sps = parse_h265_sps(nal);
+        h265_sps_[sps.sps_id] = sps;
+      } else if (nal.type == kH265NalPps) {
+        const auto pps = parse_h265_pps(nal);
+        h265_pps_[pps.pps_id] = pps;
+      }
+    } catch (std::runtime_error&) {
+      // Slices referring to it get no QP.
+    }
+  } else if (nal.type == 39 || nal.type == 40) {
+    syntax->sei_bytes += nal.size;
+  } else if (nal.type < 32) {
+    syntax->slice_bytes += nal.size;
+    uint8_t rbsp[8];
+    BitReader reader{rbsp, unescape_rbsp(nal.data, nal.size, rbsp, sizeof(rbsp))};
+    reader.skip(16 + 1 + (nal.type >= 16 && nal.type <= 23 ? 1 : 0));
+    const auto pps = h265_pps_.find(reader.ue());
+    if (pps == h265_pps_.end()) {
+      return;
+    }
+    const auto sps = h265_sps_.find(pps->second.sps_id);
+    if (sps == h265_sps_.end()) {
+      return;
+    }
+    const int qp = parse_h265_slice_qp(nal, sps->second, pps->second);
+    if (qp >= 0) {
+      *qp_sum += qp;
+      (*qp_count)++;
+    }
+  }
+}
@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+enum class NalCodec { h264, h265, av1 };
+
+// Codec of the encodeapp codec name, throws std::invalid_argument for codecs
+// without NAL units or OBUs.
+NalCodec nal_codec_from_string(const std::string& codec);
+
+// NAL unit without start code, or OBU with its header. Points into the
+// parsed buffer.
+struct NalUnit {
+  const uint8_t* data;
+  size_t size;
+  int type;
+};
+
+// Splits an Annex-B byte stream at its start codes.
+std::vector<NalUnit> split_annexb(const uint8_t* data, size_t size, NalCodec codec);
+
+// Splits a low overhead AV1 bitstream into OBUs, throws std::runtime_error
+// when an OBU size runs past the end of the buffer.
+std::vector<NalUnit> split_obus(const uint8_t* data, size_t size);
+
+std::vector<NalUnit> split_nal_units(const uint8_t* data, size_t size, NalCodec codec);
+
+// Removes emulation prevention bytes.
+std::vector<uint8_t> unescape_rbsp(const uint8_t* data, size_t size);
+
+// Unescapes the start of data into rbsp, returns the number of bytes written.
+size_t unescape_rbsp(const uint8_t* data, size_t size, uint8_t* rbsp, size_t rbsp_size);
+
+// MSB first reader of RBSP or OBU payload bits, reads past the end return zero
+// bits and set overrun.
+class BitReader {
+ public:
+  BitReader(const uint8_t* data, size_t size);
+
+  uint32_t bits(int count);
+  bool bit();
+  // Exp-Golomb codes.
+  uint32_t ue();
+  int32_t se();
+  void skip(size_t count);
+
+  bool overrun() const;
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t position_;
+};
+
+constexpr const int kH264NalSps = 7;
+constexpr const int kH264NalPps = 8;
+constexpr const int kH265NalVps = 32;
+constexpr const int kH265NalSps = 33;
+constexpr const int kH265NalPps = 34;
+constexpr const int kAv1ObuSequenceHeader = 1;
+constexpr const int kAv1ObuTemporalDelimiter = 2;
+
+struct H264Sps {
+  int profile_idc;
+  int constraint_flags;
+  int level_idc;
+  int sps_id;
+  int chroma_format_idc;
+  bool separate_colour_plane;
+  int bit_depth_luma;
+  int bit_depth_chroma;
+  int log2_max_frame_num;
+  int pic_order_cnt_type;
+  int log2_max_pic_order_cnt_lsb;
+  bool delta_pic_order_always_zero;
+  bool frame_mbs_only;
+};
+
+// nal is the whole SPS NAL unit with its header.
+H264Sps parse_h264_sps(const NalUnit& nal);
+
+struct H264Pps {
+  int pps_id;
+  int sps_id;
+  bool entropy_coding_mode;
+  bool bottom_field_pic_order_in_frame_present;
+  int num_ref_idx_l0_default;
+  int num_ref_idx_l1_default;
+  bool weighted_pred;
+  int weighted_bipred_idc;
+  int pic_init_qp;
+  bool redundant_pic_cnt_present;
+};
+
+H264Pps parse_h264_pps(const NalUnit& nal);
+
+struct H265ShortTermRps {
+  int num_delta_pocs;
+  int num_used_by_curr;
+};
+
+struct H265Sps {
+  int profile_space;
+  int tier_flag;
+  int profile_idc;
+  uint32_t profile_compatibility_flags;
+  // general_progressive_source_flag to general_reserved_zero bits.
+  uint64_t constraint_indicator_flags;
+  int level_idc;
+  int max_sub_layers;
+  bool temporal_id_nesting;
+  int sps_id;
+  int chroma_format_idc;
+  bool separate_colour_plane;
+  int width;
+  int height;
+  int bit_depth_luma;
+  int bit_depth_chroma;
+  int log2_max_pic_order_cnt_lsb;
+  int log2_ctb_size;
+  bool sample_adaptive_offset;
+  std::vector<H265ShortTermRps> short_term_ref_pic_sets;
+  bool long_term_ref_pics_present;
+  std::vector<bool> long_term_used_by_curr;
+  bool temporal_mvp;
+};
+
+H265Sps parse_h265_sps(const NalUnit& nal);
+
+struct H265Pps {
+  int pps_id;
+  int sps_id;
+  bool dependent_slice_segments_enabled;
+  bool output_flag_present;
+  int num_extra_slice_header_bits;
+  bool cabac_init_present;
+  int num_ref_idx_l0_default;
+  int num_ref_idx_l1_default;
+  int init_qp;
+  bool weighted_pred;
+  bool weighted_bipred;
+  bool lists_modification_present;
+};
+
+H265Pps parse_h265_pps(const NalUnit& nal);
+
+struct Av1SequenceHeader {
+  int profile;
+  int level_idx;
+  int tier;
+  bool high_bitdepth;
+  bool twelve_bit;
+  bool monochrome;
+  bool subsampling_x;
+  bool subsampling_y;
+  int chroma_sample_position;
+};
+
+// obu is the whole sequence header OBU with its header.
+Av1SequenceHeader parse_av1_sequence_header(const NalUnit& obu);
+
+// Slice headers are parsed from a copy of their first bytes.
+constexpr const size_t kSliceHeaderBytes = 256;
+
+// Slice QP from the slice header, -1 when the header is longer than
+// kSliceHeaderBytes or is a dependent slice segment.
+int parse_h264_slice_qp(const NalUnit& nal, const H264Sps& sps, const H264Pps& pps);
+int parse_h265_slice_qp(const NalUnit& nal, const H265Sps& sps, const H265Pps& pps);
+
+// Syntax of an encoded frame, read without decoding it.
+struct FrameSyntax {
+  std::vector<int> nal_types;
+  // Mean slice QP, -1 when unknown as for AV1.
+  int qp;
+  // Highest temporal layer id of the frame.
+  int temporal_id;
+  // VPS, SPS, PPS or sequence header.
+  size_t parameter_set_bytes;
+  // SEI or metadata OBUs.
+  size_t sei_bytes;
+  // Slices, or frame and tile group OBUs.
+  size_t slice_bytes;
+};
+
+// Analyzes the frames of one stream in order. Parameter sets are kept to
+// parse the slice headers of later frames.
+class BitstreamAnalyzer {
+ public:
+  explicit BitstreamAnalyzer(NalCodec codec);
+
+  FrameSyntax analyze(const uint8_t* data, size_t size);
+
+ private:
+  void analyze_h264(const NalUnit& nal, FrameSyntax* syntax, int* qp_sum, int* qp_count);
+  void analyze_h265(const NalUnit& nal, FrameSyntax* syntax, int* qp_sum, int* qp_count);
+
+  const NalCodec codec_;
+  std::map<int, H264Sps> h264_sps_;
+  std::map<int, H264Pps> h264_pps_;
+  std::map<int, H265Sps> h265_sps_;
+  std::map<int, H265Pps> h265_pps_;
+};
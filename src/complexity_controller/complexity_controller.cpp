@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "complexity_controller.hpp"
+
+#include "vpl/preview/vpl.hpp"
+
+// Fractions of the frame budget bounding the band the target usage holds in.
+constexpr const double kSpeedUpLoad = 0.9;
+constexpr const double kQualityLoad = 0.65;
+constexpr const size_t kMinWindowFrames = 8;
+// Windows under the band before a better quality is tried.
+constexpr const size_t kQualityWindows = 2;
+
+ComplexityController::ComplexityController(double target_fps,
+                                           uint16_t target_usage,
+                                           size_t window_frames) :
+  budget_us_{target_fps > 0 ? 1e6 / target_fps : 0},
+  window_frames_{window_frames ? window_frames
+                               : std::max(kMinWindowFrames, static_cast<size_t>(target_fps / 4))},
+  target_usage_{target_usage},
+  frames_{0},
+  window_count_{0},
+  window_sum_us_{0},
+  settling_{false},
+  windows_{0},
+  change_window_{0},
+  quality_step_{false},
+  low_windows_{0},
+  low_windows_needed_{kQualityWindows} {
+  if (target_fps <= 0) {
+    throw std::invalid_argument("Invalid target fps " + std::to_string(target_fps));
+  }
+  if (target_usage < MFX_TARGETUSAGE_BEST_QUALITY || target_usage > MFX_TARGETUSAGE_BEST_SPEED) {
+    throw std::invalid_argument("Invalid target usage " + std::to_string(target_usage));
+  }
+}
+
+std::optional<uint16_t> ComplexityController::add_frame(long encode_time_us) {
+  frames_++;
+  window_sum_us_ += encode_time_us;
+  if (++window_count_ < window_frames_) {
+    return std::nullopt;
+  }
+  const double frame_time_us = window_sum_us_ / window_count_;
+  window_count_ = 0;
+  window_sum_us_ = 0;
+  if (settling_) {
+    settling_ = false;
+    return std::nullopt;
+  }
+  windows_++;
+  if (frame_time_us > budget_us_ * kSpeedUpLoad) {
+    low_windows_ = 0;
+    if (target_usage_ == MFX_TARGETUSAGE_BEST_SPEED) {
+      return std::nullopt;
+    }
+    // The better quality didn't hold, it has to wait longer next time.
+    if (quality_step_ && windows_ - change_window_ <= kQualityWindows) {
+      low_windows_needed_ *= 2;
+    }
+    change(target_usage_ + 1, frame_time_us);
+    quality_step_ = false;
+    return target_usage_;
+  }
+  if (frame_time_us >= budget_us_ * kQualityLoad) {
+    low_windows_ = 0;
+    return std::nullopt;
+  }
+  if (target_usage_ == MFX_TARGETUSAGE_BEST_QUALITY || ++low_windows_ < low_windows_needed_) {
+    return std::nullopt;
+  }
+  change(target_usage_ - 1, frame_time_us);
+  quality_step_ = true;
+  return target_usage_;
+}
+
+uint16_t ComplexityController::target_usage() const {
+  return target_usage_;
+}
+
+double ComplexityController::budget_us() const {
+  return budget_us_;
+}
+
+const std::vector<ComplexityChange>& ComplexityController::changes() const {
+  return changes_;
+}
+
+void ComplexityController::change(uint16_t target_usage, double frame_time_us) {
+  target_usage_ = target_usage;
+  changes_.push_back({frames_, target_usage, frame_time_us});
+  change_window_ = windows_;
+  low_windows_ = 0;
+  settling_ = true;
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Target usage switched to after frame, frame_time_us is the mean encode
+// time of the window that led to it.
+struct ComplexityChange {
+  size_t frame;
+  uint16_t target_usage;
+  double frame_time_us;
+};
+
+// Keeps the encode time of a frame within the budget of a target frame rate
+// by moving the target usage, 1 best quality to 7 best speed. Encode times
+// are averaged over windows of window_frames. A window over 90% of the
+// budget steps to a faster target usage, windows under 65% step back to a
+// better quality. The band between them and the windows needed to step back
+// keep the controller from oscillating, and a quality step taken back right
+// away doubles the windows needed before it is tried again.
+class ComplexityController {
+ public:
+  // window_frames 0 picks a quarter second of frames, at least 8.
+  ComplexityController(double target_fps, uint16_t target_usage, size_t window_frames = 0);
+
+  // Adds the encode time of the next frame. Returns the target usage to
+  // switch to when a window ends out of the band.
+  std::optional<uint16_t> add_frame(long encode_time_us);
+
+  uint16_t target_usage() const;
+
+  double budget_us() const;
+
+  const std::vector<ComplexityChange>& changes() const;
+
+ private:
+  void change(uint16_t target_usage, double frame_time_us);
+
+  const double budget_us_;
+  const size_t window_frames_;
+  uint16_t target_usage_;
+  size_t frames_;
+  size_t window_count_;
+  double window_sum_us_;
+  // The window after a change mixes frames of both target usages.
+  bool settling_;
+  size_t windows_;
+  size_t change_window_;
+  bool quality_step_;
+  size_t low_windows_;
+  size_t low_windows_needed_;
+  std::vector<ComplexityChange> changes_;
+};
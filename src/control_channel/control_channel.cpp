@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: MIT
+
+#include <sys/stat.h>
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "control_channel.hpp"
+
+#include "nlohmann/json.hpp"
+
+static int64_t file_mtime(const std::string& path) {
+  struct stat file_stat {};
+  if (stat(path.c_str(), &file_stat) != 0) {
+    return -1;
+  }
+  return static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 + file_stat.st_mtim.tv_nsec;
+}
+
+// Value of key between min and max, 0 when it is missing.
+static double ranged_value(const nlohmann::json& json, const char* key, double min, double max) {
+  if (!json.contains(key)) {
+    return 0;
+  }
+  const double value = json.value(key, 0.0);
+  if (!(value >= min && value <= max)) {
+    throw std::out_of_range("Invalid " + std::string(key) + " " + json[key].dump());
+  }
+  return value;
+}
+
+Reconfiguration parse_reconfiguration(const std::string& content) {
+  const auto json = nlohmann::json::parse(content);
+  Reconfiguration reconfiguration{};
+  reconfiguration.target_kbps = static_cast<uint16_t>(
+      ranged_value(json, "bitrate", 0, std::numeric_limits<uint16_t>::max()));
+  reconfiguration.max_kbps = static_cast<uint16_t>(
+      ranged_value(json, "maxbitrate", 0, std::numeric_limits<uint16_t>::max()));
+  reconfiguration.frame_rate =
+      static_cast<int>(ranged_value(json, "rate", 1, std::numeric_limits<uint16_t>::max()));
+  reconfiguration.at_idr = json.value("at", "frame") == "idr";
+  return reconfiguration;
+}
+
+// The file present at start is the initial state, not a change.
+ControlFile::ControlFile(std::string path) : path_{std::move(path)}, mtime_{file_mtime(path_)} {}
+
+std::optional<Reconfiguration> ControlFile::poll() {
+  const auto mtime = file_mtime(path_);
+  if (mtime == mtime_ || mtime < 0) {
+    return std::nullopt;
+  }
+  mtime_ = mtime;
+  std::ifstream control_file{path_};
+  std::stringstream content;
+  content << control_file.rdbuf();
+  try {
+    return parse_reconfiguration(content.str());
+  } catch (nlohmann::json::exception& e) {
+    std::cout << "Ignoring control file: " << e.what() << std::endl;
+    return std::nullopt;
+  } catch (std::out_of_range& e) {
+    std::cout << "Ignoring control file: " << e.what() << std::endl;
+    return std::nullopt;
+  }
+}
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "video_encoder/video_encoder.hpp"
+
+// Watches a JSON file for rate control changes, e.g. written by a network
+// feedback loop:
+//   {"bitrate": 1500, "maxbitrate": 2000, "rate": 30, "at": "idr"}
+// Every field is optional, "at" is "frame" (default) or "idr". Bitrates are
+// kbps up to 65535, a rate is at least 1 fps. Changes with a field out of
+// range are ignored as a whole.
+class ControlFile {
+ public:
+  explicit ControlFile(std::string path);
+
+  // Returns the change when the file was modified since the last poll.
+  std::optional<Reconfiguration> poll();
+
+ private:
+  const std::string path_;
+  int64_t mtime_;
+};
+
+// Throws nlohmann::json::exception on malformed content and
+// std::out_of_range on a field out of range.
+Reconfiguration parse_reconfiguration(const std::string& content);
@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: MIT
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "cpu_usage.hpp"
+
+#include "numa/numa.hpp"
+
+static long to_us(const timeval& time) {
+  return time.tv_sec * 1000000L + time.tv_usec;
+}
+
+CpuTimes cpu_times() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  const long wall = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count();
+  return {to_us(usage.ru_utime), to_us(usage.ru_stime), wall};
+}
+
+CpuTimes cpu_times(const std::vector<pid_t>& threads) {
+  const long ticks_per_second = sysconf(_SC_CLK_TCK);
+  long user_ticks = 0;
+  long system_ticks = 0;
+  for (const auto thread : threads) {
+    std::ifstream stat_file{"/proc/self/task/" + std::to_string(thread) + "/stat"};
+    std::string stat;
+    if (!std::getline(stat_file, stat)) {
+      continue;
+    }
+    // The thread name in parentheses may contain spaces, the fields after it
+    // start with the state. utime and stime are the 14th and 15th fields.
+    std::istringstream fields{stat.substr(stat.rfind(')') + 1)};
+    std::string skipped;
+    for (int field = 3; field < 14; field++) {
+      fields >> skipped;
+    }
+    long user = 0;
+    long system = 0;
+    if (fields >> user >> system) {
+      user_ticks += user;
+      system_ticks += system;
+    }
+  }
+  const long wall = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count();
+  return {user_ticks * 1000000L / ticks_per_second,
+          system_ticks * 1000000L / ticks_per_second,
+          wall};
+}
+
+std::vector<pid_t> process_threads() {
+  std::vector<pid_t> threads;
+  std::error_code error;
+  for (const auto& entry : std::filesystem::directory_iterator{"/proc/self/task", error}) {
+    threads.push_back(std::stoi(entry.path().filename().string()));
+  }
+  std::sort(threads.begin(), threads.end());
+  return threads;
+}
+
+pid_t current_thread() {
+  return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+double cpu_utilization(const CpuTimes& start, const CpuTimes& stop) {
+  const long wall = stop.wall - start.wall;
+  if (wall <= 0) {
+    return 0;
+  }
+  return static_cast<double>(stop.user - start.user + stop.system - start.system) / wall;
+}
+
+long peak_rss_kb() {
+  std::ifstream status{"/proc/self/status"};
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmHWM:", 0) == 0) {
+      return std::stol(line.substr(6));
+    }
+  }
+  return 0;
+}
+
+bool reset_peak_rss() {
+  std::ofstream clear_refs{"/proc/self/clear_refs"};
+  clear_refs << "5";
+  clear_refs.flush();
+  return static_cast<bool>(clear_refs);
+}
+
+int allowed_cpus() {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+    return 0;
+  }
+  return CPU_COUNT(&cpu_set);
+}
+
+bool pin_thread_to_cpuset(const std::string& cpuset) {
+  std::vector<int> cpus;
+  try {
+    cpus = parse_cpu_list(cpuset);
+  } catch (std::logic_error&) {
+    throw std::invalid_argument("Invalid cpuset " + cpuset);
+  }
+  if (cpus.empty()) {
+    throw std::invalid_argument("Empty cpuset");
+  }
+  return pin_thread(cpus);
+}
+
+ThreadAffinityGuard::ThreadAffinityGuard() {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+    return;
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &cpu_set)) {
+      cpus_.push_back(cpu);
+    }
+  }
+}
+
+ThreadAffinityGuard::~ThreadAffinityGuard() {
+  if (!cpus_.empty()) {
+    pin_thread(cpus_);
+  }
+}
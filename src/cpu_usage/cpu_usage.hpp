@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+// Cpu time of the process and the wall clock time it was sampled at, in us.
+struct CpuTimes {
+  long user;
+  long system;
+  long wall;
+};
+
+CpuTimes cpu_times();
+
+// Cpu time of the listed threads of the process, threads that exited count
+// as 0. Accurate to a clock tick.
+CpuTimes cpu_times(const std::vector<pid_t>& threads);
+
+// Threads of the process, in ascending order.
+std::vector<pid_t> process_threads();
+
+pid_t current_thread();
+
+// Cpus busy on average between the two samples, 1.0 is one fully used cpu.
+double cpu_utilization(const CpuTimes& start, const CpuTimes& stop);
+
+// Peak resident set size of the process in kB, 0 when unknown.
+long peak_rss_kb();
+
+// Restarts the peak resident set size at the current size. Returns false
+// when the kernel doesn't support it.
+bool reset_peak_rss();
+
+// Number of cpus the calling thread may run on.
+int allowed_cpus();
+
+// Pins the calling thread to a kernel cpu list such as "0-3,8". Threads the
+// encoder session creates afterwards inherit the affinity. Throws
+// std::invalid_argument for a malformed or empty list.
+bool pin_thread_to_cpuset(const std::string& cpuset);
+
+// Puts the affinity of the calling thread back to what it was at
+// construction, for threads that run more than one job.
+class ThreadAffinityGuard {
+ public:
+  ThreadAffinityGuard();
+  ~ThreadAffinityGuard();
+
+  ThreadAffinityGuard(const ThreadAffinityGuard&) = delete;
+  ThreadAffinityGuard& operator=(const ThreadAffinityGuard&) = delete;
+
+ private:
+  // Empty when the affinity couldn't be read.
+  std::vector<int> cpus_;
+};
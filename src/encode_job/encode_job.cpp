@@ -0,0 +1,1202 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "encode_job.hpp"
+
+#include "arena/arena.hpp"
+#include "bitstream_parser/bitstream_parser.hpp"
+#include "complexity_controller/complexity_controller.hpp"
+#include "control_channel/control_channel.hpp"
+#include "cpu_usage/cpu_usage.hpp"
+#include "frame_pool/frame_pool.hpp"
+#include "mapping/mapping.hpp"
+#include "memory_frame_reader/memory_frame_reader.hpp"
+#include "perf_counters/perf_counters.hpp"
+#include "pts_tracker/pts_tracker.hpp"
+#include "segment_writer/segment_writer.hpp"
+#include "stream_writer/stream_writer.hpp"
+#include "synthetic_frame_reader/synthetic_frame_reader.hpp"
+#include "trace/trace.hpp"
+#include "two_pass/two_pass.hpp"
+#include "utils.hpp"
+#include "video_encoder/video_encoder.hpp"
+
+constexpr const int kTimeout100Ms = 100;
+constexpr const uint16_t kFirstPassQp = 26;
+// Input frames the encoder can hold for reordering and async depth.
+constexpr const size_t kZeroCopyFrames = 16;
+// Encoded frames queued for or being written by the writer thread.
+constexpr const size_t kBitstreams = 8;
+// 90 kHz time stamps of the written stream.
+constexpr const uint32_t kTimescale = kPtsTimescale;
+
+namespace vpl = oneapi::vpl;
+
+// Bitstreams allocated once and lent to the writer thread, encoding waits for
+// one to come back when the writer falls behind.
+class BitstreamPool {
+ public:
+  explicit BitstreamPool(size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      free_.push_back(std::make_shared<vpl::bitstream_as_dst>());
+    }
+  }
+
+  std::shared_ptr<vpl::bitstream_as_dst> acquire() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    returned_.wait(lock, [this] { return !free_.empty(); });
+    auto bitstream = std::move(free_.back());
+    free_.pop_back();
+    return bitstream;
+  }
+
+  void release(std::shared_ptr<vpl::bitstream_as_dst> bitstream) {
+    bitstream->set_DataLength(0);
+    std::lock_guard<std::mutex> lock{mutex_};
+    free_.push_back(std::move(bitstream));
+    returned_.notify_one();
+  }
+
+  // Returns the bitstream to the pool once the owner is destroyed.
+  std::shared_ptr<void> lend(std::shared_ptr<vpl::bitstream_as_dst> bitstream) {
+    auto* data = bitstream.get();
+    return std::shared_ptr<void>(data, [this, bitstream](void*) { release(bitstream); });
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable returned_;
+  std::vector<std::shared_ptr<vpl::bitstream_as_dst>> free_;
+};
+
+long time_since_epoch() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+void to_json(nlohmann::json& json, const EncodeJob& job) {
+  json = nlohmann::json{{"input", job.input_filename},
+                        {"output", job.output_filename},
+                        {"stats", job.stats_filename},
+                        {"pass_stats", job.pass_stats_filename},
+                        {"height", job.height},
+                        {"width", job.width},
+                        {"rate", job.frame_rate},
+                        {"codec_type", job.codec_type},
+                        {"color_format", job.color_format},
+                        {"chroma_format", job.chroma_format},
+                        {"bitrate_mode", job.bitrate_mode},
+                        {"bitrate", job.bitrate},
+                        {"use_hw", job.use_hw},
+                        {"pass", job.pass},
+                        {"target_size", job.target_size},
+                        {"control", job.control_filename},
+                        {"zero_copy", job.zero_copy},
+                        {"arena", job.arena},
+                        {"prefault", job.prefault},
+                        {"container", job.container},
+                        {"segment_duration", job.segment_duration},
+                        {"playlist_size", job.playlist_size},
+                        {"threads", job.threads},
+                        {"cpuset", job.cpuset},
+                        {"low_latency", job.low_latency},
+                        {"slices", job.slices},
+                        {"preload", job.preload},
+                        {"preload_frames", job.preload_frames},
+                        {"loops", job.loops},
+                        {"loop_duration", job.loop_duration},
+                        {"warmup_frames", job.warmup_frames},
+                        {"perf_counters", job.perf_counters},
+                        {"pacing", job.pacing},
+                        {"input_queue", job.input_queue},
+                        {"target_fps", job.target_fps}};
+}
+
+void from_json(const nlohmann::json& json, EncodeJob& job) {
+  const EncodeJob defaults{};
+  job.input_filename = json.at("input").get<std::string>();
+  job.output_filename = json.value("output", defaults.output_filename);
+  job.stats_filename = json.value("stats", defaults.stats_filename);
+  job.pass_stats_filename = json.value("pass_stats", defaults.pass_stats_filename);
+  job.height = json.value("height", defaults.height);
+  job.width = json.value("width", defaults.width);
+  job.frame_rate = json.value("rate", defaults.frame_rate);
+  job.codec_type = json.value("codec_type", defaults.codec_type);
+  job.color_format = json.value("color_format", defaults.color_format);
+  job.chroma_format = json.value("chroma_format", defaults.chroma_format);
+  job.bitrate_mode = json.value("bitrate_mode", defaults.bitrate_mode);
+  job.bitrate = json.value("bitrate", defaults.bitrate);
+  job.use_hw = json.value("use_hw", defaults.use_hw);
+  job.pass = json.value("pass", defaults.pass);
+  job.target_size = json.value("target_size", defaults.target_size);
+  job.control_filename = json.value("control", defaults.control_filename);
+  job.zero_copy = json.value("zero_copy", defaults.zero_copy);
+  job.arena = json.value("arena", defaults.arena);
+  job.prefault = json.value("prefault", defaults.prefault);
+  job.container = json.value("container", defaults.container);
+  job.segment_duration = json.value("segment_duration", defaults.segment_duration);
+  job.playlist_size = json.value("playlist_size", defaults.playlist_size);
+  job.threads = json.value("threads", defaults.threads);
+  job.cpuset = json.value("cpuset", defaults.cpuset);
+  job.low_latency = json.value("low_latency", defaults.low_latency);
+  job.slices = json.value("slices", defaults.slices);
+  job.preload = json.value("preload", defaults.preload);
+  job.preload_frames = json.value("preload_frames", defaults.preload_frames);
+  job.loops = json.value("loops", defaults.loops);
+  job.loop_duration = json.value("loop_duration", defaults.loop_duration);
+  job.warmup_frames = json.value("warmup_frames", defaults.warmup_frames);
+  job.perf_counters = json.value("perf_counters", defaults.perf_counters);
+  job.pacing = json.value("pacing", defaults.pacing);
+  job.input_queue = json.value("input_queue", defaults.input_queue);
+  job.target_fps = json.value("target_fps", defaults.target_fps);
+}
+
+static std::string encoded_file_extension(const EncodeJob& job) {
+  const auto container = resolve_container(job.container, job.codec_type);
+  return container == "raw" ? "." + job.codec_type : "." + container;
+}
+
+void set_default_filenames(EncodeJob* job) {
+  // Segmented output names the playlist, segments are named after it.
+  const std::string encoded_file_ext =
+      job->segment_duration > 0 ? ".m3u8" : encoded_file_extension(*job);
+  const auto last_index = job->input_filename.find_last_of(".");
+  auto basename = (last_index == std::string::npos) ? job->input_filename
+                                                  : job->input_filename.substr(0, last_index);
+  if (is_synthetic_input(job->input_filename)) {
+    // Generated input has no file name to derive the others from.
+    basename = "synthetic";
+  }
+  if (job->output_filename.empty()) {
+    job->output_filename = basename + encoded_file_ext;
+  }
+  if (job->stats_filename.empty()) {
+    job->stats_filename = basename + ".json";
+  }
+  if (job->pass_stats_filename.empty()) {
+    job->pass_stats_filename = basename + ".2pass";
+  }
+}
+
+std::string input_color_format(const EncodeJob& job) {
+  if (!job.color_format.empty()) {
+    return job.color_format;
+  }
+  return job.use_hw ? "nv12" : "i420";
+}
+
+std::unique_ptr<vpl::default_selector> make_impl_selector(const EncodeJob& job) {
+  const vpl::implementation_type impl_type{job.use_hw ? vpl::implementation_type::hw
+                                                      : vpl::implementation_type::sw};
+  const auto codec_type = codec_formats.at(job.codec_type);
+  // Default implementation selector. Selects first impl based on property list.
+  return std::make_unique<vpl::default_selector>(std::vector<vpl::property>{
+      vpl::dprops::impl(impl_type),
+      vpl::dprops::api_version(2, 5),
+      vpl::dprops::encoder({vpl::dprops::codec_id(codec_type)})});
+}
+
+// Encoder settings and rate control of the job. Returns 0 or errno value.
+static int make_encoder_settings(const EncodeJob& job,
+                                 EncoderParams* encoder_params,
+                                 vpl::rate_control_method* bitrate_mode,
+                                 FirstPassStats* first_pass_stats,
+                                 std::optional<BitAllocator>* bit_allocator) {
+  *bitrate_mode = bitrate_control_method.at(job.bitrate_mode);
+  // Bitrates go to the encoder in 16 bits of kbps.
+  if (job.bitrate < 0 || job.bitrate > std::numeric_limits<uint16_t>::max()) {
+    std::cout << "Invalid bitrate " << job.bitrate << " kbps" << std::endl;
+    return EINVAL;
+  }
+
+  // Two-pass mode runs in constant QP, the second pass moves the QP of each
+  // frame away from the first pass one.
+  encoder_params->target_kbps = job.bitrate;
+  encoder_params->num_thread = job.threads;
+  encoder_params->num_slice = job.slices;
+  if (job.low_latency) {
+    if (job.bitrate_mode.rfind("la", 0) == 0) {
+      std::cout << "Low latency can't use lookahead bitrate mode " << job.bitrate_mode
+                << std::endl;
+      return EINVAL;
+    }
+    encoder_params->async_depth = 1;
+    encoder_params->gop_ref_dist = 1;
+  }
+  if (job.pass == 1) {
+    *bitrate_mode = vpl::rate_control_method::cqp;
+    encoder_params->target_usage = MFX_TARGETUSAGE_BEST_SPEED;
+    encoder_params->qp = kFirstPassQp;
+    first_pass_stats->qp = kFirstPassQp;
+    first_pass_stats->fps = job.frame_rate;
+  } else if (job.pass == 2) {
+    if (job.target_size == 0) {
+      std::cout << "Second pass requires --target-size" << std::endl;
+      return EINVAL;
+    }
+    std::ifstream pass_stats_file{job.pass_stats_filename,
+                                  std::ios_base::in | std::ios_base::binary};
+    if (!pass_stats_file) {
+      std::cout << "Couldn't open first pass stats file" << std::endl;
+      return ENOENT;
+    }
+    try {
+      *first_pass_stats = read_first_pass_stats(pass_stats_file);
+      bit_allocator->emplace(*first_pass_stats, job.target_size);
+    } catch (std::runtime_error& e) {
+      std::cout << "Invalid first pass stats: " << e.what() << std::endl;
+      return EINVAL;
+    }
+    *bitrate_mode = vpl::rate_control_method::cqp;
+    encoder_params->qp = first_pass_stats->qp;
+  } else if (job.pass != 0) {
+    std::cout << "Invalid pass " << job.pass << std::endl;
+    return EINVAL;
+  }
+  return 0;
+}
+
+static bool has_target_bitrate(vpl::rate_control_method bitrate_mode) {
+  return bitrate_mode != vpl::rate_control_method::cqp &&
+         bitrate_mode != vpl::rate_control_method::icq &&
+         bitrate_mode != vpl::rate_control_method::la_icq;
+}
+
+// Input pacing and complexity control of the job. Returns 0 or errno value.
+static int make_rate_adaptation(const EncodeJob& job,
+                                EncoderParams* encoder_params,
+                                PacingPolicy* pacing_policy,
+                                std::optional<ComplexityController>* complexity) {
+  *pacing_policy = PacingPolicy::queue;
+  if (!job.pacing.empty()) {
+    try {
+      *pacing_policy = pacing_policy_from_string(job.pacing);
+    } catch (std::invalid_argument& e) {
+      std::cout << e.what() << std::endl;
+      return EINVAL;
+    }
+    if (job.zero_copy || !job.arena.empty()) {
+      std::cout << "Zero copy input can't be paced" << std::endl;
+      return EINVAL;
+    }
+    if (job.input_queue < 1) {
+      std::cout << "Invalid input queue " << job.input_queue << std::endl;
+      return EINVAL;
+    }
+  }
+  // The controller starts from an explicit target usage so it knows where it is.
+  if (job.target_fps != 0) {
+    if (!job.pacing.empty() && *pacing_policy == PacingPolicy::adapt) {
+      std::cout << "Target fps and the adapt policy both change the target usage" << std::endl;
+      return EINVAL;
+    }
+    if (!encoder_params->target_usage) {
+      encoder_params->target_usage = MFX_TARGETUSAGE_BALANCED;
+    }
+    try {
+      complexity->emplace(job.target_fps, encoder_params->target_usage);
+    } catch (std::invalid_argument& e) {
+      std::cout << e.what() << std::endl;
+      return EINVAL;
+    }
+  }
+  return 0;
+}
+
+// Input of a job from the file or generator to the frames the session reads.
+// The readers point into the file and preloaded frames, so it stays in place.
+struct JobInput {
+  bool synthetic = false;
+  SyntheticPattern synthetic_pattern{};
+  size_t synthetic_frames = 0;
+  std::ifstream file;
+  std::vector<uint8_t> preloaded_frames;
+  std::unique_ptr<vpl::frame_source_reader> frame_reader;
+  // Stopped when the loop duration is over.
+  MemoryFrameReader* memory_reader = nullptr;
+  // Zero copy input, the session then has no frame source.
+  std::unique_ptr<ExternalFramePool> frame_pool;
+  std::unique_ptr<Arena> arena;
+  std::unique_ptr<PacedFrameReader> paced_reader;
+  vpl::frame_source_reader* frame_source = nullptr;
+  bool eos = false;
+};
+
+// Opens the input file or parses the generator of the job. Returns 0 or
+// errno value.
+static int open_input(const EncodeJob& job, JobInput* input) {
+  input->synthetic = is_synthetic_input(job.input_filename);
+  const bool preload = job.preload || job.loops != 1 || job.loop_duration > 0;
+  if (preload && (job.zero_copy || !job.arena.empty())) {
+    std::cout << "Zero copy input can't be preloaded" << std::endl;
+    return EINVAL;
+  }
+  if (input->synthetic) {
+    try {
+      input->synthetic_pattern =
+          parse_synthetic_input(job.input_filename, &input->synthetic_frames);
+    } catch (std::invalid_argument& e) {
+      std::cout << e.what() << std::endl;
+      return EINVAL;
+    }
+    if (job.zero_copy || !job.arena.empty()) {
+      std::cout << "Zero copy input needs an input file" << std::endl;
+      return EINVAL;
+    }
+  } else {
+    input->file.open(job.input_filename, std::ios_base::in | std::ios_base::binary);
+    if (!input->file) {
+      std::cout << "Couldn't open input file" << std::endl;
+      return ENOENT;
+    }
+  }
+  return 0;
+}
+
+// Opens the encoded output behind the writer thread. segment_writer is set
+// for segmented output, owned by async_writer and read once it is closed.
+// Returns 0 or errno value.
+static int open_output(const EncodeJob& job,
+                       std::unique_ptr<AsyncWriter>* async_writer,
+                       SegmentWriter** segment_writer) {
+  try {
+    // Positional width and height as for the frame reader.
+    auto make_writer = [&job](const std::string& filename) {
+      return make_stream_writer(job.container,
+                                job.codec_type,
+                                filename,
+                                job.height,
+                                job.width,
+                                job.frame_rate,
+                                kTimescale);
+    };
+    std::unique_ptr<StreamWriter> writer{};
+    if (job.segment_duration > 0) {
+      check_container(job.container, job.codec_type);
+      // HLS media segments are MPEG-TS or fragmented MP4.
+      if (resolve_container(job.container, job.codec_type) != "mp4") {
+        throw std::invalid_argument("Segmented output needs --container mp4");
+      }
+      const auto last_index = job.output_filename.find_last_of(".");
+      auto segments = std::make_unique<SegmentWriter>(job.output_filename,
+                                                      job.output_filename.substr(0, last_index),
+                                                      encoded_file_extension(job),
+                                                      job.segment_duration,
+                                                      job.playlist_size,
+                                                      kTimescale,
+                                                      make_writer);
+      *segment_writer = segments.get();
+      writer = std::move(segments);
+    } else {
+      writer = make_writer(job.output_filename);
+    }
+    *async_writer = std::make_unique<AsyncWriter>(std::move(writer), kBitstreams, job.low_latency);
+  } catch (std::invalid_argument& e) {
+    std::cout << e.what() << std::endl;
+    return EINVAL;
+  } catch (std::runtime_error& e) {
+    std::cout << "Couldn't open output file" << std::endl;
+    return ENOENT;
+  }
+  return 0;
+}
+
+// Builds the frame readers of an opened input: preloaded, generated or read
+// from the file, zero copy surfaces and pacing on top. The preload time goes
+// to the stats. Returns 0 or errno value.
+static int make_frame_source(const EncodeJob& job,
+                             vpl::color_format_fourcc input_fourcc,
+                             PacingPolicy pacing_policy,
+                             uint16_t target_usage,
+                             JobInput* input,
+                             StatsDataFrame* stats_data_frame) {
+  const int frame_height = job.height;
+  const int frame_width = job.width;
+  const bool preload = job.preload || job.loops != 1 || job.loop_duration > 0;
+
+  // Preloaded input is read once, the encode loop serves it from memory.
+  const size_t preload_limit = job.preload_frames;
+  if (preload) {
+    const auto preload_start_time = time_since_epoch();
+    try {
+      const size_t frame_size = packed_frame_size(frame_height, frame_width, input_fourcc);
+      if (input->synthetic) {
+        const SyntheticFrameGenerator generator(
+            frame_height, frame_width, input_fourcc, input->synthetic_pattern);
+        const size_t frames = preload_limit ? std::min(preload_limit, input->synthetic_frames)
+                                            : input->synthetic_frames;
+        input->preloaded_frames.resize(frames * frame_size);
+        for (size_t i = 0; i < frames; i++) {
+          generator.render(i, input->preloaded_frames.data() + i * frame_size);
+        }
+      } else {
+        input->preloaded_frames = load_frames(input->file, frame_size, preload_limit);
+      }
+    } catch (std::invalid_argument& e) {
+      std::cout << "Couldn't preload input: " << e.what() << std::endl;
+      return EINVAL;
+    }
+    if (input->preloaded_frames.empty()) {
+      std::cout << "No input frames to preload" << std::endl;
+      return EINVAL;
+    }
+    stats_data_frame->preload_time = time_since_epoch() - preload_start_time;
+  }
+
+  // create raw freames reader
+  if (preload) {
+    const size_t frames = input->preloaded_frames.size() /
+                          packed_frame_size(frame_height, frame_width, input_fourcc);
+    const size_t total_frames = job.loop_duration > 0 ? std::numeric_limits<size_t>::max()
+                                                      : frames * job.loops;
+    auto reader = std::make_unique<MemoryFrameReader>(
+        frame_height, frame_width, input_fourcc, &input->preloaded_frames, total_frames);
+    input->memory_reader = reader.get();
+    input->frame_reader = std::move(reader);
+    std::cout << "Preloaded " << frames << " frames in " << stats_data_frame->preload_time
+              << " ms" << std::endl;
+  } else if (input->synthetic) {
+    try {
+      input->frame_reader = std::make_unique<SyntheticFrameReader>(frame_height,
+                                                                   frame_width,
+                                                                   input_fourcc,
+                                                                   input->synthetic_pattern,
+                                                                   input->synthetic_frames);
+    } catch (std::invalid_argument& e) {
+      std::cout << e.what() << std::endl;
+      return EINVAL;
+    }
+  } else {
+    input->frame_reader = std::make_unique<vpl::raw_frame_file_reader>(
+        frame_height, frame_width, input_fourcc, input->file);
+  }
+  input->frame_source = input->frame_reader.get();
+
+  // Zero copy input reads the file straight into surfaces the encoder uses.
+  if (job.zero_copy || !job.arena.empty()) {
+    try {
+      input->frame_pool = std::make_unique<ExternalFramePool>(
+          make_frame_layout(frame_height, frame_width, input_fourcc));
+      if (job.arena.empty()) {
+        input->frame_pool->allocate(kZeroCopyFrames);
+      } else {
+        const size_t frame_size = input->frame_pool->layout().size;
+        input->arena = std::make_unique<Arena>(arena_type_from_string(job.arena),
+                                               kZeroCopyFrames * frame_size,
+                                               job.prefault,
+                                               job.numa_node);
+        for (size_t i = 0; i < kZeroCopyFrames; i++) {
+          input->frame_pool->add_buffer(input->arena->allocate(frame_size));
+        }
+      }
+    } catch (std::exception& e) {
+      std::cout << "Zero copy input failed: " << e.what() << std::endl;
+      return EINVAL;
+    }
+    input->frame_source = nullptr;
+  }
+
+  // Frames arrive at the frame rate, the encoder waits for them.
+  if (!job.pacing.empty()) {
+    input->paced_reader =
+        std::make_unique<PacedFrameReader>(input->frame_source,
+                                           job.frame_rate,
+                                           pacing_policy,
+                                           job.input_queue,
+                                           target_usage ? target_usage : MFX_TARGETUSAGE_BALANCED);
+    input->frame_source = input->paced_reader.get();
+  }
+  return 0;
+}
+
+// Resets a pooled session for the key, or initializes the warm session or a
+// new one when there is none or the reset fails. Returns 0 or errno value.
+static int acquire_session(vpl::implementation_selector& impl_sel,
+                           SessionPool* session_pool,
+                           std::unique_ptr<VideoEncoder>* fresh_session,
+                           const SessionKey& session_key,
+                           vpl::frame_source_reader* frame_source,
+                           const vpl::frame_info& info,
+                           vpl::codec_format_fourcc codec_type,
+                           vpl::rate_control_method bitrate_mode,
+                           const EncoderParams& encoder_params,
+                           std::unique_ptr<VideoEncoder>* video_encoder,
+                           bool* reused_session) {
+  *video_encoder = session_pool ? session_pool->acquire(session_key) : nullptr;
+  *reused_session = *video_encoder != nullptr;
+  auto init_start_time = time_since_epoch();
+  try {
+    if (*reused_session) {
+      try {
+        (*video_encoder)->set_frame_source(frame_source);
+        (*video_encoder)->reset(info, codec_type, bitrate_mode, encoder_params);
+      } catch (vpl::base_exception& e) {
+        // The pooled session is closed, a new one may still take the stream.
+        std::cout << "Session reset failed, initializing a new one: " << e.what() << std::endl;
+        video_encoder->reset();
+        *reused_session = false;
+        init_start_time = time_since_epoch();
+      }
+    }
+    if (!*reused_session) {
+      if (fresh_session && *fresh_session) {
+        *video_encoder = std::move(*fresh_session);
+        (*video_encoder)->set_frame_source(frame_source);
+      } else {
+        *video_encoder = std::make_unique<VideoEncoder>(impl_sel, frame_source);
+      }
+      (*video_encoder)->init(info, codec_type, bitrate_mode, {}, encoder_params);
+    }
+  } catch (vpl::base_exception& e) {
+    std::cout << "Encoder init failed: " << e.what() << std::endl;
+    return EIO;
+  }
+  if (session_pool) {
+    const int init_time = time_since_epoch() - init_start_time;
+    if (*reused_session) {
+      session_pool->record_hit(init_time);
+    } else {
+      session_pool->record_miss(init_time);
+    }
+  }
+  return 0;
+}
+
+// Submits the next frame. The session reads it from the frame source, zero
+// copy input is read here into a free surface. Returns EIO when the encoder
+// holds all surfaces, 0 otherwise.
+static int submit_frame(VideoEncoder* video_encoder,
+                        JobInput* input,
+                        std::shared_ptr<vpl::bitstream_as_dst> bitstream,
+                        const vpl::encoder_process_list& encoder_process_list,
+                        vpl::status* status) {
+  if (!input->frame_pool) {
+    TraceScope trace{"submit"};
+    *status = video_encoder->encode(bitstream, encoder_process_list);
+    return 0;
+  }
+  auto& frame_pool = *input->frame_pool;
+  frame_pool.collect();
+  mfxFrameSurface1* surface = nullptr;
+  if (!input->eos) {
+    surface = frame_pool.acquire();
+    if (!surface) {
+      std::cout << "Encoder holds all " << kZeroCopyFrames << " input frames" << std::endl;
+      return EIO;
+    }
+    TraceScope trace{"read"};
+    if (!read_frame(input->file, frame_pool.layout(), surface)) {
+      frame_pool.cancel(surface);
+      surface = nullptr;
+      input->eos = true;
+    }
+  }
+  {
+    TraceScope trace{"submit"};
+    *status = video_encoder->encode(surface, bitstream, encoder_process_list);
+  }
+  if (surface) {
+    frame_pool.submit(surface);
+  }
+  return 0;
+}
+
+// Fills the frame info of an encoded frame: size, type, time stamps, the
+// input frame it came from with its latency, and the frame syntax. Returns
+// the arrival of the input frame, unset when it isn't known.
+static std::chrono::steady_clock::time_point describe_frame(
+    const vpl::bitstream_as_dst& bitstream,
+    const uint8_t* data,
+    uint32_t size,
+    VideoEncoder* video_encoder,
+    const PacedFrameReader* paced_reader,
+    std::optional<BitstreamAnalyzer>& analyzer,
+    FrameInfo* frame_info,
+    long* parse_time_ns) {
+  frame_info->stop_time = time_since_epoch();
+  frame_info->size = bitstream.get_DataLength();
+  frame_info->iframe = (bitstream.get_FrameType() & MFX_FRAMETYPE_I) ? 1 : 0;
+  // Frames come out in coding order, the PTS leads back to the input frame.
+  const int64_t pts = static_cast<int64_t>(bitstream.get_TimeStamp());
+  int64_t dts = bitstream.get_DecodeTimeStamp();
+  if (dts == static_cast<int64_t>(MFX_TIMESTAMP_UNKNOWN)) {
+    dts = pts;
+  }
+  frame_info->pts = pts;
+  frame_info->dts = dts;
+  frame_info->input_frame = -1;
+  frame_info->lateness_us = -1;
+  std::chrono::steady_clock::time_point capture{};
+  if (const auto input = video_encoder->match_input_frame(pts)) {
+    if (bitstream.get_FrameType() & MFX_FRAMETYPE_IDR) {
+      video_encoder->idr_encoded(input->index);
+    }
+    capture = input->arrival;
+    frame_info->input_frame = input->index;
+    frame_info->reorder_delay = input->frames_after;
+    frame_info->latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now() - input->arrival)
+                                 .count();
+    if (paced_reader && input->index < paced_reader->lateness_us().size()) {
+      frame_info->lateness_us = paced_reader->lateness_us()[input->index];
+    }
+  }
+  frame_info->qp = -1;
+  if (analyzer) {
+    TraceScope trace{"parse"};
+    const auto parse_start = std::chrono::steady_clock::now();
+    try {
+      auto syntax = analyzer->analyze(data, size);
+      frame_info->qp = syntax.qp;
+      frame_info->temporal_id = syntax.temporal_id;
+      frame_info->nal_types = std::move(syntax.nal_types);
+      frame_info->parameter_set_bytes = syntax.parameter_set_bytes;
+      frame_info->sei_bytes = syntax.sei_bytes;
+      frame_info->slice_bytes = syntax.slice_bytes;
+    } catch (std::runtime_error& e) {
+      std::cout << "Couldn't parse encoded frame: " << e.what() << std::endl;
+    }
+    *parse_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - parse_start)
+                          .count();
+  }
+  return capture;
+}
+
+// Publishes an encoded frame and the queue depths behind it. reported_drops
+// counts the paced input drops already published.
+static void publish_frame_metrics(Metrics* metrics,
+                                  const FrameInfo& frame_info,
+                                  const AsyncWriter& async_writer,
+                                  const VideoEncoder& video_encoder,
+                                  const PacedFrameReader* paced_reader,
+                                  size_t* reported_drops) {
+  metrics->add_frame(frame_info.size, frame_info.input_frame >= 0 ? frame_info.latency_us : -1);
+  metrics->set_writer_queue_depth(async_writer.queued_frames());
+  metrics->set_encoder_queue_depth(video_encoder.frames_in_flight());
+  if (paced_reader) {
+    metrics->add_dropped_frames(paced_reader->dropped_frames() - *reported_drops);
+    *reported_drops = paced_reader->dropped_frames();
+    metrics->set_input_queue_depth(paced_reader->queue_depth());
+  }
+}
+
+// Records the frame size for the first pass or the second pass allocation.
+static void update_pass_stats(const EncodeJob& job,
+                              const FrameInfo& frame_info,
+                              FirstPassStats* first_pass_stats,
+                              std::optional<BitAllocator>& bit_allocator) {
+  // Both passes index frames in display order.
+  const size_t display_frame =
+      frame_info.input_frame >= 0 ? frame_info.input_frame : frame_info.counter;
+  if (job.pass == 1) {
+    if (first_pass_stats->frames.size() <= display_frame) {
+      first_pass_stats->frames.resize(display_frame + 1);
+    }
+    first_pass_stats->frames[display_frame] = {static_cast<uint32_t>(frame_info.size),
+                                               frame_info.iframe != 0};
+  } else if (bit_allocator) {
+    bit_allocator->update(display_frame, frame_info.size);
+  }
+}
+
+// Output latencies of the measured frames, the writer also saw the warmup ones.
+static void fill_output_latencies(const AsyncWriter& async_writer,
+                                  size_t warmup_frames,
+                                  StatsDataFrame* stats_data_frame) {
+  const auto& output_latencies = async_writer.output_latencies();
+  for (size_t i = 0; i + warmup_frames < output_latencies.size() &&
+                     i < stats_data_frame->frame_info.size();
+       i++) {
+    const auto& latency = output_latencies[i + warmup_frames];
+    stats_data_frame->frame_info[i].first_byte_latency_us = latency.first_byte_us;
+    stats_data_frame->frame_info[i].last_byte_latency_us = latency.last_byte_us;
+  }
+}
+
+static void fill_counter_stats(const PerfCounterValues& counters,
+                               StatsDataFrame* stats_data_frame) {
+  stats_data_frame->counters.cycles = counters.cycles;
+  stats_data_frame->counters.instructions = counters.instructions;
+  stats_data_frame->counters.llc_references = counters.llc_references;
+  stats_data_frame->counters.llc_misses = counters.llc_misses;
+  stats_data_frame->counters.branches = counters.branches;
+  stats_data_frame->counters.branch_misses = counters.branch_misses;
+  stats_data_frame->counters.ipc = ipc(counters);
+  stats_data_frame->counters.llc_mpki = llc_mpki(counters);
+  stats_data_frame->counters.llc_miss_rate = llc_miss_rate(counters);
+  stats_data_frame->counters.branch_miss_rate = branch_miss_rate(counters);
+}
+
+static void fill_pacing_stats(const EncodeJob& job,
+                              PacingPolicy pacing_policy,
+                              const PacedFrameReader& paced_reader,
+                              StatsDataFrame* stats_data_frame) {
+  const auto& lateness_us = paced_reader.lateness_us();
+  stats_data_frame->pacing.policy = to_string(pacing_policy);
+  stats_data_frame->pacing.rate = job.frame_rate;
+  stats_data_frame->pacing.frames = lateness_us.size();
+  stats_data_frame->pacing.late_frames = paced_reader.late_frames();
+  stats_data_frame->pacing.dropped_frames = paced_reader.dropped_frames();
+  stats_data_frame->pacing.max_lateness_us =
+      lateness_us.empty() ? 0 : *std::max_element(lateness_us.begin(), lateness_us.end());
+  stats_data_frame->pacing.p99_lateness_us =
+      percentile(std::vector<double>(lateness_us.begin(), lateness_us.end()), 0.99);
+  stats_data_frame->pacing.queue_frames =
+      pacing_policy == PacingPolicy::queue ? 0 : job.input_queue;
+  stats_data_frame->pacing.blocked_us = paced_reader.blocked_us();
+  for (const auto& event : paced_reader.events()) {
+    stats_data_frame->backpressure.push_back({static_cast<long>(event.frame),
+                                              to_string(event.action),
+                                              static_cast<long>(event.frames),
+                                              static_cast<long>(event.queue_depth),
+                                              event.target_usage,
+                                              event.blocked_us});
+  }
+  std::cout << "Paced at " << job.frame_rate << " fps: " << paced_reader.late_frames()
+            << " late and " << paced_reader.dropped_frames() << " dropped frames" << std::endl;
+}
+
+static void fill_complexity_stats(const EncodeJob& job,
+                                  const ComplexityController& complexity,
+                                  StatsDataFrame* stats_data_frame) {
+  stats_data_frame->complexity.target_fps = job.target_fps;
+  stats_data_frame->complexity.budget_us = complexity.budget_us();
+  for (const auto& change : complexity.changes()) {
+    stats_data_frame->complexity.changes.push_back(
+        {static_cast<long>(change.frame), change.target_usage, change.frame_time_us});
+  }
+  std::cout << "Target usage " << complexity.target_usage() << " after "
+            << complexity.changes().size() << " changes" << std::endl;
+}
+
+int run_encode_job(const EncodeJob& job,
+                   vpl::implementation_selector& impl_sel,
+                   StatsDataFrame* stats_data_frame,
+                   const FrameCallback& on_frame,
+                   SessionPool* session_pool,
+                   Metrics* metrics,
+                   std::unique_ptr<VideoEncoder>* fresh_session) {
+  const auto startup_start_time = time_since_epoch();
+  set_trace_thread_name("encode");
+  const int frame_height = job.height;
+  const int frame_width = job.width;
+  const int frame_rate = job.frame_rate;
+  const auto codec_type = codec_formats.at(job.codec_type);
+  const auto chroma_format = chroma_formats.at(job.chroma_format);
+
+  EncoderParams encoder_params{};
+  vpl::rate_control_method bitrate_mode{};
+  FirstPassStats first_pass_stats{};
+  std::optional<BitAllocator> bit_allocator{};
+  if (const int error = make_encoder_settings(
+          job, &encoder_params, &bitrate_mode, &first_pass_stats, &bit_allocator)) {
+    return error;
+  }
+
+  // The session threads inherit the affinity of the thread creating it. The
+  // calling thread gets its own back when the job ends, a server worker runs
+  // later jobs with other cpusets or its NUMA node pinning.
+  std::optional<ThreadAffinityGuard> affinity_guard{};
+  if (!job.cpuset.empty()) {
+    affinity_guard.emplace();
+    try {
+      if (!pin_thread_to_cpuset(job.cpuset)) {
+        std::cout << "Couldn't pin to cpuset " << job.cpuset << std::endl;
+      }
+    } catch (std::invalid_argument& e) {
+      std::cout << e.what() << std::endl;
+      return EINVAL;
+    }
+  }
+
+  PacingPolicy pacing_policy{};
+  std::optional<ComplexityController> complexity{};
+  if (const int error = make_rate_adaptation(job, &encoder_params, &pacing_policy, &complexity)) {
+    return error;
+  }
+
+  // Setup input and output files
+  JobInput input{};
+  if (const int error = open_input(job, &input)) {
+    return error;
+  }
+  // Bitstreams are returned by the writer thread, the pool outlives the writer.
+  BitstreamPool bitstream_pool{kBitstreams};
+  std::unique_ptr<AsyncWriter> async_writer{};
+  SegmentWriter* segment_writer = nullptr;
+  if (const int error = open_output(job, &async_writer, &segment_writer)) {
+    return error;
+  }
+
+  std::ofstream output_stats_file{job.stats_filename, std::ios_base::out | std::ios_base::binary};
+  if (!output_stats_file) {
+    std::cout << "Couldn't open stats file" << std::endl;
+    return ENOENT;
+  }
+
+  // Statistics data frame
+  stats_data_frame->settings.codec = job.codec_type;
+  stats_data_frame->settings.gop = -1;
+  stats_data_frame->settings.fps = frame_rate;
+  stats_data_frame->settings.bitrate = job.bitrate ? std::to_string(job.bitrate) + " kbps" : "";
+  stats_data_frame->settings.mean_bitrate = "";
+  stats_data_frame->settings.width = frame_width;
+  stats_data_frame->settings.height = frame_height;
+
+  bool is_stillgoing = true;
+  const auto input_fourcc = color_formats.at(input_color_format(job));
+  if (const int error = make_frame_source(job,
+                                          input_fourcc,
+                                          pacing_policy,
+                                          encoder_params.target_usage,
+                                          &input,
+                                          stats_data_frame)) {
+    return error;
+  }
+  PacedFrameReader* paced_reader = input.paced_reader.get();
+
+  const SessionKey session_key{job.codec_type,
+                               input_color_format(job),
+                               frame_width,
+                               frame_height,
+                               job.use_hw,
+                               job.threads,
+                               job.cpuset,
+                               job.numa_node,
+                               bitrate_mode,
+                               encoder_params.async_depth,
+                               encoder_params.gop_ref_dist};
+
+  vpl::frame_info info{};
+  info.set_frame_rate({frame_rate, 1});
+  info.set_frame_size({ALIGN16(frame_height), ALIGN16(frame_width)});
+  info.set_FourCC(input_fourcc);
+  info.set_ChromaFormat(chroma_format);
+  info.set_ROI({{0, 0}, {frame_height, frame_width}});
+  info.set_PicStruct(vpl::pic_struct::progressive);
+
+  std::unique_ptr<VideoEncoder> video_encoder{};
+  bool reused_session = false;
+  if (const int error = acquire_session(impl_sel,
+                                        session_pool,
+                                        fresh_session,
+                                        session_key,
+                                        input.frame_source,
+                                        info,
+                                        codec_type,
+                                        bitrate_mode,
+                                        encoder_params,
+                                        &video_encoder,
+                                        &reused_session)) {
+    return error;
+  }
+  std::cout << info << std::endl;
+  std::cout << (reused_session ? "Reset done" : "Init done") << std::endl;
+  std::cout << "Encoding " << job.input_filename << " -> " << job.output_filename << std::endl;
+  std::cout << "Statistics " << job.stats_filename << std::endl;
+
+  // Restarted once the warmup frames are encoded.
+  auto encoding_start_time = time_since_epoch();
+  // Cpu time of the session threads and the thread submitting frames, other
+  // jobs of the process are left out.
+  auto job_threads = video_encoder->session_threads();
+  job_threads.push_back(current_thread());
+  auto encoding_start_cpu = cpu_times(job_threads);
+  // Opened on the threads themselves, a pooled session started its threads
+  // before this job.
+  std::optional<PerfCounters> perf_counters{};
+  if (job.perf_counters) {
+    perf_counters.emplace(job_threads);
+    if (!perf_counters->available()) {
+      std::cout << "Hardware counters unavailable: " << perf_counters->error() << std::endl;
+      stats_data_frame->counters.error = perf_counters->error();
+      perf_counters.reset();
+    }
+  }
+  auto read_counters = [&perf_counters] {
+    return perf_counters ? perf_counters->read() : PerfCounterValues{};
+  };
+  stats_data_frame->counters.enabled = job.perf_counters;
+  stats_data_frame->counters.available = perf_counters.has_value();
+  auto encoding_start_counters = read_counters();
+  stats_data_frame->startup_time = encoding_start_time - startup_start_time;
+  const auto loop_end = std::chrono::steady_clock::now() +
+                        std::chrono::duration<double>(job.loop_duration);
+  int warmup_frames = job.warmup_frames;
+  int output_frames = 0;
+  size_t input_frame = 0;
+  bool drained = false;
+  std::optional<ControlFile> control_file{};
+  if (!job.control_filename.empty()) {
+    control_file.emplace(job.control_filename);
+  }
+  int64_t frame_duration = kTimescale / frame_rate;
+  // Frame syntax is read inline, the parser only touches headers.
+  std::optional<BitstreamAnalyzer> analyzer{};
+  if (job.codec_type == "avc" || job.codec_type == "hevc" || job.codec_type == "av1") {
+    analyzer.emplace(nal_codec_from_string(job.codec_type));
+  }
+  long parse_time_ns = 0;
+  PerfCounterValues frame_counters{};
+  // Paced input drops already counted in metrics.
+  size_t reported_drops = 0;
+  // Target usage of the frames submitted, 0 for the implementation default.
+  uint16_t target_usage = encoder_params.target_usage;
+  std::optional<uint16_t> next_target_usage{};
+  // main encoder Loop
+  while (is_stillgoing == true) {
+    if (input.memory_reader && job.loop_duration > 0 && !input.memory_reader->is_EOS() &&
+        std::chrono::steady_clock::now() >= loop_end) {
+      input.memory_reader->stop();
+    }
+    FrameInfo frame_info{};
+    vpl::status wrn = vpl::status::Ok;
+    auto bitstream = bitstream_pool.acquire();
+
+    vpl::encoder_process_list encoder_process_list;
+    // Second pass frame QP is applied as a QP delta over the whole frame.
+    auto frame_qp = std::make_unique<vpl::ExtEncoderROI>();
+    if (bit_allocator) {
+      frame_qp->get_ref().NumROI = 1;
+      frame_qp->get_ref().ROIMode = MFX_ROI_MODE_QP_DELTA;
+      frame_qp->get_ref().ROI[0].Left = 0;
+      frame_qp->get_ref().ROI[0].Top = 0;
+      frame_qp->get_ref().ROI[0].Right = ALIGN16(frame_height);
+      frame_qp->get_ref().ROI[0].Bottom = ALIGN16(frame_width);
+      frame_qp->get_ref().ROI[0].DeltaQP =
+          bit_allocator->frame_qp(input_frame) - first_pass_stats.qp;
+      encoder_process_list.add_buffer(frame_qp.get());
+    }
+    if (control_file) {
+      auto reconfiguration = control_file->poll();
+      // Constant quality modes have no bitrate the encoder would follow.
+      if (reconfiguration && (reconfiguration->target_kbps || reconfiguration->max_kbps) &&
+          !has_target_bitrate(bitrate_mode)) {
+        std::cout << "Ignoring bitrate change, the bitrate mode has no target bitrate"
+                  << std::endl;
+        reconfiguration->target_kbps = 0;
+        reconfiguration->max_kbps = 0;
+      }
+      if (reconfiguration && (reconfiguration->target_kbps || reconfiguration->max_kbps ||
+                              reconfiguration->frame_rate)) {
+        std::cout << "Reconfigure at frame " << input_frame << std::endl;
+        video_encoder->reconfigure(*reconfiguration);
+        if (reconfiguration->frame_rate) {
+          frame_duration = kTimescale / reconfiguration->frame_rate;
+          if (paced_reader) {
+            paced_reader->set_rate(reconfiguration->frame_rate);
+          }
+        }
+      }
+    }
+    // Complexity the adapt policy or the controller asked for with the
+    // previous frame.
+    if (!next_target_usage && paced_reader) {
+      next_target_usage = paced_reader->take_target_usage();
+    }
+    if (next_target_usage) {
+      Reconfiguration reconfiguration{};
+      reconfiguration.target_usage = *next_target_usage;
+      video_encoder->reconfigure(reconfiguration);
+      target_usage = *next_target_usage;
+      next_target_usage.reset();
+    }
+    // Time waiting for paced frames to arrive isn't encode time.
+    const auto submit_start = std::chrono::steady_clock::now();
+    const long waited_start_us = paced_reader ? paced_reader->waited_us() : 0;
+    try {
+      frame_info.start_time = time_since_epoch();
+      frame_counters = read_counters();
+      if (const int error =
+              submit_frame(video_encoder.get(), &input, bitstream, encoder_process_list, &wrn)) {
+        return error;
+      }
+      ++input_frame;
+    } catch (vpl::base_exception& e) {
+      std::cout << "Encoder died: " << e.what() << std::endl;
+      return EIO;
+    }
+
+    switch (wrn) {
+    case vpl::status::Ok: {
+      std::chrono::duration<int, std::milli> timeout(kTimeout100Ms);
+      {
+        TraceScope trace{"sync"};
+        bitstream->wait_for(timeout);
+      }
+      // Counted on all encoder threads from submit to bitstream ready.
+      const auto counters = read_counters() - frame_counters;
+      frame_info.ipc = ipc(counters);
+      frame_info.llc_mpki = llc_mpki(counters);
+      frame_info.target_usage = target_usage;
+      if (complexity) {
+        const long waited_us = paced_reader ? paced_reader->waited_us() - waited_start_us : 0;
+        next_target_usage = complexity->add_frame(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - submit_start)
+                .count() -
+            waited_us);
+      }
+      const bool key = bitstream->get_FrameType() & MFX_FRAMETYPE_IDR;
+      const auto [data, size] = bitstream->get_valid_data();
+      const auto capture = describe_frame(*bitstream,
+                                          data,
+                                          size,
+                                          video_encoder.get(),
+                                          paced_reader,
+                                          analyzer,
+                                          &frame_info,
+                                          &parse_time_ns);
+      try {
+        async_writer->write({data,
+                              size,
+                              key,
+                              frame_info.pts,
+                              frame_info.dts,
+                              frame_duration,
+                              bitstream_pool.lend(std::move(bitstream)),
+                              capture});
+      } catch (std::runtime_error& e) {
+        std::cout << "Couldn't write encoded frame: " << e.what() << std::endl;
+        return EIO;
+      }
+      if (metrics) {
+        publish_frame_metrics(
+            metrics, frame_info, *async_writer, *video_encoder, paced_reader, &reported_drops);
+      }
+      TraceScope stats_trace{"stats"};
+      frame_info.counter = output_frames++;
+      update_pass_stats(job, frame_info, &first_pass_stats, bit_allocator);
+      // Warmup frames pay for page cache misses and encoder start up.
+      if (warmup_frames > 0) {
+        if (--warmup_frames == 0) {
+          encoding_start_time = time_since_epoch();
+          encoding_start_cpu = cpu_times(job_threads);
+          encoding_start_counters = read_counters();
+          parse_time_ns = 0;
+        }
+        break;
+      }
+      if (on_frame) {
+        on_frame(frame_info);
+      }
+      stats_data_frame->frame_info.emplace_back(std::move(frame_info));
+    } break;
+    case vpl::status::EndOfStreamReached:
+      std::cout << "EndOfStream Reached" << std::endl;
+      is_stillgoing = false;
+      drained = true;
+      break;
+    case vpl::status::DeviceBusy:
+      // For non-CPU implementations,
+      // Wait a few milliseconds then try again
+      std::cout << "DeviceBusy" << std::endl;
+      break;
+    default:
+      std::cout << "unknown status: " << static_cast<int>(wrn) << std::endl;
+      is_stillgoing = false;
+      break;
+    }
+    if (bitstream) {
+      bitstream_pool.release(std::move(bitstream));
+    }
+  }
+  try {
+    async_writer->close();
+  } catch (std::runtime_error& e) {
+    std::cout << "Couldn't write encoded stream: " << e.what() << std::endl;
+    return EIO;
+  }
+  if (segment_writer) {
+    stats_data_frame->segments = segment_writer->segments();
+  }
+  fill_output_latencies(*async_writer, job.warmup_frames - warmup_frames, stats_data_frame);
+  const auto encoding_end_time = time_since_epoch();
+  const auto encoding_end_cpu = cpu_times(job_threads);
+  const auto counters = read_counters() - encoding_start_counters;
+  stats_data_frame->id = "42";
+  stats_data_frame->description = "onevpl encoder test";
+  stats_data_frame->test = "test encoder parameters";
+  stats_data_frame->test_definition = "n/a";
+  stats_data_frame->date = "today";
+  stats_data_frame->encapp_version = "1.6";
+  stats_data_frame->proctime = encoding_end_time - encoding_start_time;
+  stats_data_frame->framecount = stats_data_frame->frame_info.size();
+  stats_data_frame->warmup_frames = job.warmup_frames - warmup_frames;
+  stats_data_frame->parse_time_ns =
+      stats_data_frame->framecount ? parse_time_ns / stats_data_frame->framecount : 0;
+  stats_data_frame->encoded_file = job.output_filename;
+  stats_data_frame->source_file = job.input_filename;
+  if (input.arena) {
+    stats_data_frame->arena = input.arena->info();
+  }
+  stats_data_frame->cpu.threads = job.threads;
+  stats_data_frame->cpu.cpuset = job.cpuset;
+  stats_data_frame->cpu.cores = allowed_cpus();
+  stats_data_frame->cpu.user_time = (encoding_end_cpu.user - encoding_start_cpu.user) / 1000;
+  stats_data_frame->cpu.system_time =
+      (encoding_end_cpu.system - encoding_start_cpu.system) / 1000;
+  stats_data_frame->cpu.utilization = cpu_utilization(encoding_start_cpu, encoding_end_cpu);
+  fill_counter_stats(counters, stats_data_frame);
+  stats_data_frame->pacing.enabled = paced_reader != nullptr;
+  if (paced_reader) {
+    fill_pacing_stats(job, pacing_policy, *paced_reader, stats_data_frame);
+  }
+  stats_data_frame->complexity.enabled = complexity.has_value();
+  if (complexity) {
+    fill_complexity_stats(job, *complexity, stats_data_frame);
+  }
+  stats_data_frame->numa.node = job.numa_node;
+  stats_data_frame->numa.fps =
+      stats_data_frame->proctime
+          ? stats_data_frame->framecount * 1000.0 / stats_data_frame->proctime
+          : 0;
+  for (const auto& event : video_encoder->reconfigure_events()) {
+    stats_data_frame->reconfigures.push_back({static_cast<int>(event.frame),
+                                              event.reconfiguration.target_kbps,
+                                              event.reconfiguration.max_kbps,
+                                              event.reconfiguration.frame_rate,
+                                              event.reconfiguration.target_usage,
+                                              event.reconfiguration.at_idr,
+                                              event.stall_time_us});
+  }
+
+  std::cout << "Encoded " << stats_data_frame->frame_info.size() << " frames" << std::endl;
+
+  if (job.pass == 1) {
+    std::ofstream pass_stats_file{job.pass_stats_filename,
+                                  std::ios_base::out | std::ios_base::binary};
+    if (!pass_stats_file) {
+      std::cout << "Couldn't open first pass stats file" << std::endl;
+      return ENOENT;
+    }
+    write_first_pass_stats(first_pass_stats, pass_stats_file);
+    std::cout << "First pass stats " << job.pass_stats_filename << std::endl;
+  }
+
+  std::cout << "\n-- Encode information --\n\n";
+  const auto video_param = video_encoder->get_working_params();
+  std::cout << *(video_param.get()) << std::endl;
+  if (session_pool) {
+    if (drained) {
+      session_pool->release(session_key, std::move(video_encoder));
+    }
+    stats_data_frame->session_pool = session_pool->info();
+    stats_data_frame->session_pool.reused = reused_session;
+  }
+  TraceScope trace{"stats"};
+  Statistics stats{*stats_data_frame};
+  stats.write(output_stats_file);
+  return 0;
+}
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "nlohmann/json.hpp"
+#include "vpl/preview/vpl.hpp"
+
+#include "metrics/metrics.hpp"
+#include "paced_frame_reader/paced_frame_reader.hpp"
+#include "session_pool/session_pool.hpp"
+#include "statistics/statistics.hpp"
+
+// Single encode, holds the encodeapp options.
+struct EncodeJob {
+  std::string input_filename;
+  std::string output_filename;
+  std::string stats_filename;
+  std::string pass_stats_filename;
+  int height = 0;
+  int width = 0;
+  int frame_rate = 30;
+  std::string codec_type = "hevc";
+  std::string color_format;
+  std::string chroma_format = "yuv420";
+  std::string bitrate_mode = "cqp";
+  int bitrate = 0;
+  bool use_hw = false;
+  int pass = 0;
+  uint64_t target_size = 0;
+  std::string control_filename;
+  bool zero_copy = false;
+  // "default" or "hugepage" backs the zero copy frames with an arena.
+  std::string arena;
+  bool prefault = false;
+  // "raw" elementary stream, "mp4" fragmented MP4, "ivf" or "auto".
+  std::string container = "auto";
+  // Seconds of the segments of segmented output, 0 writes a single file.
+  double segment_duration = 0;
+  // Segments listed in the rolling playlist.
+  int playlist_size = 5;
+  // Software encoder threads, 0 lets the implementation decide.
+  int threads = 0;
+  // Kernel cpu list the encode threads run on, such as "0-3,8".
+  std::string cpuset;
+  // No B-frames or lookahead and a single frame in flight, each frame is
+  // flushed to the output as soon as it is encoded.
+  bool low_latency = false;
+  // Slices per frame, 0 lets the implementation decide.
+  int slices = 0;
+  // Reads the input, or its first preload_frames frames, into memory before
+  // encoding. Looping preloads the input too.
+  bool preload = false;
+  int preload_frames = 0;
+  // Passes over the preloaded input, or seconds to loop over it when set.
+  int loops = 1;
+  double loop_duration = 0;
+  // Frames encoded before measuring, left out of the statistics.
+  int warmup_frames = 0;
+  // Hardware counters around encoding, skipped when the kernel refuses them.
+  bool perf_counters = false;
+  // Reads the input at the frame rate as from a live source, empty reads
+  // frames as fast as the encoder takes them. The policy for a full input
+  // queue of input_queue frames is "queue", which never fills, "block",
+  // "drop-oldest", "drop-newest" or "adapt" for a faster target usage.
+  std::string pacing;
+  int input_queue = kInputQueueFrames;
+  // Moves the target usage to encode at target_fps with the best quality
+  // that holds it, 0 keeps the target usage fixed.
+  double target_fps = 0;
+  // NUMA node the job thread is pinned to, chosen by the runner and not
+  // part of the job description.
+  int numa_node = -1;
+};
+
+void to_json(nlohmann::json& json, const EncodeJob& job);
+void from_json(const nlohmann::json& json, EncodeJob& job);
+
+// Derives output, statistics and first pass file names from the input file
+// name when they are not set.
+void set_default_filenames(EncodeJob* job);
+
+// Input color format name, defaults to the native format of the implementation.
+std::string input_color_format(const EncodeJob& job);
+
+std::unique_ptr<oneapi::vpl::default_selector> make_impl_selector(const EncodeJob& job);
+
+using FrameCallback = std::function<void(const FrameInfo&)>;
+
+// Encodes the job to the end, writes the encoded stream and the statistics
+// file. on_frame is called for every encoded frame. Fields of
+// stats_data_frame that the job does not measure are kept as set by the
+// caller. With session_pool the session is taken from and returned to the
+// pool. Warmup frames included, every encoded frame is counted in metrics.
+// fresh_session is an uninitialized session of impl_sel, taken when the job
+// needs a new session instead of creating one. Returns 0 or errno value.
+int run_encode_job(const EncodeJob& job,
+                   oneapi::vpl::implementation_selector& impl_sel,
+                   StatsDataFrame* stats_data_frame,
+                   const FrameCallback& on_frame = {},
+                   SessionPool* session_pool = nullptr,
+                   Metrics* metrics = nullptr,
+                   std::unique_ptr<VideoEncoder>* fresh_session = nullptr);
+
+long time_since_epoch();
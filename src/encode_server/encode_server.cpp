@@ -0,0 +1,352 @@
+// SPDX-License-Identifier: MIT
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "encode_server.hpp"
+
+namespace vpl = oneapi::vpl;
+
+constexpr const int kListenBacklog = 16;
+constexpr const size_t kReadChunk = 4096;
+constexpr const size_t kIdleSessionsPerWorker = 2;
+// Time a client gets to send its job, in total, before the next one is
+// accepted.
+constexpr const int kRequestTimeoutMs = 5000;
+// Time a reply may wait for a client that stopped reading.
+constexpr const int kSendTimeoutMs = 5000;
+
+static sockaddr_un make_address(const std::string& socket_path) {
+  sockaddr_un address{};
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Socket path too long: " + socket_path);
+  }
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+  return address;
+}
+
+static bool send_line(int fd, const nlohmann::json& message) {
+  const auto line = message.dump() + "\n";
+  size_t sent = 0;
+  while (sent < line.size()) {
+    const auto ret = send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      return false;
+    }
+    sent += ret;
+  }
+  return true;
+}
+
+// Reads up to the next new line, buffer keeps what was read past it. Gives up
+// after timeout_ms in total, -1 waits as long as it takes.
+static bool read_line(int fd, std::string* buffer, std::string* line, int timeout_ms = -1) {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{timeout_ms};
+  auto end = buffer->find('\n');
+  while (end == std::string::npos) {
+    if (timeout_ms >= 0) {
+      const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 deadline - std::chrono::steady_clock::now())
+                                 .count();
+      pollfd pfd{fd, POLLIN, 0};
+      const int ready = remaining > 0 ? poll(&pfd, 1, static_cast<int>(remaining)) : 0;
+      if (ready < 0 && errno == EINTR) {
+        continue;
+      }
+      if (ready <= 0) {
+        return false;
+      }
+    }
+    char chunk[kReadChunk];
+    const auto ret = read(fd, chunk, sizeof(chunk));
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      return false;
+    }
+    buffer->append(chunk, ret);
+    end = buffer->find('\n');
+  }
+  *line = buffer->substr(0, end);
+  buffer->erase(0, end + 1);
+  return true;
+}
+
+static long elapsed_ms(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                               since)
+      .count();
+}
+
+EncodeServer::EncodeServer(std::string socket_path,
+                           int workers,
+                           const EncodeJob& warm_up_job,
+                           const NumaPolicy& numa_policy) :
+  socket_path_{std::move(socket_path)},
+  listen_fd_{-1},
+  stopping_{false},
+  session_pool_{kIdleSessionsPerWorker * workers},
+  numa_topology_{numa_topology()} {
+  const auto address = make_address(socket_path_);
+  // Remove the socket left behind by a previous server, never a regular file.
+  struct stat socket_stat {};
+  if (lstat(socket_path_.c_str(), &socket_stat) == 0 && S_ISSOCK(socket_stat.st_mode)) {
+    unlink(socket_path_.c_str());
+  }
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+  }
+  // Jobs read and write files as the server user, only that user may connect.
+  // The socket is created 0600 rather than changed after bind to leave no
+  // window, no other threads exist yet to see the umask.
+  const mode_t old_umask = umask(S_IRWXG | S_IRWXO | S_IXUSR);
+  const int bound =
+      bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+  umask(old_umask);
+  if (bound < 0 || listen(listen_fd_, kListenBacklog) < 0) {
+    const std::string error = std::strerror(errno);
+    close(listen_fd_);
+    throw std::runtime_error("Couldn't listen on " + socket_path_ + ": " + error);
+  }
+  for (int i = 0; i < workers; i++) {
+    const int node = numa_node_for(numa_policy, numa_topology_, i);
+    workers_.emplace_back(&EncodeServer::worker_loop, this, warm_up_job, node);
+  }
+}
+
+EncodeServer::~EncodeServer() {
+  stop();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  for (auto& pending : jobs_) {
+    close(pending.client);
+  }
+  close(listen_fd_);
+  unlink(socket_path_.c_str());
+}
+
+void EncodeServer::run() {
+  std::cout << "Listening on " << socket_path_ << std::endl;
+  while (true) {
+    const int client = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      break;
+    }
+    ucred peer{};
+    socklen_t peer_size = sizeof(peer);
+    if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &peer, &peer_size) < 0 ||
+        peer.uid != geteuid()) {
+      send_line(client, {{"type", "done"}, {"status", EACCES}, {"error", "Permission denied"}});
+      close(client);
+      continue;
+    }
+    // Replies are sent from the encode thread, they mustn't stall it.
+    const timeval send_timeout{kSendTimeoutMs / 1000, (kSendTimeoutMs % 1000) * 1000};
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    std::string buffer;
+    std::string line;
+    PendingJob pending{client, {}, std::chrono::steady_clock::now()};
+    try {
+      if (!read_line(client, &buffer, &line, kRequestTimeoutMs)) {
+        close(client);
+        continue;
+      }
+      pending.job = nlohmann::json::parse(line).get<EncodeJob>();
+      set_default_filenames(&pending.job);
+    } catch (nlohmann::json::exception& e) {
+      send_line(client, {{"type", "done"}, {"status", EINVAL}, {"error", e.what()}});
+      close(client);
+      continue;
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (stopping_) {
+      close(client);
+      break;
+    }
+    send_line(client, {{"type", "queued"}, {"position", jobs_.size()}});
+    jobs_.push_back(std::move(pending));
+    jobs_cv_.notify_one();
+  }
+}
+
+void EncodeServer::stop() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (!stopping_) {
+    stopping_ = true;
+    shutdown(listen_fd_, SHUT_RDWR);
+    jobs_cv_.notify_all();
+  }
+}
+
+EncodeServer::WarmSession& EncodeServer::warm_session(const EncodeJob& job,
+                                                      WarmSessions* warm_sessions) {
+  auto& warm = (*warm_sessions)[{job.use_hw, job.codec_type}];
+  if (!warm.impl_sel) {
+    warm.impl_sel = make_impl_selector(job);
+  }
+  if (!warm.session) {
+    warm.session = std::make_unique<VideoEncoder>(*warm.impl_sel, nullptr);
+  }
+  return warm;
+}
+
+void EncodeServer::worker_loop(EncodeJob warm_up_job, int numa_node) {
+  // Pinned before the session exists, so the encoder threads and the memory
+  // they first touch stay on the node too.
+  if (numa_node >= 0 && !pin_thread(numa_topology_[numa_node].cpus)) {
+    std::cout << "Couldn't pin worker to NUMA node " << numa_topology_[numa_node].id << std::endl;
+  }
+  WarmSessions warm_sessions;
+  try {
+    warm_session(warm_up_job, &warm_sessions);
+  } catch (vpl::base_exception& e) {
+    std::cout << "Warm up failed: " << e.what() << std::endl;
+  }
+  while (true) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    jobs_cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+    if (stopping_) {
+      return;
+    }
+    auto pending = std::move(jobs_.front());
+    jobs_.pop_front();
+    lock.unlock();
+    serve(&pending, &warm_sessions, numa_node);
+    close(pending.client);
+  }
+}
+
+nlohmann::json EncodeServer::record_throughput(int numa_node,
+                                               const StatsDataFrame& stats_data_frame) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  auto& throughput = node_throughput_[numa_node];
+  throughput.frames += stats_data_frame.framecount;
+  throughput.proctime += stats_data_frame.proctime;
+  auto nodes = nlohmann::json::array();
+  for (const auto& [node, node_throughput] : node_throughput_) {
+    nodes.push_back({{"node", node},
+                     {"frames", node_throughput.frames},
+                     {"fps",
+                      node_throughput.proctime
+                          ? node_throughput.frames * 1000.0 / node_throughput.proctime
+                          : 0}});
+  }
+  return nodes;
+}
+
+void EncodeServer::serve(PendingJob* pending, WarmSessions* warm_sessions, int numa_node) {
+  if (numa_node >= 0) {
+    pending->job.numa_node = numa_topology_[numa_node].id;
+  }
+  StatsDataFrame stats_data_frame{};
+  stats_data_frame.queue_wait_time = elapsed_ms(pending->queued);
+  const auto startup_start = std::chrono::steady_clock::now();
+  int status = 0;
+  try {
+    auto& warm = warm_session(pending->job, warm_sessions);
+    const int selector_time = elapsed_ms(startup_start);
+    const int client = pending->client;
+    // The job goes on without a client that stopped reading, it only loses
+    // the frame replies.
+    bool streaming = true;
+    status = run_encode_job(
+        pending->job,
+        *warm.impl_sel,
+        &stats_data_frame,
+        [client, &streaming](const FrameInfo& frame_info) {
+          if (!streaming) {
+            return;
+          }
+          const nlohmann::json reply{{"type", "frame"},
+                                     {"frame", frame_info.counter},
+                                     {"iframe", frame_info.iframe},
+                                     {"size", frame_info.size},
+                                     {"proctime", frame_info.stop_time - frame_info.start_time}};
+          if (!send_line(client, reply)) {
+            std::cout << "Client stopped reading, frame replies dropped" << std::endl;
+            streaming = false;
+          }
+        },
+        &session_pool_,
+        nullptr,
+        &warm.session);
+    stats_data_frame.startup_time += selector_time;
+  } catch (vpl::base_exception& e) {
+    send_line(pending->client, {{"type", "done"}, {"status", EIO}, {"error", e.what()}});
+    return;
+  } catch (std::out_of_range& e) {
+    send_line(pending->client, {{"type", "done"}, {"status", EINVAL}, {"error", e.what()}});
+    return;
+  } catch (std::invalid_argument& e) {
+    send_line(pending->client, {{"type", "done"}, {"status", EINVAL}, {"error", e.what()}});
+    return;
+  } catch (std::exception& e) {
+    // Anything else fails the job, never the worker.
+    send_line(pending->client, {{"type", "done"}, {"status", EIO}, {"error", e.what()}});
+    return;
+  }
+  send_line(pending->client,
+            {{"type", "done"},
+             {"status", status},
+             {"queuewaittime", stats_data_frame.queue_wait_time},
+             {"startuptime", stats_data_frame.startup_time},
+             {"proctime", stats_data_frame.proctime},
+             {"framecount", stats_data_frame.framecount},
+             {"encodedfile", stats_data_frame.encoded_file},
+             {"sessionreused", stats_data_frame.session_pool.reused},
+             {"poolhitrate", stats_data_frame.session_pool.hit_rate},
+             {"inittimesaved", stats_data_frame.session_pool.init_time_saved},
+             {"numa", record_throughput(pending->job.numa_node, stats_data_frame)}});
+  // The next job finds a session ready again, created after the reply.
+  try {
+    warm_session(pending->job, warm_sessions);
+  } catch (std::exception& e) {
+    std::cout << "Warm up failed: " << e.what() << std::endl;
+  }
+}
+
+int submit_encode_job(const std::string& socket_path, const EncodeJob& job) {
+  const auto address = make_address(socket_path);
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+    std::cout << "Couldn't connect to " << socket_path << ": " << std::strerror(errno)
+              << std::endl;
+    if (fd >= 0) {
+      close(fd);
+    }
+    return ECONNREFUSED;
+  }
+  int status = EIO;
+  std::string buffer;
+  std::string line;
+  if (send_line(fd, job)) {
+    while (read_line(fd, &buffer, &line)) {
+      std::cout << line << std::endl;
+      const auto message = nlohmann::json::parse(line, nullptr, false);
+      if (!message.is_discarded() && message.value("type", "") == "done") {
+        status = message.value("status", EIO);
+        break;
+      }
+    }
+  }
+  close(fd);
+  return status;
+}
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "encode_job/encode_job.hpp"
+#include "numa/numa.hpp"
+#include "session_pool/session_pool.hpp"
+#include "video_encoder/video_encoder.hpp"
+
+// Runs encode jobs for clients connected over a UNIX socket. Worker threads
+// and the loaded implementations stay resident between jobs, and sessions of
+// finished jobs are reset for the next job with the same stream geometry.
+//
+// Protocol: the client sends an EncodeJob as a single JSON line and the server
+// answers with JSON lines, "queued" once, "frame" per encoded frame and
+// "done" with the job status and timings. Only clients of the server user are
+// served.
+class EncodeServer {
+ public:
+  // Every worker loads the implementation for the warm_up_job codec before
+  // the first client connects. Workers are pinned to NUMA nodes according to
+  // numa_policy, with their frame memory allocated on the same node.
+  EncodeServer(std::string socket_path,
+               int workers,
+               const EncodeJob& warm_up_job,
+               const NumaPolicy& numa_policy = {NumaPolicy::Mode::off, -1});
+  ~EncodeServer();
+
+  // Accepts clients until stop() is called.
+  void run();
+
+  void stop();
+
+ private:
+  struct PendingJob {
+    int client;
+    EncodeJob job;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  // Selector and an uninitialized session holding the implementation loaded,
+  // the next job needing a new session takes it.
+  struct WarmSession {
+    std::unique_ptr<oneapi::vpl::default_selector> impl_sel;
+    std::unique_ptr<VideoEncoder> session;
+  };
+
+  using WarmSessions = std::map<std::pair<bool, std::string>, WarmSession>;
+
+  struct NodeThroughput {
+    long frames;
+    long proctime;
+  };
+
+  void worker_loop(EncodeJob warm_up_job, int numa_node);
+  void serve(PendingJob* pending, WarmSessions* warm_sessions, int numa_node);
+  nlohmann::json record_throughput(int numa_node, const StatsDataFrame& stats_data_frame);
+  static WarmSession& warm_session(const EncodeJob& job, WarmSessions* warm_sessions);
+
+  const std::string socket_path_;
+  int listen_fd_;
+  bool stopping_;
+  std::mutex mutex_;
+  std::condition_variable jobs_cv_;
+  std::deque<PendingJob> jobs_;
+  SessionPool session_pool_;
+  const std::vector<NumaNode> numa_topology_;
+  std::map<int, NodeThroughput> node_throughput_;
+  std::vector<std::thread> workers_;
+};
+
+// Sends the job to the server, prints the server replies to stdout. Returns
+// the job status.
+int submit_encode_job(const std::string& socket_path, const EncodeJob& job);
@@ -1,40 +1,35 @@
 // SPDX-License-Identifier: MIT
 
+#include <pthread.h>
+
 #include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
 
 #include "cxxopts.hpp"
-#include "nlohmann/json.hpp"
 #include "vpl/preview/vpl.hpp"
 
-#include "mapping/mapping.hpp"
+#include "encode_job/encode_job.hpp"
+#include "encode_server/encode_server.hpp"
+#include "impl_cache/impl_cache.hpp"
+#include "metrics/metrics.hpp"
+#include "numa/numa.hpp"
 #include "statistics/statistics.hpp"
-#include "utils.hpp"
-#include "video_encoder/video_encoder.hpp"
-
-constexpr const int kTimeout100Ms = 100;
-
-namespace vpl = oneapi::vpl;
-
-static void write_encoded_stream(std::shared_ptr<vpl::bitstream_as_dst> bits,
-                                 std::ofstream* encoded_file) {
-  auto [ptr, len] = bits->get_valid_data();
-  encoded_file->write(reinterpret_cast<char*>(ptr), len);
-  bits->set_DataLength(0);
-  return;
-}
-
-static long time_since_epoch() {
-  return std::chrono::duration_cast<std::chrono::milliseconds>(
-             std::chrono::system_clock::now().time_since_epoch())
-      .count();
-}
+#include "synthetic_frame_reader/synthetic_frame_reader.hpp"
+#include "trace/trace.hpp"
 
 int main(int argc, char** argv) {
   cxxopts::Options options{"Encode app", "oneVPL encode application."};
   options.add_options(
       "hello_encode",
-      {{"i,input", "Input file", cxxopts::value<std::string>()},
+      {{"i,input",
+        "Input file, or synthetic[:frames=N,complexity=C,scenecut=S,text=0|1,seed=X]",
+        cxxopts::value<std::string>()},
        {"o,output", "Output file", cxxopts::value<std::string>()->default_value("")},
        {"h,height", "Height", cxxopts::value<int>()->default_value("0")},
        {"w,width", "Width", cxxopts::value<int>()->default_value("0")},
@@ -43,7 +38,88 @@ int main(int argc, char** argv) {
        {"color-format", "Color format", cxxopts::value<std::string>()},
        {"chroma-format", "Chroma format", cxxopts::value<std::string>()->default_value("yuv420")},
        {"bitrate-mode", "Bitrate mode", cxxopts::value<std::string>()->default_value("cqp")},
+       {"bitrate", "Target bitrate in kbps", cxxopts::value<int>()->default_value("0")},
+       {"control-file",
+        "JSON file watched for bitrate and frame rate changes",
+        cxxopts::value<std::string>()},
+       {"zero-copy",
+        "Read input into encoder surfaces owned by the application",
+        cxxopts::value<bool>()->default_value("false")},
+       {"arena",
+        "Zero copy frames from an arena of default or hugepage pages",
+        cxxopts::value<std::string>()},
+       {"prefault",
+        "Fault in arena pages at start",
+        cxxopts::value<bool>()->default_value("false")},
+       {"container",
+        "Output container, raw, mp4, ivf or auto for ivf with vp9 and av1",
+        cxxopts::value<std::string>()->default_value("auto")},
+       {"segment-duration",
+        "Split output into segments of N seconds at IDR frames with a playlist",
+        cxxopts::value<double>()->default_value("0")},
+       {"playlist-size",
+        "Segments listed in the rolling playlist",
+        cxxopts::value<int>()->default_value("5")},
+       {"threads",
+        "Software encoder threads, 0 for the implementation default",
+        cxxopts::value<int>()->default_value("0")},
+       {"cpuset",
+        "Run the encode threads on the cpu list, e.g. 0-3,8",
+        cxxopts::value<std::string>()},
+       {"low-latency",
+        "No B-frames or lookahead, one frame in flight, flush every frame",
+        cxxopts::value<bool>()->default_value("false")},
+       {"slices", "Slices per frame", cxxopts::value<int>()->default_value("0")},
+       {"preload",
+        "Load the input, or its first N frames, into memory before encoding",
+        cxxopts::value<int>()->implicit_value("0")},
+       {"loop",
+        "Encode the preloaded input N times, or for a duration such as 30s",
+        cxxopts::value<std::string>()->default_value("1")},
+       {"realtime",
+        "Read input at the frame rate as a live source, with the policy for a full input "
+        "queue: queue, block, drop-oldest, drop-newest or adapt",
+        cxxopts::value<std::string>()->implicit_value("queue")},
+       {"input-queue",
+        "Frames the input queue of real-time input holds",
+        cxxopts::value<int>()->default_value(std::to_string(kInputQueueFrames))},
+       {"target-fps",
+        "Move the target usage to the best quality that encodes at N fps",
+        cxxopts::value<double>()->default_value("0")},
+       {"perf-counters",
+        "Count cycles, instructions, cache and branch misses while encoding",
+        cxxopts::value<bool>()->default_value("false")},
+       {"metrics-file",
+        "Publish live metrics in the Prometheus text format to the file",
+        cxxopts::value<std::string>()},
+       {"metrics-port",
+        "Serve live metrics over HTTP on the localhost port",
+        cxxopts::value<int>()},
+       {"metrics-interval",
+        "Seconds between live metrics updates",
+        cxxopts::value<double>()->default_value("1")},
+       {"trace",
+        "Write a Chrome trace of the encode pipeline to the file",
+        cxxopts::value<std::string>()},
+       {"warmup",
+        "Frames encoded before measuring, left out of the statistics",
+        cxxopts::value<int>()->default_value("0")},
        {"use-hw", "Use hardware implementation", cxxopts::value<bool>()->default_value("false")},
+       {"pass", "Two-pass mode, 1 analyses the input, 2 encodes to the target size",
+        cxxopts::value<int>()->default_value("0")},
+       {"pass-stats", "First pass stats file", cxxopts::value<std::string>()},
+       {"stats", "Statistics file", cxxopts::value<std::string>()},
+       {"target-size", "Second pass target file size in bytes",
+        cxxopts::value<uint64_t>()->default_value("0")},
+       {"server", "Run encode server on the UNIX socket", cxxopts::value<std::string>()},
+       {"workers", "Encode server worker threads", cxxopts::value<int>()->default_value("1")},
+       {"numa",
+        "Session placement: off, auto or node:N",
+        cxxopts::value<std::string>()->default_value("off")},
+       {"connect", "Submit the job to the encode server", cxxopts::value<std::string>()},
+       {"impl-cache",
+        "Validate options against implementation capabilities cached in the file",
+        cxxopts::value<std::string>()->implicit_value(default_impl_cache_path())},
        {"help", "Print usage"}});
   auto result = options.parse(argc, argv);
 
@@ -51,155 +127,228 @@ int main(int argc, char** argv) {
     std::cout << options.help() << std::endl;
     return 0;
   }
-  const bool use_hw_impl = result["use-hw"].as<bool>();
-  const int frame_height = result["height"].as<int>();
-  const int frame_width = result["width"].as<int>();
-  const int frame_rate = result["rate"].as<int>();
-  const std::string input_filename = result["input"].as<std::string>();
-  const auto codec_type = codec_formats.at(result["codec-type"].as<std::string>());
-  const auto chroma_format = chroma_formats.at(result["chroma-format"].as<std::string>());
-  const auto bitrate_mode = bitrate_control_method.at(result["bitrate-mode"].as<std::string>());
 
-  std::string output_filename{};
-  std::string output_stats_filename{};
-  const std::string encoded_file_ext = "." + result["codec-type"].as<std::string>();
-  const auto last_index = input_filename.find_last_of(".");
-  if (last_index == std::string::npos) {
-    output_filename = input_filename + encoded_file_ext;
-    output_stats_filename = input_filename + ".json";
-  } else {
-    output_filename = input_filename.substr(0, last_index) + encoded_file_ext;
-    output_stats_filename = input_filename.substr(0, last_index) + ".json";
+  EncodeJob job{};
+  job.use_hw = result["use-hw"].as<bool>();
+  job.height = result["height"].as<int>();
+  job.width = result["width"].as<int>();
+  job.frame_rate = result["rate"].as<int>();
+  job.codec_type = result["codec-type"].as<std::string>();
+  job.chroma_format = result["chroma-format"].as<std::string>();
+  job.bitrate_mode = result["bitrate-mode"].as<std::string>();
+  job.bitrate = result["bitrate"].as<int>();
+  job.zero_copy = result["zero-copy"].as<bool>();
+  job.prefault = result["prefault"].as<bool>();
+  if (result.count("arena")) {
+    job.arena = result["arena"].as<std::string>();
+  }
+  job.container = result["container"].as<std::string>();
+  job.segment_duration = result["segment-duration"].as<double>();
+  job.playlist_size = result["playlist-size"].as<int>();
+  if (job.playlist_size < 1) {
+    std::cout << "Invalid playlist size " << job.playlist_size << std::endl;
+    return EINVAL;
+  }
+  job.threads = result["threads"].as<int>();
+  if (job.threads < 0) {
+    std::cout << "Invalid thread count " << job.threads << std::endl;
+    return EINVAL;
+  }
+  if (result.count("cpuset")) {
+    job.cpuset = result["cpuset"].as<std::string>();
+  }
+  job.low_latency = result["low-latency"].as<bool>();
+  job.slices = result["slices"].as<int>();
+  if (job.slices < 0) {
+    std::cout << "Invalid slice count " << job.slices << std::endl;
+    return EINVAL;
+  }
+  if (result.count("preload")) {
+    job.preload = true;
+    job.preload_frames = result["preload"].as<int>();
+  }
+  const auto loop = result["loop"].as<std::string>();
+  try {
+    size_t parsed = 0;
+    const bool duration = !loop.empty() && loop.back() == 's';
+    if (duration) {
+      job.loop_duration = std::stod(loop, &parsed);
+      parsed++;
+    } else {
+      job.loops = std::stoi(loop, &parsed);
+    }
+    if (parsed != loop.size() || job.loops < 1 || (duration && job.loop_duration <= 0)) {
+      throw std::invalid_argument(loop);
+    }
+  } catch (std::logic_error&) {
+    std::cout << "Invalid loop " << loop << std::endl;
+    return EINVAL;
+  }
+  job.warmup_frames = result["warmup"].as<int>();
+  job.perf_counters = result["perf-counters"].as<bool>();
+  if (result.count("realtime")) {
+    job.pacing = result["realtime"].as<std::string>();
+  }
+  job.input_queue = result["input-queue"].as<int>();
+  job.target_fps = result["target-fps"].as<double>();
+  if (job.target_fps < 0) {
+    std::cout << "Invalid target fps " << job.target_fps << std::endl;
+    return EINVAL;
+  }
+  if (job.preload_frames < 0 || job.warmup_frames < 0) {
+    std::cout << "Invalid preload or warmup frame count" << std::endl;
+    return EINVAL;
+  }
+  job.pass = result["pass"].as<int>();
+  job.target_size = result["target-size"].as<uint64_t>();
+  if (result.count("color-format")) {
+    job.color_format = result["color-format"].as<std::string>();
   }
   if (result.count("output")) {
-    output_filename = result["output"].as<std::string>();
+    job.output_filename = result["output"].as<std::string>();
   }
-
-  // Setup input and output files
-  std::ifstream input_file{input_filename, std::ios_base::in | std::ios_base::binary};
-  if (!input_file) {
-    std::cout << "Couldn't open input file" << std::endl;
-    return ENOENT;
+  if (result.count("control-file")) {
+    job.control_filename = result["control-file"].as<std::string>();
   }
-
-  std::ofstream output_file{output_filename, std::ios_base::out | std::ios_base::binary};
-  if (!output_file) {
-    std::cout << "Couldn't open output file" << std::endl;
-    return ENOENT;
+  if (result.count("pass-stats")) {
+    job.pass_stats_filename = result["pass-stats"].as<std::string>();
   }
-
-  std::ofstream output_stats_file{output_stats_filename,
-                                  std::ios_base::out | std::ios_base::binary};
-  if (!output_file) {
-    std::cout << "Couldn't open stats file" << std::endl;
-    return ENOENT;
+  if (result.count("stats")) {
+    job.stats_filename = result["stats"].as<std::string>();
   }
 
-  // Statistics data frame
-  StatsDataFrame stats_data_frame{};
-  stats_data_frame.settings.codec = result["codec-type"].as<std::string>();
-  stats_data_frame.settings.gop = -1;
-  stats_data_frame.settings.fps = frame_rate;
-  stats_data_frame.settings.bitrate = "";
-  stats_data_frame.settings.mean_bitrate = "";
-  stats_data_frame.settings.width = frame_width;
-  stats_data_frame.settings.height = frame_height;
-
-  bool is_stillgoing = true;
-  vpl::implementation_type impl_type{use_hw_impl ? vpl::implementation_type::hw
-                                                 : vpl::implementation_type::sw};
-
-  // Initialize VPL session for any implementation of HEVC/H265 encode
-  // Default implementation selector. Selects first impl based on property list.
-  vpl::default_selector impl_sel{{vpl::dprops::impl(impl_type),
-                                  vpl::dprops::api_version(2, 5),
-                                  vpl::dprops::encoder({vpl::dprops::codec_id(codec_type)})}};
-
-  vpl::color_format_fourcc input_fourcc = (impl_type == vpl::implementation_type::sw)
-                                              ? vpl::color_format_fourcc::i420
-                                              : vpl::color_format_fourcc::nv12;
-  if (result.count("color-format")) {
-    input_fourcc = color_formats.at(result["color-format"].as<std::string>());
+  NumaPolicy numa_policy{};
+  try {
+    numa_policy = numa_policy_from_string(result["numa"].as<std::string>());
+  } catch (std::invalid_argument& e) {
+    std::cout << e.what() << std::endl;
+    return EINVAL;
   }
 
-  // create raw freames reader
-  vpl::raw_frame_file_reader frame_file_reader(frame_height, frame_width, input_fourcc, input_file);
+  if (result.count("server")) {
+    // SIGINT and SIGTERM stop the server, the workers finish their jobs and
+    // the socket is removed. Blocked before the workers start, so only the
+    // signal thread takes them.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+    try {
+      EncodeServer server{
+          result["server"].as<std::string>(), result["workers"].as<int>(), job, numa_policy};
+      std::thread signal_thread{[&server, &stop_signals] {
+        int signal = 0;
+        sigwait(&stop_signals, &signal);
+        server.stop();
+      }};
+      server.run();
+      // run() also ends when accepting fails, the signal thread is woken then.
+      pthread_kill(signal_thread.native_handle(), SIGTERM);
+      signal_thread.join();
+    } catch (std::exception& e) {
+      std::cout << "Encode server failed: " << e.what() << std::endl;
+      return EIO;
+    }
+    return 0;
+  }
 
-  VideoEncoder video_encoder{impl_sel, &frame_file_reader};
+  if (!result.count("input")) {
+    std::cout << options.help() << std::endl;
+    return EINVAL;
+  }
+  job.input_filename = result["input"].as<std::string>();
+  set_default_filenames(&job);
 
-  vpl::frame_info info{};
-  info.set_frame_rate({frame_rate, 1});
-  info.set_frame_size({ALIGN16(frame_height), ALIGN16(frame_width)});
-  info.set_FourCC(input_fourcc);
-  info.set_ChromaFormat(chroma_format);
-  info.set_ROI({{0, 0}, {frame_height, frame_width}});
-  info.set_PicStruct(vpl::pic_struct::progressive);
+  if (result.count("connect")) {
+    // Server runs in its own working directory.
+    for (auto* filename : {&job.input_filename,
+                           &job.output_filename,
+                           &job.stats_filename,
+                           &job.pass_stats_filename,
+                           &job.control_filename}) {
+      if (filename->empty() || is_synthetic_input(*filename)) {
+        continue;
+      }
+      *filename = std::filesystem::absolute(*filename).string();
+    }
+    return submit_encode_job(result["connect"].as<std::string>(), job);
+  }
 
-  video_encoder.init(std::move(info), codec_type, bitrate_mode);
-  std::cout << info << std::endl;
-  std::cout << "Init done" << std::endl;
-  std::cout << "Encoding " << input_filename << " -> " << output_filename << std::endl;
-  std::cout << "Statistics " << output_stats_filename << std::endl;
+  // Reject options no implementation supports before any session is created.
+  if (result.count("impl-cache")) {
+    bool cache_hit = false;
+    const auto impl_cache = load_impl_cache(result["impl-cache"].as<std::string>(), &cache_hit);
+    std::cout << "Implementation capabilities " << (cache_hit ? "cached" : "probed") << std::endl;
+    std::string reason;
+    if (!is_supported(impl_cache,
+                      job.use_hw,
+                      job.codec_type,
+                      input_color_format(job),
+                      job.bitrate_mode,
+                      &reason)) {
+      std::cout << "Unsupported options: " << reason << std::endl;
+      return EINVAL;
+    }
+  }
 
-  const auto encoding_start_time = time_since_epoch();
-  // main encoder Loop
-  while (is_stillgoing == true) {
-    FrameInfo frame_info{};
-    vpl::status wrn = vpl::status::Ok;
+  // Pin before the session starts its threads and allocates its surfaces.
+  try {
+    const auto topology = numa_topology();
+    const int numa_node = numa_node_for(numa_policy, topology, 0);
+    if (numa_node >= 0) {
+      job.numa_node = topology[numa_node].id;
+      if (!pin_thread(topology[numa_node].cpus)) {
+        std::cout << "Couldn't pin to NUMA node " << job.numa_node << std::endl;
+      }
+    }
+  } catch (std::invalid_argument& e) {
+    std::cout << e.what() << std::endl;
+    return EINVAL;
+  }
 
-    auto bitstream = std::make_shared<vpl::bitstream_as_dst>();
+  // Initialize VPL session for any implementation of HEVC/H265 encode
+  const auto impl_sel = make_impl_selector(job);
+  StatsDataFrame stats_data_frame{};
+  Metrics metrics{};
+  std::unique_ptr<MetricsExporter> metrics_exporter{};
+  if (result.count("metrics-file") || result.count("metrics-port")) {
+    const auto interval = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::duration<double>(result["metrics-interval"].as<double>()));
+    if (interval.count() <= 0) {
+      std::cout << "Invalid metrics interval " << result["metrics-interval"].as<double>()
+                << std::endl;
+      return EINVAL;
+    }
     try {
-      frame_info.start_time = time_since_epoch();
-      wrn = video_encoder.encode(bitstream);
-    } catch (vpl::base_exception& e) {
-      std::cout << "Encoder died: " << e.what() << std::endl;
+      metrics_exporter = std::make_unique<MetricsExporter>(
+          metrics,
+          result.count("metrics-file") ? result["metrics-file"].as<std::string>() : "",
+          result.count("metrics-port") ? result["metrics-port"].as<int>() : -1,
+          interval);
+    } catch (std::runtime_error& e) {
+      std::cout << "Couldn't publish metrics: " << e.what() << std::endl;
       return EIO;
     }
-
-    switch (wrn) {
-    case vpl::status::Ok: {
-      std::chrono::duration<int, std::milli> timeout(kTimeout100Ms);
-      bitstream->wait_for(timeout);
-      frame_info.stop_time = time_since_epoch();
-      frame_info.size = bitstream->get_DataLength();
-      write_encoded_stream(bitstream, &output_file);
-      frame_info.iframe = (bitstream->get_FrameType() & MFX_FRAMETYPE_I) ? 1 : 0;
-      frame_info.counter = stats_data_frame.frame_info.size();
-      stats_data_frame.frame_info.emplace_back(std::move(frame_info));
-    } break;
-    case vpl::status::EndOfStreamReached:
-      std::cout << "EndOfStream Reached" << std::endl;
-      is_stillgoing = false;
-      break;
-    case vpl::status::DeviceBusy:
-      // For non-CPU implementations,
-      // Wait a few milliseconds then try again
-      std::cout << "DeviceBusy" << std::endl;
-      break;
-    default:
-      std::cout << "unknown status: " << static_cast<int>(wrn) << std::endl;
-      is_stillgoing = false;
-      break;
+    if (metrics_exporter->port() >= 0) {
+      std::cout << "Metrics on http://127.0.0.1:" << metrics_exporter->port() << "/metrics"
+                << std::endl;
     }
   }
-  const auto encoding_end_time = time_since_epoch();
-  stats_data_frame.id = "42";
-  stats_data_frame.description = "onevpl encoder test";
-  stats_data_frame.test = "test encoder parameters";
-  stats_data_frame.test_definition = "n/a";
-  stats_data_frame.date = "today";
-  stats_data_frame.encapp_version = "1.6";
-  stats_data_frame.proctime = encoding_end_time - encoding_start_time;
-  stats_data_frame.framecount = stats_data_frame.frame_info.size();
-  stats_data_frame.encoded_file = output_filename;
-  stats_data_frame.source_file = input_filename;
-
-  std::cout << "Encoded " << stats_data_frame.frame_info.size() << " frames" << std::endl;
-
-  std::cout << "\n-- Encode information --\n\n";
-  const auto video_param = video_encoder.get_working_params();
-  std::cout << *(video_param.get()) << std::endl;
-  Statistics stats{std::move(stats_data_frame)};
-  stats.write(output_stats_file);
-  return 0;
+  Metrics* job_metrics = metrics_exporter ? &metrics : nullptr;
+  if (!result.count("trace")) {
+    return run_encode_job(job, *impl_sel, &stats_data_frame, {}, nullptr, job_metrics);
+  }
+  start_trace();
+  const int status = run_encode_job(job, *impl_sel, &stats_data_frame, {}, nullptr, job_metrics);
+  stop_trace();
+  const auto trace_filename = result["trace"].as<std::string>();
+  std::ofstream trace_file{trace_filename};
+  write_trace(trace_file);
+  if (!trace_file) {
+    std::cout << "Couldn't write trace " << trace_filename << std::endl;
+    return status ? status : EIO;
+  }
+  std::cout << "Trace " << trace_filename << std::endl;
+  return status;
 }
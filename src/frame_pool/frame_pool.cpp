@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "frame_pool.hpp"
+
+#include "utils.hpp"
+
+namespace vpl = oneapi::vpl;
+
+FrameLayout make_frame_layout(uint16_t width, uint16_t height, vpl::color_format_fourcc fourcc) {
+  FrameLayout layout{};
+  layout.width = width;
+  layout.height = height;
+  layout.fourcc = fourcc;
+  const size_t aligned_height = ALIGN16(height);
+  switch (fourcc) {
+  case vpl::color_format_fourcc::i420:
+    layout.pitch = ALIGN16(width);
+    layout.offsets[1] = layout.pitch * aligned_height;
+    layout.offsets[2] = layout.offsets[1] + layout.pitch / 2 * aligned_height / 2;
+    layout.size = layout.offsets[2] + layout.pitch / 2 * aligned_height / 2;
+    break;
+  case vpl::color_format_fourcc::nv12:
+    layout.pitch = ALIGN16(width);
+    layout.offsets[1] = layout.pitch * aligned_height;
+    layout.offsets[2] = layout.offsets[1] + 1;
+    layout.size = layout.offsets[1] + layout.pitch * aligned_height / 2;
+    break;
+  case vpl::color_format_fourcc::p010:
+    layout.pitch = ALIGN16(width) * 2;
+    layout.offsets[1] = layout.pitch * aligned_height;
+    layout.offsets[2] = layout.offsets[1] + 2;
+    layout.size = layout.offsets[1] + layout.pitch * aligned_height / 2;
+    break;
+  default:
+    throw std::invalid_argument("Unsupported external frame color format");
+  }
+  // Keeps consecutive buffers of an arena aligned too.
+  layout.size = (layout.size + kFrameBufferAlignment - 1) / kFrameBufferAlignment *
+                kFrameBufferAlignment;
+  return layout;
+}
+
+static bool read_plane(std::istream& input,
+                       uint8_t* plane,
+                       size_t pitch,
+                       size_t row_size,
+                       size_t rows) {
+  if (pitch == row_size) {
+    return static_cast<bool>(input.read(reinterpret_cast<char*>(plane), row_size * rows));
+  }
+  for (size_t row = 0; row < rows; row++) {
+    if (!input.read(reinterpret_cast<char*>(plane + row * pitch), row_size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool read_frame(std::istream& input, const FrameLayout& layout, mfxFrameSurface1* surface) {
+  auto& data = surface->Data;
+  switch (layout.fourcc) {
+  case vpl::color_format_fourcc::i420:
+    return read_plane(input, data.Y, layout.pitch, layout.width, layout.height) &&
+           read_plane(input, data.U, layout.pitch / 2, layout.width / 2, layout.height / 2) &&
+           read_plane(input, data.V, layout.pitch / 2, layout.width / 2, layout.height / 2);
+  case vpl::color_format_fourcc::nv12:
+    return read_plane(input, data.Y, layout.pitch, layout.width, layout.height) &&
+           read_plane(input, data.UV, layout.pitch, layout.width, layout.height / 2);
+  case vpl::color_format_fourcc::p010:
+    return read_plane(input, data.Y, layout.pitch, layout.width * 2, layout.height) &&
+           read_plane(input, data.UV, layout.pitch, layout.width * 2, layout.height / 2);
+  default:
+    return false;
+  }
+}
+
+ExternalFramePool::ExternalFramePool(const FrameLayout& layout) : layout_{layout} {}
+
+const FrameLayout& ExternalFramePool::layout() const {
+  return layout_;
+}
+
+void ExternalFramePool::add_buffer(uint8_t* buffer) {
+  if (reinterpret_cast<uintptr_t>(buffer) % kFrameBufferAlignment) {
+    throw std::invalid_argument("Frame buffer is not aligned");
+  }
+  auto frame = std::make_unique<Frame>();
+  frame->buffer = buffer;
+  frame->acquired = false;
+  frame->submitted = false;
+
+  auto& surface = frame->surface;
+  surface = {};
+  surface.Info.FourCC = static_cast<mfxU32>(layout_.fourcc);
+  surface.Info.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+  surface.Info.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
+  surface.Info.Width = ALIGN16(layout_.width);
+  surface.Info.Height = ALIGN16(layout_.height);
+  surface.Info.CropW = layout_.width;
+  surface.Info.CropH = layout_.height;
+  if (layout_.fourcc == vpl::color_format_fourcc::p010) {
+    surface.Info.BitDepthLuma = 10;
+    surface.Info.BitDepthChroma = 10;
+  }
+  surface.Data.Pitch = layout_.pitch;
+  surface.Data.Y = buffer + layout_.offsets[0];
+  if (layout_.fourcc == vpl::color_format_fourcc::i420) {
+    surface.Data.U = buffer + layout_.offsets[1];
+    surface.Data.V = buffer + layout_.offsets[2];
+  } else {
+    surface.Data.UV = buffer + layout_.offsets[1];
+  }
+  frames_.push_back(std::move(frame));
+}
+
+void ExternalFramePool::allocate(size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    auto* buffer = static_cast<uint8_t*>(std::aligned_alloc(kFrameBufferAlignment, layout_.size));
+    if (!buffer) {
+      throw std::bad_alloc();
+    }
+    owned_buffers_.emplace_back(buffer, &std::free);
+    add_buffer(buffer);
+  }
+}
+
+mfxFrameSurface1* ExternalFramePool::acquire() {
+  for (auto& frame : frames_) {
+    if (!frame->acquired) {
+      frame->acquired = true;
+      return &frame->surface;
+    }
+  }
+  return nullptr;
+}
+
+void ExternalFramePool::submit(mfxFrameSurface1* surface, ReleaseCallback on_release) {
+  auto* frame = find(surface);
+  frame->submitted = true;
+  frame->on_release = std::move(on_release);
+}
+
+void ExternalFramePool::cancel(mfxFrameSurface1* surface) {
+  find(surface)->acquired = false;
+}
+
+size_t ExternalFramePool::collect() {
+  size_t released = 0;
+  for (auto& frame : frames_) {
+    if (frame->submitted && frame->surface.Data.Locked == 0) {
+      frame->submitted = false;
+      frame->acquired = false;
+      if (frame->on_release) {
+        frame->on_release(frame->buffer);
+        frame->on_release = nullptr;
+      }
+      released++;
+    }
+  }
+  return released;
+}
+
+size_t ExternalFramePool::free_frames() const {
+  return std::count_if(
+      frames_.begin(), frames_.end(), [](const auto& frame) { return !frame->acquired; });
+}
+
+ExternalFramePool::Frame* ExternalFramePool::find(mfxFrameSurface1* surface) {
+  const auto found = std::find_if(frames_.begin(), frames_.end(), [surface](const auto& frame) {
+    return &frame->surface == surface;
+  });
+  if (found == frames_.end()) {
+    throw std::invalid_argument("Surface doesn't belong to the pool");
+  }
+  return found->get();
+}
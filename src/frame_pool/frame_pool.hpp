@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdlib>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <vector>
+
+#include "vpl/preview/vpl.hpp"
+
+constexpr const size_t kFrameBufferAlignment = 64;
+
+// Planes of a frame in a single buffer, rows padded to ALIGN16 pitch.
+struct FrameLayout {
+  uint16_t width;
+  uint16_t height;
+  oneapi::vpl::color_format_fourcc fourcc;
+  uint32_t pitch;
+  // Offset of Y, U (or UV) and V planes.
+  size_t offsets[3];
+  size_t size;
+};
+
+// Supports i420, nv12 and p010. Throws std::invalid_argument for other
+// formats.
+FrameLayout make_frame_layout(uint16_t width,
+                              uint16_t height,
+                              oneapi::vpl::color_format_fourcc fourcc);
+
+// Reads a packed raw frame into the pitched planes of the surface.
+bool read_frame(std::istream& input, const FrameLayout& layout, mfxFrameSurface1* surface);
+
+// Frame buffers submitted to the encoder without a copy into library owned
+// surfaces. A buffer stays with the encoder until it unlocks the surface,
+// then its release callback runs and it can be acquired again.
+class ExternalFramePool {
+ public:
+  using ReleaseCallback = std::function<void(uint8_t* buffer)>;
+
+  explicit ExternalFramePool(const FrameLayout& layout);
+
+  const FrameLayout& layout() const;
+
+  // Registers a caller owned buffer of layout().size bytes, aligned to
+  // kFrameBufferAlignment. The buffer must outlive the pool.
+  void add_buffer(uint8_t* buffer);
+
+  // Adds count buffers owned by the pool.
+  void allocate(size_t count);
+
+  // Surface of a free buffer, null when the encoder holds all of them.
+  mfxFrameSurface1* acquire();
+
+  // Hands the surface to the encoder, on_release runs once it's unlocked.
+  void submit(mfxFrameSurface1* surface, ReleaseCallback on_release = {});
+
+  // Returns an acquired surface which was not submitted.
+  void cancel(mfxFrameSurface1* surface);
+
+  // Releases surfaces the encoder no longer holds, returns their count.
+  size_t collect();
+
+  size_t free_frames() const;
+
+ private:
+  struct Frame {
+    mfxFrameSurface1 surface;
+    uint8_t* buffer;
+    bool acquired;
+    bool submitted;
+    ReleaseCallback on_release;
+  };
+
+  Frame* find(mfxFrameSurface1* surface);
+
+  const FrameLayout layout_;
+  std::vector<std::unique_ptr<Frame>> frames_;
+  std::vector<std::unique_ptr<uint8_t, decltype(&std::free)>> owned_buffers_;
+};
@@ -0,0 +1,330 @@
+// SPDX-License-Identifier: MIT
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+#include "impl_cache.hpp"
+
+#include "mapping/mapping.hpp"
+#include "vpl/mfx.h"
+
+constexpr const mfxU16 kProbeWidth = 320;
+constexpr const mfxU16 kProbeHeight = 240;
+constexpr const mfxU16 kProbeKbps = 1000;
+constexpr const mfxU16 kProbeQp = 26;
+
+static void to_json(nlohmann::json& json, const ColorFormatCaps& caps) {
+  json = nlohmann::json{{"color_format", caps.color_format},
+                        {"bitrate_modes", caps.bitrate_modes}};
+}
+
+static void from_json(const nlohmann::json& json, ColorFormatCaps& caps) {
+  json.at("color_format").get_to(caps.color_format);
+  json.at("bitrate_modes").get_to(caps.bitrate_modes);
+}
+
+static void to_json(nlohmann::json& json, const EncoderCaps& caps) {
+  json = nlohmann::json{{"codec", caps.codec}, {"color_formats", caps.color_formats}};
+}
+
+static void from_json(const nlohmann::json& json, EncoderCaps& caps) {
+  json.at("codec").get_to(caps.codec);
+  json.at("color_formats").get_to(caps.color_formats);
+}
+
+static void to_json(nlohmann::json& json, const ImplCaps& caps) {
+  json = nlohmann::json{{"name", caps.name},
+                        {"hw", caps.hw},
+                        {"probed", caps.probed},
+                        {"encoders", caps.encoders}};
+}
+
+static void from_json(const nlohmann::json& json, ImplCaps& caps) {
+  json.at("name").get_to(caps.name);
+  json.at("hw").get_to(caps.hw);
+  json.at("probed").get_to(caps.probed);
+  json.at("encoders").get_to(caps.encoders);
+}
+
+static void to_json(nlohmann::json& json, const FileStamp& stamp) {
+  json = nlohmann::json{{"path", stamp.path}, {"mtime", stamp.mtime}};
+}
+
+static void from_json(const nlohmann::json& json, FileStamp& stamp) {
+  json.at("path").get_to(stamp.path);
+  json.at("mtime").get_to(stamp.mtime);
+}
+
+void to_json(nlohmann::json& json, const ImplCache& cache) {
+  json = nlohmann::json{
+      {"api_version", cache.api_version}, {"files", cache.files}, {"impls", cache.impls}};
+}
+
+void from_json(const nlohmann::json& json, ImplCache& cache) {
+  json.at("api_version").get_to(cache.api_version);
+  json.at("files").get_to(cache.files);
+  json.at("impls").get_to(cache.impls);
+}
+
+static int64_t file_mtime(const std::string& path) {
+  struct stat file_stat {};
+  if (stat(path.c_str(), &file_stat) != 0) {
+    return -1;
+  }
+  return static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 + file_stat.st_mtim.tv_nsec;
+}
+
+// Stamps the library and its directory, so installing a new implementation
+// next to it also invalidates the cache.
+static void add_file_stamps(const std::string& library, std::vector<FileStamp>* files) {
+  for (const auto& path : {library, std::filesystem::path(library).parent_path().string()}) {
+    const auto found = std::find_if(files->begin(), files->end(), [&path](const FileStamp& stamp) {
+      return stamp.path == path;
+    });
+    if (!path.empty() && found == files->end()) {
+      files->push_back({path, file_mtime(path)});
+    }
+  }
+}
+
+static std::string dispatcher_path() {
+  Dl_info info{};
+  if (dladdr(reinterpret_cast<void*>(&MFXLoad), &info) == 0 || !info.dli_fname) {
+    return "";
+  }
+  return std::filesystem::absolute(info.dli_fname).string();
+}
+
+template <typename Map, typename Value>
+static std::vector<std::string> names_of(const Map& map, Value value) {
+  std::vector<std::string> names;
+  for (const auto& [name, mapped] : map) {
+    if (static_cast<mfxU32>(mapped) == static_cast<mfxU32>(value)) {
+      names.push_back(name);
+    }
+  }
+  return names;
+}
+
+static bool query_encoder(mfxSession session,
+                          mfxU32 codec_id,
+                          mfxU32 color_format,
+                          oneapi::vpl::rate_control_method bitrate_mode) {
+  mfxVideoParam params{};
+  params.IOPattern = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+  params.mfx.CodecId = codec_id;
+  params.mfx.RateControlMethod = static_cast<mfxU16>(bitrate_mode);
+  params.mfx.TargetKbps = kProbeKbps;
+  params.mfx.MaxKbps = kProbeKbps;
+  params.mfx.QPI = kProbeQp;
+  params.mfx.QPP = kProbeQp;
+  params.mfx.QPB = kProbeQp;
+  params.mfx.FrameInfo.FourCC = color_format;
+  params.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+  params.mfx.FrameInfo.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
+  params.mfx.FrameInfo.Width = kProbeWidth;
+  params.mfx.FrameInfo.Height = kProbeHeight;
+  params.mfx.FrameInfo.CropW = kProbeWidth;
+  params.mfx.FrameInfo.CropH = kProbeHeight;
+  params.mfx.FrameInfo.FrameRateExtN = 30;
+  params.mfx.FrameInfo.FrameRateExtD = 1;
+  mfxVideoParam corrected = params;
+  // Warnings mean the parameters were adjusted, the combination still works.
+  return MFXVideoENCODE_Query(session, &params, &corrected) >= MFX_ERR_NONE;
+}
+
+std::string default_impl_cache_path() {
+  const char* cache_home = std::getenv("XDG_CACHE_HOME");
+  const char* home = std::getenv("HOME");
+  const std::filesystem::path cache_dir =
+      cache_home ? cache_home : std::filesystem::path(home ? home : "/tmp") / ".cache";
+  return (cache_dir / "onevpl-examples" / "impl_cache.json").string();
+}
+
+bool is_impl_cache_valid(const ImplCache& cache) {
+  if (cache.api_version != MFX_VERSION || cache.files.empty()) {
+    return false;
+  }
+  const auto dispatcher = dispatcher_path();
+  const bool has_dispatcher =
+      std::any_of(cache.files.begin(), cache.files.end(), [&dispatcher](const FileStamp& stamp) {
+        return stamp.path == dispatcher;
+      });
+  return has_dispatcher &&
+         std::all_of(cache.files.begin(), cache.files.end(), [](const FileStamp& stamp) {
+           return file_mtime(stamp.path) == stamp.mtime;
+         });
+}
+
+ImplCache probe_impl_caps() {
+  ImplCache cache{};
+  cache.api_version = MFX_VERSION;
+  add_file_stamps(dispatcher_path(), &cache.files);
+
+  mfxLoader loader = MFXLoad();
+  if (!loader) {
+    return cache;
+  }
+  for (mfxU32 i = 0;; i++) {
+    mfxHDL desc_handle = nullptr;
+    if (MFXEnumImplementations(loader, i, MFX_IMPLCAPS_IMPLDESCSTRUCTURE, &desc_handle) !=
+        MFX_ERR_NONE) {
+      break;
+    }
+    const auto* desc = static_cast<mfxImplDescription*>(desc_handle);
+    ImplCaps impl_caps{};
+    impl_caps.name = desc->ImplName;
+    impl_caps.hw = desc->Impl == MFX_IMPL_TYPE_HARDWARE;
+
+    mfxHDL path_handle = nullptr;
+    if (MFXEnumImplementations(loader, i, MFX_IMPLCAPS_IMPLPATH, &path_handle) == MFX_ERR_NONE) {
+      add_file_stamps(static_cast<mfxChar*>(path_handle), &cache.files);
+      MFXDispReleaseImplDescription(loader, path_handle);
+    }
+
+    mfxSession session = nullptr;
+    const bool has_session = MFXCreateSession(loader, i, &session) == MFX_ERR_NONE;
+    impl_caps.probed = has_session;
+    for (mfxU16 c = 0; c < desc->Enc.NumCodecs; c++) {
+      const auto& codec = desc->Enc.Codecs[c];
+      std::vector<mfxU32> fourccs;
+      for (mfxU16 p = 0; p < codec.NumProfiles; p++) {
+        for (mfxU16 m = 0; m < codec.Profiles[p].NumMemTypes; m++) {
+          const auto& mem_desc = codec.Profiles[p].MemDesc[m];
+          fourccs.insert(fourccs.end(),
+                         mem_desc.ColorFormats,
+                         mem_desc.ColorFormats + mem_desc.NumColorFormats);
+        }
+      }
+      std::sort(fourccs.begin(), fourccs.end());
+      fourccs.erase(std::unique(fourccs.begin(), fourccs.end()), fourccs.end());
+
+      // Rate control support can differ between color formats, each one is
+      // queried on its own.
+      std::vector<ColorFormatCaps> format_caps;
+      for (const auto fourcc : fourccs) {
+        std::vector<std::string> bitrate_modes;
+        for (const auto& [bitrate_name, bitrate_mode] : bitrate_control_method) {
+          if (has_session && query_encoder(session, codec.CodecID, fourcc, bitrate_mode)) {
+            bitrate_modes.push_back(bitrate_name);
+          }
+        }
+        for (const auto& color_name : names_of(color_formats, fourcc)) {
+          format_caps.push_back({color_name, bitrate_modes});
+        }
+      }
+      for (const auto& codec_name : names_of(codec_formats, codec.CodecID)) {
+        impl_caps.encoders.push_back({codec_name, format_caps});
+      }
+    }
+    if (has_session) {
+      MFXClose(session);
+    }
+    MFXDispReleaseImplDescription(loader, desc_handle);
+    cache.impls.push_back(std::move(impl_caps));
+  }
+  MFXUnload(loader);
+  return cache;
+}
+
+ImplCache load_impl_cache(const std::string& path, bool* cache_hit) {
+  std::ifstream cache_file{path};
+  if (cache_file) {
+    const auto json = nlohmann::json::parse(cache_file, nullptr, false);
+    try {
+      auto cache = json.get<ImplCache>();
+      if (is_impl_cache_valid(cache)) {
+        if (cache_hit) {
+          *cache_hit = true;
+        }
+        return cache;
+      }
+    } catch (nlohmann::json::exception&) {
+      // Broken cache file is replaced below.
+    }
+  }
+  if (cache_hit) {
+    *cache_hit = false;
+  }
+  auto cache = probe_impl_caps();
+  std::error_code error;
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+  // Written to a file of its own and renamed, concurrent runs never read a
+  // partial file or write into each other's.
+  std::string tmp_path = path + ".XXXXXX";
+  const int fd = mkstemp(tmp_path.data());
+  if (fd < 0) {
+    return cache;
+  }
+  const auto content = nlohmann::json(cache).dump(2) + "\n";
+  size_t written = 0;
+  while (written < content.size()) {
+    const auto ret = write(fd, content.data() + written, content.size() - written);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      break;
+    }
+    written += ret;
+  }
+  const bool closed = close(fd) == 0;
+  if (closed && written == content.size()) {
+    std::filesystem::rename(tmp_path, path, error);
+    if (!error) {
+      return cache;
+    }
+  }
+  std::filesystem::remove(tmp_path, error);
+  return cache;
+}
+
+bool is_supported(const ImplCache& cache,
+                  bool hw,
+                  const std::string& codec,
+                  const std::string& color_format,
+                  const std::string& bitrate_mode,
+                  std::string* reason) {
+  bool has_codec = false;
+  bool has_color_format = false;
+  for (const auto& impl : cache.impls) {
+    if (impl.hw != hw) {
+      continue;
+    }
+    for (const auto& encoder : impl.encoders) {
+      if (encoder.codec != codec) {
+        continue;
+      }
+      has_codec = true;
+      const auto& formats = encoder.color_formats;
+      const auto format = std::find_if(
+          formats.begin(), formats.end(), [&color_format](const ColorFormatCaps& caps) {
+            return caps.color_format == color_format;
+          });
+      if (format == formats.end()) {
+        continue;
+      }
+      has_color_format = true;
+      const auto& modes = format->bitrate_modes;
+      if (!impl.probed || std::find(modes.begin(), modes.end(), bitrate_mode) != modes.end()) {
+        return true;
+      }
+    }
+  }
+  const std::string impl_type = hw ? "hardware" : "software";
+  if (!has_codec) {
+    *reason = "no " + impl_type + " implementation encodes " + codec;
+  } else if (!has_color_format) {
+    *reason = codec + " encoder doesn't accept " + color_format + " input";
+  } else {
+    *reason = codec + " encoder doesn't support " + bitrate_mode + " bitrate mode";
+  }
+  return false;
+}
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+// Rate control methods an encoder accepts with one color format.
+struct ColorFormatCaps {
+  std::string color_format;
+  std::vector<std::string> bitrate_modes;
+};
+
+struct EncoderCaps {
+  std::string codec;
+  std::vector<ColorFormatCaps> color_formats;
+};
+
+struct ImplCaps {
+  std::string name;
+  bool hw;
+  // False when no session could be created to query the encoders, their
+  // rate control methods are unknown then.
+  bool probed;
+  std::vector<EncoderCaps> encoders;
+};
+
+// Modification time of a file the capabilities depend on.
+struct FileStamp {
+  std::string path;
+  int64_t mtime;
+};
+
+// Implementation capabilities, valid as long as the API version and every
+// stamped file are unchanged.
+struct ImplCache {
+  uint32_t api_version;
+  std::vector<FileStamp> files;
+  std::vector<ImplCaps> impls;
+};
+
+void to_json(nlohmann::json& json, const ImplCache& cache);
+void from_json(const nlohmann::json& json, ImplCache& cache);
+
+// $XDG_CACHE_HOME/onevpl-examples/impl_cache.json, ~/.cache when unset.
+std::string default_impl_cache_path();
+
+bool is_impl_cache_valid(const ImplCache& cache);
+
+// Enumerates implementations and queries every codec, color format and rate
+// control method, slow since it loads and initializes each implementation.
+ImplCache probe_impl_caps();
+
+// Returns the cache file content, probes and rewrites the file when it is
+// missing or stale.
+ImplCache load_impl_cache(const std::string& path, bool* cache_hit = nullptr);
+
+// Checks the combination against the cached capabilities, reason is set
+// when it is not supported by any implementation. Implementations that
+// couldn't be probed support every rate control method.
+bool is_supported(const ImplCache& cache,
+                  bool hw,
+                  const std::string& codec,
+                  const std::string& color_format,
+                  const std::string& bitrate_mode,
+                  std::string* reason);
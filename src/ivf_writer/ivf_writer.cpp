@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: MIT
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "ivf_writer.hpp"
+
+#include "bitstream_parser/bitstream_parser.hpp"
+
+constexpr const uint8_t kAv1TemporalDelimiter[] = {0x12, 0x00};
+
+static void put_u16(uint8_t* bytes, uint16_t value) {
+  bytes[0] = value & 0xff;
+  bytes[1] = value >> 8;
+}
+
+static void put_u32(uint8_t* bytes, uint32_t value) {
+  put_u16(bytes, value & 0xffff);
+  put_u16(bytes + 2, value >> 16);
+}
+
+static void put_u64(uint8_t* bytes, uint64_t value) {
+  put_u32(bytes, value & 0xffffffff);
+  put_u32(bytes + 4, value >> 32);
+}
+
+// Writes every vector, retrying after partial writes.
+static void write_all(int fd, iovec* vectors, int count) {
+  while (count > 0) {
+    const ssize_t written = writev(fd, vectors, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(std::string("Couldn't write IVF file: ") + std::strerror(errno));
+    }
+    size_t remaining = written;
+    while (count > 0 && remaining >= vectors->iov_len) {
+      remaining -= vectors->iov_len;
+      vectors++;
+      count--;
+    }
+    if (count > 0) {
+      vectors->iov_base = static_cast<uint8_t*>(vectors->iov_base) + remaining;
+      vectors->iov_len -= remaining;
+    }
+  }
+}
+
+IvfWriter::IvfWriter(const std::string& filename,
+                     const std::string& codec,
+                     int width,
+                     int height,
+                     int frame_rate) :
+  fd_{-1},
+  av1_{codec == "av1"},
+  frames_{0} {
+  if (codec != "vp9" && codec != "av1") {
+    throw std::invalid_argument("IVF doesn't carry " + codec);
+  }
+  fd_ = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error("Couldn't open " + filename);
+  }
+  uint8_t header[kIvfFileHeaderSize] = {};
+  std::memcpy(header, "DKIF", 4);
+  put_u16(header + 4, 0);
+  put_u16(header + 6, kIvfFileHeaderSize);
+  std::memcpy(header + 8, av1_ ? "AV01" : "VP90", 4);
+  put_u16(header + 12, width);
+  put_u16(header + 14, height);
+  put_u32(header + 16, frame_rate);
+  put_u32(header + 20, 1);
+  iovec vector{header, sizeof(header)};
+  write_all(fd_, &vector, 1);
+}
+
+IvfWriter::~IvfWriter() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+void IvfWriter::write(const EncodedFrame& frame) {
+  bool add_temporal_delimiter = false;
+  if (av1_) {
+    const auto obus = split_obus(frame.data, frame.size);
+    add_temporal_delimiter = obus.empty() || obus.front().type != kAv1ObuTemporalDelimiter;
+  }
+  const size_t frame_size = frame.size + (add_temporal_delimiter ? 2 : 0);
+  uint8_t header[kIvfFrameHeaderSize];
+  put_u32(header, frame_size);
+  put_u64(header + 4, frames_);
+
+  iovec vectors[3];
+  int count = 0;
+  vectors[count++] = {header, sizeof(header)};
+  if (add_temporal_delimiter) {
+    vectors[count++] = {const_cast<uint8_t*>(kAv1TemporalDelimiter),
+                        sizeof(kAv1TemporalDelimiter)};
+  }
+  vectors[count++] = {const_cast<uint8_t*>(frame.data), frame.size};
+  write_all(fd_, vectors, count);
+  frames_++;
+}
+
+void IvfWriter::close() {
+  if (fd_ < 0) {
+    return;
+  }
+  uint8_t frame_count[4];
+  put_u32(frame_count, frames_);
+  const bool written = pwrite(fd_, frame_count, sizeof(frame_count), 24) == sizeof(frame_count);
+  const bool closed = ::close(fd_) == 0;
+  fd_ = -1;
+  if (!written || !closed) {
+    throw std::runtime_error("Couldn't close IVF file");
+  }
+}
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "stream_writer/stream_writer.hpp"
+
+constexpr const size_t kIvfFileHeaderSize = 32;
+constexpr const size_t kIvfFrameHeaderSize = 12;
+
+// IVF file of VP9 or AV1 frames. Frame headers are written with writev next
+// to the encoded data, the data is not copied. Frame PTS is the frame
+// counter in a 1/frame_rate time base. AV1 frames are checked to be whole
+// temporal units, a temporal delimiter is added where the encoder left it
+// out.
+class IvfWriter : public StreamWriter {
+ public:
+  // codec is "vp9" or "av1", throws std::invalid_argument for other codecs
+  // and std::runtime_error when the file can't be created.
+  IvfWriter(const std::string& filename,
+            const std::string& codec,
+            int width,
+            int height,
+            int frame_rate);
+  ~IvfWriter() override;
+
+  void write(const EncodedFrame& frame) override;
+
+  // Fills in the frame count of the file header.
+  void close() override;
+
+ private:
+  int fd_;
+  const bool av1_;
+  uint32_t frames_;
+};
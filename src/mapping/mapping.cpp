@@ -11,7 +11,7 @@ const std::map<std::string, vpl::codec_format_fourcc> codec_formats{
     {"vc1", vpl::codec_format_fourcc::vc1},
     {"capture", vpl::codec_format_fourcc::capture},
     {"vp9", vpl::codec_format_fourcc::vp9},
-    {"av1", vpl::codec_format_fourcc::avc},
+    {"av1", vpl::codec_format_fourcc::av1},
 };
 
 const std::map<std::string, vpl::chroma_format_idc> chroma_formats{
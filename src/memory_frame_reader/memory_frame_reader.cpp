@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+#include <stdexcept>
+
+#include "memory_frame_reader.hpp"
+
+#include "trace/trace.hpp"
+
+namespace vpl = oneapi::vpl;
+
+size_t packed_frame_size(uint16_t width, uint16_t height, vpl::color_format_fourcc fourcc) {
+  const size_t luma = static_cast<size_t>(width) * height;
+  switch (fourcc) {
+  case vpl::color_format_fourcc::i420:
+  case vpl::color_format_fourcc::nv12:
+    return luma + 2 * (luma / 4);
+  case vpl::color_format_fourcc::p010:
+    return 2 * (luma + 2 * (luma / 4));
+  default:
+    throw std::invalid_argument("Unsupported packed frame color format");
+  }
+}
+
+static const uint8_t* copy_plane(const uint8_t* source,
+                                 uint8_t* plane,
+                                 size_t pitch,
+                                 size_t row_size,
+                                 size_t rows) {
+  if (pitch == row_size) {
+    std::memcpy(plane, source, row_size * rows);
+    return source + row_size * rows;
+  }
+  for (size_t row = 0; row < rows; row++) {
+    std::memcpy(plane + row * pitch, source, row_size);
+    source += row_size;
+  }
+  return source;
+}
+
+void copy_packed_frame(const uint8_t* frame,
+                       uint16_t width,
+                       uint16_t height,
+                       vpl::color_format_fourcc fourcc,
+                       mfxFrameSurface1* surface) {
+  TraceScope trace{"convert"};
+  auto& data = surface->Data;
+  const size_t pitch = data.Pitch;
+  switch (fourcc) {
+  case vpl::color_format_fourcc::i420:
+    frame = copy_plane(frame, data.Y, pitch, width, height);
+    frame = copy_plane(frame, data.U, pitch / 2, width / 2, height / 2);
+    copy_plane(frame, data.V, pitch / 2, width / 2, height / 2);
+    break;
+  case vpl::color_format_fourcc::nv12:
+    frame = copy_plane(frame, data.Y, pitch, width, height);
+    copy_plane(frame, data.UV, pitch, width, height / 2);
+    break;
+  case vpl::color_format_fourcc::p010:
+    frame = copy_plane(frame, data.Y, pitch, width * 2, height);
+    copy_plane(frame, data.UV, pitch, width * 2, height / 2);
+    break;
+  default:
+    throw std::invalid_argument("Unsupported packed frame color format");
+  }
+}
+
+std::vector<uint8_t> load_frames(std::istream& input, size_t frame_size, size_t max_frames) {
+  std::vector<uint8_t> frames;
+  while (max_frames == 0 || frames.size() < max_frames * frame_size) {
+    const size_t offset = frames.size();
+    frames.resize(offset + frame_size);
+    if (!input.read(reinterpret_cast<char*>(frames.data() + offset), frame_size)) {
+      frames.resize(offset);
+      break;
+    }
+  }
+  return frames;
+}
+
+MemoryFrameReader::MemoryFrameReader(uint16_t width,
+                                     uint16_t height,
+                                     vpl::color_format_fourcc fourcc,
+                                     const std::vector<uint8_t>* frames,
+                                     size_t total_frames) :
+  width_{width},
+  height_{height},
+  fourcc_{fourcc},
+  frame_size_{packed_frame_size(width, height, fourcc)},
+  frames_{frames},
+  frame_count_{frames->size() / frame_size_},
+  total_frames_{frame_count_ ? total_frames : 0},
+  frames_read_{0} {}
+
+bool MemoryFrameReader::is_EOS() {
+  return frames_read_ >= total_frames_;
+}
+
+mfxStatus MemoryFrameReader::get_data(std::shared_ptr<vpl::frame_surface> sfc) {
+  if (is_EOS()) {
+    return MFX_ERR_MORE_DATA;
+  }
+  const mfxStatus status = sfc->map(vpl::memory_access::write);
+  if (status != MFX_ERR_NONE) {
+    return status;
+  }
+  const uint8_t* frame = frames_->data() + (frames_read_ % frame_count_) * frame_size_;
+  copy_packed_frame(frame, width_, height_, fourcc_, sfc->get_raw_interface());
+  frames_read_++;
+  return sfc->unmap();
+}
+
+size_t MemoryFrameReader::frames_read() const {
+  return frames_read_;
+}
+
+void MemoryFrameReader::stop() {
+  total_frames_ = frames_read_;
+}
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <istream>
+#include <vector>
+
+#include "vpl/preview/vpl.hpp"
+
+// Size of a packed raw frame as stored in a file, supports i420, nv12 and
+// p010. Throws std::invalid_argument for other formats.
+size_t packed_frame_size(uint16_t width, uint16_t height, oneapi::vpl::color_format_fourcc fourcc);
+
+// Copies a packed raw frame into the planes of the surface, rows are placed
+// at the surface pitch.
+void copy_packed_frame(const uint8_t* frame,
+                       uint16_t width,
+                       uint16_t height,
+                       oneapi::vpl::color_format_fourcc fourcc,
+                       mfxFrameSurface1* surface);
+
+// Reads up to max_frames packed frames, all of them when max_frames is 0.
+std::vector<uint8_t> load_frames(std::istream& input, size_t frame_size, size_t max_frames);
+
+// Serves packed frames held in memory, cycling through them until
+// total_frames were read. Nothing touches the file system while encoding.
+class MemoryFrameReader : public oneapi::vpl::frame_source_reader {
+ public:
+  MemoryFrameReader(uint16_t width,
+                    uint16_t height,
+                    oneapi::vpl::color_format_fourcc fourcc,
+                    const std::vector<uint8_t>* frames,
+                    size_t total_frames);
+
+  bool is_EOS() override;
+
+  mfxStatus get_data(std::shared_ptr<oneapi::vpl::frame_surface> sfc) override;
+
+  size_t frames_read() const;
+
+  // Ends the input after the frames read so far.
+  void stop();
+
+ private:
+  const uint16_t width_;
+  const uint16_t height_;
+  const oneapi::vpl::color_format_fourcc fourcc_;
+  const size_t frame_size_;
+  const std::vector<uint8_t>* frames_;
+  const size_t frame_count_;
+  size_t total_frames_;
+  size_t frames_read_;
+};
@@ -0,0 +1,352 @@
+// SPDX-License-Identifier: MIT
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "metrics.hpp"
+
+constexpr const int kListenBacklog = 16;
+constexpr const size_t kMaxRequestSize = 8192;
+// A client that doesn't finish its request in time is dropped, it would
+// hold up publishing. The limit is for the whole request, not each read.
+constexpr const int kRequestTimeoutMs = 1000;
+
+void Metrics::add_frame(uint64_t bytes, long latency_us) {
+  frames_.fetch_add(1, std::memory_order_relaxed);
+  bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  if (latency_us < 0) {
+    return;
+  }
+  const auto bucket =
+      std::lower_bound(kLatencyBuckets.begin(), kLatencyBuckets.end(), latency_us) -
+      kLatencyBuckets.begin();
+  latency_frames_[bucket].fetch_add(1, std::memory_order_relaxed);
+  latency_sum_us_.fetch_add(latency_us, std::memory_order_relaxed);
+}
+
+void Metrics::add_dropped_frames(uint64_t frames) {
+  dropped_frames_.fetch_add(frames, std::memory_order_relaxed);
+}
+
+void Metrics::set_input_queue_depth(uint64_t frames) {
+  input_queue_depth_.store(frames, std::memory_order_relaxed);
+}
+
+void Metrics::set_writer_queue_depth(uint64_t frames) {
+  writer_queue_depth_.store(frames, std::memory_order_relaxed);
+}
+
+void Metrics::set_encoder_queue_depth(uint64_t frames) {
+  encoder_queue_depth_.store(frames, std::memory_order_relaxed);
+}
+
+MetricsSnapshot Metrics::snapshot() const {
+  MetricsSnapshot snapshot{};
+  snapshot.time = std::chrono::steady_clock::now();
+  snapshot.frames = frames_.load(std::memory_order_relaxed);
+  snapshot.bytes = bytes_.load(std::memory_order_relaxed);
+  snapshot.dropped_frames = dropped_frames_.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < latency_frames_.size(); i++) {
+    snapshot.latency_frames[i] = latency_frames_[i].load(std::memory_order_relaxed);
+  }
+  snapshot.latency_sum_us = latency_sum_us_.load(std::memory_order_relaxed);
+  snapshot.input_queue_depth = input_queue_depth_.load(std::memory_order_relaxed);
+  snapshot.writer_queue_depth = writer_queue_depth_.load(std::memory_order_relaxed);
+  snapshot.encoder_queue_depth = encoder_queue_depth_.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+double latency_percentile(const MetricsSnapshot& current,
+                          const MetricsSnapshot& previous,
+                          double percentile) {
+  std::array<uint64_t, kLatencyBuckets.size() + 1> frames{};
+  uint64_t total = 0;
+  for (size_t i = 0; i < frames.size(); i++) {
+    frames[i] = current.latency_frames[i] - previous.latency_frames[i];
+    total += frames[i];
+  }
+  if (total == 0) {
+    return -1;
+  }
+  const double target = percentile * total;
+  uint64_t below = 0;
+  for (size_t i = 0; i < frames.size(); i++) {
+    if (frames[i] == 0 || below + frames[i] < target) {
+      below += frames[i];
+      continue;
+    }
+    const double lower = i ? kLatencyBuckets[i - 1] : 0;
+    // Slower than the last bound, only the bound is known.
+    if (i == kLatencyBuckets.size()) {
+      return lower;
+    }
+    return lower + (kLatencyBuckets[i] - lower) * (target - below) / frames[i];
+  }
+  return kLatencyBuckets.back();
+}
+
+static void write_metric(std::ostream& output,
+                         const char* name,
+                         const char* type,
+                         const char* help,
+                         double value) {
+  output << "# HELP " << name << " " << help << "\n"
+         << "# TYPE " << name << " " << type << "\n"
+         << name << " " << value << "\n";
+}
+
+void write_metrics(std::ostream& output,
+                   const MetricsSnapshot& current,
+                   const MetricsSnapshot& previous) {
+  const double seconds = std::chrono::duration<double>(current.time - previous.time).count();
+  const double fps = seconds > 0 ? (current.frames - previous.frames) / seconds : 0;
+  const double p99_latency_us = latency_percentile(current, previous, 0.99);
+  // Integers print in full, counters pass a million frames.
+  output.precision(15);
+  write_metric(output,
+               "encodeapp_frames_encoded_total",
+               "counter",
+               "Frames encoded.",
+               current.frames);
+  write_metric(
+      output, "encodeapp_output_bytes_total", "counter", "Encoded bytes.", current.bytes);
+  write_metric(output,
+               "encodeapp_dropped_frames_total",
+               "counter",
+               "Input frames dropped before encoding.",
+               current.dropped_frames);
+  write_metric(output,
+               "encodeapp_fps",
+               "gauge",
+               "Frames encoded per second since the previous update.",
+               fps);
+  write_metric(output,
+               "encodeapp_input_queue_depth",
+               "gauge",
+               "Frames waiting in the input queue of paced input.",
+               current.input_queue_depth);
+  write_metric(output,
+               "encodeapp_writer_queue_depth",
+               "gauge",
+               "Encoded frames waiting for the output writer.",
+               current.writer_queue_depth);
+  write_metric(output,
+               "encodeapp_encoder_queue_depth",
+               "gauge",
+               "Frames submitted to the encoder and not encoded yet.",
+               current.encoder_queue_depth);
+  write_metric(output,
+               "encodeapp_latency_p99_seconds",
+               "gauge",
+               "99th percentile encode latency since the previous update, NaN without frames.",
+               p99_latency_us < 0 ? std::nan("") : p99_latency_us / 1e6);
+
+  output << "# HELP encodeapp_latency_seconds Encode latency from submit to bitstream ready.\n"
+         << "# TYPE encodeapp_latency_seconds histogram\n";
+  uint64_t frames = 0;
+  for (size_t i = 0; i < current.latency_frames.size(); i++) {
+    frames += current.latency_frames[i];
+    output << "encodeapp_latency_seconds_bucket{le=\"";
+    if (i < kLatencyBuckets.size()) {
+      output << kLatencyBuckets[i] / 1e6;
+    } else {
+      output << "+Inf";
+    }
+    output << "\"} " << frames << "\n";
+  }
+  output << "encodeapp_latency_seconds_sum " << current.latency_sum_us / 1e6 << "\n"
+         << "encodeapp_latency_seconds_count " << frames << "\n";
+}
+
+static int listen_localhost(int port) {
+  const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::runtime_error(std::string{"socket failed: "} + std::strerror(errno));
+  }
+  const int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(static_cast<uint16_t>(port));
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(fd, kListenBacklog) != 0) {
+    const int error = errno;
+    close(fd);
+    throw std::runtime_error("Couldn't listen on port " + std::to_string(port) + ": " +
+                             std::strerror(error));
+  }
+  return fd;
+}
+
+MetricsExporter::MetricsExporter(const Metrics& metrics,
+                                 std::string filename,
+                                 int port,
+                                 std::chrono::milliseconds interval) :
+  metrics_{metrics},
+  filename_{std::move(filename)},
+  interval_{interval},
+  listen_fd_{-1},
+  port_{-1},
+  stop_fds_{-1, -1},
+  previous_{metrics.snapshot()} {
+  if (port >= 0) {
+    listen_fd_ = listen_localhost(port);
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length);
+    port_ = ntohs(address.sin_port);
+  }
+  if (pipe2(stop_fds_, O_CLOEXEC) != 0) {
+    const int error = errno;
+    if (listen_fd_ >= 0) {
+      close(listen_fd_);
+    }
+    throw std::runtime_error(std::string{"pipe failed: "} + std::strerror(error));
+  }
+  // Scrapes before the first interval see zeros rather than nothing.
+  std::ostringstream text;
+  write_metrics(text, previous_, previous_);
+  text_ = text.str();
+  thread_ = std::thread{&MetricsExporter::run, this};
+}
+
+MetricsExporter::~MetricsExporter() {
+  const char stop = 0;
+  while (write(stop_fds_[1], &stop, 1) < 0 && errno == EINTR) {
+  }
+  thread_.join();
+  close(stop_fds_[0]);
+  close(stop_fds_[1]);
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+  }
+}
+
+int MetricsExporter::port() const {
+  return port_;
+}
+
+void MetricsExporter::run() {
+  auto next_publish = std::chrono::steady_clock::now() + interval_;
+  while (true) {
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= next_publish) {
+      publish();
+      // Skips the updates missed while a client was served.
+      next_publish = std::max(next_publish + interval_, now);
+    }
+    pollfd fds[2] = {{stop_fds_[0], POLLIN, 0}, {listen_fd_, POLLIN, 0}};
+    const auto timeout =
+        std::chrono::duration_cast<std::chrono::milliseconds>(next_publish - now).count() + 1;
+    const int ready = poll(fds, listen_fd_ >= 0 ? 2 : 1, static_cast<int>(timeout));
+    if (ready < 0 && errno != EINTR) {
+      break;
+    }
+    if (fds[0].revents) {
+      break;
+    }
+    if (fds[1].revents & POLLIN) {
+      const int client = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client >= 0) {
+        serve(client);
+        close(client);
+      }
+    }
+  }
+  publish();
+}
+
+void MetricsExporter::publish() {
+  const auto current = metrics_.snapshot();
+  std::ostringstream text;
+  write_metrics(text, current, previous_);
+  text_ = text.str();
+  previous_ = current;
+  if (filename_.empty()) {
+    return;
+  }
+  // Readers see the previous file or the new one, never a partial write.
+  const auto temporary = filename_ + ".tmp";
+  std::ofstream output{temporary};
+  output << text_;
+  output.close();
+  if (!output || std::rename(temporary.c_str(), filename_.c_str()) != 0) {
+    std::remove(temporary.c_str());
+  }
+}
+
+void MetricsExporter::serve(int client) {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds{kRequestTimeoutMs};
+  const timeval timeout{0, kRequestTimeoutMs * 1000};
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  std::string request;
+  while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequestSize) {
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                               deadline - std::chrono::steady_clock::now())
+                               .count();
+    pollfd fd{client, POLLIN, 0};
+    const int ready = remaining > 0 ? poll(&fd, 1, static_cast<int>(remaining)) : 0;
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready <= 0) {
+      return;
+    }
+    char chunk[1024];
+    const auto ret = read(client, chunk, sizeof(chunk));
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      return;
+    }
+    request.append(chunk, ret);
+  }
+  // Any path but the request line is ignored.
+  const auto path_start = request.find(' ') + 1;
+  const auto path = request.substr(path_start, request.find(' ', path_start) - path_start);
+  std::string status = "200 OK";
+  std::string body = text_;
+  if (request.compare(0, 4, "GET ") != 0) {
+    status = "405 Method Not Allowed";
+    body.clear();
+  } else if (path != "/metrics" && path != "/") {
+    status = "404 Not Found";
+    body.clear();
+  }
+  const auto response = "HTTP/1.1 " + status +
+                        "\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Content-Length: " +
+                        std::to_string(body.size()) +
+                        "\r\n"
+                        "Connection: close\r\n\r\n" +
+                        body;
+  size_t sent = 0;
+  while (sent < response.size()) {
+    const auto ret = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      return;
+    }
+    sent += ret;
+  }
+}
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Upper bounds of the latency histogram buckets in microseconds, a last
+// bucket takes the slower frames.
+constexpr const std::array<long, 20> kLatencyBuckets{
+    250,   500,   1000,   2000,   3000,   5000,   7500,   10000,  15000,   20000,
+    30000, 50000, 75000, 100000, 150000, 200000, 300000, 500000, 1000000, 2000000};
+
+// Values of the metrics at one point in time.
+struct MetricsSnapshot {
+  std::chrono::steady_clock::time_point time{};
+  uint64_t frames = 0;
+  uint64_t bytes = 0;
+  uint64_t dropped_frames = 0;
+  // Frames per latency bucket, not cumulative.
+  std::array<uint64_t, kLatencyBuckets.size() + 1> latency_frames{};
+  uint64_t latency_sum_us = 0;
+  uint64_t input_queue_depth = 0;
+  uint64_t writer_queue_depth = 0;
+  uint64_t encoder_queue_depth = 0;
+};
+
+// Counters and gauges of a running encode. Updates are single atomic adds
+// and stores, the encode loop never waits on a reader.
+class Metrics {
+ public:
+  // An encoded frame, latency_us < 0 when the input frame isn't known.
+  void add_frame(uint64_t bytes, long latency_us);
+
+  void add_dropped_frames(uint64_t frames);
+
+  // Frames waiting in the input queue of a paced source.
+  void set_input_queue_depth(uint64_t frames);
+
+  // Frames waiting for the output writer.
+  void set_writer_queue_depth(uint64_t frames);
+
+  // Frames submitted to the encoder and not encoded yet.
+  void set_encoder_queue_depth(uint64_t frames);
+
+  MetricsSnapshot snapshot() const;
+
+ private:
+  std::atomic<uint64_t> frames_{0};
+  std::atomic<uint64_t> bytes_{0};
+  std::atomic<uint64_t> dropped_frames_{0};
+  std::array<std::atomic<uint64_t>, kLatencyBuckets.size() + 1> latency_frames_{};
+  std::atomic<uint64_t> latency_sum_us_{0};
+  std::atomic<uint64_t> input_queue_depth_{0};
+  std::atomic<uint64_t> writer_queue_depth_{0};
+  std::atomic<uint64_t> encoder_queue_depth_{0};
+};
+
+// Latency percentile in microseconds of the frames encoded between two
+// snapshots, interpolated within its bucket. -1 without frames.
+double latency_percentile(const MetricsSnapshot& current,
+                          const MetricsSnapshot& previous,
+                          double percentile);
+
+// Writes the metrics in the Prometheus text format. The frame rate and p99
+// latency gauges cover the frames encoded since previous.
+void write_metrics(std::ostream& output,
+                   const MetricsSnapshot& current,
+                   const MetricsSnapshot& previous);
+
+// Publishes the metrics every interval on its own thread, to a text file
+// replaced atomically, as read by the node exporter textfile collector, and
+// to HTTP clients on a localhost port. An empty filename or a port < 0
+// leaves that out, port 0 listens on any free port. Throws
+// std::runtime_error when the port can't be opened.
+class MetricsExporter {
+ public:
+  MetricsExporter(const Metrics& metrics,
+                  std::string filename,
+                  int port,
+                  std::chrono::milliseconds interval);
+  // Publishes the final values.
+  ~MetricsExporter();
+
+  MetricsExporter(const MetricsExporter&) = delete;
+  MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+  // Port listened on, -1 without a listener.
+  int port() const;
+
+ private:
+  void run();
+  void publish();
+  void serve(int client);
+
+  const Metrics& metrics_;
+  const std::string filename_;
+  const std::chrono::milliseconds interval_;
+  int listen_fd_;
+  int port_;
+  // Written to by the destructor to wake the thread.
+  int stop_fds_[2];
+  // Only touched by the exporter thread.
+  MetricsSnapshot previous_;
+  std::string text_;
+  std::thread thread_;
+};
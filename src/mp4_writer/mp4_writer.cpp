@@ -0,0 +1,412 @@
+// SPDX-License-Identifier: MIT
+
+#include <stdexcept>
+
+#include "mp4_writer.hpp"
+
+constexpr const uint32_t kTrackId = 1;
+constexpr const uint32_t kSampleFlagsKey = 0x02000000;
+// sample_depends_on other samples, sample_is_non_sync_sample.
+constexpr const uint32_t kSampleFlagsNonKey = 0x01010000;
+constexpr const int kH264NalAud = 9;
+constexpr const int kH265NalAud = 35;
+
+// Big endian box builder, sizes are filled in when a box ends.
+class BoxBuilder {
+ public:
+  explicit BoxBuilder(std::vector<uint8_t>* bytes) : bytes_{bytes} {}
+
+  size_t begin(const char* type) {
+    const size_t start = bytes_->size();
+    u32(0);
+    bytes_->insert(bytes_->end(), type, type + 4);
+    return start;
+  }
+
+  size_t begin_full(const char* type, uint8_t version, uint32_t flags) {
+    const size_t start = begin(type);
+    u32((static_cast<uint32_t>(version) << 24) | flags);
+    return start;
+  }
+
+  void end(size_t start) { patch_u32(start, bytes_->size() - start); }
+
+  void u8(uint8_t value) { bytes_->push_back(value); }
+
+  void u16(uint16_t value) {
+    u8(value >> 8);
+    u8(value & 0xff);
+  }
+
+  void u32(uint32_t value) {
+    u16(value >> 16);
+    u16(value & 0xffff);
+  }
+
+  void u64(uint64_t value) {
+    u32(value >> 32);
+    u32(value & 0xffffffff);
+  }
+
+  void zeros(size_t count) { bytes_->insert(bytes_->end(), count, 0); }
+
+  void append(const uint8_t* data, size_t size) {
+    bytes_->insert(bytes_->end(), data, data + size);
+  }
+
+  void patch_u16(size_t position, uint16_t value) {
+    (*bytes_)[position] = value >> 8;
+    (*bytes_)[position + 1] = value & 0xff;
+  }
+
+  void patch_u32(size_t position, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+      (*bytes_)[position + i] = (value >> (24 - 8 * i)) & 0xff;
+    }
+  }
+
+  size_t size() const { return bytes_->size(); }
+
+ private:
+  std::vector<uint8_t>* bytes_;
+};
+
+static void write_matrix(BoxBuilder* box) {
+  for (const uint32_t value : {0x00010000u, 0u, 0u, 0u, 0x00010000u, 0u, 0u, 0u, 0x40000000u}) {
+    box->u32(value);
+  }
+}
+
+static const NalUnit* find_nal(const std::vector<NalUnit>& nal_units, int type) {
+  for (const auto& nal : nal_units) {
+    if (nal.type == type) {
+      return &nal;
+    }
+  }
+  return nullptr;
+}
+
+static void write_avcc(BoxBuilder* box, const std::vector<NalUnit>& nal_units) {
+  const auto* sps_nal = find_nal(nal_units, kH264NalSps);
+  const auto* pps_nal = find_nal(nal_units, kH264NalPps);
+  if (!sps_nal || !pps_nal) {
+    throw std::runtime_error("First key frame has no SPS and PPS");
+  }
+  const auto sps = parse_h264_sps(*sps_nal);
+  const auto avcc = box->begin("avcC");
+  box->u8(1);
+  box->u8(sps.profile_idc);
+  box->u8(sps.constraint_flags);
+  box->u8(sps.level_idc);
+  box->u8(0xfc | 3);  // four byte NAL unit lengths
+  box->u8(0xe0 | 1);
+  box->u16(sps_nal->size);
+  box->append(sps_nal->data, sps_nal->size);
+  box->u8(1);
+  box->u16(pps_nal->size);
+  box->append(pps_nal->data, pps_nal->size);
+  if (sps.profile_idc == 100 || sps.profile_idc == 110 || sps.profile_idc == 122 ||
+      sps.profile_idc == 144) {
+    box->u8(0xfc | sps.chroma_format_idc);
+    box->u8(0xf8 | (sps.bit_depth_luma - 8));
+    box->u8(0xf8 | (sps.bit_depth_chroma - 8));
+    box->u8(0);
+  }
+  box->end(avcc);
+}
+
+static void write_hvcc(BoxBuilder* box, const std::vector<NalUnit>& nal_units) {
+  const auto* sps_nal = find_nal(nal_units, kH265NalSps);
+  if (!find_nal(nal_units, kH265NalVps) || !sps_nal || !find_nal(nal_units, kH265NalPps)) {
+    throw std::runtime_error("First key frame has no VPS, SPS and PPS");
+  }
+  const auto sps = parse_h265_sps(*sps_nal);
+  const auto hvcc = box->begin("hvcC");
+  box->u8(1);
+  box->u8((sps.profile_space << 6) | (sps.tier_flag << 5) | sps.profile_idc);
+  box->u32(sps.profile_compatibility_flags);
+  box->u16(sps.constraint_indicator_flags >> 32);
+  box->u32(sps.constraint_indicator_flags & 0xffffffff);
+  box->u8(sps.level_idc);
+  box->u16(0xf000);  // min_spatial_segmentation_idc
+  box->u8(0xfc);     // parallelismType
+  box->u8(0xfc | sps.chroma_format_idc);
+  box->u8(0xf8 | (sps.bit_depth_luma - 8));
+  box->u8(0xf8 | (sps.bit_depth_chroma - 8));
+  box->u16(0);  // avgFrameRate
+  box->u8((sps.max_sub_layers << 3) | (sps.temporal_id_nesting << 2) | 3);
+  box->u8(3);
+  for (const int type : {kH265NalVps, kH265NalSps, kH265NalPps}) {
+    // array_completeness is 0, parameter sets can also be in band.
+    box->u8(type);
+    const size_t count_position = box->size();
+    box->u16(0);
+    uint16_t count = 0;
+    for (const auto& nal : nal_units) {
+      if (nal.type == type) {
+        box->u16(nal.size);
+        box->append(nal.data, nal.size);
+        count++;
+      }
+    }
+    box->patch_u16(count_position, count);
+  }
+  box->end(hvcc);
+}
+
+static void write_av1c(BoxBuilder* box, const std::vector<NalUnit>& obus) {
+  const auto* sequence_header_obu = find_nal(obus, kAv1ObuSequenceHeader);
+  if (!sequence_header_obu) {
+    throw std::runtime_error("First key frame has no sequence header");
+  }
+  const auto header = parse_av1_sequence_header(*sequence_header_obu);
+  const auto av1c = box->begin("av1C");
+  box->u8(0x81);
+  box->u8((header.profile << 5) | header.level_idx);
+  box->u8((header.tier << 7) | (header.high_bitdepth << 6) | (header.twelve_bit << 5) |
+          (header.monochrome << 4) | (header.subsampling_x << 3) | (header.subsampling_y << 2) |
+          header.chroma_sample_position);
+  box->u8(0);  // no initial_presentation_delay
+  box->append(sequence_header_obu->data, sequence_header_obu->size);
+  box->end(av1c);
+}
+
+static void write_sample_entry(BoxBuilder* box,
+                               const Mp4Track& track,
+                               const std::vector<NalUnit>& nal_units) {
+  const char* types[] = {"avc3", "hev1", "av01"};
+  const auto entry = box->begin(types[static_cast<int>(track.codec)]);
+  box->zeros(6);
+  box->u16(1);  // data_reference_index
+  box->zeros(16);
+  box->u16(track.width);
+  box->u16(track.height);
+  box->u32(0x00480000);  // 72 dpi
+  box->u32(0x00480000);
+  box->u32(0);
+  box->u16(1);  // frame_count
+  box->zeros(32);
+  box->u16(0x0018);
+  box->u16(0xffff);
+  switch (track.codec) {
+  case NalCodec::h264:
+    write_avcc(box, nal_units);
+    break;
+  case NalCodec::h265:
+    write_hvcc(box, nal_units);
+    break;
+  case NalCodec::av1:
+    write_av1c(box, nal_units);
+    break;
+  }
+  box->end(entry);
+}
+
+Mp4Writer::Mp4Writer(const std::string& filename, const Mp4Track& track) :
+  output_{filename, std::ios_base::out | std::ios_base::binary},
+  track_{track},
+  initialized_{false},
+  first_dts_{0},
+  sequence_number_{0},
+  fragment_decode_time_{0} {
+  if (!output_) {
+    throw std::runtime_error("Couldn't open " + filename);
+  }
+}
+
+void Mp4Writer::write(const EncodedFrame& frame) {
+  const auto nal_units = split_nal_units(frame.data, frame.size, track_.codec);
+  if (!initialized_) {
+    if (!frame.key) {
+      throw std::runtime_error("Stream doesn't start with a key frame");
+    }
+    write_init_segment(nal_units);
+    first_dts_ = frame.dts;
+    initialized_ = true;
+  }
+  if (!samples_.empty() && (frame.key || samples_.size() >= kMaxFragmentFrames)) {
+    write_fragment();
+  }
+  if (samples_.empty()) {
+    fragment_decode_time_ = frame.dts - first_dts_;
+  }
+
+  const size_t sample_start = mdat_.size();
+  BoxBuilder mdat{&mdat_};
+  for (const auto& nal : nal_units) {
+    if (track_.codec == NalCodec::av1) {
+      if (nal.type != kAv1ObuTemporalDelimiter) {
+        mdat.append(nal.data, nal.size);
+      }
+      continue;
+    }
+    if ((track_.codec == NalCodec::h264 && nal.type == kH264NalAud) ||
+        (track_.codec == NalCodec::h265 && nal.type == kH265NalAud) || nal.size == 0) {
+      continue;
+    }
+    mdat.u32(nal.size);
+    mdat.append(nal.data, nal.size);
+  }
+  samples_.push_back({static_cast<uint32_t>(mdat_.size() - sample_start),
+                      static_cast<uint32_t>(frame.duration),
+                      frame.key ? kSampleFlagsKey : kSampleFlagsNonKey,
+                      static_cast<int32_t>(frame.pts - frame.dts)});
+}
+
+void Mp4Writer::close() {
+  if (!samples_.empty()) {
+    write_fragment();
+  }
+  output_.close();
+  if (!output_) {
+    throw std::runtime_error("Couldn't close MP4 file");
+  }
+}
+
+void Mp4Writer::write_init_segment(const std::vector<NalUnit>& nal_units) {
+  std::vector<uint8_t> bytes;
+  BoxBuilder box{&bytes};
+
+  const auto ftyp = box.begin("ftyp");
+  box.append(reinterpret_cast<const uint8_t*>("iso6"), 4);
+  box.u32(0);
+  box.append(reinterpret_cast<const uint8_t*>("iso6iso5mp41"), 12);
+  box.end(ftyp);
+
+  const auto moov = box.begin("moov");
+  const auto mvhd = box.begin_full("mvhd", 0, 0);
+  box.u32(0);  // creation_time
+  box.u32(0);  // modification_time
+  box.u32(track_.timescale);
+  box.u32(0);  // duration, in the fragments
+  box.u32(0x00010000);
+  box.u16(0x0100);
+  box.zeros(10);
+  write_matrix(&box);
+  box.zeros(24);
+  box.u32(kTrackId + 1);
+  box.end(mvhd);
+
+  const auto trak = box.begin("trak");
+  const auto tkhd = box.begin_full("tkhd", 0, 3);  // enabled, in movie
+  box.u32(0);
+  box.u32(0);
+  box.u32(kTrackId);
+  box.u32(0);
+  box.u32(0);
+  box.zeros(8);
+  box.u16(0);  // layer
+  box.u16(0);  // alternate_group
+  box.u16(0);  // volume
+  box.u16(0);
+  write_matrix(&box);
+  box.u32(static_cast<uint32_t>(track_.width) << 16);
+  box.u32(static_cast<uint32_t>(track_.height) << 16);
+  box.end(tkhd);
+
+  const auto mdia = box.begin("mdia");
+  const auto mdhd = box.begin_full("mdhd", 0, 0);
+  box.u32(0);
+  box.u32(0);
+  box.u32(track_.timescale);
+  box.u32(0);
+  box.u16(0x55c4);  // "und"
+  box.u16(0);
+  box.end(mdhd);
+  const auto hdlr = box.begin_full("hdlr", 0, 0);
+  box.u32(0);
+  box.append(reinterpret_cast<const uint8_t*>("vide"), 4);
+  box.zeros(12);
+  box.append(reinterpret_cast<const uint8_t*>("VideoHandler"), 13);
+  box.end(hdlr);
+
+  const auto minf = box.begin("minf");
+  const auto vmhd = box.begin_full("vmhd", 0, 1);
+  box.zeros(8);
+  box.end(vmhd);
+  const auto dinf = box.begin("dinf");
+  const auto dref = box.begin_full("dref", 0, 0);
+  box.u32(1);
+  box.end(box.begin_full("url ", 0, 1));  // media in the same file
+  box.end(dref);
+  box.end(dinf);
+
+  const auto stbl = box.begin("stbl");
+  const auto stsd = box.begin_full("stsd", 0, 0);
+  box.u32(1);
+  write_sample_entry(&box, track_, nal_units);
+  box.end(stsd);
+  // Samples are described by the fragments.
+  for (const char* type : {"stts", "stsc", "stco"}) {
+    const auto table = box.begin_full(type, 0, 0);
+    box.u32(0);
+    box.end(table);
+  }
+  const auto stsz = box.begin_full("stsz", 0, 0);
+  box.u32(0);
+  box.u32(0);
+  box.end(stsz);
+  box.end(stbl);
+  box.end(minf);
+  box.end(mdia);
+  box.end(trak);
+
+  const auto mvex = box.begin("mvex");
+  const auto trex = box.begin_full("trex", 0, 0);
+  box.u32(kTrackId);
+  box.u32(1);  // default_sample_description_index
+  box.u32(0);
+  box.u32(0);
+  box.u32(0);
+  box.end(trex);
+  box.end(mvex);
+  box.end(moov);
+
+  write_bytes(bytes);
+}
+
+void Mp4Writer::write_fragment() {
+  std::vector<uint8_t> bytes;
+  BoxBuilder box{&bytes};
+  const auto moof = box.begin("moof");
+  const auto mfhd = box.begin_full("mfhd", 0, 0);
+  box.u32(++sequence_number_);
+  box.end(mfhd);
+  const auto traf = box.begin("traf");
+  const auto tfhd = box.begin_full("tfhd", 0, 0x020000);  // default-base-is-moof
+  box.u32(kTrackId);
+  box.end(tfhd);
+  const auto tfdt = box.begin_full("tfdt", 1, 0);
+  box.u64(fragment_decode_time_);
+  box.end(tfdt);
+  // data-offset, sample duration, size, flags and composition time offset
+  const auto trun = box.begin_full("trun", 1, 0x000f01);
+  box.u32(samples_.size());
+  const size_t data_offset_position = box.size();
+  box.u32(0);
+  for (const auto& sample : samples_) {
+    box.u32(sample.duration);
+    box.u32(sample.size);
+    box.u32(sample.flags);
+    box.u32(static_cast<uint32_t>(sample.composition_offset));
+  }
+  box.end(trun);
+  box.end(traf);
+  box.end(moof);
+  box.patch_u32(data_offset_position, box.size() - moof + 8);
+
+  box.u32(mdat_.size() + 8);
+  box.append(reinterpret_cast<const uint8_t*>("mdat"), 4);
+  write_bytes(bytes);
+  write_bytes(mdat_);
+  // Keeps the capacity for the next fragment.
+  mdat_.clear();
+  samples_.clear();
+}
+
+void Mp4Writer::write_bytes(const std::vector<uint8_t>& bytes) {
+  output_.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+  if (!output_) {
+    throw std::runtime_error("Couldn't write MP4 file");
+  }
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "bitstream_parser/bitstream_parser.hpp"
+#include "stream_writer/stream_writer.hpp"
+
+struct Mp4Track {
+  NalCodec codec;
+  int width;
+  int height;
+  uint32_t timescale;
+};
+
+// Fragments are written at key frames and at most this many frames apart.
+constexpr const size_t kMaxFragmentFrames = 120;
+
+// Fragmented MP4 with a single video track. The init segment is written with
+// the first frame, a key frame carrying the parameter sets or the sequence
+// header. Only the fragment being built is held in memory. Parameter sets
+// are kept in band (avc3, hev1) so a reconfigured stream stays decodable.
+class Mp4Writer : public StreamWriter {
+ public:
+  Mp4Writer(const std::string& filename, const Mp4Track& track);
+
+  void write(const EncodedFrame& frame) override;
+  void close() override;
+
+ private:
+  struct Sample {
+    uint32_t size;
+    uint32_t duration;
+    uint32_t flags;
+    int32_t composition_offset;
+  };
+
+  void write_init_segment(const std::vector<NalUnit>& nal_units);
+  void write_fragment();
+  void write_bytes(const std::vector<uint8_t>& bytes);
+
+  std::ofstream output_;
+  const Mp4Track track_;
+  bool initialized_;
+  int64_t first_dts_;
+  uint32_t sequence_number_;
+  int64_t fragment_decode_time_;
+  std::vector<Sample> samples_;
+  std::vector<uint8_t> mdat_;
+};
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: MIT
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "numa.hpp"
+
+// From linux/mempolicy.h, not shipped with every libc.
+constexpr const int kMpolBind = 2;
+
+std::vector<int> parse_cpu_list(const std::string& cpu_list) {
+  std::vector<int> cpus;
+  std::istringstream ranges{cpu_list};
+  std::string range;
+  while (std::getline(ranges, range, ',')) {
+    if (range.find_first_not_of(" \n") == std::string::npos) {
+      continue;
+    }
+    const auto dash = range.find('-');
+    const int first = std::stoi(range.substr(0, dash));
+    const int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+static std::string read_first_line(const std::filesystem::path& path) {
+  std::ifstream file{path};
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+std::vector<NumaNode> numa_topology(const std::string& sysfs_root) {
+  std::vector<NumaNode> topology;
+  const std::filesystem::path node_dir = std::filesystem::path(sysfs_root) / "node";
+  std::error_code error;
+  for (const auto& entry : std::filesystem::directory_iterator(node_dir, error)) {
+    const auto name = entry.path().filename().string();
+    if (name.rfind("node", 0) != 0 || name.size() == 4 ||
+        name.find_first_not_of("0123456789", 4) != std::string::npos) {
+      continue;
+    }
+    NumaNode node{std::stoi(name.substr(4)),
+                  parse_cpu_list(read_first_line(entry.path() / "cpulist"))};
+    if (!node.cpus.empty()) {
+      topology.push_back(std::move(node));
+    }
+  }
+  if (topology.empty()) {
+    const auto online = std::filesystem::path(sysfs_root) / "cpu" / "online";
+    topology.push_back({0, parse_cpu_list(read_first_line(online))});
+  }
+  std::sort(topology.begin(), topology.end(), [](const NumaNode& a, const NumaNode& b) {
+    return a.id < b.id;
+  });
+  return topology;
+}
+
+NumaPolicy numa_policy_from_string(const std::string& policy) {
+  if (policy == "off") {
+    return {NumaPolicy::Mode::off, -1};
+  }
+  if (policy == "auto") {
+    return {NumaPolicy::Mode::automatic, -1};
+  }
+  if (policy.rfind("node:", 0) == 0 && policy.size() > 5 &&
+      policy.find_first_not_of("0123456789", 5) == std::string::npos) {
+    return {NumaPolicy::Mode::node, std::stoi(policy.substr(5))};
+  }
+  throw std::invalid_argument("Unknown NUMA policy " + policy);
+}
+
+int numa_node_for(const NumaPolicy& policy, const std::vector<NumaNode>& topology, size_t session) {
+  switch (policy.mode) {
+  case NumaPolicy::Mode::automatic:
+    return topology.empty() ? -1 : session % topology.size();
+  case NumaPolicy::Mode::node: {
+    const auto found =
+        std::find_if(topology.begin(), topology.end(), [&policy](const NumaNode& node) {
+          return node.id == policy.node;
+        });
+    if (found == topology.end()) {
+      throw std::invalid_argument("No NUMA node " + std::to_string(policy.node));
+    }
+    return found - topology.begin();
+  }
+  default:
+    return -1;
+  }
+}
+
+bool pin_thread(const std::vector<int>& cpus) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (const int cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &cpu_set);
+    }
+  }
+  return CPU_COUNT(&cpu_set) > 0 &&
+         pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+}
+
+bool bind_memory(void* address, size_t size, int node) {
+  constexpr const size_t kBitsPerMask = sizeof(unsigned long) * 8;
+  if (node < 0 || static_cast<size_t>(node) >= kBitsPerMask * 16) {
+    return false;
+  }
+  unsigned long node_mask[16] = {};
+  node_mask[node / kBitsPerMask] = 1UL << (node % kBitsPerMask);
+  return syscall(SYS_mbind, address, size, kMpolBind, node_mask, kBitsPerMask * 16 + 1, 0) == 0;
+}
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct NumaNode {
+  int id;
+  std::vector<int> cpus;
+};
+
+// Parses a kernel cpu list such as "0-3,8,10-11".
+std::vector<int> parse_cpu_list(const std::string& cpu_list);
+
+// Nodes with their cpus from sysfs, a single node 0 with every online cpu on
+// kernels without NUMA support.
+std::vector<NumaNode> numa_topology(const std::string& sysfs_root = "/sys/devices/system");
+
+// --numa option: off, auto places sessions round robin over the nodes,
+// node:N places every session on node N.
+struct NumaPolicy {
+  enum class Mode { off, automatic, node };
+  Mode mode;
+  int node;
+};
+
+// Throws std::invalid_argument for unknown policies.
+NumaPolicy numa_policy_from_string(const std::string& policy);
+
+// Index into topology of the node running the session, -1 when off.
+int numa_node_for(const NumaPolicy& policy, const std::vector<NumaNode>& topology, size_t session);
+
+// Restricts the calling thread and threads it creates later to the cpus.
+bool pin_thread(const std::vector<int>& cpus);
+
+// Allocates the pages of the range on the node (mbind MPOL_BIND). Must be
+// called before the pages are touched.
+bool bind_memory(void* address, size_t size, int node);
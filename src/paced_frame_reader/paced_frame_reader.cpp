@@ -0,0 +1,274 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+#include "paced_frame_reader.hpp"
+
+#include "trace/trace.hpp"
+
+namespace vpl = oneapi::vpl;
+
+static long elapsed_us(std::chrono::steady_clock::time_point since,
+                       std::chrono::steady_clock::time_point until) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(until - since).count();
+}
+
+PacingPolicy pacing_policy_from_string(const std::string& policy) {
+  if (policy == "queue") {
+    return PacingPolicy::queue;
+  }
+  if (policy == "block") {
+    return PacingPolicy::block;
+  }
+  if (policy == "drop-oldest") {
+    return PacingPolicy::drop_oldest;
+  }
+  if (policy == "drop-newest") {
+    return PacingPolicy::drop_newest;
+  }
+  if (policy == "adapt") {
+    return PacingPolicy::adapt;
+  }
+  throw std::invalid_argument("Unknown pacing policy " + policy);
+}
+
+std::string to_string(PacingPolicy policy) {
+  switch (policy) {
+  case PacingPolicy::block:
+    return "block";
+  case PacingPolicy::drop_oldest:
+    return "drop-oldest";
+  case PacingPolicy::drop_newest:
+    return "drop-newest";
+  case PacingPolicy::adapt:
+    return "adapt";
+  default:
+    return "queue";
+  }
+}
+
+std::string to_string(BackpressureEvent::Action action) {
+  switch (action) {
+  case BackpressureEvent::Action::drop_oldest:
+    return "drop-oldest";
+  case BackpressureEvent::Action::drop_newest:
+    return "drop-newest";
+  case BackpressureEvent::Action::block:
+    return "block";
+  default:
+    return "targetusage";
+  }
+}
+
+PacedFrameReader::PacedFrameReader(vpl::frame_source_reader* frame_source,
+                                   double rate,
+                                   PacingPolicy policy,
+                                   size_t queue_frames,
+                                   uint16_t target_usage) :
+  frame_source_{frame_source},
+  rate_{rate},
+  policy_{policy},
+  queue_frames_{queue_frames},
+  started_{false},
+  anchor_time_{},
+  anchor_frame_{0},
+  next_arrival_{0},
+  latest_arrival_{},
+  last_arrival_{},
+  source_frames_{0},
+  blocked_{false},
+  base_target_usage_{target_usage},
+  target_usage_{target_usage},
+  reads_since_change_{queue_frames},
+  empty_reads_{0},
+  late_frames_{0},
+  dropped_frames_{0},
+  blocked_us_{0},
+  waited_us_{0} {
+  if (rate <= 0) {
+    throw std::invalid_argument("Invalid pacing rate " + std::to_string(rate));
+  }
+  if (queue_frames == 0) {
+    throw std::invalid_argument("Input queue needs room for a frame");
+  }
+}
+
+bool PacedFrameReader::is_EOS() {
+  return frame_source_->is_EOS();
+}
+
+mfxStatus PacedFrameReader::get_data(std::shared_ptr<vpl::frame_surface> sfc) {
+  auto now = std::chrono::steady_clock::now();
+  if (!started_) {
+    anchor_time_ = now;
+    latest_arrival_ = now;
+    started_ = true;
+  }
+  receive(now);
+  if (queue_.empty()) {
+    TraceScope trace{"pace"};
+    const auto wait_start = now;
+    std::this_thread::sleep_until(arrival(next_arrival_));
+    now = std::chrono::steady_clock::now();
+    waited_us_ += elapsed_us(wait_start, now);
+    receive(now);
+  }
+  const auto queued = queue_.front();
+  queue_.pop_front();
+  if (blocked_) {
+    // The held back frame arrives now that there is room for it.
+    const long blocked_us = elapsed_us(arrival(next_arrival_), now);
+    blocked_us_ += blocked_us;
+    auto* last = events_.empty() ? nullptr : &events_.back();
+    if (last && last->action == BackpressureEvent::Action::block &&
+        last->frame + last->frames == next_arrival_) {
+      last->frames++;
+      last->blocked_us += blocked_us;
+    } else {
+      events_.push_back({BackpressureEvent::Action::block,
+                         next_arrival_,
+                         1,
+                         queue_frames_,
+                         target_usage_,
+                         blocked_us});
+    }
+    anchor_time_ = now;
+    anchor_frame_ = next_arrival_;
+    blocked_ = false;
+    receive(now);
+  }
+  // Source frames before the queued one were dropped.
+  while (source_frames_ <= queued.frame) {
+    const mfxStatus status = frame_source_->get_data(sfc);
+    if (status != MFX_ERR_NONE) {
+      return status;
+    }
+    source_frames_++;
+  }
+  last_arrival_ = queued.arrival;
+  lateness_us_.push_back(elapsed_us(queued.arrival, now));
+  if (latest_arrival_ > queued.arrival) {
+    late_frames_++;
+  }
+  adapt();
+  return MFX_ERR_NONE;
+}
+
+void PacedFrameReader::set_rate(double rate) {
+  if (rate <= 0) {
+    throw std::invalid_argument("Invalid pacing rate " + std::to_string(rate));
+  }
+  if (started_ && !blocked_) {
+    anchor_time_ = arrival(next_arrival_);
+    anchor_frame_ = next_arrival_;
+  }
+  rate_ = rate;
+}
+
+size_t PacedFrameReader::queue_depth() const {
+  return queue_.size();
+}
+
+std::optional<uint16_t> PacedFrameReader::take_target_usage() {
+  auto target_usage = pending_target_usage_;
+  pending_target_usage_.reset();
+  return target_usage;
+}
+
+std::chrono::steady_clock::time_point PacedFrameReader::last_arrival() const {
+  return last_arrival_;
+}
+
+const std::vector<long>& PacedFrameReader::lateness_us() const {
+  return lateness_us_;
+}
+
+size_t PacedFrameReader::late_frames() const {
+  return late_frames_;
+}
+
+size_t PacedFrameReader::dropped_frames() const {
+  return dropped_frames_;
+}
+
+long PacedFrameReader::blocked_us() const {
+  return blocked_us_;
+}
+
+long PacedFrameReader::waited_us() const {
+  return waited_us_;
+}
+
+const std::vector<BackpressureEvent>& PacedFrameReader::events() const {
+  return events_;
+}
+
+std::chrono::steady_clock::time_point PacedFrameReader::arrival(size_t frame) const {
+  return anchor_time_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            std::chrono::duration<double>((frame - anchor_frame_) / rate_));
+}
+
+void PacedFrameReader::receive(std::chrono::steady_clock::time_point now) {
+  while (!blocked_ && arrival(next_arrival_) <= now) {
+    const size_t frame = next_arrival_;
+    if (policy_ != PacingPolicy::queue && queue_.size() >= queue_frames_) {
+      if (policy_ == PacingPolicy::block) {
+        blocked_ = true;
+        break;
+      }
+      if (policy_ == PacingPolicy::drop_newest) {
+        latest_arrival_ = arrival(frame);
+        add_drops(BackpressureEvent::Action::drop_newest, frame);
+        next_arrival_++;
+        continue;
+      }
+      queue_.pop_front();
+      add_drops(BackpressureEvent::Action::drop_oldest, frame);
+    }
+    latest_arrival_ = arrival(frame);
+    queue_.push_back({frame, latest_arrival_});
+    next_arrival_++;
+  }
+}
+
+void PacedFrameReader::add_drops(BackpressureEvent::Action action, size_t frame) {
+  dropped_frames_++;
+  // Frames dropped one after another make one event.
+  auto* last = events_.empty() ? nullptr : &events_.back();
+  if (last && last->action == action && last->frame + last->frames == frame) {
+    last->frames++;
+    return;
+  }
+  events_.push_back({action, frame, 1, queue_.size(), target_usage_, 0});
+}
+
+void PacedFrameReader::adapt() {
+  if (policy_ != PacingPolicy::adapt) {
+    return;
+  }
+  reads_since_change_++;
+  empty_reads_ = queue_.empty() ? empty_reads_ + 1 : 0;
+  // A change shows once the frames encoded before it are out, the queue gets
+  // that long to drain before the next one.
+  const size_t high_depth = std::max<size_t>(1, queue_frames_ * 3 / 4);
+  if (queue_.size() >= high_depth && target_usage_ < MFX_TARGETUSAGE_BEST_SPEED &&
+      reads_since_change_ >= queue_frames_) {
+    target_usage_++;
+  } else if (empty_reads_ >= rate_ && target_usage_ > base_target_usage_) {
+    // Complexity comes back after a second without a queue.
+    target_usage_--;
+  } else {
+    return;
+  }
+  pending_target_usage_ = target_usage_;
+  reads_since_change_ = 0;
+  empty_reads_ = 0;
+  events_.push_back({BackpressureEvent::Action::target_usage,
+                     source_frames_,
+                     0,
+                     queue_.size(),
+                     target_usage_,
+                     0});
+}
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "vpl/preview/vpl.hpp"
+
+// Frames the input queue of a paced source holds by default.
+constexpr const size_t kInputQueueFrames = 4;
+
+// What a paced source does when its input queue is full. queue never fills,
+// block holds the source back until the encoder takes a frame, drop_oldest
+// makes room by dropping the oldest queued frame, drop_newest drops the
+// arriving frame. adapt lowers the encoder complexity while the queue fills
+// and raises it again once the queue stays empty, it drops the oldest frame
+// when the queue is full.
+enum class PacingPolicy { queue, block, drop_oldest, drop_newest, adapt };
+
+// Throws std::invalid_argument for unknown policies.
+PacingPolicy pacing_policy_from_string(const std::string& policy);
+
+std::string to_string(PacingPolicy policy);
+
+// Action a paced source took against backpressure.
+struct BackpressureEvent {
+  enum class Action { drop_oldest, drop_newest, block, target_usage };
+  Action action;
+  // Source frame arriving when the action was taken, for target usage the
+  // next frame read.
+  size_t frame;
+  // Frames dropped, or held back by block.
+  size_t frames;
+  // Frames queued when the action was taken.
+  size_t queue_depth;
+  // Target usage asked for by adapt.
+  uint16_t target_usage;
+  // Time the source was held back by block.
+  long blocked_us;
+};
+
+std::string to_string(BackpressureEvent::Action action);
+
+// Hands out the frames of another source no faster than a live source at
+// rate fps would, frame n arriving n / rate seconds after the first read.
+// Frames that arrive before the encoder takes them wait in an input queue of
+// queue_frames, reads block until a frame arrives. A frame is late when a
+// newer frame arrived before it was read, so the encoder doesn't keep up.
+class PacedFrameReader : public oneapi::vpl::frame_source_reader {
+ public:
+  // target_usage is the encoder complexity adapt starts from and returns to.
+  PacedFrameReader(oneapi::vpl::frame_source_reader* frame_source,
+                   double rate,
+                   PacingPolicy policy,
+                   size_t queue_frames = kInputQueueFrames,
+                   uint16_t target_usage = MFX_TARGETUSAGE_BALANCED);
+
+  bool is_EOS() override;
+
+  mfxStatus get_data(std::shared_ptr<oneapi::vpl::frame_surface> sfc) override;
+
+  // Frames arrive at rate from the next one on.
+  void set_rate(double rate);
+
+  // Frames waiting in the input queue after the last read.
+  size_t queue_depth() const;
+
+  // Target usage adapt asked for since the last call, to be applied with a
+  // reconfiguration before the next frame.
+  std::optional<uint16_t> take_target_usage();
+
+  // Arrival of the frame the last read handed out, the time a live source
+  // would have delivered it.
+  std::chrono::steady_clock::time_point last_arrival() const;
+
+  // Time from arrival to read of each frame handed out, in read order.
+  const std::vector<long>& lateness_us() const;
+
+  size_t late_frames() const;
+
+  // Frames dropped from the input queue or on arrival.
+  size_t dropped_frames() const;
+
+  // Time the source was held back by block.
+  long blocked_us() const;
+
+  // Time reads waited for frames to arrive.
+  long waited_us() const;
+
+  const std::vector<BackpressureEvent>& events() const;
+
+ private:
+  struct QueuedFrame {
+    size_t frame;
+    std::chrono::steady_clock::time_point arrival;
+  };
+
+  std::chrono::steady_clock::time_point arrival(size_t frame) const;
+  // Queues the frames that arrived until now, applying the policy.
+  void receive(std::chrono::steady_clock::time_point now);
+  void add_drops(BackpressureEvent::Action action, size_t frame);
+  void adapt();
+
+  oneapi::vpl::frame_source_reader* frame_source_;
+  double rate_;
+  const PacingPolicy policy_;
+  const size_t queue_frames_;
+  bool started_;
+  // Frames after anchor_frame_ arrive at anchor_time_ + n / rate_.
+  std::chrono::steady_clock::time_point anchor_time_;
+  size_t anchor_frame_;
+  size_t next_arrival_;
+  std::chrono::steady_clock::time_point latest_arrival_;
+  std::chrono::steady_clock::time_point last_arrival_;
+  std::deque<QueuedFrame> queue_;
+  // Frames taken from the source, handed out or dropped.
+  size_t source_frames_;
+  // The next frame waits for room in the queue.
+  bool blocked_;
+  const uint16_t base_target_usage_;
+  uint16_t target_usage_;
+  std::optional<uint16_t> pending_target_usage_;
+  // Reads since adapt changed the target usage and in a row with an empty
+  // queue.
+  size_t reads_since_change_;
+  size_t empty_reads_;
+  std::vector<long> lateness_us_;
+  size_t late_frames_;
+  size_t dropped_frames_;
+  long blocked_us_;
+  long waited_us_;
+  std::vector<BackpressureEvent> events_;
+};
@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: MIT
+
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+
+#include "perf_check.hpp"
+
+#include "statistics/statistics.hpp"
+
+// Sign of the change that counts as a regression, 0 for both.
+static const std::map<std::string, int> kRegressionSign{
+    {"fps", -1},
+    {"framesize", 0},
+    {"p50latency", 1},
+    {"p99latency", 1},
+};
+
+std::map<std::string, double> perf_metrics(const nlohmann::json& stats) {
+  const auto& frames = stats.at("frames");
+  if (!frames.is_array() || frames.empty()) {
+    throw std::runtime_error("Statistics hold no frames");
+  }
+  double size = 0;
+  std::vector<double> latencies;
+  for (const auto& frame : frames) {
+    size += frame.at("size").get<double>();
+    const double latency = frame.value("latency", -1.0);
+    if (latency >= 0) {
+      latencies.push_back(latency);
+    }
+  }
+  const double proctime = stats.at("proctime").get<double>();
+  return {{"fps", proctime > 0 ? frames.size() * 1000.0 / proctime : 0},
+          {"framesize", size / frames.size()},
+          {"p50latency", percentile(latencies, 0.5)},
+          {"p99latency", percentile(latencies, 0.99)}};
+}
+
+std::vector<PerfCheck> compare_perf(const nlohmann::json& baseline,
+                                    const std::map<std::string, double>& measured,
+                                    const std::map<std::string, double>& tolerances) {
+  std::vector<PerfCheck> checks;
+  for (const auto& [metric, value] : baseline.at("metrics").items()) {
+    const auto sign = kRegressionSign.find(metric);
+    const auto measurement = measured.find(metric);
+    if (sign == kRegressionSign.end() || measurement == measured.end()) {
+      throw std::runtime_error("Unknown metric " + metric);
+    }
+    PerfCheck check{metric, !value.is_null(), 0, measurement->second, 0, true};
+    const auto tolerance = tolerances.find(metric);
+    check.tolerance = tolerance != tolerances.end()
+                          ? tolerance->second
+                          : baseline.value("tolerances", nlohmann::json::object())
+                                .value(metric, 0.0);
+    if (check.recorded) {
+      check.baseline = value.get<double>();
+      const double allowed = std::abs(check.baseline) * check.tolerance;
+      const double change = check.measured - check.baseline;
+      if (sign->second == 0) {
+        check.passed = std::abs(change) <= allowed;
+      } else {
+        check.passed = change * sign->second <= allowed;
+      }
+    }
+    checks.push_back(check);
+  }
+  return checks;
+}
+
+void write_perf_report(const std::vector<PerfCheck>& checks, std::ostream& output) {
+  output << std::left << std::setw(12) << "metric" << std::right << std::setw(14) << "baseline"
+         << std::setw(14) << "measured" << std::setw(10) << "change" << std::setw(11)
+         << "tolerance" << std::endl;
+  output << std::fixed << std::setprecision(2);
+  for (const auto& check : checks) {
+    output << std::left << std::setw(12) << check.metric << std::right << std::setw(14);
+    if (check.recorded) {
+      output << check.baseline;
+    } else {
+      output << "-";
+    }
+    output << std::setw(14) << check.measured << std::setw(9);
+    if (check.recorded && check.baseline != 0) {
+      output << (check.measured - check.baseline) * 100 / check.baseline << "%";
+    } else {
+      output << "-" << " ";
+    }
+    output << std::setw(10) << check.tolerance * 100 << "%";
+    output << (!check.recorded ? "  not recorded" : check.passed ? "  ok" : "  REGRESSED")
+           << std::endl;
+  }
+}
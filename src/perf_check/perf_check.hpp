@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+// fps, mean frame size and p50/p99 latency of an encodeapp statistics file.
+// Throws std::runtime_error when the statistics hold no frames.
+std::map<std::string, double> perf_metrics(const nlohmann::json& stats);
+
+// Exit status of perf_check when the checks passed but the baseline misses
+// metrics, reported by ctest as skipped rather than passed.
+constexpr const int kPerfCheckSkipped = 77;
+
+struct PerfCheck {
+  std::string metric;
+  // Unset when the baseline has no value for the metric yet.
+  bool recorded;
+  double baseline;
+  double measured;
+  // Allowed change as a fraction of the baseline.
+  double tolerance;
+  bool passed;
+};
+
+// Checks the metrics of the baseline file, {"metrics": {...}, "tolerances":
+// {...}}. fps may only drop and latencies may only grow by their tolerance,
+// the frame size may move either way. tolerances override the file.
+std::vector<PerfCheck> compare_perf(const nlohmann::json& baseline,
+                                    const std::map<std::string, double>& measured,
+                                    const std::map<std::string, double>& tolerances = {});
+
+// Table of the checks, one row per metric.
+void write_perf_report(const std::vector<PerfCheck>& checks, std::ostream& output);
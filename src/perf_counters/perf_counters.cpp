@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: MIT
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "perf_counters.hpp"
+
+static std::vector<int> open_counter(uint64_t config,
+                                     const std::vector<pid_t>& threads,
+                                     std::string* error) {
+  perf_event_attr attr{};
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.inherit = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  std::vector<int> fds{};
+  // Threads that exited in the meantime (ESRCH) have nothing left to count.
+  for (pid_t thread : threads) {
+    const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, thread, -1, -1, 0));
+    if (fd >= 0) {
+      fds.push_back(fd);
+    } else if (errno != ESRCH && error->empty()) {
+      *error = std::strerror(errno);
+    }
+  }
+  return fds;
+}
+
+static int64_t read_counter(const std::vector<int>& fds) {
+  if (fds.empty()) {
+    return -1;
+  }
+  int64_t sum = 0;
+  for (int fd : fds) {
+    uint64_t values[3]{};
+    if (::read(fd, values, sizeof(values)) != sizeof(values)) {
+      return -1;
+    }
+    // Multiplexed events only ran part of the time they were enabled, a
+    // thread that hasn't run since has nothing to add.
+    if (values[2] != 0) {
+      sum += static_cast<int64_t>(static_cast<double>(values[0]) * values[1] / values[2]);
+    }
+  }
+  return sum;
+}
+
+static void close_counter(const std::vector<int>& fds) {
+  for (int fd : fds) {
+    close(fd);
+  }
+}
+
+static int64_t difference(int64_t stop, int64_t start) {
+  return stop < 0 || start < 0 ? -1 : stop - start;
+}
+
+static double ratio(int64_t numerator, int64_t denominator, double scale = 1) {
+  return numerator < 0 || denominator <= 0 ? -1 : numerator * scale / denominator;
+}
+
+PerfCounterValues operator-(const PerfCounterValues& stop, const PerfCounterValues& start) {
+  return {difference(stop.cycles, start.cycles),
+          difference(stop.instructions, start.instructions),
+          difference(stop.llc_references, start.llc_references),
+          difference(stop.llc_misses, start.llc_misses),
+          difference(stop.branches, start.branches),
+          difference(stop.branch_misses, start.branch_misses)};
+}
+
+double ipc(const PerfCounterValues& values) {
+  return ratio(values.instructions, values.cycles);
+}
+
+double llc_mpki(const PerfCounterValues& values) {
+  return ratio(values.llc_misses, values.instructions, 1000);
+}
+
+double llc_miss_rate(const PerfCounterValues& values) {
+  return ratio(values.llc_misses, values.llc_references);
+}
+
+double branch_miss_rate(const PerfCounterValues& values) {
+  return ratio(values.branch_misses, values.branches);
+}
+
+PerfCounters::PerfCounters(const std::vector<pid_t>& threads) :
+  error_{},
+  cycles_{open_counter(PERF_COUNT_HW_CPU_CYCLES, threads, &error_)},
+  instructions_{open_counter(PERF_COUNT_HW_INSTRUCTIONS, threads, &error_)},
+  llc_references_{open_counter(PERF_COUNT_HW_CACHE_REFERENCES, threads, &error_)},
+  llc_misses_{open_counter(PERF_COUNT_HW_CACHE_MISSES, threads, &error_)},
+  branches_{open_counter(PERF_COUNT_HW_BRANCH_INSTRUCTIONS, threads, &error_)},
+  branch_misses_{open_counter(PERF_COUNT_HW_BRANCH_MISSES, threads, &error_)} {
+  if (available()) {
+    error_.clear();
+  } else if (error_.empty()) {
+    error_ = "no thread to count";
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  for (const auto* fds :
+       {&cycles_, &instructions_, &llc_references_, &llc_misses_, &branches_, &branch_misses_}) {
+    close_counter(*fds);
+  }
+}
+
+bool PerfCounters::available() const {
+  for (const auto* fds :
+       {&cycles_, &instructions_, &llc_references_, &llc_misses_, &branches_, &branch_misses_}) {
+    if (!fds->empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const std::string& PerfCounters::error() const {
+  return error_;
+}
+
+PerfCounterValues PerfCounters::read() const {
+  return {read_counter(cycles_),
+          read_counter(instructions_),
+          read_counter(llc_references_),
+          read_counter(llc_misses_),
+          read_counter(branches_),
+          read_counter(branch_misses_)};
+}
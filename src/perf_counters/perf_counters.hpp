@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Hardware event counts, -1 for events the kernel doesn't count.
+struct PerfCounterValues {
+  int64_t cycles = -1;
+  int64_t instructions = -1;
+  int64_t llc_references = -1;
+  int64_t llc_misses = -1;
+  int64_t branches = -1;
+  int64_t branch_misses = -1;
+};
+
+// Counts between two reads, -1 where either read misses the event.
+PerfCounterValues operator-(const PerfCounterValues& stop, const PerfCounterValues& start);
+
+// Instructions per cycle, -1 when not counted.
+double ipc(const PerfCounterValues& values);
+
+// Last level cache misses per 1000 instructions, -1 when not counted.
+double llc_mpki(const PerfCounterValues& values);
+
+// Fraction of last level cache references that miss, -1 when not counted.
+double llc_miss_rate(const PerfCounterValues& values);
+
+// Fraction of branches mispredicted, -1 when not counted.
+double branch_miss_rate(const PerfCounterValues& values);
+
+// perf_event_open counters of the listed threads and of the threads they
+// create afterwards. Threads that already run, such as those of a pooled
+// encoder session, are counted too. User space only, so they open at the
+// default perf_event_paranoid level. Events the kernel or the cpu refuses
+// are left out.
+class PerfCounters {
+ public:
+  explicit PerfCounters(const std::vector<pid_t>& threads);
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  // False when no event could be opened, error tells why.
+  bool available() const;
+  const std::string& error() const;
+
+  // Counts since the counters were opened, summed over the threads and
+  // scaled up when the kernel multiplexed the events.
+  PerfCounterValues read() const;
+
+ private:
+  // First, the counters report into it while they open.
+  std::string error_;
+  // One descriptor per thread the event opened on.
+  std::vector<int> cycles_;
+  std::vector<int> instructions_;
+  std::vector<int> llc_references_;
+  std::vector<int> llc_misses_;
+  std::vector<int> branches_;
+  std::vector<int> branch_misses_;
+};
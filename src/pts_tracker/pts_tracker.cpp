@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: MIT
+
+#include "pts_tracker.hpp"
+
+PtsTracker::PtsTracker(int64_t frame_duration) :
+  frame_duration_{frame_duration},
+  next_pts_{0},
+  next_index_{0} {}
+
+void PtsTracker::reset(int64_t frame_duration) {
+  frame_duration_ = frame_duration;
+  next_pts_ = 0;
+  next_index_ = 0;
+  pending_.clear();
+}
+
+void PtsTracker::set_frame_duration(int64_t frame_duration) {
+  frame_duration_ = frame_duration;
+}
+
+int64_t PtsTracker::stamp(std::chrono::steady_clock::time_point arrival) {
+  const int64_t pts = next_pts_;
+  pending_[pts] = {next_index_, pts, arrival, 0};
+  next_pts_ += frame_duration_;
+  next_index_++;
+  return pts;
+}
+
+std::optional<InputFrame> PtsTracker::match(int64_t pts) {
+  const auto input = pending_.find(pts);
+  if (input == pending_.end()) {
+    return std::nullopt;
+  }
+  auto frame = input->second;
+  pending_.erase(input);
+  frame.frames_after = next_index_ - frame.index - 1;
+  return frame;
+}
+
+size_t PtsTracker::pending() const {
+  return pending_.size();
+}
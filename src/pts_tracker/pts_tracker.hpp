@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <optional>
+
+// Surface and bitstream timestamps are in 90 kHz units.
+constexpr const uint32_t kPtsTimescale = 90000;
+
+// Input frame an encoded frame was made from.
+struct InputFrame {
+  // Position in display order.
+  size_t index;
+  int64_t pts;
+  std::chrono::steady_clock::time_point arrival;
+  // Input frames submitted after this one before it was encoded, the
+  // reorder and pipeline delay in frames.
+  size_t frames_after;
+};
+
+// Stamps input frames with presentation timestamps when they are read and
+// matches the encoded frames, which come out in coding order, back to them.
+class PtsTracker {
+ public:
+  explicit PtsTracker(int64_t frame_duration = kPtsTimescale / 30);
+
+  // Restarts at PTS 0 for a new stream.
+  void reset(int64_t frame_duration);
+
+  // Frames stamped after the call are spaced by frame_duration.
+  void set_frame_duration(int64_t frame_duration);
+
+  // Records an input frame arriving, returns its PTS.
+  int64_t stamp(std::chrono::steady_clock::time_point arrival = std::chrono::steady_clock::now());
+
+  // Removes and returns the input frame with pts, nullopt when it wasn't
+  // stamped or was matched before.
+  std::optional<InputFrame> match(int64_t pts);
+
+  // Frames stamped and not matched yet.
+  size_t pending() const;
+
+ private:
+  int64_t frame_duration_;
+  int64_t next_pts_;
+  size_t next_index_;
+  std::map<int64_t, InputFrame> pending_;
+};
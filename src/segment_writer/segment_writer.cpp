@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "segment_writer.hpp"
+
+static std::string base_name(const std::string& path) {
+  const auto separator = path.find_last_of('/');
+  return separator == std::string::npos ? path : path.substr(separator + 1);
+}
+
+static void rename_file(const std::string& from, const std::string& to) {
+  if (std::rename(from.c_str(), to.c_str()) != 0) {
+    throw std::runtime_error("Couldn't rename " + from + " to " + to);
+  }
+}
+
+// Bytes of the ftyp and moov boxes at the start of an MP4 file.
+static uint64_t mp4_init_size(const std::string& path) {
+  std::ifstream file{path, std::ios_base::in | std::ios_base::binary};
+  uint64_t init_size = 0;
+  uint8_t header[8];
+  while (file.seekg(init_size) && file.read(reinterpret_cast<char*>(header), sizeof(header))) {
+    const uint32_t size = static_cast<uint32_t>(header[0]) << 24 | header[1] << 16 |
+                          header[2] << 8 | header[3];
+    const std::string type(reinterpret_cast<const char*>(header) + 4, 4);
+    if ((type != "ftyp" && type != "moov") || size < sizeof(header)) {
+      break;
+    }
+    init_size += size;
+  }
+  return init_size;
+}
+
+std::string segment_filename(const std::string& prefix,
+                             size_t index,
+                             const std::string& extension) {
+  std::ostringstream filename;
+  filename << prefix << "_" << std::setw(5) << std::setfill('0') << index << extension;
+  return filename.str();
+}
+
+SegmentWriter::SegmentWriter(std::string playlist_filename,
+                             std::string segment_prefix,
+                             std::string segment_extension,
+                             double segment_duration,
+                             size_t playlist_size,
+                             uint32_t timescale,
+                             StreamWriterFactory make_writer) :
+  playlist_filename_{std::move(playlist_filename)},
+  segment_prefix_{std::move(segment_prefix)},
+  segment_extension_{std::move(segment_extension)},
+  segment_duration_{static_cast<int64_t>(segment_duration * timescale)},
+  playlist_size_{playlist_size},
+  timescale_{timescale},
+  make_writer_{std::move(make_writer)},
+  segment_start_pts_{0},
+  segment_length_{0},
+  segment_size_{0},
+  media_sequence_{0} {}
+
+void SegmentWriter::write(const EncodedFrame& frame) {
+  if (segment_ && frame.key && frame.pts - segment_start_pts_ >= segment_duration_) {
+    finish_segment();
+  }
+  if (!segment_) {
+    start_segment(frame);
+  }
+  segment_->write(frame);
+  segment_length_ += frame.duration;
+  segment_size_ += frame.size;
+}
+
+void SegmentWriter::flush() {
+  if (segment_) {
+    segment_->flush();
+  }
+}
+
+void SegmentWriter::close() {
+  if (segment_) {
+    finish_segment();
+  }
+  write_playlist(true);
+}
+
+const std::vector<SegmentInfo>& SegmentWriter::segments() const {
+  return segments_;
+}
+
+void SegmentWriter::start_segment(const EncodedFrame& frame) {
+  segment_filename_ = segment_filename(segment_prefix_, segments_.size(), segment_extension_);
+  segment_ = make_writer_(segment_filename_ + ".tmp");
+  segment_start_pts_ = frame.pts;
+  segment_length_ = 0;
+  segment_size_ = 0;
+}
+
+void SegmentWriter::finish_segment() {
+  const auto start = std::chrono::steady_clock::now();
+  segment_->close();
+  segment_.reset();
+  rename_file(segment_filename_ + ".tmp", segment_filename_);
+  const double duration = static_cast<double>(segment_length_) / timescale_;
+  const uint64_t init_size = segment_extension_ == ".mp4" ? mp4_init_size(segment_filename_) : 0;
+  playlist_.push_back({base_name(segment_filename_),
+                       duration,
+                       std::filesystem::file_size(segment_filename_),
+                       init_size});
+  if (playlist_.size() > playlist_size_) {
+    expired_.push_back(std::filesystem::path(segment_filename_)
+                           .replace_filename(playlist_.front().filename)
+                           .string());
+    playlist_.pop_front();
+    media_sequence_++;
+  }
+  write_playlist(false);
+  // Segments stay for a playlist length after they left it, as long as a
+  // client may still have a playlist listing them.
+  while (expired_.size() > playlist_size_) {
+    std::remove(expired_.front().c_str());
+    expired_.pop_front();
+  }
+  const auto write_latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+  segments_.push_back({segment_filename_, segment_size_, duration, write_latency});
+}
+
+void SegmentWriter::write_playlist(bool ended) {
+  double target_duration = 1;
+  for (const auto& entry : playlist_) {
+    target_duration = std::max(target_duration, std::ceil(entry.duration));
+  }
+  const auto temporary_filename = playlist_filename_ + ".tmp";
+  {
+    std::ofstream playlist{temporary_filename};
+    // Fragmented MP4 segments need EXT-X-MAP, version 7 for the init segment
+    // byte ranges of each file.
+    const bool fragmented = segment_extension_ == ".mp4";
+    playlist << "#EXTM3U\n";
+    playlist << "#EXT-X-VERSION:" << (fragmented ? 7 : 3) << "\n";
+    playlist << "#EXT-X-TARGETDURATION:" << static_cast<int>(target_duration) << "\n";
+    playlist << "#EXT-X-MEDIA-SEQUENCE:" << media_sequence_ << "\n";
+    for (const auto& entry : playlist_) {
+      if (fragmented) {
+        playlist << "#EXT-X-MAP:URI=\"" << entry.filename << "\",BYTERANGE=\"" << entry.init_size
+                 << "@0\"\n";
+      }
+      playlist << "#EXTINF:" << std::fixed << std::setprecision(3) << entry.duration << ",\n";
+      if (fragmented) {
+        playlist << "#EXT-X-BYTERANGE:" << entry.size - entry.init_size << "@" << entry.init_size
+                 << "\n";
+      }
+      playlist << entry.filename << "\n";
+    }
+    if (ended) {
+      playlist << "#EXT-X-ENDLIST\n";
+    }
+    if (!playlist) {
+      throw std::runtime_error("Couldn't write playlist " + temporary_filename);
+    }
+  }
+  rename_file(temporary_filename, playlist_filename_);
+}
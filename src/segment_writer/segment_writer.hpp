@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "statistics/statistics.hpp"
+#include "stream_writer/stream_writer.hpp"
+
+using StreamWriterFactory = std::function<std::unique_ptr<StreamWriter>(const std::string&)>;
+
+// Splits the stream into segment files at the first key frame after
+// segment_duration seconds and keeps a playlist of the last playlist_size
+// segments. Segments are written as "<name>.tmp" and renamed when complete,
+// the playlist is replaced by rename as well, so readers never see partial
+// files. A segment that left the playlist is deleted once playlist_size more
+// have left, clients that read an older playlist can still fetch it. MP4
+// segments carry their own init segment, which the playlist maps by byte
+// range. Meant to run on the writer thread of an AsyncWriter.
+class SegmentWriter : public StreamWriter {
+ public:
+  // Segment i is written to segment_prefix + "_<i>" + segment_extension by a
+  // writer of make_writer.
+  SegmentWriter(std::string playlist_filename,
+                std::string segment_prefix,
+                std::string segment_extension,
+                double segment_duration,
+                size_t playlist_size,
+                uint32_t timescale,
+                StreamWriterFactory make_writer);
+
+  void write(const EncodedFrame& frame) override;
+  void flush() override;
+
+  // Finalizes the last segment and ends the playlist.
+  void close() override;
+
+  // Finalized segments, valid after close.
+  const std::vector<SegmentInfo>& segments() const;
+
+ private:
+  struct PlaylistEntry {
+    std::string filename;
+    double duration;
+    // Bytes of the file and of the init segment at its start, 0 when the
+    // container has none.
+    uint64_t size;
+    uint64_t init_size;
+  };
+
+  void start_segment(const EncodedFrame& frame);
+  void finish_segment();
+  void write_playlist(bool ended);
+
+  const std::string playlist_filename_;
+  const std::string segment_prefix_;
+  const std::string segment_extension_;
+  const int64_t segment_duration_;
+  const size_t playlist_size_;
+  const uint32_t timescale_;
+  StreamWriterFactory make_writer_;
+
+  std::unique_ptr<StreamWriter> segment_;
+  std::string segment_filename_;
+  int64_t segment_start_pts_;
+  int64_t segment_length_;
+  size_t segment_size_;
+  size_t media_sequence_;
+  std::deque<PlaylistEntry> playlist_;
+  // Paths of segments that left the playlist, oldest first.
+  std::deque<std::string> expired_;
+  std::vector<SegmentInfo> segments_;
+};
+
+// "<prefix>_<index>.<extension>" with a zero padded index.
+std::string segment_filename(const std::string& prefix,
+                             size_t index,
+                             const std::string& extension);
@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "session_pool.hpp"
+
+SessionPool::SessionPool(size_t max_idle_sessions) :
+  max_idle_sessions_{max_idle_sessions}, hits_{0}, misses_{0}, init_time_{0}, reset_time_{0} {}
+
+std::unique_ptr<VideoEncoder> SessionPool::acquire(const SessionKey& key) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  const auto found =
+      std::find_if(idle_sessions_.begin(), idle_sessions_.end(), [&key](const auto& idle) {
+        return idle.first == key;
+      });
+  if (found == idle_sessions_.end()) {
+    return nullptr;
+  }
+  auto session = std::move(found->second);
+  idle_sessions_.erase(found);
+  return session;
+}
+
+void SessionPool::release(const SessionKey& key, std::unique_ptr<VideoEncoder> session) {
+  session->set_frame_source(nullptr);
+  std::unique_ptr<VideoEncoder> closed_session;
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    idle_sessions_.emplace_front(key, std::move(session));
+    if (idle_sessions_.size() > max_idle_sessions_) {
+      closed_session = std::move(idle_sessions_.back().second);
+      idle_sessions_.pop_back();
+    }
+  }
+}
+
+void SessionPool::record_miss(int init_time) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  misses_++;
+  init_time_ += init_time;
+}
+
+void SessionPool::record_hit(int reset_time) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  hits_++;
+  reset_time_ += reset_time;
+}
+
+SessionPoolInfo SessionPool::info() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  SessionPoolInfo info{};
+  info.hits = hits_;
+  info.misses = misses_;
+  const int lookups = hits_ + misses_;
+  info.hit_rate = lookups ? static_cast<double>(hits_) / lookups : 0;
+  // Every hit would have cost a mean init otherwise.
+  const long mean_init_time = misses_ ? init_time_ / misses_ : 0;
+  info.init_time_saved = std::max<long>(mean_init_time * hits_ - reset_time_, 0);
+  return info;
+}
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include "statistics/statistics.hpp"
+#include "video_encoder/video_encoder.hpp"
+
+// Sessions are only reused for streams they can be reset to.
+struct SessionKey {
+  std::string codec;
+  std::string color_format;
+  int width;
+  int height;
+  bool hw;
+  // Thread count and affinity are fixed when the session starts its threads.
+  int threads;
+  std::string cpuset;
+  // Threads and surfaces stay on the NUMA node that first touched them, -1
+  // when the job isn't pinned to a node.
+  int numa_node;
+  // A reset can't change the rate control method, the async depth or the
+  // distance between anchor frames.
+  oneapi::vpl::rate_control_method bitrate_mode;
+  uint16_t async_depth;
+  uint16_t gop_ref_dist;
+
+  bool operator==(const SessionKey& other) const {
+    return std::tie(codec,
+                    color_format,
+                    width,
+                    height,
+                    hw,
+                    threads,
+                    cpuset,
+                    numa_node,
+                    bitrate_mode,
+                    async_depth,
+                    gop_ref_dist) == std::tie(other.codec,
+                                              other.color_format,
+                                              other.width,
+                                              other.height,
+                                              other.hw,
+                                              other.threads,
+                                              other.cpuset,
+                                              other.numa_node,
+                                              other.bitrate_mode,
+                                              other.async_depth,
+                                              other.gop_ref_dist);
+  }
+};
+
+// Idle encoder sessions of finished jobs. A job with a matching key resets an
+// idle session instead of creating and initializing a new one.
+class SessionPool {
+ public:
+  explicit SessionPool(size_t max_idle_sessions);
+
+  // Removes an idle session for the key from the pool, null when none.
+  std::unique_ptr<VideoEncoder> acquire(const SessionKey& key);
+
+  // Returns the session of a finished job, the least recently used idle
+  // session is closed when the pool is full.
+  void release(const SessionKey& key, std::unique_ptr<VideoEncoder> session);
+
+  // Counts a session created and initialized in init_time ms.
+  void record_miss(int init_time);
+
+  // Counts a session reused by a reset which took reset_time ms.
+  void record_hit(int reset_time);
+
+  SessionPoolInfo info() const;
+
+ private:
+  const size_t max_idle_sessions_;
+  mutable std::mutex mutex_;
+  std::list<std::pair<SessionKey, std::unique_ptr<VideoEncoder>>> idle_sessions_;
+  int hits_;
+  int misses_;
+  long init_time_;
+  long reset_time_;
+};
@@ -1,11 +1,23 @@
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
 #include <fstream>
 
 #include "statistics.hpp"
 
 #include "nlohmann/json.hpp"
 
+double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  const double rank = std::clamp(fraction, 0.0, 1.0) * (values.size() - 1);
+  const size_t lower = static_cast<size_t>(rank);
+  const size_t upper = std::min(lower + 1, values.size() - 1);
+  return values[lower] + (values[upper] - values[lower]) * (rank - lower);
+}
+
 Statistics::Statistics(StatsDataFrame stats_data_frame) :
   stats_data_frame_{std::move(stats_data_frame)} {}
 
@@ -16,11 +28,53 @@ void Statistics::write(std::ostream& output) const {
                                    {"iframe", frame_info.iframe},
                                    {"size", frame_info.size},
                                    {"pts", frame_info.pts},
+                                   {"dts", frame_info.dts},
+                                   {"inputframe", frame_info.input_frame},
+                                   {"reorderdelay", frame_info.reorder_delay},
+                                   {"latency", frame_info.latency_us},
+                                   {"firstbytelatency", frame_info.first_byte_latency_us},
+                                   {"lastbytelatency", frame_info.last_byte_latency_us},
                                    {"proctime", frame_info.stop_time - frame_info.start_time},
                                    {"starttime", frame_info.start_time},
-                                   {"stoptime", frame_info.stop_time}};
+                                   {"stoptime", frame_info.stop_time},
+                                   {"qp", frame_info.qp},
+                                   {"temporalid", frame_info.temporal_id},
+                                   {"naltypes", frame_info.nal_types},
+                                   {"parametersetbytes", frame_info.parameter_set_bytes},
+                                   {"seibytes", frame_info.sei_bytes},
+                                   {"slicebytes", frame_info.slice_bytes},
+                                   {"ipc", frame_info.ipc},
+                                   {"llcmpki", frame_info.llc_mpki},
+                                   {"lateness", frame_info.lateness_us},
+                                   {"targetusage", frame_info.target_usage}};
     frames_info.push_back(frame_info_json);
   }
+  nlohmann::json reconfigures = nlohmann::json::array();
+  for (const auto& reconfigure : stats_data_frame_.reconfigures) {
+    reconfigures.push_back({{"frame", reconfigure.frame},
+                            {"bitrate", reconfigure.bitrate},
+                            {"maxbitrate", reconfigure.max_bitrate},
+                            {"fps", reconfigure.fps},
+                            {"targetusage", reconfigure.target_usage},
+                            {"idr", reconfigure.idr},
+                            {"stalltime", reconfigure.stall_time_us}});
+  }
+  nlohmann::json backpressure = nlohmann::json::array();
+  for (const auto& event : stats_data_frame_.backpressure) {
+    backpressure.push_back({{"frame", event.frame},
+                            {"action", event.action},
+                            {"frames", event.frames},
+                            {"queuedepth", event.queue_depth},
+                            {"targetusage", event.target_usage},
+                            {"blocktime", event.blocked_us}});
+  }
+  nlohmann::json segments = nlohmann::json::array();
+  for (const auto& segment : stats_data_frame_.segments) {
+    segments.push_back({{"file", segment.filename},
+                        {"size", segment.size},
+                        {"duration", segment.duration},
+                        {"writelatency", segment.write_latency_us}});
+  }
   nlohmann::json settings{
       {"codec", stats_data_frame_.settings.codec},
       {"gop", stats_data_frame_.settings.gop},
@@ -30,6 +84,78 @@ void Statistics::write(std::ostream& output) const {
       {"width", stats_data_frame_.settings.width},
       {"height", stats_data_frame_.settings.height},
   };
+  nlohmann::json session_pool{
+      {"reused", stats_data_frame_.session_pool.reused},
+      {"hits", stats_data_frame_.session_pool.hits},
+      {"misses", stats_data_frame_.session_pool.misses},
+      {"hitrate", stats_data_frame_.session_pool.hit_rate},
+      {"inittimesaved", stats_data_frame_.session_pool.init_time_saved},
+  };
+  nlohmann::json arena{
+      {"type", stats_data_frame_.arena.type},
+      {"reserved", stats_data_frame_.arena.reserved},
+      {"used", stats_data_frame_.arena.used},
+      {"hugepagebytes", stats_data_frame_.arena.hugepage_bytes},
+      {"hugepagehitrate", stats_data_frame_.arena.hugepage_hit_rate},
+      {"explicithugepages", stats_data_frame_.arena.explicit_hugepages},
+      {"prefaulted", stats_data_frame_.arena.prefaulted},
+      {"numabound", stats_data_frame_.arena.numa_bound},
+  };
+  nlohmann::json numa{
+      {"node", stats_data_frame_.numa.node},
+      {"fps", stats_data_frame_.numa.fps},
+  };
+  nlohmann::json cpu{
+      {"threads", stats_data_frame_.cpu.threads},
+      {"cpuset", stats_data_frame_.cpu.cpuset},
+      {"cores", stats_data_frame_.cpu.cores},
+      {"usertime", stats_data_frame_.cpu.user_time},
+      {"systime", stats_data_frame_.cpu.system_time},
+      {"utilization", stats_data_frame_.cpu.utilization},
+      {"coreutilization",
+       stats_data_frame_.cpu.cores
+           ? stats_data_frame_.cpu.utilization / stats_data_frame_.cpu.cores
+           : 0},
+  };
+  nlohmann::json counters{
+      {"enabled", stats_data_frame_.counters.enabled},
+      {"available", stats_data_frame_.counters.available},
+      {"error", stats_data_frame_.counters.error},
+      {"cycles", stats_data_frame_.counters.cycles},
+      {"instructions", stats_data_frame_.counters.instructions},
+      {"llcreferences", stats_data_frame_.counters.llc_references},
+      {"llcmisses", stats_data_frame_.counters.llc_misses},
+      {"branches", stats_data_frame_.counters.branches},
+      {"branchmisses", stats_data_frame_.counters.branch_misses},
+      {"ipc", stats_data_frame_.counters.ipc},
+      {"llcmpki", stats_data_frame_.counters.llc_mpki},
+      {"llcmissrate", stats_data_frame_.counters.llc_miss_rate},
+      {"branchmissrate", stats_data_frame_.counters.branch_miss_rate},
+  };
+  nlohmann::json pacing{
+      {"enabled", stats_data_frame_.pacing.enabled},
+      {"policy", stats_data_frame_.pacing.policy},
+      {"rate", stats_data_frame_.pacing.rate},
+      {"frames", stats_data_frame_.pacing.frames},
+      {"lateframes", stats_data_frame_.pacing.late_frames},
+      {"droppedframes", stats_data_frame_.pacing.dropped_frames},
+      {"maxlateness", stats_data_frame_.pacing.max_lateness_us},
+      {"p99lateness", stats_data_frame_.pacing.p99_lateness_us},
+      {"queueframes", stats_data_frame_.pacing.queue_frames},
+      {"blocktime", stats_data_frame_.pacing.blocked_us},
+  };
+  nlohmann::json complexity_changes = nlohmann::json::array();
+  for (const auto& change : stats_data_frame_.complexity.changes) {
+    complexity_changes.push_back({{"frame", change.frame},
+                                  {"targetusage", change.target_usage},
+                                  {"frametime", change.frame_time_us}});
+  }
+  nlohmann::json complexity{
+      {"enabled", stats_data_frame_.complexity.enabled},
+      {"targetfps", stats_data_frame_.complexity.target_fps},
+      {"budget", stats_data_frame_.complexity.budget_us},
+      {"changes", complexity_changes},
+  };
   nlohmann::json stats{{"id", stats_data_frame_.id},
                        {"description", stats_data_frame_.description},
                        {"test", stats_data_frame_.test},
@@ -37,10 +163,25 @@ void Statistics::write(std::ostream& output) const {
                        {"date", stats_data_frame_.date},
                        {"encapp_version", stats_data_frame_.encapp_version},
                        {"proctime", stats_data_frame_.proctime},
+                       {"startuptime", stats_data_frame_.startup_time},
+                       {"queuewaittime", stats_data_frame_.queue_wait_time},
                        {"framecount", stats_data_frame_.framecount},
+                       {"warmupframes", stats_data_frame_.warmup_frames},
+                       {"preloadtime", stats_data_frame_.preload_time},
+                       {"parsetime", stats_data_frame_.parse_time_ns},
                        {"encodedfile", stats_data_frame_.encoded_file},
                        {"sourcefile", stats_data_frame_.source_file},
                        {"settings", settings},
+                       {"sessionpool", session_pool},
+                       {"reconfigures", reconfigures},
+                       {"arena", arena},
+                       {"numa", numa},
+                       {"cpu", cpu},
+                       {"counters", counters},
+                       {"pacing", pacing},
+                       {"backpressure", backpressure},
+                       {"complexity", complexity},
+                       {"segments", segments},
                        {"frames", frames_info}};
   output << std::setw(4) << stats << std::endl;
 }
@@ -2,16 +2,42 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
 struct FrameInfo {
+  // Output order.
   int counter;
   int iframe;
   size_t size;
-  int pts;
+  int64_t pts;
+  int64_t dts;
+  // Display order of the input frame, -1 when it couldn't be matched.
+  long input_frame;
+  // Input frames that arrived after this one before it was encoded.
+  int reorder_delay;
+  // Input frame arrival to bitstream ready.
+  long latency_us;
+  // Input frame arrival to the first and last byte reaching the output.
+  long first_byte_latency_us;
+  long last_byte_latency_us;
   long start_time;
   long stop_time;
+  // Read from the bitstream, qp is -1 when the codec has no slice QP.
+  int qp;
+  int temporal_id;
+  std::vector<int> nal_types;
+  size_t parameter_set_bytes;
+  size_t sei_bytes;
+  size_t slice_bytes;
+  // From submit to bitstream ready, -1 without hardware counters.
+  double ipc;
+  double llc_mpki;
+  // Paced input frame arrival to read, -1 without pacing.
+  long lateness_us;
+  // Target usage when the frame came out, 0 for the implementation default.
+  int target_usage;
 };
 
 struct Settings {
@@ -42,6 +68,119 @@ struct EncoderMediaFormat {
   int height;
 };
 
+struct SessionPoolInfo {
+  bool reused;
+  int hits;
+  int misses;
+  double hit_rate;
+  long init_time_saved;
+};
+
+struct ArenaInfo {
+  std::string type;
+  size_t reserved;
+  size_t used;
+  size_t hugepage_bytes;
+  double hugepage_hit_rate;
+  bool explicit_hugepages;
+  bool prefaulted;
+  bool numa_bound;
+};
+
+struct NumaInfo {
+  int node;
+  double fps;
+};
+
+struct CpuInfo {
+  int threads;
+  std::string cpuset;
+  int cores;
+  long user_time;
+  long system_time;
+  // Cpus busy on average while encoding.
+  double utilization;
+};
+
+// Hardware counters of the encode, rates are -1 for events not counted.
+struct CounterInfo {
+  bool enabled;
+  bool available;
+  std::string error;
+  long cycles;
+  long instructions;
+  long llc_references;
+  long llc_misses;
+  long branches;
+  long branch_misses;
+  double ipc;
+  double llc_mpki;
+  double llc_miss_rate;
+  double branch_miss_rate;
+};
+
+// Input read at the frame rate as from a live source. Frames are late when
+// read after a newer frame arrived, dropped frames never reached the encoder.
+struct PacingInfo {
+  bool enabled;
+  std::string policy;
+  double rate;
+  long frames;
+  long late_frames;
+  long dropped_frames;
+  long max_lateness_us;
+  double p99_lateness_us;
+  // Frames the input queue holds, 0 without a limit, and time the source was
+  // held back by block.
+  long queue_frames;
+  long blocked_us;
+};
+
+// Action taken against a full input queue from frame on. frames were dropped
+// or held back, target_usage is the complexity adapt switched to.
+struct BackpressureInfo {
+  long frame;
+  std::string action;
+  long frames;
+  long queue_depth;
+  int target_usage;
+  long blocked_us;
+};
+
+// Target usage switched to after frame, frame_time_us is the mean encode
+// time that led to it.
+struct ComplexityChangeInfo {
+  long frame;
+  int target_usage;
+  double frame_time_us;
+};
+
+// Target usage moved to encode at target_fps, within a frame budget.
+struct ComplexityInfo {
+  bool enabled;
+  double target_fps;
+  double budget_us;
+  std::vector<ComplexityChangeInfo> changes;
+};
+
+struct SegmentInfo {
+  std::string filename;
+  size_t size;
+  double duration;
+  // Time to close, rename and list the segment on the writer thread.
+  long write_latency_us;
+};
+
+struct ReconfigureInfo {
+  int frame;
+  int bitrate;
+  int max_bitrate;
+  int fps;
+  int target_usage;
+  bool idr;
+  long stall_time_us;
+};
+
 struct StatsDataFrame {
   std::string id;
   std::string description;
@@ -50,14 +189,36 @@ struct StatsDataFrame {
   std::string date;
   std::string encapp_version;
   int proctime;
+  int startup_time;
+  int queue_wait_time;
   int framecount;
+  // Frames encoded before measuring, left out of frames and proctime.
+  int warmup_frames;
+  // Time to load preloaded input into memory.
+  int preload_time;
+  // Mean time to parse the bitstream of a frame.
+  long parse_time_ns;
   std::string encoded_file;
   std::string source_file;
   Settings settings;
   EncoderMediaFormat encoder_media_format;
+  SessionPoolInfo session_pool;
+  ArenaInfo arena;
+  NumaInfo numa;
+  CpuInfo cpu;
+  CounterInfo counters;
+  PacingInfo pacing;
+  ComplexityInfo complexity;
   std::vector<FrameInfo> frame_info;
+  std::vector<ReconfigureInfo> reconfigures;
+  std::vector<BackpressureInfo> backpressure;
+  std::vector<SegmentInfo> segments;
 };
 
+// Value below which fraction of the values lie, interpolated between the
+// nearest ranks. 0 for no values.
+double percentile(std::vector<double> values, double fraction);
+
 class Statistics {
  public:
   Statistics(StatsDataFrame stats_data_frame);
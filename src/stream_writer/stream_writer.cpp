@@ -0,0 +1,193 @@
+// SPDX-License-Identifier: MIT
+
+#include <stdexcept>
+
+#include "stream_writer.hpp"
+
+#include "ivf_writer/ivf_writer.hpp"
+#include "mp4_writer/mp4_writer.hpp"
+#include "trace/trace.hpp"
+
+RawStreamWriter::RawStreamWriter(const std::string& filename) :
+  output_{filename, std::ios_base::out | std::ios_base::binary} {
+  if (!output_) {
+    throw std::runtime_error("Couldn't open " + filename);
+  }
+}
+
+void RawStreamWriter::write(const EncodedFrame& frame) {
+  output_.write(reinterpret_cast<const char*>(frame.data), frame.size);
+  if (!output_) {
+    throw std::runtime_error("Couldn't write encoded frame");
+  }
+}
+
+void RawStreamWriter::flush() {
+  output_.flush();
+  if (!output_) {
+    throw std::runtime_error("Couldn't flush encoded stream");
+  }
+}
+
+void RawStreamWriter::close() {
+  output_.close();
+  if (!output_) {
+    throw std::runtime_error("Couldn't close encoded stream");
+  }
+}
+
+static long elapsed_us(std::chrono::steady_clock::time_point since,
+                       std::chrono::steady_clock::time_point until) {
+  if (since == std::chrono::steady_clock::time_point{}) {
+    return -1;
+  }
+  return std::chrono::duration_cast<std::chrono::microseconds>(until - since).count();
+}
+
+AsyncWriter::AsyncWriter(std::unique_ptr<StreamWriter> writer,
+                         size_t max_queued_frames,
+                         bool flush_frames) :
+  writer_{std::move(writer)},
+  max_queued_frames_{max_queued_frames},
+  flush_frames_{flush_frames},
+  queued_frames_{0},
+  closing_{false},
+  thread_{&AsyncWriter::run, this} {}
+
+AsyncWriter::~AsyncWriter() {
+  try {
+    close();
+  } catch (std::exception&) {
+    // Errors are only reported to callers of close.
+  }
+}
+
+void AsyncWriter::write(const EncodedFrame& frame) {
+  // Waits here while the writer falls behind.
+  TraceScope trace{"enqueue"};
+  std::unique_lock<std::mutex> lock{mutex_};
+  queue_changed_.wait(lock, [this] {
+    return queue_.size() < max_queued_frames_ || error_ || closing_;
+  });
+  rethrow_error();
+  if (closing_) {
+    throw std::runtime_error("Write after close");
+  }
+  queue_.push_back(frame);
+  queued_frames_.store(queue_.size(), std::memory_order_relaxed);
+  queue_changed_.notify_all();
+}
+
+void AsyncWriter::close() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    closing_ = true;
+    queue_changed_.notify_all();
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+    if (!error_) {
+      try {
+        writer_->close();
+      } catch (std::exception&) {
+        error_ = std::current_exception();
+      }
+    }
+  }
+  std::lock_guard<std::mutex> lock{mutex_};
+  rethrow_error();
+}
+
+void AsyncWriter::run() {
+  set_trace_thread_name("writer");
+  std::unique_lock<std::mutex> lock{mutex_};
+  while (true) {
+    queue_changed_.wait(lock, [this] { return !queue_.empty() || closing_; });
+    if (queue_.empty()) {
+      return;
+    }
+    // The frame owner is released outside of the lock, it can return a
+    // buffer to a pool the encode loop waits on.
+    auto frame = std::move(queue_.front());
+    queue_.pop_front();
+    queued_frames_.store(queue_.size(), std::memory_order_relaxed);
+    queue_changed_.notify_all();
+    lock.unlock();
+    try {
+      const auto first_byte = std::chrono::steady_clock::now();
+      TraceScope trace{"write"};
+      writer_->write(frame);
+      if (flush_frames_) {
+        writer_->flush();
+      }
+      output_latencies_.push_back({elapsed_us(frame.capture, first_byte),
+                                   elapsed_us(frame.capture, std::chrono::steady_clock::now())});
+    } catch (std::exception&) {
+      frame = {};
+      lock.lock();
+      error_ = std::current_exception();
+      auto dropped = std::move(queue_);
+      queue_.clear();
+      queue_changed_.notify_all();
+      lock.unlock();
+      return;
+    }
+    frame = {};
+    lock.lock();
+  }
+}
+
+const std::vector<OutputLatency>& AsyncWriter::output_latencies() const {
+  return output_latencies_;
+}
+
+size_t AsyncWriter::queued_frames() const {
+  return queued_frames_.load(std::memory_order_relaxed);
+}
+
+void AsyncWriter::rethrow_error() {
+  if (error_) {
+    auto error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+std::string resolve_container(const std::string& container, const std::string& codec) {
+  if (container != "auto") {
+    return container;
+  }
+  return (codec == "vp9" || codec == "av1") ? "ivf" : "raw";
+}
+
+void check_container(const std::string& container_option, const std::string& codec) {
+  const auto container = resolve_container(container_option, codec);
+  if (container == "mp4") {
+    nal_codec_from_string(codec);
+  } else if (container == "ivf") {
+    if (codec != "vp9" && codec != "av1") {
+      throw std::invalid_argument("IVF doesn't carry " + codec);
+    }
+  } else if (container != "raw") {
+    throw std::invalid_argument("Unknown container " + container);
+  }
+}
+
+std::unique_ptr<StreamWriter> make_stream_writer(const std::string& container_option,
+                                                 const std::string& codec,
+                                                 const std::string& filename,
+                                                 int width,
+                                                 int height,
+                                                 int frame_rate,
+                                                 uint32_t timescale) {
+  check_container(container_option, codec);
+  const auto container = resolve_container(container_option, codec);
+  if (container == "raw") {
+    return std::make_unique<RawStreamWriter>(filename);
+  }
+  if (container == "mp4") {
+    return std::make_unique<Mp4Writer>(
+        filename, Mp4Track{nal_codec_from_string(codec), width, height, timescale});
+  }
+  return std::make_unique<IvfWriter>(filename, codec, width, height, frame_rate);
+}
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Encoded frame as handed from the encode loop to a writer.
+struct EncodedFrame {
+  const uint8_t* data;
+  size_t size;
+  bool key;
+  // In units of the writer time scale.
+  int64_t pts;
+  int64_t dts;
+  int64_t duration;
+  // Keeps data valid until the writer is done with the frame.
+  std::shared_ptr<void> owner;
+  // Arrival of the input frame, unset when unknown.
+  std::chrono::steady_clock::time_point capture{};
+};
+
+// Time from the capture of a frame to its first byte being handed to the
+// output and to its last byte being flushed, -1 when the capture is unknown.
+struct OutputLatency {
+  long first_byte_us;
+  long last_byte_us;
+};
+
+// Output of an encoded stream. Writers throw std::runtime_error on errors.
+class StreamWriter {
+ public:
+  virtual ~StreamWriter() = default;
+
+  virtual void write(const EncodedFrame& frame) = 0;
+
+  // Pushes the frames written so far to the output.
+  virtual void flush() {}
+
+  // Writes buffered data, the writer is unusable afterwards.
+  virtual void close() = 0;
+};
+
+// Elementary stream as produced by the encoder.
+class RawStreamWriter : public StreamWriter {
+ public:
+  explicit RawStreamWriter(const std::string& filename);
+
+  void write(const EncodedFrame& frame) override;
+  void flush() override;
+  void close() override;
+
+ private:
+  std::ofstream output_;
+};
+
+// Runs another writer on its own thread. Frames are queued without copying,
+// write blocks while max_queued_frames are waiting so the frame owners of the
+// encode loop stay bounded. Errors of the writer thread are thrown by the next
+// write or close. With flush_frames every frame is flushed once written.
+class AsyncWriter : public StreamWriter {
+ public:
+  AsyncWriter(std::unique_ptr<StreamWriter> writer,
+              size_t max_queued_frames,
+              bool flush_frames = false);
+  ~AsyncWriter() override;
+
+  void write(const EncodedFrame& frame) override;
+  void close() override;
+
+  // Latency of each frame in write order, valid after close.
+  const std::vector<OutputLatency>& output_latencies() const;
+
+  // Frames waiting for the writer thread, read without locking.
+  size_t queued_frames() const;
+
+ private:
+  void run();
+  void rethrow_error();
+
+  std::unique_ptr<StreamWriter> writer_;
+  const size_t max_queued_frames_;
+  const bool flush_frames_;
+  // Only touched by the writer thread until it is joined.
+  std::vector<OutputLatency> output_latencies_;
+  std::mutex mutex_;
+  std::condition_variable queue_changed_;
+  std::deque<EncodedFrame> queue_;
+  // Size of queue_, for readers that don't take the lock.
+  std::atomic<size_t> queued_frames_;
+  bool closing_;
+  std::exception_ptr error_;
+  std::thread thread_;
+};
+
+// Container written for the container option, "auto" picks ivf for vp9 and
+// av1 and the raw elementary stream for the other codecs.
+std::string resolve_container(const std::string& container, const std::string& codec);
+
+// Throws std::invalid_argument when the codec can't be written to the container.
+void check_container(const std::string& container, const std::string& codec);
+
+// Writer for the container name, "auto", "raw", "mp4" or "ivf". Throws
+// std::invalid_argument for containers the codec can't be written to.
+std::unique_ptr<StreamWriter> make_stream_writer(const std::string& container,
+                                                 const std::string& codec,
+                                                 const std::string& filename,
+                                                 int width,
+                                                 int height,
+                                                 int frame_rate,
+                                                 uint32_t timescale);
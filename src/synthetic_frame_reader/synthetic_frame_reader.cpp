@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include "synthetic_frame_reader.hpp"
+
+#include "memory_frame_reader/memory_frame_reader.hpp"
+#include "trace/trace.hpp"
+
+namespace vpl = oneapi::vpl;
+
+constexpr const char* kSyntheticInput = "synthetic";
+constexpr const size_t kNoiseTile = 256;
+// Gradient phase is a triangle wave with this period.
+constexpr const int kPeriod = 512;
+constexpr const uint8_t kTextBackground = 16;
+constexpr const uint8_t kTextForeground = 235;
+// Digits of 3x5 cells, rows top down, "0123456789 " repeats across the frame.
+constexpr const uint16_t kDigits[10] = {0b111101101101111,
+                                        0b010110010010111,
+                                        0b111001111100111,
+                                        0b111001111001111,
+                                        0b101101111001001,
+                                        0b111100111001111,
+                                        0b111100111101111,
+                                        0b111001010010010,
+                                        0b111101111101111,
+                                        0b111101111001111};
+constexpr const size_t kTextChars = 11;
+
+static uint64_t mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+static int triangle(int phase) {
+  // Mirrors the second half of the period without a branch.
+  const int wrapped = phase & (kPeriod - 1);
+  return wrapped ^ (-(wrapped >> 8) & (kPeriod - 1));
+}
+
+// Gradient directions, motion and noise offsets of the scene of a frame.
+struct Scene {
+  int64_t luma_x, luma_y, luma_base;
+  int64_t u_x, u_y, u_base;
+  int64_t v_x, v_y, v_base;
+  int64_t speed;
+  size_t noise_x, noise_y;
+};
+
+static Scene make_scene(const SyntheticPattern& pattern, size_t index) {
+  const size_t scene = pattern.scene_cut_interval ? index / pattern.scene_cut_interval : 0;
+  const uint64_t h = mix(mix(pattern.seed) + scene);
+  const uint64_t g = mix(h);
+  return {1 + static_cast<int64_t>(h % 4),
+          1 + static_cast<int64_t>((h >> 2) % 4),
+          static_cast<int64_t>((h >> 8) % kPeriod),
+          1 + static_cast<int64_t>((h >> 4) % 2),
+          static_cast<int64_t>((h >> 5) % 2),
+          static_cast<int64_t>((h >> 20) % kPeriod),
+          static_cast<int64_t>((h >> 6) % 2),
+          1 + static_cast<int64_t>((h >> 7) % 2),
+          static_cast<int64_t>((h >> 32) % kPeriod),
+          1 + static_cast<int64_t>((h >> 48) % 4),
+          static_cast<size_t>(g % kNoiseTile),
+          static_cast<size_t>((g >> 8) % kNoiseTile)};
+}
+
+static void store_row(const uint8_t* row, size_t size, bool high_depth, uint8_t* output) {
+  if (!high_depth) {
+    std::memcpy(output, row, size);
+    return;
+  }
+  // P010 holds 10 bits in the high bits of little endian 16 bit samples.
+  for (size_t i = 0; i < size; i++) {
+    output[2 * i] = 0;
+    output[2 * i + 1] = row[i];
+  }
+}
+
+bool is_synthetic_input(const std::string& input) {
+  const std::string prefix = kSyntheticInput;
+  return input == prefix || input.rfind(prefix + ":", 0) == 0;
+}
+
+SyntheticPattern parse_synthetic_input(const std::string& input, size_t* frames) {
+  const std::string prefix = kSyntheticInput;
+  if (!is_synthetic_input(input)) {
+    throw std::invalid_argument("Invalid synthetic input " + input);
+  }
+  SyntheticPattern pattern{};
+  *frames = 300;
+  std::istringstream options{input.size() > prefix.size() ? input.substr(prefix.size() + 1)
+                                                           : ""};
+  std::string option;
+  while (std::getline(options, option, ',')) {
+    const auto separator = option.find('=');
+    const auto key = option.substr(0, separator);
+    long value = 0;
+    try {
+      size_t parsed = 0;
+      const auto text = separator == std::string::npos ? "" : option.substr(separator + 1);
+      value = std::stol(text, &parsed);
+      if (parsed != text.size() || value < 0) {
+        throw std::invalid_argument(text);
+      }
+    } catch (std::logic_error&) {
+      throw std::invalid_argument("Invalid synthetic input option " + option);
+    }
+    if (key == "frames") {
+      *frames = value;
+    } else if (key == "complexity" && value <= 100) {
+      pattern.complexity = value;
+    } else if (key == "scenecut") {
+      pattern.scene_cut_interval = value;
+    } else if (key == "text" && value <= 1) {
+      pattern.text = value;
+    } else if (key == "seed") {
+      pattern.seed = value;
+    } else {
+      throw std::invalid_argument("Invalid synthetic input option " + option);
+    }
+  }
+  return pattern;
+}
+
+SyntheticFrameGenerator::SyntheticFrameGenerator(uint16_t width,
+                                                 uint16_t height,
+                                                 vpl::color_format_fourcc fourcc,
+                                                 const SyntheticPattern& pattern) :
+  width_{width},
+  height_{height},
+  fourcc_{fourcc},
+  pattern_{pattern},
+  frame_size_{packed_frame_size(width, height, fourcc)},
+  noise_(kNoiseTile * kNoiseTile) {
+  uint64_t state = pattern.seed;
+  for (auto& noise : noise_) {
+    state = mix(state);
+    noise = static_cast<int8_t>((static_cast<int>(state & 0xff) - 128) * pattern.complexity / 100);
+  }
+}
+
+size_t SyntheticFrameGenerator::frame_size() const {
+  return frame_size_;
+}
+
+void SyntheticFrameGenerator::render(size_t index, uint8_t* frame) const {
+  const Scene scene = make_scene(pattern_, index);
+  const bool high_depth = fourcc_ == vpl::color_format_fourcc::p010;
+  const size_t sample_size = high_depth ? 2 : 1;
+  // Gradients span a few periods whatever the resolution.
+  const int64_t span = std::max(width_ + height_, 1);
+  const int64_t motion = static_cast<int64_t>(index) * scene.speed * 4;
+
+  const size_t text_scale = std::max(height_ / 48, 1);
+  const size_t text_top = pattern_.text ? height_ * 3 / 4 : height_;
+  const size_t text_bottom = std::min<size_t>(text_top + 7 * text_scale, height_);
+  const size_t text_cell = 4 * text_scale;
+  const size_t text_scroll = index * 2 * text_scale;
+
+  // Phases of the columns are computed once, rows only add an offset.
+  std::vector<int> columns(width_);
+  for (size_t x = 0; x < width_; x++) {
+    columns[x] = static_cast<int64_t>(x) * scene.luma_x * 1024 / span % kPeriod;
+  }
+  const size_t noise_x = scene.noise_x + index * 5;
+  std::vector<uint8_t> row(width_);
+  // Text rows repeat for the height of a glyph cell.
+  int text_row = -2;
+  for (size_t y = 0; y < height_; y++) {
+    if (y >= text_top && y < text_bottom) {
+      const int glyph_row = static_cast<int>((y - text_top) / text_scale) - 1;
+      for (size_t x = 0; x < width_ && glyph_row != text_row; x++) {
+        const size_t position = x + text_scroll;
+        const size_t character = position / text_cell % kTextChars;
+        const size_t glyph_column = position % text_cell / text_scale;
+        const bool set = character < 10 && glyph_column < 3 && glyph_row >= 0 && glyph_row < 5 &&
+                         (kDigits[character] >> ((4 - glyph_row) * 3 + (2 - glyph_column)) & 1);
+        row[x] = set ? kTextForeground : kTextBackground;
+      }
+      text_row = glyph_row;
+    } else {
+      text_row = -2;
+      const int8_t* noise =
+          noise_.data() + (y + scene.noise_y + index * 3) % kNoiseTile * kNoiseTile;
+      const int phase =
+          (scene.luma_base + motion + static_cast<int64_t>(y) * scene.luma_y * 1024 / span) %
+          kPeriod;
+      for (size_t x = 0; x < width_; x++) {
+        const int value = triangle(phase + columns[x]) + noise[(x + noise_x) % kNoiseTile];
+        row[x] = static_cast<uint8_t>(std::clamp(value, 0, 255));
+      }
+    }
+    store_row(row.data(), width_, high_depth, frame + y * width_ * sample_size);
+  }
+
+  const size_t chroma_width = width_ / 2;
+  const size_t chroma_height = height_ / 2;
+  const size_t luma_size = static_cast<size_t>(width_) * height_ * sample_size;
+  std::vector<uint8_t> u(chroma_width);
+  std::vector<uint8_t> v(chroma_width);
+  std::vector<uint8_t> uv(width_);
+  std::vector<int> u_columns(chroma_width);
+  std::vector<int> v_columns(chroma_width);
+  for (size_t cx = 0; cx < chroma_width; cx++) {
+    u_columns[cx] = static_cast<int64_t>(2 * cx) * scene.u_x * 512 / span % kPeriod;
+    v_columns[cx] = static_cast<int64_t>(2 * cx) * scene.v_x * 512 / span % kPeriod;
+  }
+  for (size_t cy = 0; cy < chroma_height; cy++) {
+    const size_t y = 2 * cy;
+    const bool text = y >= text_top && y < text_bottom;
+    const int u_phase =
+        (scene.u_base + motion / 2 + static_cast<int64_t>(y) * scene.u_y * 512 / span) % kPeriod;
+    const int v_phase =
+        (scene.v_base + motion / 2 + static_cast<int64_t>(y) * scene.v_y * 512 / span) % kPeriod;
+    for (size_t cx = 0; cx < chroma_width; cx++) {
+      // Low saturation colors, neutral under the text.
+      u[cx] = text ? 128 : static_cast<uint8_t>(64 + triangle(u_phase + u_columns[cx]) / 2);
+      v[cx] = text ? 128 : static_cast<uint8_t>(64 + triangle(v_phase + v_columns[cx]) / 2);
+    }
+    if (fourcc_ == vpl::color_format_fourcc::i420) {
+      std::memcpy(frame + luma_size + cy * chroma_width, u.data(), chroma_width);
+      std::memcpy(frame + luma_size + (chroma_height + cy) * chroma_width, v.data(), chroma_width);
+    } else {
+      for (size_t cx = 0; cx < chroma_width; cx++) {
+        uv[2 * cx] = u[cx];
+        uv[2 * cx + 1] = v[cx];
+      }
+      store_row(uv.data(),
+                2 * chroma_width,
+                high_depth,
+                frame + luma_size + cy * 2 * chroma_width * sample_size);
+    }
+  }
+}
+
+SyntheticFrameReader::SyntheticFrameReader(uint16_t width,
+                                           uint16_t height,
+                                           vpl::color_format_fourcc fourcc,
+                                           const SyntheticPattern& pattern,
+                                           size_t total_frames) :
+  width_{width},
+  height_{height},
+  fourcc_{fourcc},
+  generator_{width, height, fourcc, pattern},
+  frame_(generator_.frame_size()),
+  total_frames_{total_frames},
+  frames_read_{0} {}
+
+bool SyntheticFrameReader::is_EOS() {
+  return frames_read_ >= total_frames_;
+}
+
+mfxStatus SyntheticFrameReader::get_data(std::shared_ptr<vpl::frame_surface> sfc) {
+  if (is_EOS()) {
+    return MFX_ERR_MORE_DATA;
+  }
+  // Rendered before mapping so the surface is held only for the copy.
+  {
+    TraceScope trace{"render"};
+    generator_.render(frames_read_, frame_.data());
+  }
+  const mfxStatus status = sfc->map(vpl::memory_access::write);
+  if (status != MFX_ERR_NONE) {
+    return status;
+  }
+  copy_packed_frame(frame_.data(), width_, height_, fourcc_, sfc->get_raw_interface());
+  frames_read_++;
+  return sfc->unmap();
+}
+
+size_t SyntheticFrameReader::frames_read() const {
+  return frames_read_;
+}
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "vpl/preview/vpl.hpp"
+
+// Procedural input, the same seed renders the same frames on every run.
+struct SyntheticPattern {
+  // Noise over the moving gradients, 0 for none to 100 for full range.
+  int complexity = 30;
+  // Frames between scene cuts, 0 for a single scene.
+  size_t scene_cut_interval = 0;
+  // Line of digits scrolling across the lower part of the frame.
+  bool text = true;
+  uint32_t seed = 1;
+};
+
+// Input "synthetic" or "synthetic:<options>" selects generated input.
+bool is_synthetic_input(const std::string& input);
+
+// Parses "synthetic[:frames=N,complexity=C,scenecut=S,text=0|1,seed=X]".
+// Throws std::invalid_argument for unknown keys or invalid values.
+SyntheticPattern parse_synthetic_input(const std::string& input, size_t* frames);
+
+// Renders packed frames of the pattern in the formats of packed_frame_size.
+class SyntheticFrameGenerator {
+ public:
+  SyntheticFrameGenerator(uint16_t width,
+                          uint16_t height,
+                          oneapi::vpl::color_format_fourcc fourcc,
+                          const SyntheticPattern& pattern);
+
+  size_t frame_size() const;
+
+  void render(size_t index, uint8_t* frame) const;
+
+ private:
+  const uint16_t width_;
+  const uint16_t height_;
+  const oneapi::vpl::color_format_fourcc fourcc_;
+  const SyntheticPattern pattern_;
+  const size_t frame_size_;
+  // Tile of noise scaled by the complexity, moved across the frame.
+  std::vector<int8_t> noise_;
+};
+
+// Serves total_frames generated frames, nothing is read from a file.
+class SyntheticFrameReader : public oneapi::vpl::frame_source_reader {
+ public:
+  SyntheticFrameReader(uint16_t width,
+                       uint16_t height,
+                       oneapi::vpl::color_format_fourcc fourcc,
+                       const SyntheticPattern& pattern,
+                       size_t total_frames);
+
+  bool is_EOS() override;
+
+  mfxStatus get_data(std::shared_ptr<oneapi::vpl::frame_surface> sfc) override;
+
+  size_t frames_read() const;
+
+ private:
+  const uint16_t width_;
+  const uint16_t height_;
+  const oneapi::vpl::color_format_fourcc fourcc_;
+  const SyntheticFrameGenerator generator_;
+  std::vector<uint8_t> frame_;
+  const size_t total_frames_;
+  size_t frames_read_;
+};
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "trace.hpp"
+
+#include "nlohmann/json.hpp"
+
+struct TraceEvent {
+  const char* name;
+  std::chrono::steady_clock::time_point begin;
+  std::chrono::steady_clock::time_point end;
+};
+
+// Written by its thread only, the count is published after the event.
+struct TraceRing {
+  TraceRing(size_t capacity, std::string name) : events(capacity), thread_name{std::move(name)} {}
+
+  std::vector<TraceEvent> events;
+  std::atomic<size_t> recorded{0};
+  std::string thread_name;
+};
+
+struct TraceState {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<TraceRing>> rings;
+  size_t capacity = kTraceEvents;
+  std::chrono::steady_clock::time_point start;
+  // Rings of an older trace are registered again.
+  std::atomic<uint64_t> generation{0};
+};
+
+struct ThreadRing {
+  uint64_t generation = 0;
+  std::shared_ptr<TraceRing> ring;
+  std::string name;
+};
+
+static TraceState& trace_state() {
+  static TraceState state;
+  return state;
+}
+
+static thread_local ThreadRing thread_ring;
+
+void start_trace(size_t events_per_thread) {
+  auto& state = trace_state();
+  std::lock_guard<std::mutex> lock{state.mutex};
+  state.rings.clear();
+  state.capacity = std::max<size_t>(events_per_thread, 1);
+  state.start = std::chrono::steady_clock::now();
+  state.generation++;
+  trace_enabled.store(true, std::memory_order_relaxed);
+}
+
+void stop_trace() {
+  trace_enabled.store(false, std::memory_order_relaxed);
+}
+
+void set_trace_thread_name(const char* name) {
+  thread_ring.name = name;
+  if (thread_ring.ring) {
+    std::lock_guard<std::mutex> lock{trace_state().mutex};
+    thread_ring.ring->thread_name = name;
+  }
+}
+
+void trace_span(const char* name,
+                std::chrono::steady_clock::time_point begin,
+                std::chrono::steady_clock::time_point end) {
+  auto& state = trace_state();
+  const uint64_t generation = state.generation.load(std::memory_order_acquire);
+  if (!thread_ring.ring || thread_ring.generation != generation) {
+    // First span of the thread in this trace, the only locked one.
+    std::lock_guard<std::mutex> lock{state.mutex};
+    thread_ring.ring = std::make_shared<TraceRing>(
+        state.capacity,
+        thread_ring.name.empty() ? "thread " + std::to_string(state.rings.size())
+                                 : thread_ring.name);
+    thread_ring.generation = generation;
+    state.rings.push_back(thread_ring.ring);
+  }
+  auto& ring = *thread_ring.ring;
+  const size_t index = ring.recorded.load(std::memory_order_relaxed);
+  ring.events[index % ring.events.size()] = {name, begin, end};
+  ring.recorded.store(index + 1, std::memory_order_release);
+}
+
+void write_trace(std::ostream& output) {
+  auto& state = trace_state();
+  std::lock_guard<std::mutex> lock{state.mutex};
+  auto microseconds = [&state](std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration<double, std::micro>(time - state.start).count();
+  };
+  nlohmann::json events = nlohmann::json::array();
+  size_t dropped = 0;
+  for (size_t tid = 0; tid < state.rings.size(); tid++) {
+    const auto& ring = *state.rings[tid];
+    events.push_back({{"name", "thread_name"},
+                      {"ph", "M"},
+                      {"pid", 1},
+                      {"tid", tid},
+                      {"args", {{"name", ring.thread_name}}}});
+    const size_t recorded = ring.recorded.load(std::memory_order_acquire);
+    const size_t first = recorded > ring.events.size() ? recorded - ring.events.size() : 0;
+    dropped += first;
+    for (size_t i = first; i < recorded; i++) {
+      const auto& event = ring.events[i % ring.events.size()];
+      events.push_back({{"name", event.name},
+                        {"cat", "encode"},
+                        {"ph", "X"},
+                        {"ts", microseconds(event.begin)},
+                        {"dur", microseconds(event.end) - microseconds(event.begin)},
+                        {"pid", 1},
+                        {"tid", tid}});
+    }
+  }
+  const nlohmann::json trace{{"traceEvents", events},
+                             {"displayTimeUnit", "ms"},
+                             {"otherData", {{"droppedevents", dropped}}}};
+  output << trace << std::endl;
+}
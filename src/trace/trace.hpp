@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+// Events kept per thread, older ones are overwritten.
+constexpr const size_t kTraceEvents = 1 << 16;
+
+// Read on every traced span, a relaxed load while tracing is off.
+inline std::atomic<bool> trace_enabled{false};
+
+// Drops the events of a previous trace and starts recording spans.
+void start_trace(size_t events_per_thread = kTraceEvents);
+
+// Stops recording, the events are kept for write_trace.
+void stop_trace();
+
+inline bool tracing() {
+  return trace_enabled.load(std::memory_order_relaxed);
+}
+
+// Names the calling thread in the trace.
+void set_trace_thread_name(const char* name);
+
+// Records a span in the ring of the calling thread, name must outlive the
+// trace. Only the calling thread writes its ring.
+void trace_span(const char* name,
+                std::chrono::steady_clock::time_point begin,
+                std::chrono::steady_clock::time_point end);
+
+// Writes the events of all threads as Chrome trace event JSON, readable by
+// chrome://tracing and Perfetto. Threads recording spans must be stopped.
+void write_trace(std::ostream& output);
+
+// Records the span of the scope while tracing is on.
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name) : name_{tracing() ? name : nullptr} {
+    if (name_) {
+      begin_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~TraceScope() {
+    if (name_) {
+      trace_span(name_, begin_, std::chrono::steady_clock::now());
+    }
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  const char* name_;
+  std::chrono::steady_clock::time_point begin_{};
+};
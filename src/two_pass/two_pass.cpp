@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+#include "two_pass.hpp"
+
+constexpr const char kMagic[] = {'V', 'P', 'L', '2'};
+constexpr const uint32_t kVersion = 1;
+constexpr const uint32_t kIframeBit = 0x80000000;
+constexpr const int kMinQp = 1;
+constexpr const int kMaxQp = 51;
+// Share of the complexity difference between frames that is kept in the bit
+// distribution, the rest is flattened out (x264 qcomp).
+constexpr const double kQcomp = 0.6;
+
+static void write_u32(std::ostream& output, uint32_t value) {
+  const char bytes[] = {static_cast<char>(value & 0xff),
+                        static_cast<char>((value >> 8) & 0xff),
+                        static_cast<char>((value >> 16) & 0xff),
+                        static_cast<char>((value >> 24) & 0xff)};
+  output.write(bytes, sizeof(bytes));
+}
+
+static uint32_t read_u32(std::istream& input) {
+  unsigned char bytes[4];
+  if (!input.read(reinterpret_cast<char*>(bytes), sizeof(bytes))) {
+    throw std::runtime_error("Truncated first pass stats");
+  }
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+void write_first_pass_stats(const FirstPassStats& stats, std::ostream& output) {
+  output.write(kMagic, sizeof(kMagic));
+  write_u32(output, kVersion);
+  write_u32(output, (static_cast<uint32_t>(stats.qp) << 16) | static_cast<uint16_t>(stats.fps));
+  write_u32(output, stats.frames.size());
+  for (const auto& frame : stats.frames) {
+    write_u32(output, (frame.size & ~kIframeBit) | (frame.iframe ? kIframeBit : 0));
+  }
+}
+
+FirstPassStats read_first_pass_stats(std::istream& input) {
+  char magic[sizeof(kMagic)];
+  if (!input.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), kMagic)) {
+    throw std::runtime_error("Not a first pass stats file");
+  }
+  if (read_u32(input) != kVersion) {
+    throw std::runtime_error("Unsupported first pass stats version");
+  }
+  FirstPassStats stats{};
+  const auto qp_fps = read_u32(input);
+  stats.qp = qp_fps >> 16;
+  stats.fps = qp_fps & 0xffff;
+  const auto frame_count = read_u32(input);
+  stats.frames.reserve(frame_count);
+  for (uint32_t i = 0; i < frame_count; ++i) {
+    const auto value = read_u32(input);
+    stats.frames.push_back({value & ~kIframeBit, (value & kIframeBit) != 0});
+  }
+  return stats;
+}
+
+BitAllocator::BitAllocator(const FirstPassStats& stats, uint64_t target_bytes) :
+  stats_{stats},
+  target_bytes_{target_bytes},
+  planned_qp_(stats.frames.size()),
+  planned_bytes_(stats.frames.size()),
+  planned_remaining_{0},
+  encoded_bytes_{0},
+  qp_offset_{0} {
+  if (stats_.frames.empty()) {
+    throw std::runtime_error("First pass stats hold no frames");
+  }
+  double weights = 0;
+  for (const auto& frame : stats_.frames) {
+    weights += std::pow(std::max<uint32_t>(frame.size, 1), kQcomp);
+  }
+  const double scale = static_cast<double>(target_bytes_) / weights;
+  for (size_t i = 0; i < stats_.frames.size(); ++i) {
+    const double complexity = std::max<uint32_t>(stats_.frames[i].size, 1);
+    const double frame_bytes = scale * std::pow(complexity, kQcomp);
+    planned_qp_[i] = stats_.qp + 6.0 * std::log2(complexity / frame_bytes);
+    planned_bytes_[i] = predicted_bytes(i, frame_qp(i));
+  }
+  planned_remaining_ = std::accumulate(planned_bytes_.begin(), planned_bytes_.end(), 0.0);
+  qp_offset_ = 6.0 * std::log2(planned_remaining_ / target_bytes_);
+}
+
+int BitAllocator::frame_qp(size_t frame) const {
+  if (frame >= planned_qp_.size()) {
+    return stats_.qp;
+  }
+  const int qp = static_cast<int>(std::lround(planned_qp_[frame] + qp_offset_));
+  return std::clamp(qp, kMinQp, kMaxQp);
+}
+
+void BitAllocator::update(size_t frame, size_t encoded_bytes) {
+  if (frame >= planned_bytes_.size()) {
+    return;
+  }
+  encoded_bytes_ += encoded_bytes;
+  planned_remaining_ -= planned_bytes_[frame];
+  if (planned_remaining_ <= 0) {
+    return;
+  }
+  // Spread the error made so far over the frames which are left.
+  const double remaining_budget =
+      std::max<double>(static_cast<double>(target_bytes_) - encoded_bytes_, 1.0);
+  qp_offset_ = 6.0 * std::log2(planned_remaining_ / remaining_budget);
+}
+
+double BitAllocator::predicted_bytes(size_t frame, int qp) const {
+  return stats_.frames[frame].size * std::pow(2.0, (stats_.qp - qp) / 6.0);
+}
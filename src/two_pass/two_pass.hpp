@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// Complexity of a single frame measured by the first pass: encoded size at a
+// fixed QP.
+struct FirstPassFrame {
+  uint32_t size;
+  bool iframe;
+};
+
+struct FirstPassStats {
+  int qp;
+  int fps;
+  std::vector<FirstPassFrame> frames;
+};
+
+// Compact binary form, 16 bytes of header and 4 bytes per frame. Throws
+// std::runtime_error when the stream does not hold valid first pass stats.
+void write_first_pass_stats(const FirstPassStats& stats, std::ostream& output);
+FirstPassStats read_first_pass_stats(std::istream& input);
+
+// Distributes a target file size over the frames of the second pass. Frame QP
+// is derived from the first pass size assuming that the size halves every 6 QP
+// steps, and the plan is corrected with the sizes actually produced so the
+// final file lands on the target.
+class BitAllocator {
+ public:
+  BitAllocator(const FirstPassStats& stats, uint64_t target_bytes);
+
+  int frame_qp(size_t frame) const;
+
+  void update(size_t frame, size_t encoded_bytes);
+
+  double predicted_bytes(size_t frame, int qp) const;
+
+ private:
+  const FirstPassStats stats_;
+  const uint64_t target_bytes_;
+  std::vector<double> planned_qp_;
+  std::vector<double> planned_bytes_;
+  double planned_remaining_;
+  uint64_t encoded_bytes_;
+  double qp_offset_;
+};
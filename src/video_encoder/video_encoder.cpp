@@ -1,33 +1,276 @@
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <mutex>
+
 #include "video_encoder.hpp"
 
+#include "cpu_usage/cpu_usage.hpp"
+#include "trace/trace.hpp"
+
 namespace vpl = oneapi::vpl;
 
 constexpr const bool kUseVideoMemory = false;
 
-VideoEncoder::VideoEncoder(vpl::implementation_selector& impl_sel,
-                           vpl::frame_source_reader* frame_source) :
-  encoder_{std::make_shared<vpl::encode_session>(impl_sel, frame_source)} {}
+// Held while a session starts its threads, they are told apart by the threads
+// that appeared meanwhile.
+static std::mutex session_start_mutex;
 
-void VideoEncoder::init(vpl::frame_info frame_info,
-                        vpl::codec_format_fourcc codec_type,
-                        vpl::rate_control_method bitrate_mode,
-                        vpl::encoder_init_list encoder_init_list) {
+static std::shared_ptr<vpl::encoder_video_param> make_encoder_params(
+    vpl::frame_info frame_info,
+    vpl::codec_format_fourcc codec_type,
+    vpl::rate_control_method bitrate_mode,
+    const EncoderParams& encoder_params) {
   auto enc_params = std::make_shared<vpl::encoder_video_param>();
   enc_params->set_RateControlMethod(bitrate_mode);
   enc_params->set_frame_info(std::move(frame_info));
   enc_params->set_CodecId(codec_type);
   enc_params->set_IOPattern((kUseVideoMemory) ? vpl::io_pattern::in_device_memory
                                               : vpl::io_pattern::in_system_memory);
-  encoder_->Init(enc_params.get(), encoder_init_list);
+  if (encoder_params.target_usage) {
+    enc_params->set_TargetUsage(encoder_params.target_usage);
+  }
+  if (encoder_params.qp) {
+    enc_params->set_QPI(encoder_params.qp);
+    enc_params->set_QPP(encoder_params.qp);
+    enc_params->set_QPB(encoder_params.qp);
+  }
+  if (encoder_params.target_kbps) {
+    enc_params->set_TargetKbps(encoder_params.target_kbps);
+  }
+  if (encoder_params.max_kbps) {
+    enc_params->set_MaxKbps(encoder_params.max_kbps);
+  }
+  if (encoder_params.num_thread) {
+    enc_params->set_NumThread(encoder_params.num_thread);
+  }
+  if (encoder_params.async_depth) {
+    enc_params->set_AsyncDepth(encoder_params.async_depth);
+  }
+  if (encoder_params.gop_ref_dist) {
+    enc_params->set_GopRefDist(encoder_params.gop_ref_dist);
+  }
+  if (encoder_params.num_slice) {
+    enc_params->set_NumSlice(encoder_params.num_slice);
+  }
+  return enc_params;
+}
+
+static int64_t frame_duration(const vpl::frame_info& frame_info) {
+  const auto [numerator, denominator] = frame_info.get_frame_rate();
+  return numerator ? int64_t{kPtsTimescale} * denominator / numerator : 0;
+}
+
+FrameSourceProxy::FrameSourceProxy(vpl::frame_source_reader* frame_source,
+                                   PtsTracker* pts_tracker) :
+  frame_source_{frame_source},
+  paced_reader_{dynamic_cast<PacedFrameReader*>(frame_source)},
+  pts_tracker_{pts_tracker} {}
+
+void FrameSourceProxy::set_frame_source(vpl::frame_source_reader* frame_source) {
+  frame_source_ = frame_source;
+  paced_reader_ = dynamic_cast<PacedFrameReader*>(frame_source);
+}
+
+bool FrameSourceProxy::is_EOS() {
+  return !frame_source_ || frame_source_->is_EOS();
+}
+
+mfxStatus FrameSourceProxy::get_data(std::shared_ptr<vpl::frame_surface> sfc) {
+  if (!frame_source_) {
+    return MFX_ERR_MORE_DATA;
+  }
+  TraceScope trace{"read"};
+  const mfxStatus status = frame_source_->get_data(sfc);
+  if (status == MFX_ERR_NONE) {
+    sfc->get_raw_interface()->Data.TimeStamp =
+        paced_reader_ ? pts_tracker_->stamp(paced_reader_->last_arrival()) : pts_tracker_->stamp();
+  }
+  return status;
+}
+
+VideoEncoder::VideoEncoder(vpl::implementation_selector& impl_sel,
+                           vpl::frame_source_reader* frame_source) :
+  frame_source_{std::make_unique<FrameSourceProxy>(frame_source, &pts_tracker_)},
+  codec_type_{},
+  bitrate_mode_{},
+  input_frames_{0},
+  idr_period_{0} {
+  std::lock_guard<std::mutex> lock{session_start_mutex};
+  const auto threads_before = process_threads();
+  encoder_ = std::make_shared<vpl::encode_session>(impl_sel, frame_source_.get());
+  add_session_threads(threads_before);
+}
+
+void VideoEncoder::init(vpl::frame_info frame_info,
+                        vpl::codec_format_fourcc codec_type,
+                        vpl::rate_control_method bitrate_mode,
+                        vpl::encoder_init_list encoder_init_list,
+                        const EncoderParams& encoder_params) {
+  auto enc_params = make_encoder_params(frame_info, codec_type, bitrate_mode, encoder_params);
+  {
+    std::lock_guard<std::mutex> lock{session_start_mutex};
+    const auto threads_before = process_threads();
+    encoder_->Init(enc_params.get(), encoder_init_list);
+    add_session_threads(threads_before);
+  }
+  frame_info_ = std::move(frame_info);
+  codec_type_ = codec_type;
+  bitrate_mode_ = bitrate_mode;
+  encoder_params_ = encoder_params;
+  pending_reconfiguration_.reset();
+  reconfigure_events_.clear();
+  input_frames_ = 0;
+  last_idr_frame_.reset();
+  idr_period_ = 0;
+  pts_tracker_.reset(frame_duration(frame_info_));
+}
+
+void VideoEncoder::reset(vpl::frame_info frame_info,
+                         vpl::codec_format_fourcc codec_type,
+                         vpl::rate_control_method bitrate_mode,
+                         const EncoderParams& encoder_params) {
+  auto enc_params = make_encoder_params(frame_info, codec_type, bitrate_mode, encoder_params);
+  // New stream starts with an IDR frame and doesn't reference the previous one.
+  vpl::encoder_reset_list encoder_reset_list;
+  auto reset_option = std::make_unique<vpl::ExtEncoderResetOption>();
+  reset_option->get_ref().StartNewSequence = MFX_CODINGOPTION_ON;
+  encoder_reset_list.add_buffer(reset_option.get());
+  encoder_->reset(enc_params.get(), encoder_reset_list);
+  frame_info_ = std::move(frame_info);
+  codec_type_ = codec_type;
+  bitrate_mode_ = bitrate_mode;
+  encoder_params_ = encoder_params;
+  pending_reconfiguration_.reset();
+  reconfigure_events_.clear();
+  input_frames_ = 0;
+  last_idr_frame_.reset();
+  idr_period_ = 0;
+  pts_tracker_.reset(frame_duration(frame_info_));
+}
+
+void VideoEncoder::reconfigure(const Reconfiguration& reconfiguration) {
+  if (!pending_reconfiguration_) {
+    pending_reconfiguration_ = reconfiguration;
+    return;
+  }
+  auto& pending = *pending_reconfiguration_;
+  if (reconfiguration.target_kbps) {
+    pending.target_kbps = reconfiguration.target_kbps;
+  }
+  if (reconfiguration.max_kbps) {
+    pending.max_kbps = reconfiguration.max_kbps;
+  }
+  if (reconfiguration.frame_rate) {
+    pending.frame_rate = reconfiguration.frame_rate;
+  }
+  if (reconfiguration.target_usage) {
+    pending.target_usage = reconfiguration.target_usage;
+  }
+  pending.at_idr = pending.at_idr || reconfiguration.at_idr;
+}
+
+void VideoEncoder::idr_encoded(size_t input_frame) {
+  if (last_idr_frame_ && input_frame > *last_idr_frame_) {
+    idr_period_ = input_frame - *last_idr_frame_;
+  }
+  last_idr_frame_ = input_frame;
+}
+
+// The next frame submitted is where the GOP puts an IDR frame.
+bool VideoEncoder::is_idr_due() const {
+  return last_idr_frame_ && idr_period_ && input_frames_ > *last_idr_frame_ &&
+         (input_frames_ - *last_idr_frame_) % idr_period_ == 0;
+}
+
+const std::vector<ReconfigureEvent>& VideoEncoder::reconfigure_events() const {
+  return reconfigure_events_;
+}
+
+void VideoEncoder::apply_reconfiguration() {
+  const auto reconfiguration = *pending_reconfiguration_;
+  pending_reconfiguration_.reset();
+  if (reconfiguration.target_kbps) {
+    encoder_params_.target_kbps = reconfiguration.target_kbps;
+  }
+  if (reconfiguration.max_kbps) {
+    encoder_params_.max_kbps = reconfiguration.max_kbps;
+  }
+  if (reconfiguration.target_usage) {
+    encoder_params_.target_usage = reconfiguration.target_usage;
+  }
+  if (reconfiguration.frame_rate) {
+    frame_info_.set_frame_rate({reconfiguration.frame_rate, 1});
+    pts_tracker_.set_frame_duration(frame_duration(frame_info_));
+  }
+  auto enc_params = make_encoder_params(frame_info_, codec_type_, bitrate_mode_, encoder_params_);
+  vpl::encoder_reset_list encoder_reset_list;
+  auto reset_option = std::make_unique<vpl::ExtEncoderResetOption>();
+  // Changes at an IDR frame are applied where the GOP has one, the new
+  // sequence starts with the IDR frame the encoder makes anyway.
+  reset_option->get_ref().StartNewSequence =
+      reconfiguration.at_idr ? MFX_CODINGOPTION_ON : MFX_CODINGOPTION_OFF;
+  encoder_reset_list.add_buffer(reset_option.get());
+
+  const auto reset_start = std::chrono::steady_clock::now();
+  encoder_->reset(enc_params.get(), encoder_reset_list);
+  const auto stall_time = std::chrono::steady_clock::now() - reset_start;
+  reconfigure_events_.push_back(
+      {input_frames_,
+       reconfiguration,
+       std::chrono::duration_cast<std::chrono::microseconds>(stall_time).count()});
+}
+
+void VideoEncoder::set_frame_source(vpl::frame_source_reader* frame_source) {
+  frame_source_->set_frame_source(frame_source);
 }
 
 vpl::status VideoEncoder::encode(std::shared_ptr<vpl::bitstream_as_dst> bitstream,
                                  vpl::encoder_process_list encoder_process_list) {
+  if (pending_reconfiguration_ && (!pending_reconfiguration_->at_idr || is_idr_due())) {
+    apply_reconfiguration();
+  }
+  input_frames_++;
   return encoder_->encode_frame(bitstream, encoder_process_list);
 }
 
+vpl::status VideoEncoder::encode(mfxFrameSurface1* surface,
+                                 std::shared_ptr<vpl::bitstream_as_dst> bitstream,
+                                 vpl::encoder_process_list encoder_process_list) {
+  if (pending_reconfiguration_ && (!pending_reconfiguration_->at_idr || is_idr_due())) {
+    apply_reconfiguration();
+  }
+  auto input = surface ? std::make_shared<vpl::frame_surface>(surface) : nullptr;
+  if (input) {
+    surface->Data.TimeStamp = pts_tracker_.stamp();
+    input_frames_++;
+  }
+  return encoder_->encode_frame(input, bitstream, encoder_process_list);
+}
+
 std::shared_ptr<vpl::encoder_video_param> VideoEncoder::get_working_params() {
   return encoder_->working_params();
 }
+
+std::optional<InputFrame> VideoEncoder::match_input_frame(int64_t pts) {
+  return pts_tracker_.match(pts);
+}
+
+size_t VideoEncoder::frames_in_flight() const {
+  return pts_tracker_.pending();
+}
+
+const std::vector<pid_t>& VideoEncoder::session_threads() const {
+  return session_threads_;
+}
+
+void VideoEncoder::add_session_threads(const std::vector<pid_t>& threads_before) {
+  const auto threads = process_threads();
+  std::set_difference(threads.begin(),
+                      threads.end(),
+                      threads_before.begin(),
+                      threads_before.end(),
+                      std::back_inserter(session_threads_));
+}
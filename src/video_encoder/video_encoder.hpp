@@ -2,8 +2,70 @@
 
 #pragma once
 
+#include <sys/types.h>
+
+#include <memory>
+#include <optional>
+#include <vector>
+
 #include "vpl/preview/vpl.hpp"
 
+#include "paced_frame_reader/paced_frame_reader.hpp"
+#include "pts_tracker/pts_tracker.hpp"
+
+// Optional encoder settings, zero keeps the implementation default.
+struct EncoderParams {
+  uint16_t target_usage = 0;
+  uint16_t qp = 0;
+  uint16_t target_kbps = 0;
+  uint16_t max_kbps = 0;
+  // Threads of a software implementation.
+  uint16_t num_thread = 0;
+  // Frames the session works on at once.
+  uint16_t async_depth = 0;
+  // Distance between anchor frames, 1 disables B-frames.
+  uint16_t gop_ref_dist = 0;
+  uint16_t num_slice = 0;
+};
+
+// Rate control change of a running stream, zero keeps the current value.
+struct Reconfiguration {
+  uint16_t target_kbps = 0;
+  uint16_t max_kbps = 0;
+  int frame_rate = 0;
+  // Encoder speed and quality trade off, 1 best quality to 7 best speed.
+  uint16_t target_usage = 0;
+  // Wait for the next IDR frame of the GOP and start the new sequence there,
+  // instead of changing the next frame.
+  bool at_idr = false;
+};
+
+struct ReconfigureEvent {
+  size_t frame;
+  Reconfiguration reconfiguration;
+  // Time the session reset blocked the encode call.
+  long stall_time_us;
+};
+
+// Forwards to a frame source which can be replaced, the session keeps the
+// reader it was created with. Frames read are stamped with their PTS.
+class FrameSourceProxy : public oneapi::vpl::frame_source_reader {
+ public:
+  FrameSourceProxy(oneapi::vpl::frame_source_reader* frame_source, PtsTracker* pts_tracker);
+
+  void set_frame_source(oneapi::vpl::frame_source_reader* frame_source);
+
+  bool is_EOS() override;
+
+  mfxStatus get_data(std::shared_ptr<oneapi::vpl::frame_surface> sfc) override;
+
+ private:
+  oneapi::vpl::frame_source_reader* frame_source_;
+  // Set when the frames are paced, their arrival is the time they were queued.
+  PacedFrameReader* paced_reader_;
+  PtsTracker* pts_tracker_;
+};
+
 class VideoEncoder {
  public:
   VideoEncoder(oneapi::vpl::implementation_selector& impl_sel,
@@ -12,13 +74,76 @@ class VideoEncoder {
   void init(oneapi::vpl::frame_info frame_info,
             oneapi::vpl::codec_format_fourcc codec_type,
             oneapi::vpl::rate_control_method bitrate_mode,
-            oneapi::vpl::encoder_init_list encoder_init_list = {});
+            oneapi::vpl::encoder_init_list encoder_init_list = {},
+            const EncoderParams& encoder_params = {});
+
+  // Re-initializes the session for a new stream with the same codec and
+  // frame size. The previous stream must be drained to the end.
+  void reset(oneapi::vpl::frame_info frame_info,
+             oneapi::vpl::codec_format_fourcc codec_type,
+             oneapi::vpl::rate_control_method bitrate_mode,
+             const EncoderParams& encoder_params = {});
+
+  // Applies the change with a session reset before the next frame is
+  // submitted. Frames in flight and allocated surfaces are kept. Changes
+  // made before they are applied are merged into one reset. A change at an
+  // IDR frame waits for the input frame the next IDR frame is predicted for,
+  // which needs two IDR frames reported.
+  void reconfigure(const Reconfiguration& reconfiguration);
+
+  // Reports an encoded IDR frame by its input frame, the distance between
+  // IDR frames predicts the next one.
+  void idr_encoded(size_t input_frame);
+
+  // Reconfigurations applied since init or reset.
+  const std::vector<ReconfigureEvent>& reconfigure_events() const;
+
+  // Frames of the next stream are read from frame_source.
+  void set_frame_source(oneapi::vpl::frame_source_reader* frame_source);
 
   oneapi::vpl::status encode(std::shared_ptr<oneapi::vpl::bitstream_as_dst> bitstream,
                              oneapi::vpl::encoder_process_list encoder_process_list = {});
 
+  // Encodes a caller owned surface without copying it, null surface drains
+  // the encoder. The surface stays locked until the encoder is done with it.
+  oneapi::vpl::status encode(mfxFrameSurface1* surface,
+                             std::shared_ptr<oneapi::vpl::bitstream_as_dst> bitstream,
+                             oneapi::vpl::encoder_process_list encoder_process_list = {});
+
   std::shared_ptr<oneapi::vpl::encoder_video_param> get_working_params();
 
+  // Input frame an encoded frame was made from, by the PTS of its bitstream.
+  // Each input frame is returned once.
+  std::optional<InputFrame> match_input_frame(int64_t pts);
+
+  // Input frames submitted and not matched to an encoded frame yet.
+  size_t frames_in_flight() const;
+
+  // Threads the implementation started for the session, the ones that
+  // appeared while it was created and initialized. Sessions start one at a
+  // time, so concurrent sessions don't take each other's threads, a writer
+  // thread another job starts meanwhile would be taken.
+  const std::vector<pid_t>& session_threads() const;
+
  private:
+  void apply_reconfiguration();
+  bool is_idr_due() const;
+  void add_session_threads(const std::vector<pid_t>& threads_before);
+
+  PtsTracker pts_tracker_;
+  std::unique_ptr<FrameSourceProxy> frame_source_;
   std::shared_ptr<oneapi::vpl::encode_session> encoder_;
+  // Parameters of the running stream, base for reconfigurations.
+  oneapi::vpl::frame_info frame_info_;
+  oneapi::vpl::codec_format_fourcc codec_type_;
+  oneapi::vpl::rate_control_method bitrate_mode_;
+  EncoderParams encoder_params_;
+  std::optional<Reconfiguration> pending_reconfiguration_;
+  std::vector<ReconfigureEvent> reconfigure_events_;
+  size_t input_frames_;
+  // Input frame of the last IDR frame and the distance to the one before,
+  // 0 until two were reported.
+  std::optional<size_t> last_idr_frame_;
+  size_t idr_period_;
+  std::vector<pid_t> session_threads_;
 };
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <cstring>
+
+#include "doctest.h"
+
+#include "arena/arena.hpp"
+
+TEST_CASE("When arena allocates, blocks should be aligned and bounded") {
+  for (const auto type : {ArenaType::standard, ArenaType::hugepage}) {
+    Arena arena{type, 3 * 1024 * 1024, true};
+    auto* first = arena.allocate(100);
+    auto* second = arena.allocate(100);
+    REQUIRE(first);
+    REQUIRE(second);
+    CHECK_EQ(reinterpret_cast<uintptr_t>(first) % 64, 0);
+    CHECK_EQ(reinterpret_cast<uintptr_t>(second) % 64, 0);
+    CHECK_GE(second - first, 100);
+    std::memset(second, 0xff, 100);
+
+    const auto info = arena.info();
+    CHECK_EQ(info.reserved, 4 * 1024 * 1024);
+    CHECK_EQ(info.used, 128 + 100);
+    CHECK(info.prefaulted);
+    CHECK_LE(info.hugepage_bytes, info.reserved);
+    CHECK_EQ(arena.allocate(info.reserved), nullptr);
+  }
+}
+
+TEST_CASE("When arena name parsed, unknown names throw") {
+  CHECK_EQ(arena_type_from_string("default"), ArenaType::standard);
+  CHECK_EQ(arena_type_from_string("hugepage"), ArenaType::hugepage);
+  CHECK_THROWS_AS(arena_type_from_string("huge"), std::invalid_argument);
+}
@@ -0,0 +1,407 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <stdexcept>
+
+#include "doctest.h"
+
+#include "bitstream_parser/bitstream_parser.hpp"
+
+// High profile 1280x720 SPS.
+static const std::vector<uint8_t> kH264Sps{0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40,
+                                           0x50, 0x05, 0xbb, 0x01, 0x10, 0x00, 0x00,
+                                           0x03, 0x00, 0x10, 0x00, 0x00, 0x03, 0x03,
+                                           0xc0, 0xf1, 0x83, 0x19, 0x60};
+
+class BitWriter {
+ public:
+  void bits(uint32_t value, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+      if (bit_count_ % 8 == 0) {
+        bytes_.push_back(0);
+      }
+      bytes_.back() |= ((value >> i) & 1) << (7 - bit_count_ % 8);
+      bit_count_++;
+    }
+  }
+
+  void ue(uint32_t value) {
+    int length = 0;
+    while ((value + 1) >> (length + 1)) {
+      length++;
+    }
+    bits(0, length);
+    bits(value + 1, length + 1);
+  }
+
+  void se(int32_t value) { ue(value > 0 ? 2 * value - 1 : -2 * value); }
+
+  // rbsp_trailing_bits()
+  void trailing() {
+    bits(1, 1);
+    while (bit_count_ % 8) {
+      bits(0, 1);
+    }
+  }
+
+  std::vector<uint8_t> bytes() const { return bytes_; }
+
+ private:
+  std::vector<uint8_t> bytes_;
+  int bit_count_ = 0;
+};
+
+// Start codes and emulation prevention bytes around NAL units.
+static std::vector<uint8_t> annexb(const std::vector<std::vector<uint8_t>>& nal_units) {
+  std::vector<uint8_t> stream;
+  for (const auto& nal : nal_units) {
+    stream.insert(stream.end(), {0, 0, 0, 1});
+    int zeros = 0;
+    for (const uint8_t byte : nal) {
+      if (zeros >= 2 && byte <= 3) {
+        stream.push_back(3);
+        zeros = 0;
+      }
+      zeros = byte == 0 ? zeros + 1 : 0;
+      stream.push_back(byte);
+    }
+  }
+  return stream;
+}
+
+// Main 10 1920x1080 SPS with 64x64 CTBs and one reference picture set.
+static std::vector<uint8_t> hevc_sps() {
+  BitWriter writer;
+  writer.bits(0x4201, 16);
+  writer.bits(0, 4);
+  writer.bits(1, 3);  // two sub-layers
+  writer.bits(1, 1);
+  writer.bits(0, 2);
+  writer.bits(1, 1);  // high tier
+  writer.bits(2, 5);  // Main 10
+  writer.bits(0x20000000, 32);
+  writer.bits(0x9000, 16);
+  writer.bits(0, 32);
+  writer.bits(123, 8);
+  writer.bits(1, 1);  // sub-layer profile present
+  writer.bits(0, 1);
+  writer.bits(0, 2 * 7);
+  writer.bits(0, 32);
+  writer.bits(0, 32);
+  writer.bits(0, 24);
+  writer.ue(0);
+  writer.ue(1);
+  writer.ue(1920);
+  writer.ue(1080);
+  writer.bits(1, 1);
+  for (const uint32_t offset : {0, 0, 0, 4}) {
+    writer.ue(offset);
+  }
+  writer.ue(2);
+  writer.ue(2);
+  writer.ue(4);  // 8 bit POC LSB
+  writer.bits(0, 1);
+  for (const uint32_t ordering : {4, 2, 0}) {
+    writer.ue(ordering);
+  }
+  for (const uint32_t block_size : {0, 3, 0, 3, 0, 0}) {
+    writer.ue(block_size);
+  }
+  writer.bits(0, 1);
+  writer.bits(1, 1);  // amp
+  writer.bits(1, 1);  // sao
+  writer.bits(0, 1);
+  writer.ue(1);
+  writer.ue(1);  // one negative picture used by the current picture
+  writer.ue(0);
+  writer.ue(0);
+  writer.bits(1, 1);
+  writer.bits(0, 1);
+  writer.bits(1, 1);  // temporal mvp
+  writer.bits(1, 1);
+  writer.bits(0, 2);
+  writer.trailing();
+  return writer.bytes();
+}
+
+TEST_CASE("When Annex-B stream is split, start codes and trailing zeros should be removed") {
+  const std::vector<uint8_t> stream{0, 0, 0, 1, 0x09, 0xf0, 0, 0, 1, 0x67, 0x42, 0,
+                                    0, 0, 0, 1, 0x65, 0x88, 0x84, 0, 0};
+  const auto nal_units = split_annexb(stream.data(), stream.size(), NalCodec::h264);
+  REQUIRE_EQ(nal_units.size(), 3);
+  CHECK_EQ(nal_units[0].type, 9);
+  CHECK_EQ(nal_units[0].size, 2);
+  CHECK_EQ(nal_units[1].type, kH264NalSps);
+  CHECK_EQ(nal_units[1].size, 2);
+  CHECK_EQ(nal_units[2].type, 5);
+  CHECK_EQ(nal_units[2].size, 3);
+
+  const std::vector<uint8_t> hevc{0, 0, 1, 0x40, 0x01, 0x0c, 0, 0, 1, 0x42, 0x01};
+  const auto hevc_units = split_annexb(hevc.data(), hevc.size(), NalCodec::h265);
+  REQUIRE_EQ(hevc_units.size(), 2);
+  CHECK_EQ(hevc_units[0].type, kH265NalVps);
+  CHECK_EQ(hevc_units[1].type, kH265NalSps);
+}
+
+TEST_CASE("When OBUs are split, sizes should come from the size field") {
+  const std::vector<uint8_t> stream{0x12, 0x00, 0x0a, 0x02, 0xaa, 0xbb, 0x32, 0x81, 0x00};
+  std::vector<uint8_t> obus = stream;
+  obus.resize(6);
+  const auto split = split_obus(obus.data(), obus.size());
+  REQUIRE_EQ(split.size(), 2);
+  CHECK_EQ(split[0].type, kAv1ObuTemporalDelimiter);
+  CHECK_EQ(split[0].size, 2);
+  CHECK_EQ(split[1].type, kAv1ObuSequenceHeader);
+  CHECK_EQ(split[1].size, 4);
+  // Frame OBU claims 129 bytes.
+  CHECK_THROWS_AS(split_obus(stream.data(), stream.size()), std::runtime_error);
+}
+
+TEST_CASE("When RBSP is unescaped, emulation prevention bytes should be removed") {
+  const std::vector<uint8_t> escaped{0x00, 0x00, 0x03, 0x01, 0x00, 0x00, 0x03, 0x00, 0x03};
+  CHECK_EQ(unescape_rbsp(escaped.data(), escaped.size()),
+           std::vector<uint8_t>{0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x03});
+}
+
+TEST_CASE("When Exp-Golomb codes are read, values should be decoded") {
+  BitWriter writer;
+  writer.ue(0);
+  writer.ue(5);
+  writer.ue(4);
+  writer.bits(0x5, 3);
+  const auto bytes = writer.bytes();
+  BitReader reader{bytes.data(), bytes.size()};
+  CHECK_EQ(reader.ue(), 0);
+  CHECK_EQ(reader.se(), 3);
+  CHECK_EQ(reader.se(), -2);
+  CHECK_EQ(reader.bits(3), 5);
+  CHECK_FALSE(reader.overrun());
+  reader.skip(64);
+  CHECK(reader.overrun());
+}
+
+TEST_CASE("When H.264 SPS is parsed, profile and format should be read") {
+  const auto sps = parse_h264_sps({kH264Sps.data(), kH264Sps.size(), kH264NalSps});
+  CHECK_EQ(sps.profile_idc, 100);
+  CHECK_EQ(sps.level_idc, 31);
+  CHECK_EQ(sps.chroma_format_idc, 1);
+  CHECK_EQ(sps.bit_depth_luma, 8);
+  CHECK_EQ(sps.bit_depth_chroma, 8);
+}
+
+TEST_CASE("When HEVC SPS is parsed, profile tier level and format should be read") {
+  const auto bytes = hevc_sps();
+  const auto sps = parse_h265_sps({bytes.data(), bytes.size(), kH265NalSps});
+  CHECK_EQ(sps.max_sub_layers, 2);
+  CHECK(sps.temporal_id_nesting);
+  CHECK_EQ(sps.tier_flag, 1);
+  CHECK_EQ(sps.profile_idc, 2);
+  CHECK_EQ(sps.profile_compatibility_flags, 0x20000000);
+  CHECK_EQ(sps.constraint_indicator_flags, 0x900000000000);
+  CHECK_EQ(sps.level_idc, 123);
+  CHECK_EQ(sps.chroma_format_idc, 1);
+  CHECK_EQ(sps.bit_depth_luma, 10);
+  CHECK_EQ(sps.bit_depth_chroma, 10);
+  CHECK_EQ(sps.width, 1920);
+  CHECK_EQ(sps.log2_max_pic_order_cnt_lsb, 8);
+  CHECK_EQ(sps.log2_ctb_size, 6);
+  CHECK(sps.sample_adaptive_offset);
+  REQUIRE_EQ(sps.short_term_ref_pic_sets.size(), 1);
+  CHECK_EQ(sps.short_term_ref_pic_sets[0].num_used_by_curr, 1);
+  CHECK(sps.temporal_mvp);
+}
+
+TEST_CASE("When AV1 sequence header is parsed, level and color config should be read") {
+  BitWriter payload;
+  payload.bits(0, 3);  // Main profile
+  payload.bits(0, 2);
+  payload.bits(0, 1);  // no timing info
+  payload.bits(0, 1);
+  payload.bits(0, 5);
+  payload.bits(0, 12);
+  payload.bits(8, 5);
+  payload.bits(1, 1);   // high tier
+  payload.bits(10, 4);  // 11 bit sizes
+  payload.bits(10, 4);
+  payload.bits(1919, 11);
+  payload.bits(1079, 11);
+  payload.bits(0, 1);
+  payload.bits(0xff, 8);  // coding tools and order hint
+  payload.bits(0x3, 2);  // jnt_comp, ref_frame_mvs
+  payload.bits(1, 1);    // choose screen content tools
+  payload.bits(1, 1);    // choose integer mv
+  payload.bits(6, 3);
+  payload.bits(0x3, 3);
+  payload.bits(1, 1);  // high bitdepth
+  payload.bits(0, 1);
+  payload.bits(0, 1);
+  payload.bits(0, 1);
+  payload.bits(2, 2);  // colocated chroma sample
+  payload.bits(0x80, 8);
+  auto obu = payload.bytes();
+  obu.insert(obu.begin(), {0x0a, static_cast<uint8_t>(obu.size())});
+  const auto header =
+      parse_av1_sequence_header({obu.data(), obu.size(), kAv1ObuSequenceHeader});
+  CHECK_EQ(header.profile, 0);
+  CHECK_EQ(header.level_idx, 8);
+  CHECK_EQ(header.tier, 1);
+  CHECK(header.high_bitdepth);
+  CHECK_FALSE(header.monochrome);
+  CHECK(header.subsampling_x);
+  CHECK(header.subsampling_y);
+  CHECK_EQ(header.chroma_sample_position, 2);
+}
+
+TEST_CASE("When H.264 frames are analyzed, slice QP and byte split should be read") {
+  BitWriter sps;
+  sps.bits(0x67, 8);
+  sps.bits(66, 8);  // Baseline
+  sps.bits(0, 8);
+  sps.bits(31, 8);
+  sps.ue(0);
+  sps.ue(0);  // 4 bit frame_num
+  sps.ue(0);
+  sps.ue(2);  // 6 bit POC LSB
+  sps.ue(1);
+  sps.bits(0, 1);
+  sps.ue(79);
+  sps.ue(44);
+  sps.bits(1, 1);  // frame_mbs_only
+  sps.bits(0x4, 4);
+  sps.trailing();
+  BitWriter pps;
+  pps.bits(0x68, 8);
+  pps.ue(0);
+  pps.ue(0);
+  pps.bits(1, 1);  // CABAC
+  pps.bits(0, 1);
+  pps.ue(0);
+  pps.ue(0);
+  pps.ue(0);
+  pps.bits(0, 3);
+  pps.se(2);  // pic_init_qp 28
+  pps.se(0);
+  pps.se(0);
+  pps.bits(0x2, 3);
+  pps.trailing();
+  BitWriter idr;
+  idr.bits(0x65, 8);
+  idr.ue(0);
+  idr.ue(7);  // I
+  idr.ue(0);
+  idr.bits(0, 4);
+  idr.ue(0);
+  idr.bits(0, 6);
+  idr.bits(0, 2);
+  idr.se(-4);
+  idr.bits(0x5a, 8);
+  idr.trailing();
+  const std::vector<uint8_t> sei{0x06, 0x05, 0x01, 0xaa, 0x80};
+  BitWriter p_slice;
+  p_slice.bits(0x41, 8);
+  p_slice.ue(0);
+  p_slice.ue(5);  // P
+  p_slice.ue(0);
+  p_slice.bits(1, 4);
+  p_slice.bits(2, 6);
+  p_slice.bits(1, 1);  // num_ref_idx_active_override
+  p_slice.ue(0);
+  p_slice.bits(1, 1);  // ref_pic_list_modification
+  p_slice.ue(0);
+  p_slice.ue(0);
+  p_slice.ue(3);
+  p_slice.bits(0, 1);
+  p_slice.ue(1);  // cabac_init_idc
+  p_slice.se(3);
+  p_slice.trailing();
+
+  BitstreamAnalyzer analyzer{NalCodec::h264};
+  const auto first =
+      annexb({{0x09, 0xf0}, sps.bytes(), pps.bytes(), sei, idr.bytes()});
+  const auto first_syntax = analyzer.analyze(first.data(), first.size());
+  CHECK_EQ(first_syntax.nal_types, std::vector<int>{9, kH264NalSps, kH264NalPps, 6, 5});
+  CHECK_EQ(first_syntax.qp, 24);
+  CHECK_EQ(first_syntax.temporal_id, 0);
+  CHECK_EQ(first_syntax.parameter_set_bytes, sps.bytes().size() + pps.bytes().size());
+  CHECK_EQ(first_syntax.sei_bytes, sei.size());
+  CHECK_EQ(first_syntax.slice_bytes, idr.bytes().size());
+
+  const auto second = annexb({p_slice.bytes()});
+  const auto second_syntax = analyzer.analyze(second.data(), second.size());
+  CHECK_EQ(second_syntax.qp, 31);
+  CHECK_EQ(second_syntax.parameter_set_bytes, 0);
+
+  // Slices without their parameter sets have no QP.
+  BitstreamAnalyzer late_analyzer{NalCodec::h264};
+  CHECK_EQ(late_analyzer.analyze(second.data(), second.size()).qp, -1);
+}
+
+TEST_CASE("When HEVC frames are analyzed, mean slice QP and temporal id should be read") {
+  BitWriter pps;
+  pps.bits(0x4401, 16);
+  pps.ue(0);
+  pps.ue(0);
+  pps.bits(0, 5);
+  pps.bits(0, 1);
+  pps.bits(1, 1);  // cabac_init_present
+  pps.ue(0);
+  pps.ue(0);
+  pps.se(-4);  // init_qp 22
+  pps.bits(0, 2);
+  pps.bits(1, 1);
+  pps.ue(1);
+  pps.se(0);
+  pps.se(0);
+  pps.bits(0, 6);
+  pps.bits(1, 1);
+  pps.bits(0, 3);
+  pps.ue(0);
+  pps.bits(0, 2);
+  pps.trailing();
+  BitWriter idr;
+  idr.bits(0x2601, 16);
+  idr.bits(1, 1);
+  idr.bits(0, 1);
+  idr.ue(0);
+  idr.ue(2);  // I
+  idr.bits(0x3, 2);
+  idr.se(5);
+  idr.trailing();
+  const auto p_slice = [](bool first_slice, int qp_delta) {
+    BitWriter writer;
+    writer.bits(0x0202, 16);  // temporal id 1
+    writer.bits(first_slice, 1);
+    writer.ue(0);
+    if (!first_slice) {
+      writer.bits(255, 9);  // slice_segment_address of 510 CTBs
+    }
+    writer.ue(1);  // P
+    writer.bits(1, 8);
+    writer.bits(1, 1);  // short_term_ref_pic_set_sps_flag
+    writer.bits(1, 1);  // slice_temporal_mvp_enabled_flag
+    writer.bits(0x3, 2);
+    writer.bits(0, 1);
+    writer.bits(1, 1);  // cabac_init_flag
+    writer.ue(0);
+    writer.se(qp_delta);
+    writer.trailing();
+    return writer.bytes();
+  };
+  const std::vector<uint8_t> vps{0x40, 0x01, 0x0c, 0x01, 0xff, 0xff};
+
+  BitstreamAnalyzer analyzer{NalCodec::h265};
+  const auto first = annexb({vps, hevc_sps(), pps.bytes(), idr.bytes()});
+  const auto first_syntax = analyzer.analyze(first.data(), first.size());
+  CHECK_EQ(first_syntax.qp, 27);
+  CHECK_EQ(first_syntax.temporal_id, 0);
+  // Sizes include the emulation prevention bytes of the stream.
+  const auto parameter_sets = annexb({vps, hevc_sps(), pps.bytes()});
+  CHECK_EQ(first_syntax.parameter_set_bytes, parameter_sets.size() - 3 * 4);
+
+  const auto second = annexb({p_slice(true, -2), p_slice(false, 0)});
+  const auto second_syntax = analyzer.analyze(second.data(), second.size());
+  CHECK_EQ(second_syntax.nal_types, std::vector<int>{1, 1});
+  CHECK_EQ(second_syntax.qp, 21);
+  CHECK_EQ(second_syntax.temporal_id, 1);
+}
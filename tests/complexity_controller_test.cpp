@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <optional>
+#include <stdexcept>
+
+#include "doctest.h"
+
+#include "complexity_controller/complexity_controller.hpp"
+
+// Adds a window of frames taking encode_time_us, returns the last decision.
+static std::optional<uint16_t> add_window(ComplexityController& controller,
+                                          long encode_time_us,
+                                          size_t frames = 8) {
+  std::optional<uint16_t> target_usage{};
+  for (size_t i = 0; i < frames; i++) {
+    target_usage = controller.add_frame(encode_time_us);
+    if (i + 1 < frames) {
+      REQUIRE_FALSE(target_usage);
+    }
+  }
+  return target_usage;
+}
+
+TEST_CASE("When the controller is set up wrong, it should throw") {
+  CHECK_THROWS_AS(ComplexityController(0, 4), std::invalid_argument);
+  CHECK_THROWS_AS(ComplexityController(30, 0), std::invalid_argument);
+  CHECK_THROWS_AS(ComplexityController(30, 8), std::invalid_argument);
+  ComplexityController controller{100, 4};
+  CHECK_EQ(controller.budget_us(), doctest::Approx(10000));
+  CHECK_EQ(controller.target_usage(), 4);
+}
+
+TEST_CASE("When frames take longer than the budget, the target usage should speed up") {
+  ComplexityController controller{100, 4, 8};
+  CHECK_EQ(add_window(controller, 12000), 5);
+  // The window after a change is left to settle.
+  CHECK_FALSE(add_window(controller, 12000));
+  CHECK_EQ(add_window(controller, 12000), 6);
+  REQUIRE_EQ(controller.changes().size(), 2);
+  CHECK_EQ(controller.changes()[0].frame, 8);
+  CHECK_EQ(controller.changes()[0].target_usage, 5);
+  CHECK_EQ(controller.changes()[0].frame_time_us, doctest::Approx(12000));
+  CHECK_EQ(controller.changes()[1].frame, 24);
+}
+
+TEST_CASE("When frames stay within the band, the target usage should hold") {
+  ComplexityController controller{100, 4, 8};
+  for (int i = 0; i < 10; i++) {
+    CHECK_FALSE(add_window(controller, 7000));
+    CHECK_FALSE(add_window(controller, 8500));
+  }
+  CHECK_EQ(controller.target_usage(), 4);
+  CHECK(controller.changes().empty());
+}
+
+TEST_CASE("When the target usage is at an end, it should stay there") {
+  ComplexityController fastest{100, 7, 8};
+  CHECK_FALSE(add_window(fastest, 20000));
+  ComplexityController best{100, 1, 8};
+  for (int i = 0; i < 4; i++) {
+    CHECK_FALSE(add_window(best, 1000));
+  }
+}
+
+TEST_CASE("When frames are well under the budget, the target usage should step back") {
+  ComplexityController controller{100, 4, 8};
+  CHECK_FALSE(add_window(controller, 5000));
+  // A window in the band starts the count again.
+  CHECK_FALSE(add_window(controller, 8000));
+  CHECK_FALSE(add_window(controller, 5000));
+  CHECK_EQ(add_window(controller, 5000), 3);
+  CHECK_EQ(controller.target_usage(), 3);
+}
+
+TEST_CASE("When a quality step is taken back right away, the next one should wait longer") {
+  ComplexityController controller{100, 4, 8};
+  add_window(controller, 5000);
+  CHECK_EQ(add_window(controller, 5000), 3);
+  add_window(controller, 9500);
+  CHECK_EQ(add_window(controller, 9500), 4);
+  add_window(controller, 5000);
+  for (int i = 0; i < 3; i++) {
+    CHECK_FALSE(add_window(controller, 5000));
+  }
+  CHECK_EQ(add_window(controller, 5000), 3);
+}
+
+TEST_CASE("When no window is given, it should cover a quarter second of frames") {
+  ComplexityController controller{120, 4};
+  CHECK_FALSE(add_window(controller, 10000, 29));
+  CHECK_EQ(controller.add_frame(10000), 5);
+}
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+#include "doctest.h"
+
+#include "control_channel/control_channel.hpp"
+
+#include "nlohmann/json.hpp"
+
+TEST_CASE("When control message parsed, fields should be the same") {
+  const auto reconfiguration =
+      parse_reconfiguration(R"({"bitrate": 1500, "maxbitrate": 2000, "rate": 25, "at": "idr"})");
+  CHECK_EQ(reconfiguration.target_kbps, 1500);
+  CHECK_EQ(reconfiguration.max_kbps, 2000);
+  CHECK_EQ(reconfiguration.frame_rate, 25);
+  CHECK(reconfiguration.at_idr);
+
+  const auto partial = parse_reconfiguration(R"({"bitrate": 800})");
+  CHECK_EQ(partial.target_kbps, 800);
+  CHECK_EQ(partial.max_kbps, 0);
+  CHECK_EQ(partial.frame_rate, 0);
+  CHECK_FALSE(partial.at_idr);
+
+  CHECK_THROWS_AS(parse_reconfiguration("{bitrate"), nlohmann::json::exception);
+}
+
+TEST_CASE("When a control field is out of range, the change should be rejected") {
+  CHECK_THROWS_AS(parse_reconfiguration(R"({"bitrate": -1})"), std::out_of_range);
+  CHECK_THROWS_AS(parse_reconfiguration(R"({"maxbitrate": 65536})"), std::out_of_range);
+  CHECK_THROWS_AS(parse_reconfiguration(R"({"rate": 0})"), std::out_of_range);
+  CHECK_THROWS_AS(parse_reconfiguration(R"({"rate": -30})"), std::out_of_range);
+  CHECK_EQ(parse_reconfiguration(R"({"bitrate": 65535})").target_kbps, 65535);
+
+  const std::string control_filename = "control_channel_range_test.json";
+  std::remove(control_filename.c_str());
+  ControlFile control_file{control_filename};
+  std::ofstream{control_filename} << R"({"bitrate": 1200, "rate": -1})";
+  CHECK_FALSE(control_file.poll());
+  std::remove(control_filename.c_str());
+}
+
+TEST_CASE("When control file modified, poll returns the change once") {
+  const std::string control_filename = "control_channel_test.json";
+  std::remove(control_filename.c_str());
+  ControlFile control_file{control_filename};
+  CHECK_FALSE(control_file.poll());
+
+  std::ofstream{control_filename} << R"({"bitrate": 1200})";
+  const auto reconfiguration = control_file.poll();
+  REQUIRE(reconfiguration);
+  CHECK_EQ(reconfiguration->target_kbps, 1200);
+  CHECK_FALSE(control_file.poll());
+  std::remove(control_filename.c_str());
+}
@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "doctest.h"
+
+#include "cpu_usage/cpu_usage.hpp"
+
+TEST_CASE("When the thread spins, utilization should count the busy cpu") {
+  const auto start = cpu_times();
+  CpuTimes now = start;
+  volatile unsigned long counter = 0;
+  while (now.wall - start.wall < 50000) {
+    for (int i = 0; i < 100000; i++) {
+      counter = counter + i;
+    }
+    now = cpu_times();
+  }
+  CHECK_GE(now.user + now.system, start.user + start.system);
+  CHECK_GT(cpu_utilization(start, now), 0.5);
+  CHECK_LT(cpu_utilization(start, now), allowed_cpus() + 0.1);
+  CHECK_EQ(cpu_utilization(now, now), 0);
+}
+
+TEST_CASE("When memory is touched, peak RSS should grow") {
+  reset_peak_rss();
+  const long before = peak_rss_kb();
+  CHECK_GT(before, 0);
+  std::vector<char> buffer(64 << 20, 1);
+  CHECK_GE(peak_rss_kb(), before + 32 * 1024);
+  CHECK_EQ(buffer.back(), 1);
+}
+
+TEST_CASE("When cpuset is malformed, pinning should be rejected") {
+  CHECK_THROWS_AS(pin_thread_to_cpuset(""), std::invalid_argument);
+  CHECK_THROWS_AS(pin_thread_to_cpuset("a-b"), std::invalid_argument);
+  CHECK_GE(allowed_cpus(), 1);
+}
+
+TEST_CASE("When the guard goes out of scope, the thread affinity should be restored") {
+  const int cpus = allowed_cpus();
+  {
+    ThreadAffinityGuard affinity_guard{};
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    REQUIRE_EQ(sched_getaffinity(0, sizeof(cpu_set), &cpu_set), 0);
+    int first = 0;
+    while (!CPU_ISSET(first, &cpu_set)) {
+      first++;
+    }
+    REQUIRE(pin_thread_to_cpuset(std::to_string(first)));
+    CHECK_EQ(allowed_cpus(), 1);
+  }
+  CHECK_EQ(allowed_cpus(), cpus);
+}
+
+TEST_CASE("When another thread spins, only its own cpu time should count it") {
+  const auto idle_thread = current_thread();
+  std::atomic<pid_t> busy_thread{0};
+  std::atomic<bool> stop{false};
+  std::thread spinner{[&] {
+    busy_thread = current_thread();
+    volatile unsigned long counter = 0;
+    while (!stop) {
+      counter = counter + 1;
+    }
+  }};
+  while (!busy_thread) {
+    std::this_thread::yield();
+  }
+  const auto threads = process_threads();
+  CHECK(std::find(threads.begin(), threads.end(), idle_thread) != threads.end());
+  CHECK(std::find(threads.begin(), threads.end(), busy_thread.load()) != threads.end());
+
+  const auto busy_start = cpu_times({busy_thread});
+  const auto idle_start = cpu_times({idle_thread});
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  const auto busy_stop = cpu_times({busy_thread});
+  const auto idle_stop = cpu_times({idle_thread});
+  stop = true;
+  spinner.join();
+  CHECK_GT(cpu_utilization(busy_start, busy_stop), 0.5);
+  CHECK_LT(cpu_utilization(idle_start, idle_stop), 0.2);
+  // Threads that exited count as nothing.
+  CHECK_EQ(cpu_times({busy_thread}).user, 0);
+}
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <sstream>
+
+#include "doctest.h"
+
+#include "frame_pool/frame_pool.hpp"
+
+namespace vpl = oneapi::vpl;
+
+TEST_CASE("When frame layout created, planes should be pitch padded") {
+  const auto layout = make_frame_layout(250, 100, vpl::color_format_fourcc::i420);
+  CHECK_EQ(layout.pitch, 256);
+  CHECK_EQ(layout.offsets[0], 0);
+  CHECK_EQ(layout.offsets[1], 256 * 112);
+  CHECK_EQ(layout.offsets[2], 256 * 112 + 128 * 56);
+  CHECK_EQ(layout.size % kFrameBufferAlignment, 0);
+  CHECK_GE(layout.size, 256 * 112 * 3 / 2);
+
+  CHECK_THROWS_AS(make_frame_layout(250, 100, vpl::color_format_fourcc::bgra),
+                  std::invalid_argument);
+}
+
+TEST_CASE("When frame read, rows should land at pitch offsets") {
+  const uint16_t width = 4;
+  const uint16_t height = 2;
+  ExternalFramePool frame_pool{make_frame_layout(width, height, vpl::color_format_fourcc::i420)};
+  frame_pool.allocate(1);
+  auto* surface = frame_pool.acquire();
+  REQUIRE(surface);
+
+  std::istringstream input{"abcdefgh1234"};
+  REQUIRE(read_frame(input, frame_pool.layout(), surface));
+  const auto pitch = frame_pool.layout().pitch;
+  CHECK_EQ(std::string(reinterpret_cast<char*>(surface->Data.Y), width), "abcd");
+  CHECK_EQ(std::string(reinterpret_cast<char*>(surface->Data.Y + pitch), width), "efgh");
+  CHECK_EQ(std::string(reinterpret_cast<char*>(surface->Data.U), 2), "12");
+  CHECK_EQ(std::string(reinterpret_cast<char*>(surface->Data.V), 2), "34");
+  CHECK_FALSE(read_frame(input, frame_pool.layout(), surface));
+}
+
+TEST_CASE("When encoder unlocks surface, release callback runs once") {
+  ExternalFramePool frame_pool{make_frame_layout(64, 64, vpl::color_format_fourcc::nv12)};
+  frame_pool.allocate(2);
+  auto* first = frame_pool.acquire();
+  auto* second = frame_pool.acquire();
+  REQUIRE(first);
+  REQUIRE(second);
+  CHECK_EQ(frame_pool.acquire(), nullptr);
+  CHECK_EQ(reinterpret_cast<uintptr_t>(first->Data.Y) % kFrameBufferAlignment, 0);
+
+  int released = 0;
+  first->Data.Locked = 1;
+  frame_pool.submit(first, [&released](uint8_t*) { released++; });
+  frame_pool.cancel(second);
+  CHECK_EQ(frame_pool.free_frames(), 1);
+  CHECK_EQ(frame_pool.collect(), 0);
+
+  first->Data.Locked = 0;
+  CHECK_EQ(frame_pool.collect(), 1);
+  CHECK_EQ(frame_pool.collect(), 0);
+  CHECK_EQ(released, 1);
+  CHECK_EQ(frame_pool.free_frames(), 2);
+}
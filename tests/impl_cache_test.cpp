@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include "doctest.h"
+
+#include "impl_cache/impl_cache.hpp"
+
+#include "vpl/mfx.h"
+
+static ImplCache make_impl_cache() {
+  ImplCache cache{};
+  cache.api_version = MFX_VERSION;
+  cache.files = {{"/usr/lib/libvpl.so.2", 1000}, {"/usr/lib", 2000}};
+  cache.impls.push_back(
+      {"mfx-gen", true, true, {{"hevc", {{"nv12", {"cbr", "vbr"}}, {"p010", {"cqp"}}}}}});
+  cache.impls.push_back({"mfx-cpu", false, true, {{"avc", {{"i420", {"cbr", "cqp"}}}}}});
+  cache.impls.push_back({"mfx-new", true, false, {{"av1", {{"nv12", {}}}}}});
+  return cache;
+}
+
+TEST_CASE("When cache is written to json, reading it gives the same capabilities") {
+  const auto cache = make_impl_cache();
+  const auto cache_in = nlohmann::json::parse(nlohmann::json(cache).dump()).get<ImplCache>();
+  CHECK_EQ(cache_in.api_version, cache.api_version);
+  REQUIRE_EQ(cache_in.files.size(), cache.files.size());
+  for (size_t i = 0; i < cache.files.size(); i++) {
+    CHECK_EQ(cache_in.files[i].path, cache.files[i].path);
+    CHECK_EQ(cache_in.files[i].mtime, cache.files[i].mtime);
+  }
+  REQUIRE_EQ(cache_in.impls.size(), cache.impls.size());
+  for (size_t i = 0; i < cache.impls.size(); i++) {
+    const auto& impl = cache.impls[i];
+    CHECK_EQ(cache_in.impls[i].name, impl.name);
+    CHECK_EQ(cache_in.impls[i].hw, impl.hw);
+    CHECK_EQ(cache_in.impls[i].probed, impl.probed);
+    REQUIRE_EQ(cache_in.impls[i].encoders.size(), impl.encoders.size());
+    for (size_t e = 0; e < impl.encoders.size(); e++) {
+      const auto& encoder = impl.encoders[e];
+      CHECK_EQ(cache_in.impls[i].encoders[e].codec, encoder.codec);
+      REQUIRE_EQ(cache_in.impls[i].encoders[e].color_formats.size(),
+                 encoder.color_formats.size());
+      for (size_t f = 0; f < encoder.color_formats.size(); f++) {
+        CHECK_EQ(cache_in.impls[i].encoders[e].color_formats[f].color_format,
+                 encoder.color_formats[f].color_format);
+        CHECK_EQ(cache_in.impls[i].encoders[e].color_formats[f].bitrate_modes,
+                 encoder.color_formats[f].bitrate_modes);
+      }
+    }
+  }
+}
+
+TEST_CASE("When cache json misses a field, reading it throws") {
+  auto json = nlohmann::json(make_impl_cache());
+  json.erase("impls");
+  CHECK_THROWS_AS(json.get<ImplCache>(), nlohmann::json::exception);
+}
+
+TEST_CASE("When combination is cached, it is supported") {
+  const auto cache = make_impl_cache();
+  std::string reason;
+  CHECK(is_supported(cache, true, "hevc", "nv12", "vbr", &reason));
+  CHECK(is_supported(cache, true, "hevc", "p010", "cqp", &reason));
+  CHECK(is_supported(cache, false, "avc", "i420", "cqp", &reason));
+}
+
+TEST_CASE("When combination isn't cached, the reason names what is missing") {
+  const auto cache = make_impl_cache();
+  std::string reason;
+  CHECK_FALSE(is_supported(cache, false, "hevc", "nv12", "cbr", &reason));
+  CHECK_EQ(reason, "no software implementation encodes hevc");
+  CHECK_FALSE(is_supported(cache, true, "hevc", "i420", "cbr", &reason));
+  CHECK_EQ(reason, "hevc encoder doesn't accept i420 input");
+  // Bitrate modes are per color format.
+  CHECK_FALSE(is_supported(cache, true, "hevc", "p010", "cbr", &reason));
+  CHECK_EQ(reason, "hevc encoder doesn't support cbr bitrate mode");
+}
+
+TEST_CASE("When implementation wasn't probed, it supports every bitrate mode") {
+  const auto cache = make_impl_cache();
+  std::string reason;
+  CHECK(is_supported(cache, true, "av1", "nv12", "icq", &reason));
+  CHECK_FALSE(is_supported(cache, true, "av1", "p010", "icq", &reason));
+}
+
+TEST_CASE("When API version differs, cache is invalid") {
+  auto cache = make_impl_cache();
+  cache.api_version = MFX_VERSION + 1;
+  CHECK_FALSE(is_impl_cache_valid(cache));
+}
+
+TEST_CASE("When cache stamps no files, it is invalid") {
+  auto cache = make_impl_cache();
+  cache.files.clear();
+  CHECK_FALSE(is_impl_cache_valid(cache));
+}
+
+TEST_CASE("When stamped library was modified, cache is invalid") {
+  auto cache = make_impl_cache();
+  cache.files = {{"impl_cache_test_missing.so", 1000}};
+  CHECK_FALSE(is_impl_cache_valid(cache));
+}
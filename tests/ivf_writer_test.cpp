@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include "doctest.h"
+
+#include "ivf_writer/ivf_writer.hpp"
+
+static std::vector<uint8_t> read_file(const std::string& filename) {
+  std::ifstream file{filename, std::ios_base::binary};
+  return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+static uint32_t read_u32(const std::vector<uint8_t>& bytes, size_t offset) {
+  return bytes[offset] | (bytes[offset + 1] << 8) | (bytes[offset + 2] << 16) |
+         (bytes[offset + 3] << 24);
+}
+
+TEST_CASE("When AV1 frames are written, headers should carry size and frame counter") {
+  const auto filename = (std::filesystem::temp_directory_path() / "ivf_writer_test.ivf").string();
+  // Temporal delimiter and padding OBU, then a padding OBU alone.
+  const std::vector<uint8_t> first{0x12, 0x00, 0x7a, 0x01, 0xaa};
+  const std::vector<uint8_t> second{0x7a, 0x01, 0xbb};
+  IvfWriter writer{filename, "av1", 1280, 720, 30};
+  writer.write({first.data(), first.size(), true, 0, 0, 3000, nullptr});
+  writer.write({second.data(), second.size(), false, 3000, 3000, 3000, nullptr});
+  writer.close();
+
+  const auto bytes = read_file(filename);
+  REQUIRE_EQ(bytes.size(), kIvfFileHeaderSize + 2 * kIvfFrameHeaderSize + 5 + 5);
+  CHECK_EQ(std::string(bytes.begin(), bytes.begin() + 4), "DKIF");
+  CHECK_EQ(read_u32(bytes, 6) & 0xffff, kIvfFileHeaderSize);
+  CHECK_EQ(std::string(bytes.begin() + 8, bytes.begin() + 12), "AV01");
+  CHECK_EQ(read_u32(bytes, 12), 1280 | (720 << 16));
+  CHECK_EQ(read_u32(bytes, 16), 30);
+  CHECK_EQ(read_u32(bytes, 20), 1);
+  CHECK_EQ(read_u32(bytes, 24), 2);
+
+  size_t offset = kIvfFileHeaderSize;
+  CHECK_EQ(read_u32(bytes, offset), 5);
+  CHECK_EQ(read_u32(bytes, offset + 4), 0);
+  offset += kIvfFrameHeaderSize + 5;
+  // The second temporal unit gets its temporal delimiter.
+  CHECK_EQ(read_u32(bytes, offset), 5);
+  CHECK_EQ(read_u32(bytes, offset + 4), 1);
+  CHECK_EQ(bytes[offset + kIvfFrameHeaderSize], 0x12);
+  CHECK_EQ(bytes.back(), 0xbb);
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("When VP9 frames are written, frames should be stored unchanged") {
+  const auto filename = (std::filesystem::temp_directory_path() / "ivf_writer_vp9.ivf").string();
+  const std::vector<uint8_t> frame{0x82, 0x49, 0x83, 0x42, 0x00};
+  IvfWriter writer{filename, "vp9", 320, 240, 25};
+  writer.write({frame.data(), frame.size(), true, 0, 0, 3600, nullptr});
+  writer.close();
+  const auto bytes = read_file(filename);
+  REQUIRE_EQ(bytes.size(), kIvfFileHeaderSize + kIvfFrameHeaderSize + frame.size());
+  CHECK_EQ(std::string(bytes.begin() + 8, bytes.begin() + 12), "VP90");
+  CHECK_EQ(std::vector<uint8_t>(bytes.end() - frame.size(), bytes.end()), frame);
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("When AV1 frame is malformed, writing should fail") {
+  const auto filename = (std::filesystem::temp_directory_path() / "ivf_writer_bad.ivf").string();
+  const std::vector<uint8_t> frame{0x32, 0x10, 0x00};
+  IvfWriter writer{filename, "av1", 320, 240, 25};
+  CHECK_THROWS_AS(writer.write({frame.data(), frame.size(), true, 0, 0, 3600, nullptr}),
+                  std::runtime_error);
+  CHECK_THROWS_AS(IvfWriter(filename, "hevc", 320, 240, 25), std::invalid_argument);
+  std::filesystem::remove(filename);
+}
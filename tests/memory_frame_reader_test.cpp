@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+#include "doctest.h"
+
+#include "memory_frame_reader/memory_frame_reader.hpp"
+
+namespace vpl = oneapi::vpl;
+
+TEST_CASE("When packed frame size is taken, chroma should be subsampled") {
+  CHECK_EQ(packed_frame_size(320, 240, vpl::color_format_fourcc::i420), 115200);
+  CHECK_EQ(packed_frame_size(320, 240, vpl::color_format_fourcc::nv12), 115200);
+  CHECK_EQ(packed_frame_size(320, 240, vpl::color_format_fourcc::p010), 230400);
+  CHECK_THROWS_AS(packed_frame_size(320, 240, vpl::color_format_fourcc::bgra),
+                  std::invalid_argument);
+}
+
+TEST_CASE("When a packed frame is copied, rows should be placed at the surface pitch") {
+  const uint16_t width = 4;
+  const uint16_t height = 2;
+  std::vector<uint8_t> frame(packed_frame_size(width, height, vpl::color_format_fourcc::i420));
+  std::iota(frame.begin(), frame.end(), 1);
+  std::vector<uint8_t> planes(64);
+  mfxFrameSurface1 surface{};
+  surface.Data.Pitch = 16;
+  surface.Data.Y = planes.data();
+  surface.Data.U = planes.data() + 32;
+  surface.Data.V = planes.data() + 48;
+  copy_packed_frame(frame.data(), width, height, vpl::color_format_fourcc::i420, &surface);
+  CHECK_EQ(planes[0], 1);
+  CHECK_EQ(planes[3], 4);
+  CHECK_EQ(planes[4], 0);
+  CHECK_EQ(planes[16], 5);
+  CHECK_EQ(planes[32], 9);
+  CHECK_EQ(planes[33], 10);
+  CHECK_EQ(planes[48], 11);
+}
+
+TEST_CASE("When frames are loaded, only whole frames up to the limit should be kept") {
+  std::istringstream input{std::string(10, 'x')};
+  CHECK_EQ(load_frames(input, 4, 0).size(), 8);
+  std::istringstream limited{std::string(10, 'x')};
+  CHECK_EQ(load_frames(limited, 4, 1).size(), 4);
+}
+
+TEST_CASE("When the reader is stopped, the input should end after the frames read") {
+  const std::vector<uint8_t> frames(packed_frame_size(4, 2, vpl::color_format_fourcc::i420));
+  MemoryFrameReader reader{4, 2, vpl::color_format_fourcc::i420, &frames, 100};
+  CHECK_FALSE(reader.is_EOS());
+  reader.stop();
+  CHECK(reader.is_EOS());
+  CHECK_EQ(reader.frames_read(), 0);
+}
@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "doctest.h"
+
+#include "metrics/metrics.hpp"
+
+// Value of the sample line starting with name, NaN when missing.
+static double sample(const std::string& text, const std::string& name) {
+  std::istringstream lines{text};
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (line.compare(0, name.size() + 1, name + " ") == 0) {
+      return std::stod(line.substr(name.size() + 1));
+    }
+  }
+  return std::nan("");
+}
+
+static std::string http_get(int port, const std::string& path) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(static_cast<uint16_t>(port));
+  REQUIRE_EQ(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+  const auto request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  REQUIRE_EQ(send(fd, request.data(), request.size(), 0), request.size());
+  std::string response;
+  char chunk[1024];
+  ssize_t ret = 0;
+  while ((ret = read(fd, chunk, sizeof(chunk))) > 0) {
+    response.append(chunk, ret);
+  }
+  close(fd);
+  return response;
+}
+
+TEST_CASE("When frames are added, counters and the latency histogram should count them") {
+  Metrics metrics{};
+  metrics.add_frame(1000, 400);
+  metrics.add_frame(2000, 400);
+  metrics.add_frame(500, -1);
+  metrics.add_dropped_frames(2);
+  metrics.set_writer_queue_depth(3);
+  metrics.set_encoder_queue_depth(4);
+
+  const auto snapshot = metrics.snapshot();
+  CHECK_EQ(snapshot.frames, 3);
+  CHECK_EQ(snapshot.bytes, 3500);
+  CHECK_EQ(snapshot.dropped_frames, 2);
+  CHECK_EQ(snapshot.latency_frames[1], 2);
+  CHECK_EQ(snapshot.latency_sum_us, 800);
+  CHECK_EQ(snapshot.writer_queue_depth, 3);
+  CHECK_EQ(snapshot.encoder_queue_depth, 4);
+}
+
+TEST_CASE("When frames are added from threads, none should be lost") {
+  Metrics metrics{};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&metrics] {
+      for (int frame = 0; frame < 10000; frame++) {
+        metrics.add_frame(1, 1000);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const auto snapshot = metrics.snapshot();
+  CHECK_EQ(snapshot.frames, 40000);
+  CHECK_EQ(snapshot.latency_frames[2], 40000);
+}
+
+TEST_CASE("When the percentile is taken, it should cover only frames since the previous snapshot") {
+  Metrics metrics{};
+  for (int frame = 0; frame < 100; frame++) {
+    metrics.add_frame(1, 100000);
+  }
+  const auto previous = metrics.snapshot();
+  CHECK_EQ(latency_percentile(previous, previous, 0.99), -1);
+  for (int frame = 0; frame < 99; frame++) {
+    metrics.add_frame(1, 900);
+  }
+  metrics.add_frame(1, 40000);
+  const auto current = metrics.snapshot();
+
+  // 99 of 100 frames fall in the 500-1000 us bucket.
+  CHECK_EQ(latency_percentile(current, previous, 0.5), doctest::Approx(750).epsilon(0.01));
+  CHECK_EQ(latency_percentile(current, previous, 0.99), doctest::Approx(1000));
+  CHECK_GT(latency_percentile(current, previous, 1.0), 30000);
+}
+
+TEST_CASE("When metrics are written, they should be in the Prometheus text format") {
+  Metrics metrics{};
+  metrics.add_frame(1000, 2500);
+  auto previous = metrics.snapshot();
+  metrics.add_frame(3000, 2500);
+  metrics.add_frame(3000, 2500000);
+  auto current = metrics.snapshot();
+  previous.time = current.time - std::chrono::seconds{2};
+
+  std::ostringstream output;
+  write_metrics(output, current, previous);
+  const auto text = output.str();
+  CHECK_NE(text.find("# TYPE encodeapp_frames_encoded_total counter\n"), std::string::npos);
+  CHECK_EQ(sample(text, "encodeapp_frames_encoded_total"), 3);
+  CHECK_EQ(sample(text, "encodeapp_output_bytes_total"), 7000);
+  CHECK_EQ(sample(text, "encodeapp_dropped_frames_total"), 0);
+  CHECK_EQ(sample(text, "encodeapp_fps"), doctest::Approx(1));
+  CHECK_EQ(sample(text, "encodeapp_latency_p99_seconds"), doctest::Approx(2));
+  CHECK_EQ(sample(text, "encodeapp_latency_seconds_bucket{le=\"0.003\"}"), 2);
+  CHECK_EQ(sample(text, "encodeapp_latency_seconds_bucket{le=\"2\"}"), 2);
+  CHECK_EQ(sample(text, "encodeapp_latency_seconds_bucket{le=\"+Inf\"}"), 3);
+  CHECK_EQ(sample(text, "encodeapp_latency_seconds_count"), 3);
+  CHECK_EQ(sample(text, "encodeapp_latency_seconds_sum"), doctest::Approx(2.505));
+}
+
+TEST_CASE("When the exporter runs, the file and the HTTP port should serve the metrics") {
+  const std::string filename = "metrics_test.prom";
+  Metrics metrics{};
+  {
+    MetricsExporter exporter{metrics, filename, 0, std::chrono::milliseconds{10}};
+    REQUIRE_GT(exporter.port(), 0);
+    metrics.add_frame(100, 1000);
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+
+    const auto response = http_get(exporter.port(), "/metrics");
+    CHECK_EQ(response.compare(0, 15, "HTTP/1.1 200 OK"), 0);
+    const auto body = response.substr(response.find("\r\n\r\n") + 4);
+    CHECK_EQ(sample(body, "encodeapp_frames_encoded_total"), 1);
+    CHECK_EQ(http_get(exporter.port(), "/other").compare(0, 12, "HTTP/1.1 404"), 0);
+
+    metrics.add_frame(100, 1000);
+  }
+  // The final values are published when the exporter stops.
+  std::ifstream file{filename};
+  std::stringstream text;
+  text << file.rdbuf();
+  CHECK_EQ(sample(text.str(), "encodeapp_frames_encoded_total"), 2);
+  CHECK_EQ(sample(text.str(), "encodeapp_output_bytes_total"), 200);
+  std::remove(filename.c_str());
+}
+
+TEST_CASE("When a client trickles its request, it should be dropped and publishing go on") {
+  const std::string filename = "metrics_slow_test.prom";
+  Metrics metrics{};
+  {
+    MetricsExporter exporter{metrics, filename, 0, std::chrono::milliseconds{10}};
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(exporter.port()));
+    REQUIRE_EQ(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    const auto start = std::chrono::steady_clock::now();
+    // A byte every 200 ms keeps every read under a second.
+    bool dropped = false;
+    for (int i = 0; i < 15 && !dropped; i++) {
+      dropped = send(fd, "G", 1, MSG_NOSIGNAL) != 1;
+      std::this_thread::sleep_for(std::chrono::milliseconds{200});
+    }
+    close(fd);
+    CHECK(dropped);
+    CHECK_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds{2500});
+    metrics.add_frame(100, 1000);
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    std::ifstream file{filename};
+    std::stringstream text;
+    text << file.rdbuf();
+    CHECK_EQ(sample(text.str(), "encodeapp_frames_encoded_total"), 1);
+  }
+  // Removed once the exporter stopped, its last publish would recreate the file.
+  std::remove(filename.c_str());
+}
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "doctest.h"
+
+#include "mp4_writer/mp4_writer.hpp"
+
+static const std::vector<uint8_t> kKeyFrame{
+    0x00, 0x00, 0x00, 0x01, 0x09, 0xf0,                                // AUD
+    0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40,  // SPS
+    0x50, 0x05, 0xbb, 0x01, 0x10, 0x00, 0x00, 0x03, 0x00, 0x10, 0x00,
+    0x00, 0x03, 0x03, 0xc0, 0xf1, 0x83, 0x19, 0x60,
+    0x00, 0x00, 0x00, 0x01, 0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0,  // PPS
+    0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00, 0x33};             // IDR slice
+static const std::vector<uint8_t> kFrame{0x00, 0x00, 0x00, 0x01, 0x41, 0x9a, 0x02};
+
+struct Box {
+  std::string type;
+  size_t offset;
+  size_t size;
+};
+
+static uint32_t read_u32(const std::vector<uint8_t>& bytes, size_t offset) {
+  return (bytes[offset] << 24) | (bytes[offset + 1] << 16) | (bytes[offset + 2] << 8) |
+         bytes[offset + 3];
+}
+
+static std::vector<Box> top_level_boxes(const std::vector<uint8_t>& bytes) {
+  std::vector<Box> boxes;
+  for (size_t offset = 0; offset + 8 <= bytes.size();) {
+    const size_t size = read_u32(bytes, offset);
+    REQUIRE_GE(size, 8);
+    boxes.push_back({std::string(bytes.begin() + offset + 4, bytes.begin() + offset + 8),
+                     offset,
+                     size});
+    offset += size;
+  }
+  return boxes;
+}
+
+static std::vector<uint8_t> read_file(const std::string& filename) {
+  std::ifstream file{filename, std::ios_base::binary};
+  return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+static size_t find(const std::vector<uint8_t>& bytes, const std::string& type) {
+  return std::search(bytes.begin(), bytes.end(), type.begin(), type.end()) - bytes.begin();
+}
+
+TEST_CASE("When a stream is muxed, fragments should start at key frames") {
+  const auto filename = (std::filesystem::temp_directory_path() / "mp4_writer_test.mp4").string();
+  Mp4Writer writer{filename, {NalCodec::h264, 1280, 720, 90000}};
+  int64_t pts = 0;
+  for (const auto* frame : {&kKeyFrame, &kFrame, &kFrame, &kKeyFrame, &kFrame}) {
+    writer.write({frame->data(), frame->size(), frame == &kKeyFrame, pts, pts, 3000, nullptr});
+    pts += 3000;
+  }
+  writer.close();
+
+  const auto bytes = read_file(filename);
+  const auto boxes = top_level_boxes(bytes);
+  std::vector<std::string> types;
+  for (const auto& box : boxes) {
+    types.push_back(box.type);
+  }
+  CHECK_EQ(types, std::vector<std::string>{"ftyp", "moov", "moof", "mdat", "moof", "mdat"});
+  size_t end = 0;
+  for (const auto& box : boxes) {
+    end = box.offset + box.size;
+  }
+  CHECK_EQ(end, bytes.size());
+
+  // avcC carries profile, level and the parameter sets.
+  const auto avcc = find(bytes, "avcC");
+  REQUIRE_LT(avcc, boxes[1].offset + boxes[1].size);
+  CHECK_EQ(bytes[avcc + 4], 1);
+  CHECK_EQ(bytes[avcc + 5], 100);
+  CHECK_EQ(bytes[avcc + 7], 31);
+  CHECK_LT(find(bytes, "avc3"), avcc);
+
+  // The first fragment holds three samples, the AUD is dropped and NAL units
+  // are length prefixed.
+  const auto trun = find(bytes, "trun");
+  CHECK_EQ(read_u32(bytes, trun + 8), 3);
+  const auto& mdat = boxes[3];
+  CHECK_EQ(read_u32(bytes, trun + 12), mdat.offset + 8 - boxes[2].offset);
+  CHECK_EQ(read_u32(bytes, mdat.offset + 8), 26);
+  CHECK_EQ(bytes[mdat.offset + 12], 0x67);
+  CHECK_EQ(mdat.size, 8 + (4 + 26) + (4 + 6) + (4 + 5) + 2 * (4 + 3));
+
+  // The second fragment starts at the decode time of its first sample.
+  const auto tfdt = boxes[4].offset + find(std::vector<uint8_t>(bytes.begin() + boxes[4].offset,
+                                                                bytes.end()),
+                                           "tfdt");
+  CHECK_EQ(read_u32(bytes, tfdt + 12), 9000);
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("When key frames are rare, fragments should stay bounded") {
+  const auto filename = (std::filesystem::temp_directory_path() / "mp4_writer_long.mp4").string();
+  Mp4Writer writer{filename, {NalCodec::h264, 1280, 720, 90000}};
+  writer.write({kKeyFrame.data(), kKeyFrame.size(), true, 0, 0, 3000, nullptr});
+  for (size_t i = 0; i < kMaxFragmentFrames; i++) {
+    writer.write({kFrame.data(), kFrame.size(), false, 0, 0, 3000, nullptr});
+  }
+  writer.close();
+  const auto boxes = top_level_boxes(read_file(filename));
+  CHECK_EQ(std::count_if(boxes.begin(), boxes.end(), [](const Box& box) {
+             return box.type == "moof";
+           }),
+           2);
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("When the stream doesn't start with parameter sets, muxing should fail") {
+  const auto filename = (std::filesystem::temp_directory_path() / "mp4_writer_bad.mp4").string();
+  Mp4Writer writer{filename, {NalCodec::h264, 1280, 720, 90000}};
+  CHECK_THROWS_AS(writer.write({kFrame.data(), kFrame.size(), false, 0, 0, 3000, nullptr}),
+                  std::runtime_error);
+  CHECK_THROWS_AS(writer.write({kFrame.data(), kFrame.size(), true, 0, 0, 3000, nullptr}),
+                  std::runtime_error);
+  std::filesystem::remove(filename);
+}
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "doctest.h"
+
+#include "numa/numa.hpp"
+
+TEST_CASE("When cpu list has ranges, every cpu should be listed") {
+  CHECK_EQ(parse_cpu_list("0-3,8,10-11\n"), std::vector<int>{0, 1, 2, 3, 8, 10, 11});
+  CHECK(parse_cpu_list("").empty());
+}
+
+TEST_CASE("When policy is parsed, unknown policies should be rejected") {
+  CHECK_EQ(numa_policy_from_string("off").mode, NumaPolicy::Mode::off);
+  CHECK_EQ(numa_policy_from_string("auto").mode, NumaPolicy::Mode::automatic);
+  const auto node = numa_policy_from_string("node:1");
+  CHECK_EQ(node.mode, NumaPolicy::Mode::node);
+  CHECK_EQ(node.node, 1);
+  CHECK_THROWS_AS(numa_policy_from_string("node:"), std::invalid_argument);
+  CHECK_THROWS_AS(numa_policy_from_string("nodes"), std::invalid_argument);
+}
+
+TEST_CASE("When sysfs has two nodes, sessions should be placed round robin") {
+  const auto root = std::filesystem::temp_directory_path() / "numa_test_sysfs";
+  std::filesystem::remove_all(root);
+  for (const auto& [name, cpus] : {std::pair{"node1", "4-7"}, std::pair{"node0", "0-3"}}) {
+    std::filesystem::create_directories(root / "node" / name);
+    std::ofstream{root / "node" / name / "cpulist"} << cpus << "\n";
+  }
+  std::filesystem::create_directories(root / "node" / "power");
+
+  const auto topology = numa_topology(root.string());
+  REQUIRE_EQ(topology.size(), 2);
+  CHECK_EQ(topology[0].id, 0);
+  CHECK_EQ(topology[1].cpus, std::vector<int>{4, 5, 6, 7});
+
+  const NumaPolicy automatic{NumaPolicy::Mode::automatic, -1};
+  CHECK_EQ(numa_node_for(automatic, topology, 0), 0);
+  CHECK_EQ(numa_node_for(automatic, topology, 1), 1);
+  CHECK_EQ(numa_node_for(automatic, topology, 2), 0);
+  CHECK_EQ(numa_node_for({NumaPolicy::Mode::node, 1}, topology, 0), 1);
+  CHECK_EQ(numa_node_for({NumaPolicy::Mode::off, -1}, topology, 0), -1);
+  CHECK_THROWS_AS(numa_node_for({NumaPolicy::Mode::node, 2}, topology, 0), std::invalid_argument);
+  std::filesystem::remove_all(root);
+}
+
+TEST_CASE("When sysfs has no nodes, online cpus should form node 0") {
+  const auto root = std::filesystem::temp_directory_path() / "numa_test_flat";
+  std::filesystem::remove_all(root);
+  std::filesystem::create_directories(root / "cpu");
+  std::ofstream{root / "cpu" / "online"} << "0-1\n";
+
+  const auto topology = numa_topology(root.string());
+  REQUIRE_EQ(topology.size(), 1);
+  CHECK_EQ(topology[0].id, 0);
+  CHECK_EQ(topology[0].cpus, std::vector<int>{0, 1});
+  std::filesystem::remove_all(root);
+}
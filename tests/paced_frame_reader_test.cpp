@@ -0,0 +1,193 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include "doctest.h"
+
+#include "paced_frame_reader/paced_frame_reader.hpp"
+
+namespace vpl = oneapi::vpl;
+
+// Counts the frames read, ends after total frames.
+class CountingFrameSource : public vpl::frame_source_reader {
+ public:
+  explicit CountingFrameSource(size_t total) : total_{total}, read_{0} {}
+
+  bool is_EOS() override {
+    return read_ >= total_;
+  }
+
+  mfxStatus get_data(std::shared_ptr<vpl::frame_surface>) override {
+    if (is_EOS()) {
+      return MFX_ERR_MORE_DATA;
+    }
+    read_++;
+    return MFX_ERR_NONE;
+  }
+
+  size_t read() const {
+    return read_;
+  }
+
+ private:
+  const size_t total_;
+  size_t read_;
+};
+
+static double elapsed_ms(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since)
+      .count();
+}
+
+TEST_CASE("When the policy is parsed, unknown policies should throw") {
+  for (const auto* policy : {"queue", "block", "drop-oldest", "drop-newest", "adapt"}) {
+    CHECK_EQ(to_string(pacing_policy_from_string(policy)), policy);
+  }
+  CHECK_THROWS_AS(pacing_policy_from_string("drop"), std::invalid_argument);
+  CountingFrameSource source{1};
+  CHECK_THROWS_AS(PacedFrameReader(&source, 0, PacingPolicy::queue), std::invalid_argument);
+  CHECK_THROWS_AS(PacedFrameReader(&source, 30, PacingPolicy::block, 0), std::invalid_argument);
+}
+
+TEST_CASE("When frames are read back to back, they should come at the rate") {
+  CountingFrameSource source{5};
+  PacedFrameReader reader{&source, 100, PacingPolicy::queue};
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 5; i++) {
+    REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  }
+  // The first frame arrives at the first read.
+  CHECK_GE(elapsed_ms(start), 39);
+  CHECK_EQ(reader.get_data(nullptr), MFX_ERR_MORE_DATA);
+  CHECK_EQ(reader.lateness_us().size(), 5);
+  CHECK_EQ(reader.late_frames(), 0);
+  CHECK_EQ(reader.dropped_frames(), 0);
+}
+
+TEST_CASE("When a frame is read late, its arrival should be when it was queued") {
+  CountingFrameSource source{2};
+  PacedFrameReader reader{&source, 100, PacingPolicy::queue};
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  const auto first_arrival = reader.last_arrival();
+  std::this_thread::sleep_for(std::chrono::milliseconds{50});
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  CHECK_EQ(reader.last_arrival() - first_arrival, std::chrono::milliseconds{10});
+  CHECK_GE(elapsed_ms(reader.last_arrival()), 39);
+}
+
+TEST_CASE("When the encoder falls behind with the queue policy, every frame should be read late") {
+  CountingFrameSource source{6};
+  PacedFrameReader reader{&source, 100, PacingPolicy::queue};
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  std::this_thread::sleep_for(std::chrono::milliseconds{45});
+  for (int i = 0; i < 5; i++) {
+    REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  }
+  CHECK_EQ(source.read(), 6);
+  CHECK_EQ(reader.dropped_frames(), 0);
+  // Frames 1 to 3 were read after the frame following them arrived.
+  CHECK_GE(reader.late_frames(), 3);
+  CHECK_GE(reader.lateness_us()[1], 30000);
+  CHECK_GT(reader.lateness_us()[1], reader.lateness_us()[2]);
+}
+
+TEST_CASE("When the queue overflows with drop-oldest, the encoder should get the newest frames") {
+  CountingFrameSource source{100};
+  PacedFrameReader reader{&source, 100, PacingPolicy::drop_oldest, 1};
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  std::this_thread::sleep_for(std::chrono::milliseconds{45});
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  // Frames 1 to 3 were pushed out by frames 2 to 4, they are read and dropped.
+  CHECK_GE(reader.dropped_frames(), 3);
+  CHECK_EQ(source.read(), reader.dropped_frames() + 2);
+  CHECK_EQ(reader.late_frames(), 0);
+  CHECK_LT(reader.lateness_us()[1], 10000);
+  REQUIRE_EQ(reader.events().size(), 1);
+  CHECK(reader.events()[0].action == BackpressureEvent::Action::drop_oldest);
+  CHECK_EQ(reader.events()[0].frame, 2);
+  CHECK_EQ(reader.events()[0].frames, reader.dropped_frames());
+}
+
+TEST_CASE("When the queue overflows with drop-newest, the queued frames should be kept") {
+  CountingFrameSource source{100};
+  PacedFrameReader reader{&source, 100, PacingPolicy::drop_newest, 2};
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  std::this_thread::sleep_for(std::chrono::milliseconds{45});
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  // Frames 1 and 2 were queued, 3 and 4 found the queue full.
+  CHECK_EQ(source.read(), 3);
+  CHECK_GE(reader.dropped_frames(), 2);
+  CHECK_EQ(reader.late_frames(), 2);
+  REQUIRE_EQ(reader.events().size(), 1);
+  CHECK(reader.events()[0].action == BackpressureEvent::Action::drop_newest);
+  CHECK_EQ(reader.events()[0].frame, 3);
+  CHECK_EQ(reader.events()[0].queue_depth, 2);
+  // The next frame read comes after the dropped ones.
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  CHECK_EQ(source.read(), reader.dropped_frames() + 4);
+}
+
+TEST_CASE("When the queue is full with block, the source should be held back") {
+  CountingFrameSource source{100};
+  PacedFrameReader reader{&source, 100, PacingPolicy::block, 2};
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  std::this_thread::sleep_for(std::chrono::milliseconds{45});
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  CHECK_EQ(reader.dropped_frames(), 0);
+  // Frame 3 was due at 30 ms and arrived with the read at 45 ms.
+  CHECK_GE(reader.blocked_us(), 10000);
+  REQUIRE_EQ(reader.events().size(), 1);
+  CHECK(reader.events()[0].action == BackpressureEvent::Action::block);
+  CHECK_EQ(reader.events()[0].frame, 3);
+  CHECK_EQ(reader.events()[0].blocked_us, reader.blocked_us());
+  CHECK_EQ(reader.queue_depth(), 2);
+  for (int i = 0; i < 3; i++) {
+    REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  }
+  CHECK_EQ(source.read(), 5);
+}
+
+TEST_CASE("When the queue fills with adapt, the target usage should go up and come back") {
+  // At 20 fps a read has 50 ms to be on time, scheduling delays don't break
+  // the run of empty reads.
+  CountingFrameSource source{1000};
+  PacedFrameReader reader{&source, 20, PacingPolicy::adapt, 4, 4};
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  CHECK_FALSE(reader.take_target_usage());
+  // Frames 1 to 4 arrive, 3 stay queued after the read.
+  std::this_thread::sleep_for(std::chrono::milliseconds{230});
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  CHECK_EQ(reader.take_target_usage(), 5);
+  CHECK_FALSE(reader.take_target_usage());
+  // A second of frames read in time brings it back.
+  std::optional<uint16_t> target_usage{};
+  for (int i = 0; i < 40 && !target_usage; i++) {
+    REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+    target_usage = reader.take_target_usage();
+  }
+  CHECK_EQ(target_usage, 4);
+  const auto& events = reader.events();
+  REQUIRE_GE(events.size(), 2);
+  CHECK(events.back().action == BackpressureEvent::Action::target_usage);
+  CHECK_EQ(events.back().target_usage, 4);
+}
+
+TEST_CASE("When the rate changes, frames after it should come at the new rate") {
+  CountingFrameSource source{10};
+  PacedFrameReader reader{&source, 1000, PacingPolicy::queue};
+  REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  reader.set_rate(50);
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 3; i++) {
+    REQUIRE_EQ(reader.get_data(nullptr), MFX_ERR_NONE);
+  }
+  // Frame 1 arrives 1 ms after frame 0, frames 2 and 3 20 ms apart.
+  CHECK_GE(elapsed_ms(start), 39);
+  CHECK_LT(reader.late_frames(), 2);
+}
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: MIT
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "cxxopts.hpp"
+#include "nlohmann/json.hpp"
+
+#include "perf_check/perf_check.hpp"
+
+// Compares the statistics of a fixed encode against a checked in baseline,
+// fails when a metric moved past its tolerance.
+int main(int argc, char** argv) {
+  cxxopts::Options options{"perf_check", "Compare encode statistics against a baseline."};
+  options.add_options(
+      "perf_check",
+      {{"stats", "encodeapp statistics file", cxxopts::value<std::string>()},
+       {"baseline", "Baseline file", cxxopts::value<std::string>()},
+       {"tolerance",
+        "Override a tolerance, e.g. fps=0.1",
+        cxxopts::value<std::vector<std::string>>()},
+       {"update",
+        "Record the measured metrics in the baseline",
+        cxxopts::value<bool>()->default_value("false")},
+       {"help", "Print usage"}});
+  auto result = options.parse(argc, argv);
+  if (result.count("help") || !result.count("stats") || !result.count("baseline")) {
+    std::cout << options.help() << std::endl;
+    return result.count("help") ? 0 : EINVAL;
+  }
+
+  std::map<std::string, double> tolerances;
+  if (result.count("tolerance")) {
+    for (const auto& tolerance : result["tolerance"].as<std::vector<std::string>>()) {
+      const auto separator = tolerance.find('=');
+      try {
+        tolerances[tolerance.substr(0, separator)] = std::stod(tolerance.substr(separator + 1));
+      } catch (std::logic_error&) {
+        std::cout << "Invalid tolerance " << tolerance << std::endl;
+        return EINVAL;
+      }
+    }
+  }
+
+  const auto baseline_filename = result["baseline"].as<std::string>();
+  nlohmann::json baseline;
+  std::map<std::string, double> measured;
+  try {
+    std::ifstream stats_file{result["stats"].as<std::string>()};
+    measured = perf_metrics(nlohmann::json::parse(stats_file));
+    std::ifstream baseline_file{baseline_filename};
+    baseline = nlohmann::json::parse(baseline_file);
+  } catch (std::exception& e) {
+    std::cout << "Couldn't read statistics or baseline: " << e.what() << std::endl;
+    return EINVAL;
+  }
+
+  if (result["update"].as<bool>()) {
+    for (auto& [metric, value] : baseline["metrics"].items()) {
+      value = measured.at(metric);
+    }
+    std::ofstream baseline_file{baseline_filename};
+    baseline_file << std::setw(4) << baseline << std::endl;
+    std::cout << "Updated " << baseline_filename << std::endl;
+    return baseline_file ? 0 : EIO;
+  }
+
+  std::vector<PerfCheck> checks;
+  try {
+    checks = compare_perf(baseline, measured, tolerances);
+  } catch (std::exception& e) {
+    std::cout << "Invalid baseline: " << e.what() << std::endl;
+    return EINVAL;
+  }
+  write_perf_report(checks, std::cout);
+  size_t unrecorded = 0;
+  for (const auto& check : checks) {
+    if (!check.passed) {
+      std::cout << "Performance regressed against " << baseline_filename << std::endl;
+      return 1;
+    }
+    unrecorded += check.recorded ? 0 : 1;
+  }
+  // A baseline without values can't catch a regression, it mustn't pass.
+  if (unrecorded) {
+    std::cout << "Skipped, " << unrecorded << " metrics not recorded in " << baseline_filename
+              << std::endl;
+    return kPerfCheckSkipped;
+  }
+  return 0;
+}
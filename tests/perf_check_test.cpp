@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <sstream>
+#include <stdexcept>
+
+#include "doctest.h"
+
+#include "perf_check/perf_check.hpp"
+
+static const nlohmann::json kBaseline = nlohmann::json::parse(R"({
+  "metrics": {"fps": 100, "framesize": 1000, "p50latency": 2000, "p99latency": null},
+  "tolerances": {"fps": 0.1, "framesize": 0.02, "p50latency": 0.5, "p99latency": 1}
+})");
+
+TEST_CASE("When statistics are read, metrics should be derived from the frames") {
+  const auto stats = nlohmann::json::parse(R"({
+    "proctime": 200,
+    "frames": [{"size": 100, "latency": 1000}, {"size": 300, "latency": 3000}]
+  })");
+  const auto metrics = perf_metrics(stats);
+  CHECK_EQ(metrics.at("fps"), 10);
+  CHECK_EQ(metrics.at("framesize"), 200);
+  CHECK_EQ(metrics.at("p50latency"), 2000);
+  CHECK_EQ(metrics.at("p99latency"), doctest::Approx(2980));
+  CHECK_THROWS_AS(perf_metrics(nlohmann::json::parse(R"({"proctime": 1, "frames": []})")),
+                  std::runtime_error);
+}
+
+TEST_CASE("When metrics move within tolerance or the good way, checks should pass") {
+  const auto checks = compare_perf(
+      kBaseline, {{"fps", 150}, {"framesize", 1010}, {"p50latency", 2900}, {"p99latency", 9}});
+  REQUIRE_EQ(checks.size(), 4);
+  for (const auto& check : checks) {
+    CAPTURE(check.metric);
+    CHECK(check.passed);
+  }
+  CHECK_FALSE(checks[3].recorded);
+}
+
+TEST_CASE("When metrics regress past tolerance, checks should fail with a report") {
+  const std::map<std::string, double> measured{
+      {"fps", 85}, {"framesize", 970}, {"p50latency", 1000}, {"p99latency", 0}};
+  const auto checks = compare_perf(kBaseline, measured);
+  CHECK_FALSE(checks[0].passed);
+  CHECK_FALSE(checks[1].passed);
+  CHECK(checks[2].passed);
+
+  CHECK(compare_perf(kBaseline, measured, {{"fps", 0.2}, {"framesize", 0.05}})[0].passed);
+
+  std::ostringstream report;
+  write_perf_report(checks, report);
+  CHECK_NE(report.str().find("REGRESSED"), std::string::npos);
+  CHECK_NE(report.str().find("-15.00%"), std::string::npos);
+  CHECK_NE(report.str().find("not recorded"), std::string::npos);
+}
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <atomic>
+#include <future>
+#include <thread>
+
+#include "doctest.h"
+
+#include "cpu_usage/cpu_usage.hpp"
+#include "perf_counters/perf_counters.hpp"
+
+TEST_CASE("When counts are subtracted, events missing from either read should stay missing") {
+  const PerfCounterValues start{100, 200, 10, 5, 50, 1};
+  const PerfCounterValues stop{300, 800, 30, 8, -1, 3};
+  const auto counts = stop - start;
+  CHECK_EQ(counts.cycles, 200);
+  CHECK_EQ(counts.instructions, 600);
+  CHECK_EQ(counts.branches, -1);
+  CHECK_EQ(ipc(counts), 3);
+  CHECK_EQ(llc_mpki(counts), 5);
+  CHECK_EQ(llc_miss_rate(counts), doctest::Approx(0.15));
+  CHECK_EQ(branch_miss_rate(counts), -1);
+}
+
+TEST_CASE("When nothing is counted, rates should be -1") {
+  const PerfCounterValues none{};
+  CHECK_EQ(ipc(none), -1);
+  CHECK_EQ(llc_mpki(none), -1);
+  CHECK_EQ(llc_miss_rate(none), -1);
+}
+
+TEST_CASE("When counters are opened, they should count or tell why not") {
+  PerfCounters counters{{current_thread()}};
+  if (!counters.available()) {
+    CHECK_FALSE(counters.error().empty());
+    CHECK_EQ(counters.read().cycles, -1);
+    return;
+  }
+  const auto start = counters.read();
+  volatile long sum = 0;
+  for (long i = 0; i < 1000000; i++) {
+    sum = sum + i;
+  }
+  const auto counts = counters.read() - start;
+  // The cpu may count cycles but not instructions.
+  if (counts.instructions >= 0) {
+    CHECK_GT(counts.instructions, 0);
+  }
+}
+
+TEST_CASE("When a thread ran before the counters were opened, it should still be counted") {
+  std::promise<pid_t> started;
+  std::atomic<bool> stop{false};
+  std::thread worker([&started, &stop] {
+    started.set_value(current_thread());
+    volatile long sum = 0;
+    while (!stop) {
+      sum = sum + 1;
+    }
+  });
+  PerfCounters counters{{started.get_future().get()}};
+  const auto start = counters.read();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  const auto counts = counters.read() - start;
+  stop = true;
+  worker.join();
+  if (!counters.available()) {
+    CHECK_FALSE(counters.error().empty());
+    return;
+  }
+  if (counts.instructions >= 0) {
+    CHECK_GT(counts.instructions, 0);
+  }
+}
+
+TEST_CASE("When no thread is given, counters should be unavailable") {
+  PerfCounters counters{{}};
+  CHECK_FALSE(counters.available());
+  CHECK_FALSE(counters.error().empty());
+}
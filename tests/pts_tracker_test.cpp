@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include "doctest.h"
+
+#include "pts_tracker/pts_tracker.hpp"
+
+using namespace std::chrono_literals;
+
+TEST_CASE("When frames are stamped, PTS should advance by the frame duration") {
+  PtsTracker tracker{3000};
+  CHECK_EQ(tracker.stamp(), 0);
+  CHECK_EQ(tracker.stamp(), 3000);
+  tracker.set_frame_duration(1500);
+  CHECK_EQ(tracker.stamp(), 6000);
+  CHECK_EQ(tracker.stamp(), 7500);
+  CHECK_EQ(tracker.pending(), 4);
+
+  tracker.reset(3000);
+  CHECK_EQ(tracker.pending(), 0);
+  CHECK_EQ(tracker.stamp(), 0);
+}
+
+TEST_CASE("When frames come out in coding order, they should match their input frames") {
+  PtsTracker tracker{3000};
+  const auto start = std::chrono::steady_clock::now();
+  // I0 P3 B1 B2 with the P frame encoded after all three inputs arrived.
+  for (int i = 0; i < 4; i++) {
+    tracker.stamp(start + i * 33ms);
+  }
+  const auto i_frame = tracker.match(0);
+  REQUIRE(i_frame);
+  CHECK_EQ(i_frame->index, 0);
+  CHECK_EQ(i_frame->arrival, start);
+  CHECK_EQ(i_frame->frames_after, 3);
+
+  const auto p_frame = tracker.match(9000);
+  REQUIRE(p_frame);
+  CHECK_EQ(p_frame->index, 3);
+  CHECK_EQ(p_frame->frames_after, 0);
+
+  const auto b_frame = tracker.match(3000);
+  REQUIRE(b_frame);
+  CHECK_EQ(b_frame->index, 1);
+  CHECK_EQ(b_frame->arrival, start + 33ms);
+  CHECK_EQ(b_frame->frames_after, 2);
+
+  CHECK_FALSE(tracker.match(3000));
+  CHECK_FALSE(tracker.match(12345));
+  CHECK_EQ(tracker.pending(), 1);
+}
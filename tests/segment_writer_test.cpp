@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "doctest.h"
+
+#include "segment_writer/segment_writer.hpp"
+
+static std::string read_file(const std::filesystem::path& path) {
+  std::ifstream file{path};
+  std::stringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+
+TEST_CASE("When stream is segmented, segments should start at key frames after the duration") {
+  const auto directory = std::filesystem::temp_directory_path() / "segment_writer_test";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  const auto playlist = (directory / "live.m3u8").string();
+  SegmentWriter writer{playlist,
+                       (directory / "live").string(),
+                       ".hevc",
+                       2,
+                       1,
+                       90000,
+                       [](const std::string& filename) {
+                         return std::make_unique<RawStreamWriter>(filename);
+                       }};
+  // Three frames a second, a key frame every second.
+  const uint8_t frame[] = {0, 0, 1, 0x26, 0x01};
+  for (int i = 0; i < 10; i++) {
+    writer.write({frame, sizeof(frame), i % 3 == 0, i * 30000, i * 30000, 30000, nullptr});
+    if (i == 6) {
+      // The first segment is complete once the next one started.
+      CHECK(std::filesystem::exists(directory / "live_00000.hevc"));
+      CHECK(std::filesystem::exists(directory / "live_00001.hevc.tmp"));
+      CHECK_NE(read_file(playlist).find("live_00000.hevc"), std::string::npos);
+    }
+  }
+  writer.close();
+
+  const auto& segments = writer.segments();
+  REQUIRE_EQ(segments.size(), 2);
+  CHECK_EQ(segments[0].size, 6 * sizeof(frame));
+  CHECK_EQ(segments[0].duration, doctest::Approx(2.0));
+  CHECK_EQ(segments[1].size, 4 * sizeof(frame));
+  CHECK_EQ(segments[1].duration, doctest::Approx(4.0 / 3));
+  CHECK_GE(segments[1].write_latency_us, 0);
+  CHECK_EQ(std::filesystem::file_size(directory / "live_00001.hevc"), 4 * sizeof(frame));
+  CHECK_FALSE(std::filesystem::exists(directory / "live_00001.hevc.tmp"));
+  CHECK_FALSE(std::filesystem::exists(playlist + ".tmp"));
+
+  // The rolling playlist only lists the last segment.
+  CHECK_EQ(read_file(playlist),
+           "#EXTM3U\n"
+           "#EXT-X-VERSION:3\n"
+           "#EXT-X-TARGETDURATION:2\n"
+           "#EXT-X-MEDIA-SEQUENCE:1\n"
+           "#EXTINF:1.333,\n"
+           "live_00001.hevc\n"
+           "#EXT-X-ENDLIST\n");
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("When MP4 segments leave the playlist, they should be mapped and later deleted") {
+  const auto directory = std::filesystem::temp_directory_path() / "segment_writer_mp4_test";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  const auto playlist = (directory / "live.m3u8").string();
+  SegmentWriter writer{playlist,
+                       (directory / "live").string(),
+                       ".mp4",
+                       1,
+                       1,
+                       90000,
+                       [](const std::string& filename) {
+                         return std::make_unique<RawStreamWriter>(filename);
+                       }};
+  // Key frames start with the ftyp and moov boxes of an init segment.
+  const uint8_t key_frame[] = {0, 0, 0, 8, 'f', 't', 'y', 'p', 0, 0, 0, 12, 'm', 'o', 'o', 'v',
+                               0, 0, 0, 0, 0, 0, 0, 9};
+  const uint8_t frame[] = {0, 0, 0, 9};
+  for (int i = 0; i < 12; i++) {
+    const bool key = i % 3 == 0;
+    writer.write({key ? key_frame : frame,
+                  key ? sizeof(key_frame) : sizeof(frame),
+                  key,
+                  i * 30000,
+                  i * 30000,
+                  30000,
+                  nullptr});
+  }
+  writer.close();
+
+  REQUIRE_EQ(writer.segments().size(), 4);
+  // A segment stays for a playlist length after it left the playlist.
+  CHECK_FALSE(std::filesystem::exists(directory / "live_00000.mp4"));
+  CHECK_FALSE(std::filesystem::exists(directory / "live_00001.mp4"));
+  CHECK(std::filesystem::exists(directory / "live_00002.mp4"));
+  CHECK(std::filesystem::exists(directory / "live_00003.mp4"));
+  CHECK_EQ(read_file(playlist),
+           "#EXTM3U\n"
+           "#EXT-X-VERSION:7\n"
+           "#EXT-X-TARGETDURATION:1\n"
+           "#EXT-X-MEDIA-SEQUENCE:3\n"
+           "#EXT-X-MAP:URI=\"live_00003.mp4\",BYTERANGE=\"20@0\"\n"
+           "#EXTINF:1.000,\n"
+           "#EXT-X-BYTERANGE:12@20\n"
+           "live_00003.mp4\n"
+           "#EXT-X-ENDLIST\n");
+  std::filesystem::remove_all(directory);
+}
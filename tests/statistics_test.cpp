@@ -40,12 +40,15 @@ TEST_CASE("When stats saved, read file and check if parameters are the same") {
   stats_data_frame.date = "2022-01-01";
   stats_data_frame.encapp_version = "v1.6";
   stats_data_frame.proctime = 12345;
+  stats_data_frame.startup_time = 45;
+  stats_data_frame.queue_wait_time = 7;
   stats_data_frame.framecount = frames.size();
   stats_data_frame.encoded_file = "out.hevc";
   stats_data_frame.source_file = "in.yuv";
   stats_data_frame.settings = settings;
   stats_data_frame.encoder_media_format = encoder_media_format;
   stats_data_frame.frame_info = frames;
+  stats_data_frame.session_pool = {true, 3, 1, 0.75, 120};
 
   std::stringstream stats_file;
 
@@ -70,9 +73,15 @@ TEST_CASE("When stats saved, read file and check if parameters are the same") {
   CHECK_EQ(stats_out["date"], "2022-01-01");
   CHECK_EQ(stats_out["encapp_version"], "v1.6");
   CHECK_EQ(stats_out["proctime"], 12345);
+  CHECK_EQ(stats_out["startuptime"], 45);
+  CHECK_EQ(stats_out["queuewaittime"], 7);
   CHECK_EQ(stats_out["framecount"], frames.size());
   CHECK_EQ(stats_out["encodedfile"], "out.hevc");
   CHECK_EQ(stats_out["sourcefile"], "in.yuv");
+  CHECK_EQ(stats_out["sessionpool"]["reused"], true);
+  CHECK_EQ(stats_out["sessionpool"]["hits"], 3);
+  CHECK_EQ(stats_out["sessionpool"]["misses"], 1);
+  CHECK_EQ(stats_out["sessionpool"]["inittimesaved"], 120);
 
   int i = 0;
   for (auto& frame_info : stats_out["frame_info"]) {
@@ -87,3 +96,16 @@ TEST_CASE("When stats saved, read file and check if parameters are the same") {
     ++i;
   }
 }
+
+TEST_CASE("When percentiles are taken, they should interpolate between ranks") {
+  CHECK_EQ(percentile({}, 0.5), 0);
+  CHECK_EQ(percentile({7}, 0.99), 7);
+  CHECK_EQ(percentile({4, 1, 3, 2}, 0), 1);
+  CHECK_EQ(percentile({4, 1, 3, 2}, 1), 4);
+  CHECK_EQ(percentile({4, 1, 3, 2}, 0.5), doctest::Approx(2.5));
+  std::vector<double> values;
+  for (int i = 1; i <= 100; i++) {
+    values.push_back(i);
+  }
+  CHECK_EQ(percentile(values, 0.99), doctest::Approx(99.01));
+}
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+#include "doctest.h"
+
+#include "stream_writer/stream_writer.hpp"
+
+class RecordingWriter : public StreamWriter {
+ public:
+  void write(const EncodedFrame& frame) override {
+    if (frame.pts == fail_at) {
+      throw std::runtime_error("disk full");
+    }
+    written.push_back(frame.pts);
+  }
+
+  void flush() override { flushed = written.size(); }
+
+  void close() override { closed = true; }
+
+  std::vector<int64_t> written;
+  size_t flushed = 0;
+  bool closed = false;
+  int64_t fail_at = -1;
+};
+
+TEST_CASE("When frames are written async, they should be written in order and released") {
+  auto recording = std::make_unique<RecordingWriter>();
+  auto* writer = recording.get();
+  std::atomic<int> released{0};
+  AsyncWriter async_writer{std::move(recording), 2};
+  for (int64_t pts = 0; pts < 100; pts++) {
+    auto owner = std::shared_ptr<void>(nullptr, [&released](void*) { released++; });
+    async_writer.write({nullptr, 0, pts == 0, pts, pts, 1, owner});
+  }
+  async_writer.close();
+  REQUIRE_EQ(writer->written.size(), 100);
+  CHECK_EQ(writer->written.back(), 99);
+  CHECK(writer->closed);
+  CHECK_EQ(released, 100);
+}
+
+TEST_CASE("When the writer thread fails, the error should be thrown to the encode loop") {
+  auto recording = std::make_unique<RecordingWriter>();
+  recording->fail_at = 3;
+  AsyncWriter async_writer{std::move(recording), 1};
+  bool thrown = false;
+  try {
+    for (int64_t pts = 0; pts < 100; pts++) {
+      async_writer.write({nullptr, 0, false, pts, pts, 1, nullptr});
+    }
+    async_writer.close();
+  } catch (std::runtime_error& e) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
+
+TEST_CASE("When frames are flushed as written, their output latency should be recorded") {
+  auto recording = std::make_unique<RecordingWriter>();
+  auto* writer = recording.get();
+  AsyncWriter async_writer{std::move(recording), 1, true};
+  const auto capture = std::chrono::steady_clock::now() - std::chrono::milliseconds{5};
+  async_writer.write({nullptr, 0, true, 0, 0, 1, nullptr, capture});
+  async_writer.write({nullptr, 0, false, 1, 1, 1, nullptr});
+  async_writer.close();
+  CHECK_EQ(writer->flushed, 2);
+  const auto& latencies = async_writer.output_latencies();
+  REQUIRE_EQ(latencies.size(), 2);
+  CHECK_GE(latencies[0].first_byte_us, 5000);
+  CHECK_GE(latencies[0].last_byte_us, latencies[0].first_byte_us);
+  CHECK_EQ(latencies[1].first_byte_us, -1);
+  CHECK_EQ(latencies[1].last_byte_us, -1);
+}
+
+TEST_CASE("When raw stream is written, frames should be concatenated") {
+  const auto filename =
+      (std::filesystem::temp_directory_path() / "stream_writer_test.hevc").string();
+  const uint8_t first[] = {0, 0, 1, 0x40};
+  const uint8_t second[] = {0, 0, 1, 0x26};
+  auto writer = make_stream_writer("auto", "hevc", filename, 64, 64, 30, 90000);
+  writer->write({first, sizeof(first), true, 0, 0, 3000, nullptr});
+  writer->write({second, sizeof(second), false, 3000, 3000, 3000, nullptr});
+  writer->close();
+  CHECK_EQ(std::filesystem::file_size(filename), 8);
+  std::filesystem::remove(filename);
+
+  CHECK_THROWS_AS(make_stream_writer("mkv", "hevc", filename, 64, 64, 30, 90000),
+                  std::invalid_argument);
+  CHECK_THROWS_AS(make_stream_writer("mp4", "mpeg2", filename, 64, 64, 30, 90000),
+                  std::invalid_argument);
+  CHECK_THROWS_AS(make_stream_writer("ivf", "hevc", filename, 64, 64, 30, 90000),
+                  std::invalid_argument);
+}
+
+TEST_CASE("When container is auto, vp9 and av1 should be written to IVF") {
+  CHECK_EQ(resolve_container("auto", "av1"), "ivf");
+  CHECK_EQ(resolve_container("auto", "vp9"), "ivf");
+  CHECK_EQ(resolve_container("auto", "hevc"), "raw");
+  CHECK_EQ(resolve_container("mp4", "av1"), "mp4");
+}
@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <cstdlib>
+#include <stdexcept>
+
+#include "doctest.h"
+
+#include "synthetic_frame_reader/synthetic_frame_reader.hpp"
+
+namespace vpl = oneapi::vpl;
+
+constexpr const auto kI420 = vpl::color_format_fourcc::i420;
+
+static std::vector<uint8_t> render(const SyntheticPattern& pattern,
+                                   size_t index,
+                                   vpl::color_format_fourcc fourcc = kI420) {
+  SyntheticFrameGenerator generator{64, 48, fourcc, pattern};
+  std::vector<uint8_t> frame(generator.frame_size());
+  generator.render(index, frame.data());
+  return frame;
+}
+
+static long difference(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+  long sum = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    sum += std::abs(a[i] - b[i]);
+  }
+  return sum;
+}
+
+TEST_CASE("When synthetic input is parsed, options should override the defaults") {
+  size_t frames = 0;
+  auto pattern = parse_synthetic_input("synthetic", &frames);
+  CHECK_EQ(frames, 300);
+  CHECK_EQ(pattern.complexity, 30);
+  pattern = parse_synthetic_input("synthetic:frames=10,complexity=80,scenecut=5,text=0,seed=7",
+                                  &frames);
+  CHECK_EQ(frames, 10);
+  CHECK_EQ(pattern.complexity, 80);
+  CHECK_EQ(pattern.scene_cut_interval, 5);
+  CHECK_FALSE(pattern.text);
+  CHECK_EQ(pattern.seed, 7);
+  CHECK(is_synthetic_input("synthetic:frames=1"));
+  CHECK_FALSE(is_synthetic_input("cars_320x240.i420"));
+  CHECK_FALSE(is_synthetic_input("synthetic.hevc"));
+  CHECK_THROWS_AS(parse_synthetic_input("synthetic:complexity=101", &frames),
+                  std::invalid_argument);
+  CHECK_THROWS_AS(parse_synthetic_input("synthetic:speed=1", &frames), std::invalid_argument);
+  CHECK_THROWS_AS(parse_synthetic_input("synthetic:frames=x", &frames), std::invalid_argument);
+}
+
+TEST_CASE("When frames are rendered, the same seed and index should give the same frame") {
+  const SyntheticPattern pattern{};
+  CHECK_EQ(render(pattern, 3), render(pattern, 3));
+  CHECK_GT(difference(render(pattern, 3), render(pattern, 4)), 0);
+  SyntheticPattern other = pattern;
+  other.seed = 2;
+  CHECK_GT(difference(render(pattern, 3), render(other, 3)), 0);
+}
+
+TEST_CASE("When the complexity grows, neighbouring samples should differ more") {
+  SyntheticPattern pattern{};
+  pattern.text = false;
+  auto roughness = [&pattern](int complexity) {
+    pattern.complexity = complexity;
+    const auto frame = render(pattern, 0);
+    long sum = 0;
+    for (size_t i = 1; i < 64 * 48; i++) {
+      sum += std::abs(frame[i] - frame[i - 1]);
+    }
+    return sum;
+  };
+  CHECK_LT(roughness(0), roughness(50));
+  CHECK_LT(roughness(50), roughness(100));
+}
+
+TEST_CASE("When a scene cut is set, frames should change completely at the cut only") {
+  SyntheticPattern pattern{};
+  pattern.complexity = 0;
+  pattern.text = false;
+  pattern.scene_cut_interval = 10;
+  // Within a scene the gradient only moves, across a cut it is a new one.
+  const auto within = difference(render(pattern, 8), render(pattern, 9));
+  const auto cut = difference(render(pattern, 9), render(pattern, 10));
+  CHECK_GT(cut, 2 * within);
+}
+
+TEST_CASE("When rendering p010, samples should be 10 bit in the high bits") {
+  const auto frame = render({}, 0, vpl::color_format_fourcc::p010);
+  REQUIRE_EQ(frame.size(), 64 * 48 * 3);
+  for (size_t i = 0; i < frame.size(); i += 2) {
+    REQUIRE_EQ(frame[i], 0);
+  }
+  const auto nv12 = render({}, 0, vpl::color_format_fourcc::nv12);
+  CHECK_EQ(nv12[0], frame[1]);
+  CHECK_EQ(nv12[64 * 48 + 1], frame[2 * 64 * 48 + 3]);
+}
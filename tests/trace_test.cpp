@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <sstream>
+#include <thread>
+
+#include "doctest.h"
+#include "nlohmann/json.hpp"
+
+#include "trace/trace.hpp"
+
+static nlohmann::json written_trace() {
+  std::stringstream output;
+  write_trace(output);
+  return nlohmann::json::parse(output);
+}
+
+static std::vector<nlohmann::json> spans(const nlohmann::json& trace) {
+  std::vector<nlohmann::json> spans;
+  for (const auto& event : trace["traceEvents"]) {
+    if (event["ph"] == "X") {
+      spans.push_back(event);
+    }
+  }
+  return spans;
+}
+
+TEST_CASE("When tracing is off, scopes should record nothing") {
+  start_trace();
+  stop_trace();
+  { TraceScope trace{"read"}; }
+  CHECK(spans(written_trace()).empty());
+}
+
+TEST_CASE("When spans are traced on threads, each thread should get its own named track") {
+  start_trace();
+  { TraceScope trace{"submit"}; }
+  std::thread writer{[] {
+    set_trace_thread_name("writer");
+    TraceScope trace{"write"};
+  }};
+  writer.join();
+  stop_trace();
+
+  const auto trace = written_trace();
+  const auto events = spans(trace);
+  REQUIRE_EQ(events.size(), 2);
+  CHECK_EQ(events[0]["name"], "submit");
+  CHECK_EQ(events[1]["name"], "write");
+  CHECK_NE(events[0]["tid"], events[1]["tid"]);
+  CHECK_GE(events[0]["dur"].get<double>(), 0);
+  bool writer_named = false;
+  for (const auto& event : trace["traceEvents"]) {
+    writer_named |= event["ph"] == "M" && event["args"]["name"] == "writer" &&
+                    event["tid"] == events[1]["tid"];
+  }
+  CHECK(writer_named);
+}
+
+TEST_CASE("When a ring is full, the newest events should be kept") {
+  start_trace(2);
+  for (const char* name : {"read", "convert", "sync"}) {
+    TraceScope trace{name};
+  }
+  stop_trace();
+  const auto trace = written_trace();
+  const auto events = spans(trace);
+  REQUIRE_EQ(events.size(), 2);
+  CHECK_EQ(events[0]["name"], "convert");
+  CHECK_EQ(events[1]["name"], "sync");
+  CHECK_EQ(trace["otherData"]["droppedevents"], 1);
+}
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: MIT
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <sstream>
+
+#include "doctest.h"
+
+#include "two_pass/two_pass.hpp"
+
+static FirstPassStats make_first_pass_stats() {
+  FirstPassStats stats{};
+  stats.qp = 26;
+  stats.fps = 30;
+  for (uint32_t i = 0; i < 60; i++) {
+    const bool iframe = (i % 30) == 0;
+    stats.frames.push_back({iframe ? 40000u : 4000u + (i % 7) * 1000u, iframe});
+  }
+  return stats;
+}
+
+TEST_CASE("When first pass stats saved, read stream and check if frames are the same") {
+  const auto stats = make_first_pass_stats();
+  std::stringstream stats_file;
+  write_first_pass_stats(stats, stats_file);
+  CHECK_EQ(stats_file.str().size(), 16 + 4 * stats.frames.size());
+
+  const auto stats_in = read_first_pass_stats(stats_file);
+  CHECK_EQ(stats_in.qp, stats.qp);
+  CHECK_EQ(stats_in.fps, stats.fps);
+  REQUIRE_EQ(stats_in.frames.size(), stats.frames.size());
+  for (size_t i = 0; i < stats.frames.size(); i++) {
+    CHECK_EQ(stats_in.frames[i].size, stats.frames[i].size);
+    CHECK_EQ(stats_in.frames[i].iframe, stats.frames[i].iframe);
+  }
+}
+
+TEST_CASE("When first pass stats are corrupted, reading throws") {
+  std::stringstream stats_file{"not a stats file"};
+  CHECK_THROWS_AS(read_first_pass_stats(stats_file), std::runtime_error);
+}
+
+TEST_CASE("When encoder follows the model, second pass hits the target size") {
+  const auto stats = make_first_pass_stats();
+  for (const uint64_t target_size : {100000u, 250000u, 600000u}) {
+    CAPTURE(target_size);
+    BitAllocator bit_allocator{stats, target_size};
+    double encoded_size = 0;
+    for (size_t i = 0; i < stats.frames.size(); i++) {
+      const auto frame_size = bit_allocator.predicted_bytes(i, bit_allocator.frame_qp(i));
+      bit_allocator.update(i, frame_size);
+      encoded_size += frame_size;
+    }
+    CHECK_EQ(encoded_size, doctest::Approx(target_size).epsilon(0.05));
+  }
+}
+
+TEST_CASE("When frame is more complex, second pass gives it a higher QP") {
+  const auto stats = make_first_pass_stats();
+  BitAllocator bit_allocator{stats, 200000};
+  CHECK_GE(bit_allocator.frame_qp(0), bit_allocator.frame_qp(1));
+  CHECK_GE(bit_allocator.frame_qp(6), bit_allocator.frame_qp(1));
+}
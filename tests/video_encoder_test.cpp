@@ -111,3 +111,99 @@ TEST_CASE("When init encoder with external buffers, not crash") {
     CHECK_MESSAGE(false, "Encoder init failed: ", std::string(exc.what()));
   }
 }
+
+TEST_CASE("When encoder reset for a new stream, frames are encoded again") {
+  const uint16_t width = 240;
+  const uint16_t height = 320;
+  const int frame_rate = 30;
+  const std::string input_filename = "../res/cars_320x240.i420";
+  const auto input_fourcc = vpl::color_format_fourcc::i420;
+
+  vpl::default_selector impl_sel{
+      {vpl::dprops::impl(vpl::implementation_type::sw),
+       vpl::dprops::api_version(2, 5),
+       vpl::dprops::encoder({vpl::dprops::codec_id(vpl::codec_format_fourcc::hevc)})}};
+  std::ifstream first_file{input_filename, std::ios_base::in | std::ios_base::binary};
+  vpl::raw_frame_file_reader first_reader{width, height, input_fourcc, first_file};
+
+  VideoEncoder video_encoder{impl_sel, &first_reader};
+
+  vpl::frame_info info{};
+  info.set_frame_rate({frame_rate, 1});
+  info.set_frame_size({ALIGN16(width), ALIGN16(height)});
+  info.set_FourCC(input_fourcc);
+  info.set_ChromaFormat(vpl::chroma_format_idc::yuv420);
+  info.set_ROI({{0, 0}, {width, height}});
+  info.set_PicStruct(vpl::pic_struct::progressive);
+
+  try {
+    video_encoder.init(info, vpl::codec_format_fourcc::hevc, vpl::rate_control_method::cqp);
+    auto bitstream = std::make_shared<vpl::bitstream_as_dst>();
+    while (video_encoder.encode(bitstream) == vpl::status::Ok) {
+      bitstream->wait_for(std::chrono::milliseconds(100));
+      bitstream->set_DataLength(0);
+    }
+
+    std::ifstream second_file{input_filename, std::ios_base::in | std::ios_base::binary};
+    vpl::raw_frame_file_reader second_reader{width, height, input_fourcc, second_file};
+    video_encoder.set_frame_source(&second_reader);
+    video_encoder.reset(info, vpl::codec_format_fourcc::hevc, vpl::rate_control_method::cqp);
+    CHECK_EQ(video_encoder.encode(bitstream), vpl::status::Ok);
+  } catch (vpl::base_exception const& exc) {
+    CHECK_MESSAGE(false, "Encoder reset failed: ", std::string(exc.what()));
+  }
+}
+
+TEST_CASE("When change waits for an IDR frame, it is applied at the predicted one") {
+  const uint16_t width = 240;
+  const uint16_t height = 320;
+  const int frame_rate = 30;
+  const std::string input_filename = "../res/cars_320x240.i420";
+  const auto input_fourcc = vpl::color_format_fourcc::i420;
+
+  vpl::default_selector impl_sel{
+      {vpl::dprops::impl(vpl::implementation_type::sw),
+       vpl::dprops::api_version(2, 5),
+       vpl::dprops::encoder({vpl::dprops::codec_id(vpl::codec_format_fourcc::hevc)})}};
+  std::ifstream input_file{input_filename, std::ios_base::in | std::ios_base::binary};
+  vpl::raw_frame_file_reader reader{width, height, input_fourcc, input_file};
+
+  VideoEncoder video_encoder{impl_sel, &reader};
+
+  vpl::frame_info info{};
+  info.set_frame_rate({frame_rate, 1});
+  info.set_frame_size({ALIGN16(width), ALIGN16(height)});
+  info.set_FourCC(input_fourcc);
+  info.set_ChromaFormat(vpl::chroma_format_idc::yuv420);
+  info.set_ROI({{0, 0}, {width, height}});
+  info.set_PicStruct(vpl::pic_struct::progressive);
+
+  try {
+    video_encoder.init(info, vpl::codec_format_fourcc::hevc, vpl::rate_control_method::cbr);
+    auto bitstream = std::make_shared<vpl::bitstream_as_dst>();
+    Reconfiguration reconfiguration{};
+    reconfiguration.target_kbps = 500;
+    reconfiguration.at_idr = true;
+    video_encoder.reconfigure(reconfiguration);
+    // One IDR frame gives no distance to predict the next one from.
+    video_encoder.idr_encoded(0);
+    for (int i = 0; i < 4; i++) {
+      REQUIRE_EQ(video_encoder.encode(bitstream), vpl::status::Ok);
+      bitstream->wait_for(std::chrono::milliseconds(100));
+      bitstream->set_DataLength(0);
+    }
+    CHECK(video_encoder.reconfigure_events().empty());
+
+    video_encoder.idr_encoded(3);
+    for (int i = 0; i < 4; i++) {
+      REQUIRE_EQ(video_encoder.encode(bitstream), vpl::status::Ok);
+      bitstream->wait_for(std::chrono::milliseconds(100));
+      bitstream->set_DataLength(0);
+    }
+    REQUIRE_EQ(video_encoder.reconfigure_events().size(), 1);
+    CHECK_EQ(video_encoder.reconfigure_events()[0].frame, 6);
+    CHECK(video_encoder.reconfigure_events()[0].reconfiguration.at_idr);
+  } catch (vpl::base_exception const& exc) {
+    CHECK_MESSAGE(false, "Encoder reconfigure failed: ", std::string(exc.what()));
+  }
+}